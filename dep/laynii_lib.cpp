@@ -1,5 +1,206 @@
 
 #include "./laynii_lib.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// ============================================================================
+// Timing and memory instrumentation
+// ============================================================================
+// Stages are opened by log_stage (the "Start ..." messages of the
+// programs). The time between two stage markers, the peak resident memory of
+// the process at the end of a stage and the voxel visits counted with
+// timing_count are reported in a table at exit. Nothing is recorded unless
+// enabled.
+struct timing_record {
+    string name;
+    double seconds;
+    double process_peak_rss_mb;
+    uint64_t voxel_visits;
+};
+
+static bool timing_active = false;
+static string timing_program = "";
+static string timing_json_path = "";
+static vector<timing_record> timing_records;
+static vector<size_t> timing_stack;
+static chrono::steady_clock::time_point timing_start, timing_last;
+
+static double process_peak_rss_mb(void) {
+    // Highest resident memory of the whole process so far (ru_maxrss). It
+    // never goes down, so a later stage, or a later program of a pipeline,
+    // shows the maximum of everything that ran before it.
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024. * 1024.);  // Bytes
+#else
+    return usage.ru_maxrss / 1024.;  // Kilobytes
+#endif
+#endif
+}
+
+static size_t timing_find(const char* name) {
+    // Stages with the same name are accumulated into one record
+    for (size_t i = 0; i < timing_records.size(); ++i) {
+        if (timing_records[i].name == name) {
+            return i;
+        }
+    }
+    timing_record record = {name, 0, 0, 0};
+    timing_records.push_back(record);
+    return timing_records.size() - 1;
+}
+
+static void timing_lap(void) {
+    // Adds the time since the last lap to the currently open stage
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (!timing_stack.empty()) {
+        timing_record& record = timing_records[timing_stack.back()];
+        record.seconds += chrono::duration<double>(now - timing_last).count();
+        record.process_peak_rss_mb = process_peak_rss_mb();
+    }
+    timing_last = now;
+}
+
+static void timing_exit(void) {
+    timing_report();
+}
+
+void timing_enable(const char* json_path) {
+    if (!timing_active) {
+        static bool registered = false;
+        if (!registered) {
+            atexit(timing_exit);
+            registered = true;
+        }
+        timing_active = true;
+        timing_records.clear();
+        timing_stack.clear();
+        timing_start = chrono::steady_clock::now();
+        timing_last = timing_start;
+        timing_stack.push_back(timing_find("Reading inputs"));
+    }
+    if (json_path) {
+        timing_json_path = json_path;
+    }
+}
+
+bool parse_timing_option(int& ac, int argc, char* argv[]) {
+    // Parses -timing and -timing_json at argv[ac]. Prints an error and
+    // returns false when the option is unknown or its argument is missing.
+    if (!strcmp(argv[ac], "-timing")) {
+        timing_enable();
+        return true;
+    } else if (!strcmp(argv[ac], "-timing_json")) {
+        if (++ac >= argc) {
+            fprintf(stderr, "** missing argument for -timing_json\n");
+            return false;
+        }
+        timing_enable(argv[ac]);
+        return true;
+    }
+    fprintf(stderr, "** invalid option, '%s'\n", argv[ac]);
+    return false;
+}
+
+static void timing_welcome(const char* programname) {
+    timing_program = programname;
+    timing_stage("Processing");
+}
+
+void timing_stage(const char* name) {
+    if (!timing_active) {
+        return;
+    }
+    timing_lap();
+    if (timing_stack.empty()) {
+        timing_stack.push_back(timing_find(name));
+    } else {
+        timing_stack.back() = timing_find(name);
+    }
+}
+
+void timing_count(uint64_t nr_voxel_visits) {
+    if (timing_active && !timing_stack.empty()) {
+        timing_records[timing_stack.back()].voxel_visits += nr_voxel_visits;
+    }
+}
+
+timing_scope::timing_scope(const char* name) {
+    if (timing_active) {
+        timing_lap();
+        timing_stack.push_back(timing_find(name));
+    }
+}
+
+timing_scope::~timing_scope() {
+    if (timing_active && timing_stack.size() > 1) {
+        timing_lap();
+        timing_stack.pop_back();
+    }
+}
+
+void timing_report(void) {
+    if (!timing_active) {
+        return;
+    }
+    timing_lap();
+    double total = chrono::duration<double>(timing_last - timing_start).count();
+
+    printf("\n  Timing (%s):\n", timing_program.c_str());
+    printf("    %-52s %10s %8s %22s %12s\n", "Stage", "Time [s]", "[%]",
+           "Process peak RSS [MB]", "Voxels/s");
+    for (size_t i = 0; i < timing_records.size(); ++i) {
+        const timing_record& r = timing_records[i];
+        double rate = r.seconds > 0 ? r.voxel_visits / r.seconds : 0;
+        printf("    %-52.52s %10.3f %8.1f %22.1f %12.3g\n", r.name.c_str(),
+               r.seconds, total > 0 ? 100. * r.seconds / total : 0.,
+               r.process_peak_rss_mb, rate);
+    }
+    printf("    %-52s %10.3f %8.1f %22.1f\n", "Total", total, 100.,
+           process_peak_rss_mb());
+
+    if (!timing_json_path.empty()) {
+        FILE* fp = fopen(timing_json_path.c_str(), "w");
+        if (!fp) {
+            fprintf(stderr, "** failed to write '%s'\n", timing_json_path.c_str());
+        } else {
+            fprintf(fp, "{\n  \"program\": \"%s\",\n", timing_program.c_str());
+            fprintf(fp, "  \"total_seconds\": %.6f,\n", total);
+            fprintf(fp, "  \"process_peak_rss_mb\": %.3f,\n",
+                    process_peak_rss_mb());
+            fprintf(fp, "  \"stages\": [\n");
+            for (size_t i = 0; i < timing_records.size(); ++i) {
+                const timing_record& r = timing_records[i];
+                string name;
+                for (size_t c = 0; c < r.name.size(); ++c) {  // JSON escapes
+                    if (r.name[c] == '"' || r.name[c] == '\\') {
+                        name += '\\';
+                    }
+                    name += r.name[c];
+                }
+                fprintf(fp, "    {\"name\": \"%s\", \"seconds\": %.6f, "
+                        "\"process_peak_rss_mb\": %.3f, \"voxel_visits\": %llu}%s\n",
+                        name.c_str(), r.seconds, r.process_peak_rss_mb,
+                        (unsigned long long)r.voxel_visits,
+                        i + 1 < timing_records.size() ? "," : "");
+            }
+            fprintf(fp, "  ]\n}\n");
+            fclose(fp);
+            log_output(timing_json_path.c_str());
+        }
+    }
+
+    // Reset, so that the next program in a pipeline starts fresh
+    timing_active = false;
+    timing_json_path = "";
+    timing_records.clear();
+    timing_stack.clear();
+}
 
 // ============================================================================
 // Command-line log messages
@@ -10,6 +211,7 @@ void log_welcome(const char* programname) {
     cout << "LayNii v2.4.0          "<< endl;
     cout << "======================="<< endl;
     cout << programname << "\n" << endl;
+    timing_welcome(programname);
 }
 
 void log_output(const char* filename) {
@@ -17,6 +219,12 @@ void log_output(const char* filename) {
     cout << "      " << filename << endl;
 }
 
+void log_stage(const char* message) {
+    // Prints a stage marker and starts timing the stage
+    cout << "\n  " << message << endl;
+    timing_stage(message);
+}
+
 void log_nifti_descriptives(nifti_image* nii) {
     // Print nifti descriptives to command line for debugging
     cout << "    File name: " << nii->fname << endl;
@@ -70,6 +278,71 @@ double ren_correl(double arr1[], double arr2[], int size) {
     return sum1 / sqrt(sum2 * sum3);
 }
 
+double ren_correl_from_sums(double n, double sum_x, double sum_y,
+                            double sum_xx, double sum_yy, double sum_xy) {
+    // Pearson correlation from sums over n samples
+    double cov = sum_xy - sum_x * sum_y / n;
+    double var1 = sum_xx - sum_x * sum_x / n;
+    double var2 = sum_yy - sum_y * sum_y / n;
+    return cov / sqrt(var1 * var2);
+}
+
+void ren_lag_correl(double arr1[], double arr2[], int size, int max_lag,
+                    double correl[]) {
+    // Correlation of arr1[t] with arr2[t + lag] for lag = -max_lag..max_lag,
+    // written to correl[lag + max_lag]. Only the overlapping time points are
+    // used. The arrays are centered in place, after which the sums of the
+    // overlaps only differ from the full sums by a few samples at the ends.
+    // So every lag costs one dot product.
+    double mean1 = ren_average(arr1, size);
+    double mean2 = ren_average(arr2, size);
+    double sum1 = 0, sum2 = 0, sum11 = 0, sum22 = 0;
+    for (int i = 0; i < size; ++i) {
+        arr1[i] -= mean1;
+        arr2[i] -= mean2;
+        sum1 += arr1[i];
+        sum2 += arr2[i];
+        sum11 += arr1[i] * arr1[i];
+        sum22 += arr2[i] * arr2[i];
+    }
+
+    // Sums of the first and last samples that drop out of the overlap
+    double head1 = 0, head2 = 0, head11 = 0, head22 = 0;
+    double tail1 = 0, tail2 = 0, tail11 = 0, tail22 = 0;
+    for (int lag = 0; lag <= max_lag; ++lag) {
+        if (lag > 0 && lag <= size) {
+            int i = lag - 1, j = size - lag;
+            head1 += arr1[i]; head11 += arr1[i] * arr1[i];
+            head2 += arr2[i]; head22 += arr2[i] * arr2[i];
+            tail1 += arr1[j]; tail11 += arr1[j] * arr1[j];
+            tail2 += arr2[j]; tail22 += arr2[j] * arr2[j];
+        }
+        int n = size - lag;
+        if (n < 2) {
+            correl[max_lag + lag] = correl[max_lag - lag] = NAN;
+            continue;
+        }
+
+        // Positive lag: arr1[0 .. n) with arr2[lag .. size)
+        double dot = 0;
+        for (int i = 0; i < n; ++i) {
+            dot += arr1[i] * arr2[i + lag];
+        }
+        correl[max_lag + lag] = ren_correl_from_sums(
+            n, sum1 - tail1, sum2 - head2, sum11 - tail11, sum22 - head22, dot);
+
+        // Negative lag: arr1[lag .. size) with arr2[0 .. n)
+        if (lag > 0) {
+            dot = 0;
+            for (int i = 0; i < n; ++i) {
+                dot += arr1[i + lag] * arr2[i];
+            }
+            correl[max_lag - lag] = ren_correl_from_sums(
+                n, sum1 - head1, sum2 - tail2, sum11 - head11, sum22 - tail22, dot);
+        }
+    }
+}
+
 double ren_skew(double arr[], int size) {
     int i;
     double sum1 = 0;
@@ -167,10 +440,135 @@ float gaus(float distance, float sigma) {
            * exp(-0.5 * distance * distance / (sigma * sigma));
 }
 
+// ============================================================================
+// Random numbers
+// ============================================================================
+void philox4x32(const uint64_t seed, const uint64_t counter, uint32_t out[4]) {
+    // Philox4x32-10 (Salmon et al., 2011, Parallel random numbers: as easy
+    // as 1, 2, 3). A keyed bijection of the counter, so every voxel can draw
+    // its own numbers without any state shared between threads.
+    uint32_t c0 = static_cast<uint32_t>(counter);
+    uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t c2 = 0, c3 = 0;
+    uint32_t k0 = static_cast<uint32_t>(seed);
+    uint32_t k1 = static_cast<uint32_t>(seed >> 32);
+    for (int r = 0; r < 10; ++r) {
+        uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+        uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+        uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+        c1 = static_cast<uint32_t>(p1);
+        c3 = static_cast<uint32_t>(p0);
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+double rand_uniform(const uint64_t seed, const uint64_t counter) {
+    // Uniform in (0, 1), from the upper 53 bits of the first two words
+    uint32_t r[4];
+    philox4x32(seed, counter, r);
+    uint64_t bits = (static_cast<uint64_t>(r[0]) << 21) | (r[1] >> 11);
+    return (static_cast<double>(bits) + 0.5) / 9007199254740992.0;
+}
+
+double rand_normal(const uint64_t seed, const uint64_t counter) {
+    // Standard normal with the Box-Muller transform on one Philox block
+    uint32_t r[4];
+    philox4x32(seed, counter, r);
+    uint64_t bits1 = (static_cast<uint64_t>(r[0]) << 21) | (r[1] >> 11);
+    uint64_t bits2 = (static_cast<uint64_t>(r[2]) << 21) | (r[3] >> 11);
+    double u1 = (static_cast<double>(bits1) + 0.5) / 9007199254740992.0;
+    double u2 = static_cast<double>(bits2) / 9007199254740992.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
 // ============================================================================
 // Utility functions
 // ============================================================================
 
+string make_output_path(const string path, const string tag,
+                        const bool use_outpath) {
+    // Resolves the output file name in the same way as save_output_nifti.
+    if (use_outpath) {
+        return path;
+    }
+
+    // Parse path
+    string dir, file, basename, ext, sep;
+    auto pos1 = path.find_last_of('/');
+    if (pos1 != string::npos) {  // For Unix
+        sep = "/";
+        dir = path.substr(0, pos1);
+        file = path.substr(pos1 + 1);
+    } else {  // For Windows
+        pos1 = path.find_last_of('\\');
+        if (pos1 != string::npos) {
+            sep = "\\";
+            dir = path.substr(0, pos1);
+            file = path.substr(pos1 + 1);
+        } else {  // Only the filename
+            sep = "";
+            dir = "";
+            file = path;
+        }
+    }
+
+    // Parse extension
+    auto const pos2 = file.find_first_of('.');
+    if (pos2 != string::npos) {
+        basename = file.substr(0, pos2);
+        ext = file.substr(pos2);
+    } else {  // Determine default extension when no extension given
+        basename = file;
+        ext = ".nii";
+    }
+
+    // Prepare output path
+    return dir + sep + basename + "_" + tag + ext;
+}
+
+bool parse_float_list(const char* text, vector<float>& values) {
+    // Parses comma separated numbers, e.g. "2,3,4", used for parameter
+    // sweeps. Returns false when an entry is not a number.
+    values.clear();
+    const char* p = text;
+    while (*p != '\0') {
+        char* end;
+        float value = strtof(p, &end);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        values.push_back(value);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+bool parse_int_list(const char* text, vector<int>& values) {
+    // Same as parse_float_list for integer parameters. Returns false when an
+    // entry is not a whole number or does not fit into an int.
+    values.clear();
+    const char* p = text;
+    while (*p != '\0') {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0')
+            || value != static_cast<int>(value)) {
+            return false;
+        }
+        values.push_back(static_cast<int>(value));
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
 void save_output_nifti(const string path, const string tag,  nifti_image* nii,
                        const bool log, const bool use_outpath) {
     ///////////////////////////////////////////////////////////////////////////
@@ -195,50 +593,19 @@ void save_output_nifti(const string path, const string tag,  nifti_image* nii,
     // example: save_output_nifti(fout, "VASO_LN", nii_boco_vaso, true, use_outpath);
     ///////////////////////////////////////////////////////////////////////////
 
-    string path_out;
-
-    if (use_outpath) {
-        path_out = path;
-    } else {
-        // Parse path
-        string dir, file, basename, ext, sep;
-        auto pos1 = path.find_last_of('/');
-        if (pos1 != string::npos) {  // For Unix
-            sep = "/";
-            dir = path.substr(0, pos1);
-            file = path.substr(pos1 + 1);
-        } else {  // For Windows
-            pos1 = path.find_last_of('\\');
-            if (pos1 != string::npos) {
-                sep = "\\";
-                dir = path.substr(0, pos1);
-                file = path.substr(pos1 + 1);
-            } else {  // Only the filename
-                sep = "";
-                dir = "";
-                file = path;
-            }
-        }
-
-        // Parse extension
-        auto const pos2 = file.find_first_of('.');
-        if (pos2 != string::npos) {
-            basename = file.substr(0, pos2);
-            ext = file.substr(pos2);
-        } else {  // Determine default extension when no extension given
-            basename = file;
-            ext = ".nii";
-        }
-
-        // Prepare output path
-        path_out = dir + sep + basename + "_" + tag + ext;
-    }
+    string path_out = make_output_path(path, tag, use_outpath);
 
     // Save nifti
+    timing_scope timer("Writing outputs");
     nifti_set_filenames(nii, path_out.c_str(), 1, 1);
-    nifti_image_write(nii);
+    bool written = pipeline_image_write(nii);
     if (log) {
-        log_output(path_out.c_str());
+        if (written) {
+            log_output(path_out.c_str());
+        } else {
+            cout << "    Keeping output in memory as:" << endl;
+            cout << "      " << path_out << endl;
+        }
     }
 }
 
@@ -326,6 +693,7 @@ nifti_image* copy_nifti_as_float32(nifti_image* nii) {
         }
     }
 
+    pipeline_image_track(nii_new);
     return nii_new;
 }
 
@@ -412,6 +780,7 @@ nifti_image* copy_nifti_as_double(nifti_image* nii) {
         }
     }
 
+    pipeline_image_track(nii_new);
     return nii_new;
 }
 
@@ -487,6 +856,7 @@ nifti_image* copy_nifti_as_int32(nifti_image* nii) {
         }
     }
 
+    pipeline_image_track(nii_new);
     return nii_new;
 }
 
@@ -564,6 +934,7 @@ nifti_image* copy_nifti_as_float16(nifti_image* nii) {
         }
     }
 
+    pipeline_image_track(nii_new);
     return nii_new;
 }
 
@@ -639,6 +1010,7 @@ nifti_image* copy_nifti_as_int16(nifti_image* nii) {
         }
     }
 
+    pipeline_image_track(nii_new);
     return nii_new;
 }
 
@@ -660,6 +1032,18 @@ uint32_t sub2ind_3D(const uint32_t x, const uint32_t y, const uint32_t z,
     return size_x * size_y * z + size_x * y + x;
 }
 
+const int8_t NEIGHBOUR_STEPS[26][3] = {
+    // 1-jump neighbours (faces)
+    {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1},
+    // 2-jump neighbours (edges)
+    {-1, -1, 0}, {-1, 1, 0}, {1, -1, 0}, {1, 1, 0},
+    {0, -1, -1}, {0, -1, 1}, {0, 1, -1}, {0, 1, 1},
+    {-1, 0, -1}, {1, 0, -1}, {-1, 0, 1}, {1, 0, 1},
+    // 3-jump neighbours (corners)
+    {-1, -1, -1}, {-1, -1, 1}, {-1, 1, -1}, {1, -1, -1},
+    {-1, 1, 1}, {1, -1, 1}, {1, 1, -1}, {1, 1, 1}
+};
+
 std::tuple<float, float> simplex_closure_2D(float x, float y) {
     float component_sum = x + y;
     float x_new = x / component_sum;
@@ -681,6 +1065,76 @@ std::tuple<float, float> simplex_perturb_2D(float x, float y, float a, float b)
 //     return std::make_tuple(x_new, y_new);
 // }
 
+// ============================================================================
+// Compact storage for the voxels of interest
+// ============================================================================
+template <typename T>
+static void scatter_voi(const voi_index& voi, const T* values, T* out,
+                        const uint32_t nr_voxels) {
+    for (uint32_t i = 0; i != nr_voxels; ++i) {
+        out[i] = 0;
+    }
+    for (uint32_t ii = 0; ii != voi.nr_voi; ++ii) {
+        out[voi.voi_id[ii]] = values[ii];
+    }
+}
+
+nifti_image* voi_to_nifti(const voi_index& voi, const float* values,
+                          nifti_image* like) {
+    nifti_image* nii = copy_nifti_as_float32(like);
+    scatter_voi(voi, values, static_cast<float*>(nii->data),
+                nii->nx * nii->ny * nii->nz);
+    return nii;
+}
+
+nifti_image* voi_to_nifti(const voi_index& voi, const int32_t* values,
+                          nifti_image* like) {
+    nifti_image* nii = copy_nifti_as_int32(like);
+    scatter_voi(voi, values, static_cast<int32_t*>(nii->data),
+                nii->nx * nii->ny * nii->nz);
+    return nii;
+}
+
+nifti_image* voi_to_nifti(const voi_index& voi, const int16_t* values,
+                          nifti_image* like) {
+    nifti_image* nii = copy_nifti_as_int16(like);
+    scatter_voi(voi, values, static_cast<int16_t*>(nii->data),
+                nii->nx * nii->ny * nii->nz);
+    return nii;
+}
+
+void sort_voi_positions(vector<uint32_t>& values, vector<uint32_t>& buffer) {
+    const size_t n = values.size();
+    if (n < 2) return;
+    uint32_t max_value = 0;
+    for (size_t k = 0; k != n; ++k) {
+        if (values[k] > max_value) max_value = values[k];
+    }
+    buffer.resize(n);
+    uint32_t* in = values.data();
+    uint32_t* out = buffer.data();
+
+    // Least significant digit first, 11 bits per pass
+    for (int shift = 0; shift < 32 && (max_value >> shift) != 0; shift += 11) {
+        uint32_t count[2049] = {0};
+        for (size_t k = 0; k != n; ++k) {
+            count[((in[k] >> shift) & 2047) + 1] += 1;
+        }
+        for (int r = 0; r != 2048; ++r) {
+            count[r + 1] += count[r];
+        }
+        for (size_t k = 0; k != n; ++k) {
+            out[count[(in[k] >> shift) & 2047]++] = in[k];
+        }
+        uint32_t* temp = in;
+        in = out;
+        out = temp;
+    }
+    if (in != values.data()) {
+        memcpy(values.data(), in, n * sizeof(uint32_t));
+    }
+}
+
 // ============================================================================
 // Smoothing
 // ============================================================================
@@ -699,21 +1153,16 @@ nifti_image* iterative_smoothing(nifti_image* nii_in, int iter_smooth,
     const uint32_t size_y = temp1->ny;
     const uint32_t size_z = temp1->nz;
     const uint32_t size_t = temp1->nt;
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-    const float dX = temp1->pixdim[1];
-    const float dY = temp1->pixdim[2];
-    const float dZ = temp1->pixdim[3];
 
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
-    // Short diagonals
-    const float dia_xy = sqrt(dX * dX + dY * dY);
-    const float dia_xz = sqrt(dX * dX + dZ * dZ);
-    const float dia_yz = sqrt(dY * dY + dZ * dZ);
-    // Long diagonals
-    const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
+    // Neighbour offsets and distances
+    const voxel_stencil<6> nb(temp1);
+
+    // Mask with a halo that never matches mask_value, so that the neighbour
+    // loop below needs no bounds checks
+    const padded_volume<int32_t> mask_pad(temp2, nii_mask_data,
+                                          mask_value == 0 ? 1 : 0);
 
     // ------------------------------------------------------------------------
     // NOTE(Faruk): This section is written to constrain voxel visits
@@ -728,11 +1177,14 @@ nifti_image* iterative_smoothing(nifti_image* nii_in, int iter_smooth,
     int32_t* voi_id;
     voi_id = (int32_t*) malloc(nr_voi*sizeof(int32_t));
 
+    vector<uint32_t> voi_pad(nr_voi);  // Indices in the padded mask
+
     // Fill in indices to be able to remap from subset to full set of voxels
     uint32_t ii = 0;
     for (uint32_t i = 0; i != nr_voxels; ++i) {
         if (*(nii_mask_data + i) != 0){
             *(voi_id + ii) = i;
+            voi_pad[ii] = mask_pad.index(i);
             ii += 1;
         }
     }
@@ -748,68 +1200,32 @@ nifti_image* iterative_smoothing(nifti_image* nii_in, int iter_smooth,
     // Pre-compute weights
     float FWHM_val = 1;  // TODO(Faruk): Might tweak this one
     float w_0 = gaus(0, FWHM_val);
-    float w_dX = gaus(dX, FWHM_val);
-    float w_dY = gaus(dY, FWHM_val);
-    float w_dZ = gaus(dZ, FWHM_val);
+    float w_nb[6];
+    for (int k = 0; k != 6; ++k) {
+        w_nb[k] = gaus(nb.dist[k], FWHM_val);
+    }
 
-    uint32_t ix, iy, iz, j;
+    uint32_t j;
     for (uint16_t t = 0; t != size_t; ++t) {  // Over 4th dim (e.g. timepoints)
         for (uint16_t n = 0; n != iter_smooth; ++n) {
             cout << "\r    Iteration: " << n+1 << "/" << iter_smooth << flush;
+            timing_count(nr_voi);
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                 uint32_t i = *(voi_id + ii);
+                const uint32_t i_pad = voi_pad[ii];
 
-                if (*(nii_mask_data + i) == mask_value) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
+                if (mask_pad.data[i_pad] == mask_value) {
                     float new_val = 0, total_weight = 0;
 
                     // Start with the voxel itself
                     new_val += *(nii_in_data + nr_voxels * t + i) * w_0;
                     total_weight += w_0;
 
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dX;
-                            total_weight += w_dX;
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dX;
-                            total_weight += w_dX;
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dY;
-                            total_weight += w_dY;
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dY;
-                            total_weight += w_dY;
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dZ;
-                            total_weight += w_dZ;
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                        if (*(nii_mask_data + j) == mask_value) {
-                            new_val += *(nii_in_data + nr_voxels * t + j) * w_dZ;
-                            total_weight += w_dZ;
+                    for (int k = 0; k != 6; ++k) {
+                        if (mask_pad.data[i_pad + nb.padded_offset[k]] == mask_value) {
+                            j = i + nb.offset[k];
+                            new_val += *(nii_in_data + nr_voxels * t + j) * w_nb[k];
+                            total_weight += w_nb[k];
                         }
                     }
                     // --------------------------------------------------------
@@ -832,5 +1248,481 @@ nifti_image* iterative_smoothing(nifti_image* nii_in, int iter_smooth,
         }
         cout << endl;
     }
+    free(voi_id);
     return nii_smooth;
 }
+
+// ============================================================================
+// Sparse Laplace systems
+// ============================================================================
+static double dot_product(const vector<double>& a, const vector<double>& b) {
+    // Serial on purpose, so that results do not depend on thread count
+    double sum = 0;
+    for (size_t n = 0; n < a.size(); ++n) {
+        sum += a[n] * b[n];
+    }
+    return sum;
+}
+
+void laplace_apply(const laplace_system& A, const vector<double>& x,
+                   vector<double>& y) {
+    // y = A x
+    const int64_t nr_rows = A.diag.size();
+    #pragma omp parallel for
+    for (int64_t n = 0; n < nr_rows; ++n) {
+        double sum = A.diag[n] * x[n];
+        for (int64_t k = A.row_start[n]; k < A.row_start[n + 1]; ++k) {
+            sum -= A.row_weight[k] * x[A.row_col[k]];
+        }
+        y[n] = sum;
+    }
+}
+
+double laplace_residual(const laplace_system& A, const vector<double>& x) {
+    // Relative residual |b - A x| / |b| (absolute when b is zero)
+    vector<double> r(x.size());
+    laplace_apply(A, x, r);
+    for (size_t n = 0; n < r.size(); ++n) {
+        r[n] = A.rhs[n] - r[n];
+    }
+    double rhs_norm = sqrt(dot_product(A.rhs, A.rhs));
+    double residual = sqrt(dot_product(r, r));
+    return rhs_norm > 0 ? residual / rhs_norm : residual;
+}
+
+int laplace_solve_cg(const laplace_system& A, vector<double>& x,
+                     const double tolerance, const int max_iterations,
+                     double& rel_residual) {
+    // Conjugate gradients with a Jacobi (diagonal) preconditioner, starting
+    // from the given x. Returns the number of iterations.
+    const int64_t nr_rows = A.diag.size();
+    vector<double> r(nr_rows), z(nr_rows), p(nr_rows), q(nr_rows);
+    laplace_apply(A, x, q);
+    for (int64_t n = 0; n < nr_rows; ++n) {
+        r[n] = A.rhs[n] - q[n];
+    }
+    double rhs_norm = sqrt(dot_product(A.rhs, A.rhs));
+    if (rhs_norm == 0) rhs_norm = 1;
+
+    for (int64_t n = 0; n < nr_rows; ++n) {
+        z[n] = A.diag[n] > 0 ? r[n] / A.diag[n] : 0;
+    }
+    p = z;
+    double rz = dot_product(r, z);
+    int iter = 0;
+    rel_residual = sqrt(dot_product(r, r)) / rhs_norm;
+    while (iter < max_iterations && rel_residual > tolerance) {
+        laplace_apply(A, p, q);
+        timing_count(A.row_col.size());
+        double alpha = rz / dot_product(p, q);
+        for (int64_t n = 0; n < nr_rows; ++n) {
+            x[n] += alpha * p[n];
+            r[n] -= alpha * q[n];
+        }
+        rel_residual = sqrt(dot_product(r, r)) / rhs_norm;
+        ++iter;
+        cout << "\r    Iteration: " << iter << ", relative residual: "
+             << rel_residual << "    " << flush;
+
+        for (int64_t n = 0; n < nr_rows; ++n) {
+            z[n] = A.diag[n] > 0 ? r[n] / A.diag[n] : 0;
+        }
+        double rz_new = dot_product(r, z);
+        double beta = rz_new / rz;
+        rz = rz_new;
+        for (int64_t n = 0; n < nr_rows; ++n) {
+            p[n] = z[n] + beta * p[n];
+        }
+    }
+    cout << endl;
+    if (rel_residual > tolerance) {
+        cout << "    Warning: Did not reach a relative residual of "
+             << tolerance << " in " << max_iterations << " iterations."
+             << endl;
+    }
+    return iter;
+}
+
+// ============================================================================
+// In-memory image store
+// ============================================================================
+// Used by the laynii driver to pass images between programs of a
+// pipeline without writing and re-reading (and re-compressing) them. When the
+// store is disabled, reading and writing go straight to disk.
+static bool pipeline_active = false;
+static bool pipeline_write_all = true;
+static map<string, nifti_image*> pipeline_images;
+static set<string> pipeline_outputs;
+static set<string> pipeline_written;
+// Images owned by the running stage, see pipeline_image_track. Programs do not
+// free their images before returning, so they are freed when the stage ends.
+static set<nifti_image*> pipeline_stage_images;
+
+static string pipeline_key(const char* path) {
+    string key = path;
+    if (key.compare(0, 2, "./") == 0) {
+        key = key.substr(2);
+    }
+    return key;
+}
+
+static nifti_image* pipeline_copy(nifti_image* nii, bool copy_data) {
+    nifti_image* nii_new = nifti_copy_nim_info(nii);
+    if (copy_data && nii->data) {
+        size_t nr_bytes = nii->nvox * nii->nbyper;
+        nii_new->data = malloc(nr_bytes);
+        memcpy(nii_new->data, nii->data, nr_bytes);
+    }
+    return nii_new;
+}
+
+void pipeline_enable(bool write_all) {
+    pipeline_active = true;
+    pipeline_write_all = write_all;
+}
+
+void pipeline_disable(void) {
+    pipeline_end_stage();
+    for (auto& entry : pipeline_images) {
+        nifti_image_free(entry.second);
+    }
+    pipeline_images.clear();
+    pipeline_outputs.clear();
+    pipeline_written.clear();
+    pipeline_active = false;
+}
+
+void pipeline_request_output(const string path) {
+    pipeline_outputs.insert(pipeline_key(path.c_str()));
+}
+
+nifti_image* pipeline_image_read(const char* path, int read_data) {
+    // Drop-in replacement for nifti_image_read
+    if (pipeline_active) {
+        auto entry = pipeline_images.find(pipeline_key(path));
+        nifti_image* nii = NULL;
+        if (entry != pipeline_images.end()) {
+            nii = pipeline_copy(entry->second, read_data != 0);
+        } else {
+            nii = nifti_image_read(path, read_data);
+        }
+        if (nii) {
+            pipeline_stage_images.insert(nii);
+        }
+        return nii;
+    }
+    return nifti_image_read(path, read_data);
+}
+
+bool pipeline_image_write(nifti_image* nii) {
+    // Returns true when the image is written to disk
+    if (!pipeline_active) {
+        nifti_image_write(nii);
+        return true;
+    }
+
+    pipeline_stage_images.insert(nii);
+    string key = pipeline_key(nii->fname);
+    auto entry = pipeline_images.find(key);
+    if (entry != pipeline_images.end()) {
+        nifti_image_free(entry->second);
+    }
+    pipeline_images[key] = pipeline_copy(nii, true);
+    pipeline_written.erase(key);
+
+    if (pipeline_write_all || pipeline_outputs.count(key) != 0) {
+        nifti_image_write(nii);
+        pipeline_written.insert(key);
+        return true;
+    }
+    return false;
+}
+
+void pipeline_image_track(nifti_image* nii) {
+    // Hands an image over to the running stage, which frees it when the
+    // stage ends. The copy_nifti_as_* functions do this themselves. Programs
+    // call it for images they build with nifti_copy_nim_info.
+    if (pipeline_active && nii) {
+        pipeline_stage_images.insert(nii);
+    }
+}
+
+void pipeline_image_free(nifti_image* nii) {
+    // Releases an image before the end of its stage. Programs use this
+    // instead of nifti_image_free, so that the stage does not free it again.
+    if (!nii) {
+        return;
+    }
+    pipeline_stage_images.erase(nii);
+    nifti_image_free(nii);
+}
+
+void pipeline_end_stage(void) {
+    for (nifti_image* nii : pipeline_stage_images) {
+        nifti_image_free(nii);
+    }
+    pipeline_stage_images.clear();
+}
+
+static void pipeline_forget(const char* path) {
+    // Drops a stored image that is about to be replaced on disk
+    auto entry = pipeline_images.find(pipeline_key(path));
+    if (entry != pipeline_images.end()) {
+        nifti_image_free(entry->second);
+        pipeline_images.erase(entry);
+    }
+}
+
+void pipeline_flush(const char* path) {
+    // Writes an image that is only kept in memory, for readers that need the
+    // file on disk (e.g. chunked streaming).
+    if (!pipeline_active) {
+        return;
+    }
+    string key = pipeline_key(path);
+    auto entry = pipeline_images.find(key);
+    if (entry != pipeline_images.end() && pipeline_written.count(key) == 0) {
+        nifti_image_write(entry->second);
+        pipeline_written.insert(key);
+    }
+}
+
+// ============================================================================
+// Chunked streaming
+// ============================================================================
+static void set_chunk_dims(nifti_image* nii, int64_t nz, int64_t nt) {
+    // Higher dimensions are folded into the 4th dimension while streaming.
+    nii->dim[3] = nz;
+    nii->dim[4] = nt;
+    for (int i = 5; i < 8; ++i) {
+        nii->dim[i] = 1;
+    }
+    nii->dim[0] = (nt > 1) ? 4 : 3;
+    nifti_update_dims_from_array(nii);
+}
+
+nifti_stream* nifti_stream_open_read(const char* fin, int64_t max_chunk_voxels,
+                                     bool whole_volumes) {
+    ///////////////////////////////////////////////////////////////////////////
+    // Reads only the header here. The data is read later in
+    // consecutive chunks (see nifti_stream_read_chunk) through a file handle
+    // that stays open, so compressed files are decompressed only once.
+    // A chunk is either a slab of slices within one volume or a block of
+    // whole volumes, depending on how many voxels fit into max_chunk_voxels.
+    ///////////////////////////////////////////////////////////////////////////
+    pipeline_flush(fin);
+    nifti_image* nii = nifti_image_read(fin, 0);
+    if (!nii) {
+        fprintf(stderr, "** failed to read NIfTI header from '%s'\n", fin);
+        return NULL;
+    }
+
+    znzFile fp = znzopen(nii->iname, "rb", nifti_is_gzfile(nii->iname));
+    if (znz_isnull(fp)) {
+        fprintf(stderr, "** failed to open NIfTI data in '%s'\n", nii->iname);
+        nifti_image_free(nii);
+        return NULL;
+    }
+    znzseek(fp, nii->iname_offset, SEEK_SET);
+
+    nifti_stream* stream = new nifti_stream;
+    stream->nii = nii;
+    stream->fp = fp;
+    stream->writing = false;
+    stream->size_z = nii->nz;
+    stream->size_time = nii->nvox / (nii->nx * nii->ny * nii->nz);
+    stream->nr_slices = stream->size_z * stream->size_time;
+    stream->slice_index = 0;
+    stream->chunk_z = 0;
+    stream->chunk_t = 0;
+    stream->bytes_done = 0;
+
+    // Determine how many slices go into one chunk
+    int64_t nr_slices = max_chunk_voxels / (nii->nx * nii->ny);
+    if (nr_slices < 1) {
+        nr_slices = 1;
+    }
+    if (nr_slices >= stream->size_z || whole_volumes) {
+        int64_t nr_volumes = nr_slices / stream->size_z;
+        if (nr_volumes < 1) {
+            nr_volumes = 1;
+        }
+        nr_slices = nr_volumes * stream->size_z;
+    }
+    stream->slices_per_chunk = nr_slices;
+    stream->nr_chunks = (stream->slices_per_chunk < stream->size_z)
+        ? stream->size_time * ((stream->size_z + nr_slices - 1) / nr_slices)
+        : (stream->nr_slices + nr_slices - 1) / nr_slices;
+    return stream;
+}
+
+nifti_image* nifti_stream_read_chunk(nifti_stream* stream) {
+    if (stream->slice_index >= stream->nr_slices) {
+        return NULL;
+    }
+
+    int64_t z = stream->slice_index % stream->size_z;
+    int64_t t = stream->slice_index / stream->size_z;
+    int64_t chunk_nz, chunk_nt;
+    if (stream->slices_per_chunk < stream->size_z) {  // Slab of slices
+        chunk_nz = min(stream->slices_per_chunk, stream->size_z - z);
+        chunk_nt = 1;
+    } else {  // Block of volumes
+        chunk_nz = stream->size_z;
+        chunk_nt = min(stream->slices_per_chunk / stream->size_z,
+                       stream->size_time - t);
+    }
+
+    nifti_image* chunk = nifti_copy_nim_info(stream->nii);
+    set_chunk_dims(chunk, chunk_nz, chunk_nt);
+    chunk->data = malloc(chunk->nvox * chunk->nbyper);
+    if (!chunk->data) {
+        fprintf(stderr, "** failed to allocate chunk of '%s'\n",
+                stream->nii->fname);
+        nifti_image_free(chunk);
+        return NULL;
+    }
+
+    int64_t nr_bytes = chunk->nvox * chunk->nbyper;
+    if (nifti_read_buffer(stream->fp, chunk->data, nr_bytes, stream->nii)
+        != nr_bytes) {
+        fprintf(stderr, "** failed to read chunk of '%s'\n",
+                stream->nii->fname);
+        nifti_image_free(chunk);
+        return NULL;
+    }
+
+    stream->chunk_z = z;
+    stream->chunk_t = t;
+    stream->slice_index += chunk_nz * chunk_nt;
+    stream->bytes_done += nr_bytes;
+    return chunk;
+}
+
+nifti_image* nifti_stream_read_box(nifti_stream* stream, const int64_t x0,
+                                   const int64_t y0, const int64_t z0,
+                                   const int64_t size_x, const int64_t size_y,
+                                   const int64_t size_z) {
+    ///////////////////////////////////////////////////////////////////////////
+    // Reads only a box of the next volume, like
+    // nifti_read_subregion_image, but through the open file handle. Rows
+    // outside of the box are skipped with forward seeks, so a compressed
+    // file is still decompressed only once and only the box is in memory.
+    ///////////////////////////////////////////////////////////////////////////
+    if (stream->slice_index >= stream->nr_slices
+        || stream->slice_index % stream->size_z != 0) {
+        return NULL;
+    }
+    nifti_image* nii = stream->nii;
+    const int64_t nbyper = nii->nbyper;
+    const int64_t t = stream->slice_index / stream->size_z;
+    const int64_t volume_offset = nii->iname_offset
+                                  + t * nii->nx * nii->ny * nii->nz * nbyper;
+
+    nifti_image* box = nifti_copy_nim_info(nii);
+    box->dim[1] = size_x;
+    box->dim[2] = size_y;
+    set_chunk_dims(box, size_z, 1);
+    box->data = malloc(box->nvox * box->nbyper);
+    if (!box->data) {
+        fprintf(stderr, "** failed to allocate box of '%s'\n", nii->fname);
+        nifti_image_free(box);
+        return NULL;
+    }
+
+    char* row = static_cast<char*>(box->data);
+    const int64_t row_bytes = size_x * nbyper;
+    for (int64_t iz = z0; iz < z0 + size_z; ++iz) {
+        for (int64_t iy = y0; iy < y0 + size_y; ++iy) {
+            int64_t offset = volume_offset
+                             + ((iz * nii->ny + iy) * nii->nx + x0) * nbyper;
+            if (znzseek(stream->fp, offset, SEEK_SET) < 0
+                || nifti_read_buffer(stream->fp, row, row_bytes, nii) != row_bytes) {
+                fprintf(stderr, "** failed to read box of '%s'\n", nii->fname);
+                nifti_image_free(box);
+                return NULL;
+            }
+            row += row_bytes;
+        }
+    }
+
+    stream->chunk_z = z0;
+    stream->chunk_t = t;
+    stream->slice_index += stream->size_z;
+    stream->bytes_done += box->nvox * nbyper;
+    return box;
+}
+
+nifti_stream* nifti_stream_open_write(nifti_image* nii, const string path,
+                                      const string tag, const bool log,
+                                      const bool use_outpath) {
+    ///////////////////////////////////////////////////////////////////////////
+    // The header of nii determines the full output dimensions.
+    // Its data is not written (it might not even be allocated). Chunks are
+    // appended with nifti_stream_write_chunk in file order.
+    ///////////////////////////////////////////////////////////////////////////
+    string path_out = make_output_path(path, tag, use_outpath);
+
+    nifti_image* nii_out = nifti_copy_nim_info(nii);
+    nifti_set_filenames(nii_out, path_out.c_str(), 1, 1);
+    pipeline_forget(nii_out->fname);
+    znzFile fp = nifti_image_write_hdr_img(nii_out, 2, "wb");
+    if (znz_isnull(fp)) {
+        fprintf(stderr, "** failed to open '%s' for writing\n",
+                path_out.c_str());
+        nifti_image_free(nii_out);
+        return NULL;
+    }
+    if (log) {
+        log_output(path_out.c_str());
+    }
+
+    nifti_stream* stream = new nifti_stream;
+    stream->nii = nii_out;
+    stream->fp = fp;
+    stream->writing = true;
+    stream->size_z = nii_out->nz;
+    stream->size_time = nii_out->nvox / (nii_out->nx * nii_out->ny * nii_out->nz);
+    stream->nr_slices = stream->size_z * stream->size_time;
+    stream->slices_per_chunk = 0;
+    stream->nr_chunks = 0;
+    stream->slice_index = 0;
+    stream->chunk_z = 0;
+    stream->chunk_t = 0;
+    stream->bytes_done = 0;
+    return stream;
+}
+
+bool nifti_stream_write_chunk(nifti_stream* stream, nifti_image* chunk) {
+    if (chunk->datatype != stream->nii->datatype) {
+        fprintf(stderr, "** chunk datatype does not match '%s'\n",
+                stream->nii->fname);
+        return false;
+    }
+    int64_t nr_bytes = chunk->nvox * chunk->nbyper;
+    if (nifti_write_buffer(stream->fp, chunk->data, nr_bytes) != nr_bytes) {
+        fprintf(stderr, "** failed to write chunk to '%s'\n",
+                stream->nii->fname);
+        return false;
+    }
+    stream->slice_index += chunk->nvox / (chunk->nx * chunk->ny);
+    stream->bytes_done += nr_bytes;
+    return true;
+}
+
+bool nifti_stream_close(nifti_stream* stream) {
+    // Returns false if the stream was not read or written completely.
+    if (!stream) {
+        return false;
+    }
+    bool complete = stream->slice_index == stream->nr_slices;
+    if (stream->writing && !complete) {
+        fprintf(stderr, "** incomplete output, %lld/%lld slices written to '%s'\n",
+                (long long)stream->slice_index, (long long)stream->nr_slices,
+                stream->nii->fname);
+    }
+    znzclose(stream->fp);
+    nifti_image_free(stream->nii);
+    delete stream;
+    return complete;
+}
@@ -1,3 +1,5 @@
+#ifndef _LAYNII_LIB_H_
+#define _LAYNII_LIB_H_
 
 #include <stdio.h>
 //#include <math.h>
@@ -6,6 +8,12 @@
 #include <iostream>
 #include <string>
 #include <tuple>
+#include <map>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
 #include "./nifti2_io.h"
 
 using namespace std;
@@ -16,6 +24,10 @@ using namespace std;
 double ren_average(double arr[], int size);
 double ren_stdev(double arr[], int size);
 double ren_correl(double arr1[], double arr2[], int size);
+double ren_correl_from_sums(double n, double sum_x, double sum_y,
+                            double sum_xx, double sum_yy, double sum_xy);
+void ren_lag_correl(double arr1[], double arr2[], int size, int max_lag,
+                    double correl[]);
 double ren_skew(double arr[], int size);
 double ren_kurt(double arr[], int size);
 double ren_autocor(double arr[], int size);
@@ -28,12 +40,23 @@ float dist2d(float x1, float y1, float x2, float y2);
 float angle(float a, float b, float c);
 float gaus(float distance, float sigma);
 
+// Counter-based random numbers. The n-th number only depends on the seed and
+// n, so results are the same no matter which thread draws them.
+void philox4x32(const uint64_t seed, const uint64_t counter, uint32_t out[4]);
+double rand_uniform(const uint64_t seed, const uint64_t counter);
+double rand_normal(const uint64_t seed, const uint64_t counter);
+
 void log_welcome(const char* programname);
 void log_output(const char* filename);
 void log_nifti_descriptives(nifti_image* nii);
+void log_stage(const char* message);
 
+string make_output_path(const string path, const string tag,
+                        const bool use_outpath);
 void save_output_nifti(string filename, string prefix, nifti_image* nii,
                        bool log = true, bool use_outpath = false);
+bool parse_float_list(const char* text, vector<float>& values);
+bool parse_int_list(const char* text, vector<int>& values);
 
 nifti_image* copy_nifti_as_double(nifti_image* nii);
 nifti_image* copy_nifti_as_float32(nifti_image* nii);
@@ -53,7 +76,468 @@ std::tuple<float, float> simplex_perturb_2D(float x, float y, float a, float b);
 nifti_image* iterative_smoothing(nifti_image* nii_in, int iter_smooth,
                                  nifti_image* nii_mask, int32_t mask_value);
 
+// ----------------------------------------------------------------------------
+// Voxel neighbourhood stencils for region growing and smoothing
+// ----------------------------------------------------------------------------
+// Neighbour steps in the order of the 1-jump (faces), 2-jump (edges) and
+// 3-jump (corners) neighbours. A connectivity of 6, 18 or 26 uses the first
+// 6, 18 or all 26 of them.
+extern const int8_t NEIGHBOUR_STEPS[26][3];
+
+template <int N>
+struct voxel_stencil {
+    static_assert(N == 6 || N == 18 || N == 26,
+                  "connectivity has to be 6, 18 or 26");
+    uint32_t size_x, size_y, size_z;
+    int32_t offset[N];         // Linear index offset of each neighbour
+    int32_t padded_offset[N];  // Same, in a padded_volume of the image
+    float dist[N];             // Distance of each neighbour in mm
+
+    explicit voxel_stencil(const nifti_image* nii)
+        : size_x(nii->nx), size_y(nii->ny), size_z(nii->nz) {
+        const float dX = nii->pixdim[1];
+        const float dY = nii->pixdim[2];
+        const float dZ = nii->pixdim[3];
+        for (int k = 0; k != N; ++k) {
+            const int sx = NEIGHBOUR_STEPS[k][0];
+            const int sy = NEIGHBOUR_STEPS[k][1];
+            const int sz = NEIGHBOUR_STEPS[k][2];
+            offset[k] = sx + static_cast<int32_t>(size_x) * (sy
+                        + static_cast<int32_t>(size_y) * sz);
+            padded_offset[k] = sx + static_cast<int32_t>(size_x + 2) * (sy
+                               + static_cast<int32_t>(size_y + 2) * sz);
+            if (k < 6) {
+                dist[k] = sx != 0 ? dX : (sy != 0 ? dY : dZ);
+            } else {  // Same arithmetic as the dia_xy, dia_xyz etc. constants
+                float sum = 0;
+                if (sx != 0) sum += dX * dX;
+                if (sy != 0) sum += dY * dY;
+                if (sz != 0) sum += dZ * dZ;
+                dist[k] = sqrt(sum);
+            }
+        }
+    }
+
+    // Writes the neighbours of voxel i that are inside the volume to j and
+    // their stencil indices to k (e.g. to look up dist[k]). Returns how many
+    // there are. Interior voxels skip all bounds checks.
+    int neighbours(const uint32_t i, uint32_t* j, uint8_t* k) const {
+        const uint32_t ix = i % size_x;
+        const uint32_t iy = (i / size_x) % size_y;
+        const uint32_t iz = i / size_x / size_y;
+        if (ix > 0 && ix + 1 < size_x && iy > 0 && iy + 1 < size_y
+            && iz > 0 && iz + 1 < size_z) {
+            for (int n = 0; n != N; ++n) {
+                j[n] = i + offset[n];
+                k[n] = n;
+            }
+            return N;
+        }
+        int nr = 0;
+        for (int n = 0; n != N; ++n) {
+            // Unsigned wrap around turns -1 at the lower border into a miss
+            if (ix + NEIGHBOUR_STEPS[n][0] < size_x
+                && iy + NEIGHBOUR_STEPS[n][1] < size_y
+                && iz + NEIGHBOUR_STEPS[n][2] < size_z) {
+                j[nr] = i + offset[n];
+                k[nr] = n;
+                ++nr;
+            }
+        }
+        return nr;
+    }
+};
+
+// Working copy of a 3D image with a one voxel halo around it. The halo is
+// filled with a sentinel value that the neighbour test of the calling loop
+// never accepts (e.g. 0 for rim labels), so neighbours can be visited with
+// voxel_stencil::padded_offset without any bounds checks. The raw index j of
+// an accepted neighbour is then simply i + voxel_stencil::offset[k].
+template <typename T>
+struct padded_volume {
+    uint32_t size_x, size_y, size_z;  // Dimensions including the halo
+    vector<T> data;
+
+    template <typename S>
+    padded_volume(const nifti_image* nii, const S* nii_data, const T sentinel)
+        : size_x(nii->nx + 2), size_y(nii->ny + 2), size_z(nii->nz + 2),
+          data(static_cast<size_t>(size_x) * size_y * size_z, sentinel) {
+        const uint32_t nx = nii->nx, ny = nii->ny, nz = nii->nz;
+        for (uint32_t iz = 0; iz != nz; ++iz) {
+            for (uint32_t iy = 0; iy != ny; ++iy) {
+                const S* src = nii_data + nx * (iy + ny * iz);
+                T* dst = &data[index(0, iy, iz)];
+                for (uint32_t ix = 0; ix != nx; ++ix) {
+                    dst[ix] = static_cast<T>(src[ix]);
+                }
+            }
+        }
+    }
+
+    // Padded index of voxel (ix, iy, iz) of the raw image
+    uint32_t index(const uint32_t ix, const uint32_t iy,
+                   const uint32_t iz) const {
+        return (ix + 1) + size_x * ((iy + 1) + size_y * (iz + 1));
+    }
+
+    // Padded index of voxel i of the raw image
+    uint32_t index(const uint32_t i) const {
+        const uint32_t nx = size_x - 2, ny = size_y - 2;
+        return index(i % nx, (i / nx) % ny, i / nx / ny);
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Compact storage for the voxels of interest (VOI) of a volume
+// ----------------------------------------------------------------------------
+// Maps the full-FOV index of a voxel to its position ii in voi_id (the
+// ascending list of voxels of interest the tools build), or -1 outside it.
+struct voi_index {
+    const int32_t* voi_id;  // Not owned
+    uint32_t nr_voi;
+    vector<int32_t> compact;
+
+    voi_index(const int32_t* voi_id, const uint32_t nr_voi,
+              const uint32_t nr_voxels)
+        : voi_id(voi_id), nr_voi(nr_voi), compact(nr_voxels, -1) {
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            compact[voi_id[ii]] = ii;
+        }
+    }
+};
+
+// Full-FOV image like the reference image, zero outside of the voxels of
+// interest. Mainly to save intermediate voi_array values.
+nifti_image* voi_to_nifti(const voi_index& voi, const float* values,
+                          nifti_image* like);
+nifti_image* voi_to_nifti(const voi_index& voi, const int32_t* values,
+                          nifti_image* like);
+nifti_image* voi_to_nifti(const voi_index& voi, const int16_t* values,
+                          nifti_image* like);
+
+// Per-voxel values of the voxels of interest only, so that scratch buffers
+// scale with the number of voxels of interest instead of the whole FOV.
+// Indexed with the VOI position ii; at() takes a full-FOV index instead.
+template <typename T>
+struct voi_array {
+    const voi_index* voi;
+    vector<T> data;
+
+    explicit voi_array(const voi_index& voi, const T value = 0)
+        : voi(&voi), data(voi.nr_voi, value) {}
+
+    T& operator[](const uint32_t ii) { return data[ii]; }
+    const T& operator[](const uint32_t ii) const { return data[ii]; }
+    T& at(const uint32_t i) { return data[voi->compact[i]]; }
+    const T& at(const uint32_t i) const { return data[voi->compact[i]]; }
+
+    nifti_image* to_nifti(nifti_image* like) const {
+        return voi_to_nifti(*voi, data.data(), like);
+    }
+};
+
+// Saves voi_array values as a full-FOV image like the reference image
+template <typename T>
+void save_output_voi(string filename, string prefix,
+                     const voi_array<T>& values, nifti_image* like,
+                     bool log = true, bool use_outpath = false) {
+    nifti_image* nii = values.to_nifti(like);
+    save_output_nifti(filename, prefix, nii, log, use_outpath);
+    nifti_image_free(nii);
+}
+
+// ----------------------------------------------------------------------------
+// Sparse Laplace systems A x = b over the voxels of a mask, where
+// A = diag - W with symmetric neighbour weights W (fixed border voxels are
+// folded into b). Rows are stored compressed, one row per unknown voxel.
+// ----------------------------------------------------------------------------
+struct laplace_system {
+    vector<int64_t> row_start;  // Size nr_rows + 1
+    vector<int32_t> row_col;
+    vector<float> row_weight;
+    vector<double> diag;
+    vector<double> rhs;
+};
+
+void laplace_apply(const laplace_system& A, const vector<double>& x,
+                   vector<double>& y);
+double laplace_residual(const laplace_system& A, const vector<double>& x);
+int laplace_solve_cg(const laplace_system& A, vector<double>& x,
+                     const double tolerance, const int max_iterations,
+                     double& rel_residual);
+
+// ----------------------------------------------------------------------------
+// Timing and memory instrumentation (enabled with -timing or -timing_json)
+// ----------------------------------------------------------------------------
+void timing_enable(const char* json_path = NULL);
+bool parse_timing_option(int& ac, int argc, char* argv[]);
+
+// Help text of the options handled by parse_timing_option
+#define TIMING_OPTIONS_HELP \
+    "    -timing      : (Optional) Print time and peak memory of the process\n" \
+    "                   per stage.\n" \
+    "    -timing_json : (Optional) Also write the timing table to a JSON file.\n"
+void timing_stage(const char* name);
+void timing_count(uint64_t nr_voxel_visits);
+void timing_report(void);
+
+// Attributes the time spent in its scope to a separate stage
+class timing_scope {
+ public:
+    explicit timing_scope(const char* name);
+    ~timing_scope();
+};
+
+// ----------------------------------------------------------------------------
+// Level-synchronous region growing
+// ----------------------------------------------------------------------------
+// Grows distances from the voxels of interest at step 1 (the seeds) exactly
+// like the classic sweep over all voxels of interest in ascending order:
+//
+//   for every voxel i with step[i] == grow_step, for every neighbour j with
+//   accept(label of j, n): if dist[i] + nb.dist[n] < dist[j] or dist[j] == 0,
+//   then dist[j], step[j] = grow_step + 1, id[j] = id[i], prevstep[j] = i
+//
+// Only the frontier (voxels at the current step) is visited. With OpenMP,
+// every step is expanded in parallel: each target keeps the smallest distance
+// and on ties the lowest source voxel, as the sweep does. Frontier voxels that
+// the sweep would skip, because a lower frontier voxel improved them earlier
+// in the same step, are found before expanding. So the results are the same
+// as the sweep for any number of threads.
+//
+// All arrays are indexed by the VOI position ii (see voi_index); id and
+// prevstep may be NULL. accept(label, n) must reject the sentinel of labels.
+
+// Sorts VOI positions in ascending order (radix sort, buffer is scratch space)
+void sort_voi_positions(vector<uint32_t>& values, vector<uint32_t>& buffer);
+
+template <int N, typename L, typename S, typename Accept>
+void grow_frontier(const voxel_stencil<N>& nb, const voi_index& voi,
+                   const padded_volume<L>& labels, Accept accept,
+                   float* dist, S* step, int32_t* id, int32_t* prevstep) {
+    const int64_t nr_voi = voi.nr_voi;
+    const int32_t* voi_id = voi.voi_id;
+    const int32_t* compact = voi.compact.data();
+    const L* labels_data = labels.data.data();
+
+    vector<uint32_t> voi_pad(nr_voi);  // Indices in the padded labels
+    vector<uint32_t> frontier, next, sort_buffer;
+    for (int64_t ii = 0; ii < nr_voi; ++ii) {
+        voi_pad[ii] = labels.index(voi_id[ii]);
+        if (step[ii] == 1) {
+            frontier.push_back(ii);
+        }
+    }
+    const uint32_t* voi_pad_data = voi_pad.data();
+
+#ifdef _OPENMP
+    // Best (distance, source) of every target as one sortable key. Distances
+    // are positive, so their bit patterns sort like the floats do.
+    const uint64_t EMPTY = ~static_cast<uint64_t>(0);
+    vector<uint64_t> best(nr_voi, EMPTY);
+    vector<uint8_t> skipped(nr_voi, 0);
+    vector<uint64_t> improved;  // (target, source) pairs within the frontier
+    vector<int32_t> new_id;
+    uint64_t* best_data = best.data();
+    uint8_t* skipped_data = skipped.data();
+
+    int32_t grow_step = 1;
+    while (!frontier.empty()) {
+        timing_count(frontier.size());
+        const int64_t nr_frontier = frontier.size();
+        const uint32_t* frontier_data = frontier.data();
+        improved.clear();
+
+        for (int pass = 0; pass != 2; ++pass) {
+            next.clear();
+            #pragma omp parallel
+            {
+                vector<uint32_t> found;  // Targets first reached by this thread
+                vector<uint64_t> found_improved;
+
+                #pragma omp for schedule(static)
+                for (int64_t f = 0; f < nr_frontier; ++f) {
+                    const uint32_t ii = frontier_data[f];
+                    if (skipped_data[ii]) continue;
+                    const uint32_t i = voi_id[ii];
+                    const L* label_i = labels_data + voi_pad_data[ii];
+                    for (int n = 0; n != N; ++n) {
+                        if (!accept(label_i[nb.padded_offset[n]], n)) continue;
+                        const uint32_t jj = compact[i + nb.offset[n]];
+                        const float d = dist[ii] + nb.dist[n];
+                        if (d < dist[jj] || dist[jj] == 0) {
+                            if (pass == 0 && step[jj] == grow_step && ii < jj) {
+                                found_improved.push_back(
+                                    (static_cast<uint64_t>(jj) << 32) | ii);
+                            }
+                            uint32_t d_bits;
+                            memcpy(&d_bits, &d, sizeof(d_bits));
+                            const uint64_t key =
+                                (static_cast<uint64_t>(d_bits) << 32) | ii;
+                            uint64_t old = __atomic_load_n(&best_data[jj],
+                                                           __ATOMIC_RELAXED);
+                            while (key < old) {
+                                if (__atomic_compare_exchange_n(
+                                        &best_data[jj], &old, key, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                                    if (old == EMPTY) {
+                                        found.push_back(jj);
+                                    }
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+                #pragma omp critical
+                {
+                    next.insert(next.end(), found.begin(), found.end());
+                    improved.insert(improved.end(), found_improved.begin(),
+                                    found_improved.end());
+                }
+            }
+            if (pass == 1 || improved.empty()) break;
+
+            // In ascending order, a frontier voxel is skipped when a lower
+            // frontier voxel that is not skipped itself improves it
+            std::sort(improved.begin(), improved.end());
+            bool any_skipped = false;
+            for (size_t k = 0; k != improved.size(); ++k) {
+                const uint32_t jj = improved[k] >> 32;
+                const uint32_t ii = improved[k] & 0xFFFFFFFF;
+                if (!skipped_data[ii] && !skipped_data[jj]) {
+                    skipped_data[jj] = 1;
+                    any_skipped = true;
+                }
+            }
+            if (!any_skipped) break;
+
+            // Expand again without the skipped voxels
+            for (size_t k = 0; k != next.size(); ++k) {
+                best_data[next[k]] = EMPTY;
+            }
+        }
+        sort_voi_positions(next, sort_buffer);
+
+        // Sources can be targets too, so read their ids before writing
+        const int64_t nr_next = next.size();
+        const uint32_t* next_data = next.data();
+        if (id != NULL) {
+            new_id.resize(nr_next);
+            #pragma omp parallel for schedule(static)
+            for (int64_t k = 0; k < nr_next; ++k) {
+                new_id[k] = id[best_data[next_data[k]] & 0xFFFFFFFF];
+            }
+        }
+        #pragma omp parallel for schedule(static)
+        for (int64_t k = 0; k < nr_next; ++k) {
+            const uint32_t jj = next_data[k];
+            const uint32_t src = best_data[jj] & 0xFFFFFFFF;
+            const uint32_t d_bits = best_data[jj] >> 32;
+            memcpy(&dist[jj], &d_bits, sizeof(d_bits));
+            step[jj] = grow_step + 1;
+            if (id != NULL) id[jj] = new_id[k];
+            if (prevstep != NULL) prevstep[jj] = voi_id[src];
+            best_data[jj] = EMPTY;
+        }
+        for (size_t k = 0; k != improved.size(); ++k) {
+            skipped_data[improved[k] >> 32] = 0;
+        }
+        frontier.swap(next);
+        grow_step += 1;
+    }
+#else
+    // Without OpenMP, sweep over the frontier in place
+    int32_t grow_step = 1;
+    while (!frontier.empty()) {
+        timing_count(frontier.size());
+        const int64_t nr_frontier = frontier.size();
+        const uint32_t* frontier_data = frontier.data();
+        next.clear();
+
+        for (int64_t f = 0; f < nr_frontier; ++f) {
+            const uint32_t ii = frontier_data[f];
+            if (step[ii] != grow_step) continue;  // Improved earlier this step
+            const uint32_t i = voi_id[ii];
+            const L* label_i = labels_data + voi_pad_data[ii];
+            for (int n = 0; n != N; ++n) {
+                if (!accept(label_i[nb.padded_offset[n]], n)) continue;
+                const uint32_t jj = compact[i + nb.offset[n]];
+                const float d = dist[ii] + nb.dist[n];
+                if (d < dist[jj] || dist[jj] == 0) {
+                    if (step[jj] != grow_step + 1) {
+                        next.push_back(jj);
+                    }
+                    dist[jj] = d;
+                    step[jj] = grow_step + 1;
+                    if (id != NULL) id[jj] = id[ii];
+                    if (prevstep != NULL) prevstep[jj] = i;
+                }
+            }
+        }
+        sort_voi_positions(next, sort_buffer);
+        frontier.swap(next);
+        grow_step += 1;
+    }
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// In-memory image store for the laynii pipeline driver
+// ----------------------------------------------------------------------------
+// Programs read their inputs with pipeline_image_read. Images that a program
+// reads, writes, copies with copy_nifti_as_* or hands over with
+// pipeline_image_track belong to the running stage. The driver frees them
+// with pipeline_end_stage. Images freed earlier go through pipeline_image_free.
+void pipeline_enable(bool write_all);
+void pipeline_disable(void);
+void pipeline_request_output(const string path);
+nifti_image* pipeline_image_read(const char* path, int read_data);
+bool pipeline_image_write(nifti_image* nii);
+void pipeline_image_track(nifti_image* nii);
+void pipeline_image_free(nifti_image* nii);
+void pipeline_end_stage(void);
+void pipeline_flush(const char* path);
+
+// ----------------------------------------------------------------------------
+// Chunked streaming of datasets that do not need to be fully in memory
+// ----------------------------------------------------------------------------
+// Default chunk size in voxels (128 MB as float32)
+const int64_t STREAM_CHUNK_VOXELS = 33554432;
+
+struct nifti_stream {
+    nifti_image* nii;          // Full image header (data is never loaded)
+    znzFile fp;
+    bool writing;
+    int64_t size_z;
+    int64_t size_time;         // All dimensions above 3 folded together
+    int64_t nr_slices;         // size_z * size_time
+    int64_t slices_per_chunk;
+    int64_t nr_chunks;
+    int64_t slice_index;       // Next slice to be read or written
+    int64_t chunk_z;           // First slice of the last chunk read
+    int64_t chunk_t;           // First volume of the last chunk read
+    int64_t bytes_done;
+};
+
+nifti_stream* nifti_stream_open_read(const char* fin,
+                                     int64_t max_chunk_voxels = STREAM_CHUNK_VOXELS,
+                                     bool whole_volumes = false);
+nifti_image* nifti_stream_read_chunk(nifti_stream* stream);
+// Reads only the given box of the next volume
+nifti_image* nifti_stream_read_box(nifti_stream* stream, const int64_t x0,
+                                   const int64_t y0, const int64_t z0,
+                                   const int64_t size_x, const int64_t size_y,
+                                   const int64_t size_z);
+nifti_stream* nifti_stream_open_write(nifti_image* nii, const string path,
+                                      const string tag, const bool log = true,
+                                      const bool use_outpath = false);
+bool nifti_stream_write_chunk(nifti_stream* stream, nifti_image* chunk);
+bool nifti_stream_close(nifti_stream* stream);
+
 // ============================================================================
 // Preprocessor macros.
 // ============================================================================
 #define PI 3.14159265;
+
+#endif  // _LAYNII_LIB_H_
@@ -0,0 +1,35 @@
+// Compiles a single LayNii program as a function for the laynii driver.
+//
+// The program source is wrapped into a namespace named after the program so
+// that its main() becomes LAYNII_TOOL::main() and helpers such as show_help()
+// do not clash between programs. Standard headers used by the programs are
+// included beforehand, outside of the namespace.
+//
+// The programs read and free their images through the pipeline_image_*
+// functions of laynii_lib, so the driver can free what is left of each stage.
+// A program that calls exit() (the NIfTI library does so on some fatal
+// errors) ends the whole pipeline.
+//
+// Example:
+//     c++ -c dep/laynii_tool.cpp -DLAYNII_TOOL=LN2_LAYERS -DLAYNII_TOOL_SRC='"../src/LN2_LAYERS.cpp"'
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <numeric>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "./laynii_lib.h"
+
+namespace LAYNII_TOOL {
+#include LAYNII_TOOL_SRC
+}
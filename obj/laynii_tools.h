@@ -0,0 +1,52 @@
+LAYNII_TOOL(LN2_LAYERS)
+LAYNII_TOOL(LN2_COLUMNS)
+LAYNII_TOOL(LN2_CONNECTED_CLUSTERS)
+LAYNII_TOOL(LN2_MULTILATERATE)
+LAYNII_TOOL(LN2_PATCH_FLATTEN)
+LAYNII_TOOL(LN2_PATCH_UNFLATTEN)
+LAYNII_TOOL(LN2_PATCH_FLATTEN_2D)
+LAYNII_TOOL(LN2_CHOLMO)
+LAYNII_TOOL(LN2_PROFILE)
+LAYNII_TOOL(LN2_LAYERDIMENSION)
+LAYNII_TOOL(LN2_MASK)
+LAYNII_TOOL(LN2_BORDERIZE)
+LAYNII_TOOL(LN2_GEODISTANCE)
+LAYNII_TOOL(LN2_IFPOINTS)
+LAYNII_TOOL(LN2_DEVEIN)
+LAYNII_TOOL(LN2_RIMIFY)
+LAYNII_TOOL(LN2_VORONOI)
+LAYNII_TOOL(LN2_ZERO_CROSSING)
+LAYNII_TOOL(LN2_UVD_FILTER)
+LAYNII_TOOL(LN2_HEXBIN)
+LAYNII_TOOL(LN2_NEIGHBORS)
+LAYNII_TOOL(LN2_GRAMAG)
+LAYNII_TOOL(LN_BOCO)
+LAYNII_TOOL(LN_MP2RAGE_DNOISE)
+LAYNII_TOOL(LN2_LAYER_SMOOTH)
+LAYNII_TOOL(LN_LAYER_SMOOTH)
+LAYNII_TOOL(LN_3DCOLUMNS)
+LAYNII_TOOL(LN_COLUMNAR_DIST)
+LAYNII_TOOL(LN_CORREL2FILES)
+LAYNII_TOOL(LN_DIRECT_SMOOTH)
+LAYNII_TOOL(LN_GRADSMOOTH)
+LAYNII_TOOL(LN_ZOOM)
+LAYNII_TOOL(LN_FLOAT_ME)
+LAYNII_TOOL(LN_SHORT_ME)
+LAYNII_TOOL(LN_EXTREMETR)
+LAYNII_TOOL(LN_GFACTOR)
+LAYNII_TOOL(LN_GROW_LAYERS)
+LAYNII_TOOL(LN_IMAGIRO)
+LAYNII_TOOL(LN_INTPRO)
+LAYNII_TOOL(LN_LEAKY_LAYERS)
+LAYNII_TOOL(LN_NOISEME)
+LAYNII_TOOL(LN_RAGRUG)
+LAYNII_TOOL(LN_SKEW)
+LAYNII_TOOL(LN_TEMPSMOOTH)
+LAYNII_TOOL(LN_TRIAL)
+LAYNII_TOOL(LN_PHYSIO_PARS)
+LAYNII_TOOL(LN_INT_ME)
+LAYNII_TOOL(LN_LOITUMA)
+LAYNII_TOOL(LN_NOISE_KERNEL)
+LAYNII_TOOL(LN_INFO)
+LAYNII_TOOL(LN_CONLAY)
+LAYNII_TOOL(LN2_DIRECTIONALITY_BIN)
@@ -20,6 +20,7 @@ int show_help(void) {
     "    -label  : (Optional) An integer. When given, output will only contain\n"
     "              the borders of voxels labeled with this value\n"
     "    -output : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -35,6 +36,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -74,7 +79,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
@@ -88,12 +93,13 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
+    // Neighbour offsets, 1, 2 or 3 jumps use the first 6, 18 or 26
+    const voxel_stencil<26> nb(nii1);
+    const int nr_jump_neighbours = jumps >= 3 ? 26 : jumps == 2 ? 18
+                                   : jumps == 1 ? 6 : 0;
+
     // ========================================================================
     // Fix input datatype issues
     nifti_image* nii_rim = copy_nifti_as_int32(nii1);
@@ -136,186 +142,21 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Borders
     // ========================================================================
-    cout << "\n  Finding border voxels..." << endl;
+    log_stage("Finding border voxels...");
 
-    uint32_t i, j, ix, iy, iz;
+    uint32_t i, j;
     bool switch_border = false;
 
     for (uint32_t ii = 0; ii != nr_voi; ++ii) {
         i = *(voi_id + ii);  // Map subset to full set
-        tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
-        if (jumps >= 1){
-            // --------------------------------------------------------
-            // 1-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0) {
-                j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x) {
-                j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0) {
-                j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y) {
-                j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iz > 0) {
-                j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iz < end_z) {
-                j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-        }
-
-        if (jumps >= 2) {
-            // --------------------------------------------------------
-            // 2-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0 && iy > 0) {
-                j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y) {
-                j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0) {
-                j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y) {
-                j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iz > 0) {
-                j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iz > 0) {
-                j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-        }
-
-        if (jumps >= 3) {
-            // --------------------------------------------------------
-            // 3-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0 && iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-                if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
-                    switch_border = true;
-                }
+        uint32_t nb_j[26];
+        uint8_t nb_k[26];
+        int nr_nb = nb.neighbours(i, nb_j, nb_k);
+        for (int nn = 0; nn != nr_nb && nb_k[nn] < nr_jump_neighbours; ++nn) {
+            j = nb_j[nn];
+            if (*(nii_rim_data + j) != *(nii_rim_data + i)) {
+                switch_border = true;
             }
         }
 
@@ -332,7 +173,6 @@ int main(int argc, char*  argv[]) {
     if (mask_label) {
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
             i = *(voi_id + ii);  // Map subset to full set
-            tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
             if (*(nii_borders_data + i) != label) {
                 *(nii_borders_data + i) = 0;
@@ -25,6 +25,7 @@ int show_help(void) {
     "                       This should not be smaller than the voxel dimension.\n"
     "    -debug           : (Optional) Save extra intermediate outputs.\n"
     "    -output          : (Optional) Output basename. Default is '_padded' as suffix.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -33,7 +34,8 @@ int main(int argc, char*  argv[]) {
 
     nifti_image *nii1 = NULL;
     char *fin = NULL, *fout = NULL;
-    uint16_t ac, nr_layers = 3;
+    int ac;
+    uint16_t nr_layers = 3;
     double_t layer_thickness = 0.8;
     bool  mode_debug = false,  mode_inner = false,  mode_outer = true;
     bool  use_outpath = false;
@@ -44,6 +46,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -layers\n");
@@ -97,7 +103,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin, 1);
+    nii1 = pipeline_image_read(fin, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -115,22 +121,14 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
     const float dX = nii1->pixdim[1];
     const float dY = nii1->pixdim[2];
     const float dZ = nii1->pixdim[3];
 
-    // Short diagonals
-    const float dia_xy = sqrt(dX * dX + dY * dY);
-    const float dia_xz = sqrt(dX * dX + dZ * dZ);
-    const float dia_yz = sqrt(dY * dY + dZ * dZ);
-    // Long diagonals
-    const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
 
     // ========================================================================
     // Fix input datatype issues
@@ -143,6 +141,10 @@ int main(int argc, char*  argv[]) {
     nifti_image* dist = copy_nifti_as_float32(nii_layers);
     float* dist_data = static_cast<float*>(dist->data);
 
+    // Layers with a halo that is never grown into, so the growing loop needs
+    // no bounds checks
+    const padded_volume<int16_t> layers_pad(nii_layers, nii_layers_data, -1);
+
 
     // ========================================================================
     // Looking what is already there in input
@@ -158,7 +160,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Grow outwards
     // ========================================================================
-    cout << "\n  Start growing ....." << endl;
+    log_stage("Start growing .....");
 
     if (mode_outer) {
         // Initialize grow volume for outwards growign
@@ -187,314 +189,28 @@ int main(int argc, char*  argv[]) {
         }
     }
 
-    uint16_t grow_step = 1;
-    uint32_t voxel_counter = nr_voxels;
-    uint32_t ix, iy, iz, j, k;
-    float d;
-    while (voxel_counter != 0) {
-        cout << "\r  Growing step " << grow_step << "......"  << flush;
-        voxel_counter = 0;
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-
-            if (*(step_data + i) == grow_step) {
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                voxel_counter += 1;
-
-                // ------------------------------------------------------------
-                // 1-jump neighbours (faces of cube)
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dX;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dX;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dY;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dY;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dZ;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dZ;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 2-jump neighbours (edges of cube)
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xy;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y) {
-                    j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xy;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xy;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y) {
-                    j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xy;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_yz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_yz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_yz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_yz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 3-jump neighbours (corners of cube)
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j)  || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_layers_data + j) == 0) {
-                        d = *(dist_data + i) + dia_xyz;
-                        if (d < *(dist_data + j) || *(dist_data + j) == 0) {
-                            *(dist_data + j) = d;
-                            *(step_data + j) = grow_step + 1;
-                        }
-                    }
-                }
-            }
+    // Only the seeds and the voxels outside of the layers take part in growing
+    vector<int32_t> voi_id;
+    for (uint32_t i = 0; i != nr_voxels; ++i) {
+        if (*(step_data + i) == 1 || *(nii_layers_data + i) == 0) {
+            voi_id.push_back(i);
         }
-        grow_step += 1;
+    }
+    const voi_index voi(voi_id.data(), voi_id.size(), nr_voxels);
+    voi_array<int16_t> voi_step(voi);
+    voi_array<float> voi_dist(voi);
+    for (uint32_t ii = 0; ii != voi.nr_voi; ++ii) {
+        voi_step[ii] = *(step_data + voi_id[ii]);
+        voi_dist[ii] = *(dist_data + voi_id[ii]);
+    }
+
+    // Grown in parallel if OpenMP is enabled
+    grow_frontier(nb, voi, layers_pad,
+                  [](const int16_t label, const int) { return label == 0; },
+                  voi_dist.data.data(), voi_step.data.data(), NULL, NULL);
+    for (uint32_t ii = 0; ii != voi.nr_voi; ++ii) {
+        *(step_data + voi_id[ii]) = voi_step[ii];
+        *(dist_data + voi_id[ii]) = voi_dist[ii];
     }
 
     if (mode_debug) {
@@ -1,6 +1,8 @@
 
 #include "../dep/laynii_lib.h"
+#include <functional>
 #include <limits>
+#include <queue>
 #include <sstream>
 
 int show_help(void) {
@@ -24,11 +26,17 @@ int show_help(void) {
     "                    the desired number of columns. Acts as a checkpoint.\n"
     "                    Especially useful for large images that takes long\n"
     "                    time to process.\n"
+    "    -incremental  : (Optional) Keep the distance to the nearest column\n"
+    "                    center for all midgm voxels and only update the voxels\n"
+    "                    that get closer to each new center. The next center is\n"
+    "                    always the farthest voxel. Much faster for many\n"
+    "                    columns, but centers differ from the default mode.\n"
     "    -debug        : (Optional) Save extra intermediate outputs.\n"
     "    -incl_borders : (Optional) Include inner and outer gray matter borders\n"
     "                    into the layering. This treats the borders as \n"
     "                    a part of gray matter. Off by default.\n"
     "    -output       : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - You can find further explanation of this algorithm at:\n"
@@ -37,6 +45,41 @@ int show_help(void) {
     return 0;
 }
 
+// Lowers the nearest center distances by growing from a new center in the
+// order of distance (Dijkstra). Growth stops at voxels that are already as
+// close to another center, so only the cell of the new center is visited.
+void grow_nearest_center(const uint32_t ii_center, const int32_t* voi_id,
+                         const int32_t* voi_compact,
+                         const voxel_stencil<26>& nb,
+                         float* dist, int32_t* step) {
+    typedef std::pair<float, uint32_t> entry;
+    std::priority_queue<entry, vector<entry>, std::greater<entry> > queue;
+    *(dist + ii_center) = 0;
+    *(step + ii_center) = 1;
+    queue.push(entry(0, ii_center));
+
+    uint32_t nb_j[26];
+    uint8_t nb_k[26];
+    while (!queue.empty()) {
+        const float d_i = queue.top().first;
+        const uint32_t ii = queue.top().second;
+        queue.pop();
+        if (d_i > *(dist + ii)) continue;  // Lowered again after pushing
+
+        int nr_nb = nb.neighbours(*(voi_id + ii), nb_j, nb_k);
+        for (int nn = 0; nn != nr_nb; ++nn) {
+            const int32_t jj = *(voi_compact + nb_j[nn]);
+            if (jj < 0) continue;
+            const float d = d_i + nb.dist[nb_k[nn]];
+            if (d < *(dist + jj)) {
+                *(dist + jj) = d;
+                *(step + jj) = *(step + ii) + 1;
+                queue.push(entry(d, jj));
+            }
+        }
+    }
+}
+
 int main(int argc, char*  argv[]) {
 
     nifti_image *nii1 = NULL, *nii2 = NULL, *nii3 = NULL;
@@ -44,12 +87,17 @@ int main(int argc, char*  argv[]) {
     int ac;
     int32_t nr_columns = 5;
     bool mode_debug = false, mode_initialize_with_centroids = false, mode_incl_borders = false;
+    bool mode_incremental = false;
 
     // Process user options
     if (argc < 2) return show_help();
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-rim")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -rim\n");
@@ -84,6 +132,8 @@ int main(int argc, char*  argv[]) {
             fout = argv[ac];
         } else if (!strcmp(argv[ac], "-incl_borders")) {
             mode_incl_borders = true;
+        } else if (!strcmp(argv[ac], "-incremental")) {
+            mode_incremental = true;
         } else if (!strcmp(argv[ac], "-debug")) {
             mode_debug = true;
         } else {
@@ -108,18 +158,18 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
     }
     if (mode_initialize_with_centroids) {
-        nii3 = nifti_image_read(fin3, 1);
+        nii3 = pipeline_image_read(fin3, 1);
         if (!nii3) {
             fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin3);
             return 2;
@@ -139,22 +189,11 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
-    const float dX = nii1->pixdim[1];
-    const float dY = nii1->pixdim[2];
-    const float dZ = nii1->pixdim[3];
-
-    // Short diagonals
-    const float dia_xy = sqrt(dX * dX + dY * dY);
-    const float dia_xz = sqrt(dX * dX + dZ * dZ);
-    const float dia_yz = sqrt(dY * dY + dZ * dZ);
-    // Long diagonals
-    const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
+    const voxel_stencil<6> nb6(nii1);
 
     // ========================================================================
     // Fix input datatype issues
@@ -171,11 +210,6 @@ int main(int argc, char*  argv[]) {
         *(nii_columns_data + i) = 0;
     }
 
-    nifti_image* flood_step = copy_nifti_as_int32(nii_columns);
-    int32_t* flood_step_data = static_cast<int32_t*>(flood_step->data);
-    nifti_image* flood_dist = copy_nifti_as_float32(nii_columns);
-    float* flood_dist_data = static_cast<float*>(flood_dist->data);
-
     // ------------------------------------------------------------------------
     // Find initial number of columns if the optional input is given
     int32_t max_column_id = 0;
@@ -232,6 +266,14 @@ int main(int argc, char*  argv[]) {
         }
     }
 
+    // Flood values are only kept for the voxels of interest, indexed by ii
+    voi_index voi(voi_id, nr_voi, nr_voxels);
+    voi_array<int32_t> flood_step(voi);
+    voi_array<float> flood_dist(voi);
+    const int32_t* voi_compact = voi.compact.data();
+    int32_t* flood_step_data = flood_step.data.data();
+    float* flood_dist_data = flood_dist.data.data();
+
     // ========================================================================
     // Find connected clusters to initialize one voxel in each
     // ========================================================================
@@ -242,7 +284,7 @@ int main(int argc, char*  argv[]) {
     int32_t init_voxel_id = 1;
     bool terminate_switch1 = true;
     while (terminate_switch1) {
-        uint32_t ix, iy, iz, i, j;
+        uint32_t i, j;
 
         if (voxel_counter == nr_voi) {
             // Indicates all clusters are reached. Terminate condition.
@@ -268,170 +310,12 @@ int main(int argc, char*  argv[]) {
                 // Map subset to full set
                 i = *(voi_id + ii);
                 if (*(nii_midgm_data + i) == init_voxel_id) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            *(nii_midgm_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+                    uint32_t nb_j[26];
+                    uint8_t nb_k[26];
+                    int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                    for (int nn = 0; nn != nr_nb; ++nn) {
+                        j = nb_j[nn];
                         if (*(nii_midgm_data + j) == 1) {
                             *(nii_midgm_data + j) = init_voxel_id;
                         }
@@ -470,426 +354,152 @@ int main(int argc, char*  argv[]) {
         *(nii_midgm_data + start_voxel) = 2;  // Reduce to single initial voxel
     }
 
-    // Initialize new voxel
-    uint32_t new_voxel_id;
-    float flood_dist_thr = std::numeric_limits<float>::infinity();
-
-    // Loop until desired number of columns reached
-    for (int32_t n = max_column_id; n < nr_columns; ++n) {
-        cout << "\r    Column [" << n+1 << "/" << nr_columns << "]";
-
-        int32_t grow_step = 1;
-        voxel_counter = 1;
-        uint32_t ix, iy, iz, i, j;
-        float d;
+    if (mode_incremental) {
+        // Distances to the nearest center are kept over all columns. Initial
+        // voxels of the clusters and given centroids are the first centers.
+        const float inf = std::numeric_limits<float>::infinity();
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            *(flood_step_data + ii) = 0;
+            *(flood_dist_data + ii) = inf;
+        }
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            uint32_t i = *(voi_id + ii);
+            if (*(nii_midgm_data + i) == 2 || *(nii_columns_data + i) != 0) {
+                grow_nearest_center(ii, voi_id, voi_compact, nb,
+                                    flood_dist_data, flood_step_data);
+            }
+        }
 
-        // Initialize grow volume
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            if (*(nii_midgm_data + i) == 2) {
-                *(flood_step_data + i) = 1.;
-                *(flood_dist_data + i) = 0.;
-            } else if (*(flood_dist_data + i) >= flood_dist_thr
-                       && *(flood_dist_data + i) > 0) {
-                *(flood_step_data + i) = 0.;
-                *(flood_dist_data + i) = 0.;
-                *(nii_midgm_data + i) = 1;
-            } else if (*(flood_dist_data + i) < flood_dist_thr
-                       && *(flood_dist_data + i) > 0) {
-                *(nii_midgm_data + i) = 0;  // no need to recompute
+        // Farthest voxel first. Entries are not removed when distances
+        // decrease; an outdated entry is pushed again with its new distance.
+        typedef std::pair<float, uint32_t> entry;
+        std::priority_queue<entry> farthest;
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            if (*(flood_dist_data + ii) > 0) {
+                farthest.push(entry(*(flood_dist_data + ii), ii));
             }
         }
 
-        while (voxel_counter != 0) {
-            voxel_counter = 0;
+        for (int32_t n = max_column_id; n < nr_columns; ++n) {
+            while (!farthest.empty()) {
+                const uint32_t ii = farthest.top().second;
+                if (farthest.top().first == *(flood_dist_data + ii)) break;
+                farthest.pop();
+                if (*(flood_dist_data + ii) > 0) {
+                    farthest.push(entry(*(flood_dist_data + ii), ii));
+                }
+            }
+            if (farthest.empty()) {
+                cout << "\n    No more voxels for new columns." << flush;
+                break;
+            }
+            const float max_distance = farthest.top().first;
+            const uint32_t ii = farthest.top().second;
+            farthest.pop();
+
+            cout << "\r    Column [" << n+1 << "/" << nr_columns << "]";
+            *(nii_columns_data + *(voi_id + ii)) = n+1;
+            grow_nearest_center(ii, voi_id, voi_compact, nb,
+                                flood_dist_data, flood_step_data);
+            cout << " | Max. distance between points: " << max_distance << " [voxel dimension units]" << flush;
+        }
+    } else {
+        // Initialize new voxel
+        uint32_t new_voxel_id;
+        float flood_dist_thr = std::numeric_limits<float>::infinity();
+
+        // Loop until desired number of columns reached
+        for (int32_t n = max_column_id; n < nr_columns; ++n) {
+            cout << "\r    Column [" << n+1 << "/" << nr_columns << "]";
+
+            int32_t grow_step = 1;
+            voxel_counter = 1;
+            uint32_t i, j;
+            int32_t jj;
+            float d;
+
+            // Initialize grow volume
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-                // Map subset to full set
-                i = *(voi_id + ii);
-                if (*(flood_step_data + i) == grow_step) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                    voxel_counter += 1;
-
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+                uint32_t i = *(voi_id + ii);
+                if (*(nii_midgm_data + i) == 2) {
+                    *(flood_step_data + ii) = 1;
+                    *(flood_dist_data + ii) = 0.;
+                } else if (*(flood_dist_data + ii) >= flood_dist_thr
+                           && *(flood_dist_data + ii) > 0) {
+                    *(flood_step_data + ii) = 0;
+                    *(flood_dist_data + ii) = 0.;
+                    *(nii_midgm_data + i) = 1;
+                } else if (*(flood_dist_data + ii) < flood_dist_thr
+                           && *(flood_dist_data + ii) > 0) {
+                    *(nii_midgm_data + i) = 0;  // no need to recompute
+                }
+            }
 
-                        if (*(nii_midgm_data + j) == 1) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                new_voxel_id = j;
+            while (voxel_counter != 0) {
+                voxel_counter = 0;
+                for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+                    // Map subset to full set
+                    i = *(voi_id + ii);
+                    if (*(flood_step_data + ii) == grow_step) {
+                        voxel_counter += 1;
+
+                        uint32_t nb_j[26];
+                        uint8_t nb_k[26];
+                        int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                        for (int nn = 0; nn != nr_nb; ++nn) {
+                            j = nb_j[nn];
+                            if (*(nii_midgm_data + j) == 1) {
+                                jj = *(voi_compact + j);
+                                d = *(flood_dist_data + ii) + nb.dist[nb_k[nn]];
+                                if (d < *(flood_dist_data + jj)
+                                    || *(flood_dist_data + jj) == 0) {
+                                    *(flood_dist_data + jj) = d;
+                                    *(flood_step_data + jj) = grow_step + 1;
+                                    new_voxel_id = j;
+                                }
                             }
                         }
                     }
                 }
+                grow_step += 1;
             }
-            grow_step += 1;
-        }
-        flood_dist_thr = *(flood_dist_data + new_voxel_id) / 2.;
-        *(nii_midgm_data + new_voxel_id) = 2;
-        *(nii_columns_data + new_voxel_id) = n+1;
-
-        // --------------------------------------------------------------------
-        // Find farthest point
-        float max_distance = 0;
-        int idx_new_point;
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            i = *(voi_id + ii);
-            if (*(flood_dist_data + i) > max_distance) {
-                max_distance = *(flood_dist_data + i);
-                idx_new_point = i;
+            jj = *(voi_compact + new_voxel_id);
+            flood_dist_thr = *(flood_dist_data + jj) / 2.;
+            *(nii_midgm_data + new_voxel_id) = 2;
+            *(nii_columns_data + new_voxel_id) = n+1;
+
+            // --------------------------------------------------------------------
+            // Find farthest point
+            float max_distance = 0;
+            int idx_new_point;
+            for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+                i = *(voi_id + ii);
+                if (*(flood_dist_data + ii) > max_distance) {
+                    max_distance = *(flood_dist_data + ii);
+                    idx_new_point = i;
+                }
             }
+            cout << " | Max. distance between points: " << max_distance << " [voxel dimension units]" << flush;
+
+            // --------------------------------------------------------------------
+            // Remove the initial voxel (reduces arbitrariness of the 1st point)
+            // NOTE(Faruk): This step guarantees to start from extrememums. The
+            // initial point is only used to determine an extremum distance.
+            // if (n == 0) {
+            //     *(nii_midgm_data + start_voxel) = 1;
+            //     // Also reset distances
+            //     for (uint32_t i = 0; i != nr_voxels; ++i) {
+            //         *(flood_step_data + i) = 0.;
+            //         *(flood_dist_data + i) = 0.;
+            //     }
+            // }
         }
-        cout << " | Max. distance between points: " << max_distance << " [voxel dimension units]" << flush;
-
-        // --------------------------------------------------------------------
-        // Remove the initial voxel (reduces arbitrariness of the 1st point)
-        // NOTE(Faruk): This step guarantees to start from extrememums. The
-        // initial point is only used to determine an extremum distance.
-        // if (n == 0) {
-        //     *(nii_midgm_data + start_voxel) = 1;
-        //     // Also reset distances
-        //     for (uint32_t i = 0; i != nr_voxels; ++i) {
-        //         *(flood_step_data + i) = 0.;
-        //         *(flood_dist_data + i) = 0.;
-        //     }
-        // }
     }
     cout << endl;
 
     if (mode_debug) {
-        save_output_nifti(fout, "flood_step", flood_step, false);
-        save_output_nifti(fout, "flood_dist", flood_dist, false);
+        save_output_voi(fout, "flood_step", flood_step, nii_rim, false);
+        save_output_voi(fout, "flood_dist", flood_dist, nii_rim, false);
     }
     // Add number of columns into the output tag
     std::ostringstream tag;
@@ -900,7 +510,7 @@ int main(int argc, char*  argv[]) {
     // Voronoi cell from MidGM cells to rest of the GM (gray matter)
     // but not borders, to avoid leakage across kissing gyri.
     // ========================================================================
-    cout << "\n  Start Voronoi..." << endl;
+    log_stage("Start Voronoi...");
 
     // ------------------------------------------------------------------------
     // Reduce number of looped-through voxels
@@ -923,115 +533,48 @@ int main(int argc, char*  argv[]) {
             ii += 1;
         }
     }
+    voi = voi_index(voi_id, nr_voi, nr_voxels);
+    flood_step = voi_array<int32_t>(voi);
+    flood_dist = voi_array<float>(voi);
+    voi_compact = voi.compact.data();
+    flood_step_data = flood_step.data.data();
+    flood_dist_data = flood_dist.data.data();
     // ------------------------------------------------------------------------
 
     // Initialize grow volume
-    for (uint32_t i = 0; i != nr_voxels; ++i) {
-        if (*(nii_columns_data + i) != 0) {
-            *(flood_step_data + i) = 1.;
-            *(flood_dist_data + i) = 0.;
-        } else {
-            *(flood_step_data + i) = 0.;
-            *(flood_dist_data + i) = 0.;
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        if (*(nii_columns_data + *(voi_id + ii)) != 0) {
+            *(flood_step_data + ii) = 1;
         }
     }
 
     int32_t grow_step = 1;
     voxel_counter = 1;
-    uint32_t ix, iy, iz, i, j;
+    uint32_t i, j;
+    int32_t jj;
     float d;
     voxel_counter = nr_voxels;
     while (voxel_counter != 0) {
         voxel_counter = 0;
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
             i = *(voi_id + ii);
-            if (*(flood_step_data + i) == grow_step) {
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
+            if (*(flood_step_data + ii) == grow_step) {
                 voxel_counter += 1;
 
                 bool jump_lock = false;
-                // ------------------------------------------------------------
-                // 1-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
+                uint32_t nb_j[26];
+                uint8_t nb_k[26];
+                int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                int nn = 0;
+                for (; nn != nr_nb && nb_k[nn] < 6; ++nn) {
+                    j = nb_j[nn];
                     if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dX;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
-                            *(nii_columns_data + j) = *(nii_columns_data + i);
-                        }
-                    } else if (*(nii_rim_data + j) != 0) {
-                        jump_lock = true;
-                    }
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dX;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
-                            *(nii_columns_data + j) = *(nii_columns_data + i);
-                        }
-                    } else if (*(nii_rim_data + j) != 0) {
-                        jump_lock = true;
-                    }
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dY;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
-                            *(nii_columns_data + j) = *(nii_columns_data + i);
-                        }
-                    } else if (*(nii_rim_data + j) != 0) {
-                        jump_lock = true;
-                    }
-                }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dY;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
-                            *(nii_columns_data + j) = *(nii_columns_data + i);
-                        }
-                    } else if (*(nii_rim_data + j) != 0) {
-                        jump_lock = true;
-                    }
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dZ;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
-                            *(nii_columns_data + j) = *(nii_columns_data + i);
-                        }
-                    } else if (*(nii_rim_data + j) != 0) {
-                        jump_lock = true;
-                    }
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(flood_dist_data + i) + dZ;
-                        if (d < *(flood_dist_data + j)
-                            || *(flood_dist_data + j) == 0) {
-                            *(flood_dist_data + j) = d;
-                            *(flood_step_data + j) = grow_step + 1;
+                        jj = *(voi_compact + j);
+                        d = *(flood_dist_data + ii) + nb.dist[nb_k[nn]];
+                        if (d < *(flood_dist_data + jj)
+                            || *(flood_dist_data + jj) == 0) {
+                            *(flood_dist_data + jj) = d;
+                            *(flood_step_data + jj) = grow_step + 1;
                             *(nii_columns_data + j) = *(nii_columns_data + i);
                         }
                     } else if (*(nii_rim_data + j) != 0) {
@@ -1040,270 +583,18 @@ int main(int argc, char*  argv[]) {
                 }
 
                 // ------------------------------------------------------------
-                // 2-jump neighbours
+                // 2-jump and 3-jump neighbours
                 // ------------------------------------------------------------
                 if (jump_lock == false) {
-
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
+                    for (; nn != nr_nb; ++nn) {
+                        j = nb_j[nn];
                         if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-
-                    // ------------------------------------------------------------
-                    // 3-jump neighbours
-                    // ------------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(nii_columns_data + j) = *(nii_columns_data + i);
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
+                            jj = *(voi_compact + j);
+                            d = *(flood_dist_data + ii) + nb.dist[nb_k[nn]];
+                            if (d < *(flood_dist_data + jj)
+                                || *(flood_dist_data + jj) == 0) {
+                                *(flood_dist_data + jj) = d;
+                                *(flood_step_data + jj) = grow_step + 1;
                                 *(nii_columns_data + j) = *(nii_columns_data + i);
                             }
                         }
@@ -1322,67 +613,35 @@ int main(int argc, char*  argv[]) {
     // NOTE(Renzo): One-two iteration should be enough. I wouldn't know why
     // the border should be thicker than one voxel. I am only using direct
     // neighbors to avoid over overwriting values of closer neighbors.
+        vector<int32_t> border_ids(nr_voxels);
         for (int index = 0; index < 2; index++) {  // growing twice
-            // NOTE(Renzo): I am hijacking flood_step_data, because it is no longer
-            // needed and I do not want to waste memory
             for (int i = 0; i != nr_voxels; ++i)  {
-                *(flood_step_data + i ) = 0 ;
+                border_ids[i] = 0;
             }
 
             for (int i = 0; i != nr_voxels; ++i) {
                 if ( (*(nii_rim_data + i) == 1 || *(nii_rim_data + i) == 2) && (*(nii_columns_data + i) == 0)) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
+                    uint32_t nb_j[6];
+                    uint8_t nb_k[6];
+                    int nr_nb = nb6.neighbours(i, nb_j, nb_k);
+                    for (int nn = 0; nn != nr_nb; ++nn) {
+                        j = nb_j[nn];
                         if (*(nii_columns_data + j) != 0 ) {
-                            *(flood_step_data + i) = *(nii_columns_data + j);
+                            border_ids[i] = *(nii_columns_data + j);
                         }
                     }
                 }
             }
             for (int i = 0; i != nr_voxels; ++i) {
-                *(nii_columns_data + i) = *(nii_columns_data + i) + *(flood_step_data + i )  ;
+                *(nii_columns_data + i) = *(nii_columns_data + i) + border_ids[i];
             }
         }
     }
     // ========================================================================
     save_output_nifti(fout, "columns" + tag.str(), nii_columns, true);
     if (mode_debug) {
-        save_output_nifti(fout, "voronoi_flood_step", flood_step, false);
-        save_output_nifti(fout, "voronoi_flood_dist", flood_dist, false);
+        save_output_voi(fout, "voronoi_flood_step", flood_step, nii_rim, false);
+        save_output_voi(fout, "voronoi_flood_dist", flood_dist, nii_rim, false);
     }
 
     cout << "\n  Finished." << endl;
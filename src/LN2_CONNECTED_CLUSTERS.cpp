@@ -14,6 +14,7 @@ int show_help(void) {
     "    -help         : Show this help.\n"
     "    -input        : Binary nifti image (only consists of 0s and 1s).\n"
     "    -output       : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -29,6 +30,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -54,7 +59,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
@@ -68,12 +73,11 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
+
     // ========================================================================
     // Fix input datatype issues
     nifti_image* nii_input = copy_nifti_as_int32(nii1);
@@ -114,7 +118,7 @@ int main(int argc, char*  argv[]) {
     int32_t init_voxel_id = 1;
     bool terminate_switch1 = true;
     while (terminate_switch1) {
-        uint32_t ix, iy, iz, i, j;
+        uint32_t i, j;
         cout << "  " << voxel_counter << "/" << nr_voi << flush;
 
         if (voxel_counter == nr_voi) {
@@ -141,170 +145,12 @@ int main(int argc, char*  argv[]) {
                 // Map subset to full set
                 i = *(voi_id + ii);
                 if (*(nii_input_data + i) == init_voxel_id) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                        if (*(nii_input_data + j) == 1) {
-                            *(nii_input_data + j) = init_voxel_id;
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+                    uint32_t nb_j[26];
+                    uint8_t nb_k[26];
+                    int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                    for (int nn = 0; nn != nr_nb; ++nn) {
+                        j = nb_j[nn];
                         if (*(nii_input_data + j) == 1) {
                             *(nii_input_data + j) = init_voxel_id;
                         }
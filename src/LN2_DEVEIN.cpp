@@ -35,6 +35,7 @@ int show_help(void) {
     "                   from Markuerkiaga et al. 2016, Fig. 5B, at 7T.\n"
     "    -output      : (Optional) Output filename, including .nii or\n"
     "                   .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - [On lambda parameter]: If you assume your cerebral blood flow (CBF)\n"
@@ -69,6 +70,10 @@ int main(int argc, char* argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layer_file")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -layer_file\n");
@@ -134,12 +139,12 @@ int main(int argc, char* argv[]) {
     }
 
     // Read inputs including data
-    nifti_image* nii = nifti_image_read(f_input, 1);
+    nifti_image* nii = pipeline_image_read(f_input, 1);
     if (!nii) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_input);
         return 2;
     }
-    nifti_image* nii_layeri = nifti_image_read(f_layer, 1);
+    nifti_image* nii_layeri = pipeline_image_read(f_layer, 1);
     if (!nii_layeri) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_layer);
         return 2;
@@ -269,12 +274,12 @@ int main(int argc, char* argv[]) {
         }
 
         // Read additional inputs
-        nifti_image* nii_columni = nifti_image_read(f_column, 1);
+        nifti_image* nii_columni = pipeline_image_read(f_column, 1);
         if (!nii_columni) {
             fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_column);
             return 2;
         }
-        nifti_image* nii_ALFi = nifti_image_read(f_ALF, 1);
+        nifti_image* nii_ALFi = pipeline_image_read(f_ALF, 1);
         if (!nii_ALFi) {
             fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_ALF);
             return 2;
@@ -312,110 +317,127 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        if (nr_layers == 0) {
+            fprintf(stderr, "** deconvolution needs a file with discrete layers\n");
+            return 1;
+        }
+
         // ====================================================================
-        // Do deconvolution column by column. First, I allocate all.
+        // Voxels of each column, in compressed rows: the voxels of column
+        // icol are column_voxels[column_start[icol-1]] to
+        // column_voxels[column_start[icol] - 1], in ascending order.
         // ====================================================================
-        float vec1[nr_layers][size_t], vec2[nr_layers][size_t], vecALF[nr_layers];
-        int vec_nr_voxels[nr_layers];
-
-        for (int i = 0; i < nr_layers; ++i) {
-            for (int t = 0; t < size_t; t++) {
-                vec1[i][t] = 0.;
-                vec2[i][t] = 0.;
+        vector<int> column_start(nr_columns + 1, 0);
+        for (int ivox = 0; ivox < nr_voxels; ++ivox) {
+            if (*(nii_column_data + ivox) > 0) {
+                column_start[*(nii_column_data + ivox)] += 1;
+            }
+        }
+        for (int icol = 1; icol <= nr_columns; ++icol) {
+            column_start[icol] += column_start[icol - 1];
+        }
+        vector<int> column_voxels(column_start[nr_columns]);
+        vector<int> column_fill(column_start.begin(), column_start.end() - 1);
+        for (int ivox = 0; ivox < nr_voxels; ++ivox) {
+            if (*(nii_column_data + ivox) > 0) {
+                column_voxels[column_fill[*(nii_column_data + ivox) - 1]++] = ivox;
             }
-            vecALF[i] = 0.;
-            vec_nr_voxels[i] = 0;
         }
 
         // ====================================================================
-        // Big loop across columns
+        // Big loop across columns, in parallel if OpenMP is enabled. Columns
+        // write to their own voxels only.
         // ====================================================================
-        for (int icol = 1; icol <= nr_columns; ++icol) {
+        #pragma omp parallel
+        {
+            // Layer profiles of the current column, vec1[i * size_t + t]
+            vector<float> vec1(nr_layers * size_t), vec2(nr_layers * size_t);
+            vector<float> vecALF(nr_layers);
+            vector<int> vec_nr_voxels(nr_layers);
 
-            // Reset vector
-            for (int i = 0; i < nr_layers; ++i) {
-                for (int t = 0; t < size_t; t++){
-                    vec1[i][t] = 0.;
-                    vec2[i][t] = 0.;
+            #pragma omp for schedule(dynamic, 16)
+            for (int icol = 1; icol <= nr_columns; ++icol) {
+
+                // Reset vector
+                for (int i = 0; i < nr_layers; ++i) {
+                    for (int t = 0; t < size_t; t++){
+                        vec1[i * size_t + t] = 0.;
+                        vec2[i * size_t + t] = 0.;
+                    }
+                    vecALF[i] = 0.;
+                    vec_nr_voxels[i] = 0;
                 }
-                vecALF[i] = 0.;
-                vec_nr_voxels[i] = 0;
-            }
 
-            // Fill vector of column #icol
-            for (int ivox = 0; ivox < nr_voxels; ++ivox) {
-                if (icol == *(nii_column_data + ivox)) {
+                // Fill vector of column #icol
+                for (int k = column_start[icol - 1]; k < column_start[icol]; ++k) {
+                    int ivox = column_voxels[k];
                     int i = *(nii_layer_data + ivox) - 1;  // current layer
 
-                    if (!mode_linear) {
-                        vecALF[i] += *(nii_ALF_data + ivox);
-                    }
-
+                    vecALF[i] += *(nii_ALF_data + ivox);
                     vec_nr_voxels[i] += 1;
 
                     for (int t = 0; t < size_t; t++) {
-                        vec1[i][t] += *(nii_input_data + t * nr_voxels + ivox);
+                        vec1[i * size_t + t] += *(nii_input_data + t * nr_voxels + ivox);
                     }
                 }
-            }
 
-            // Get mean of values within column vector
-            for (int i = 0; i < nr_layers; ++i) {
-                for (int t = 0; t < size_t; t++) {
-                    vec1[i][t] /= (float)vec_nr_voxels[i];
+                // Get mean of values within column vector
+                for (int i = 0; i < nr_layers; ++i) {
+                    for (int t = 0; t < size_t; t++) {
+                        vec1[i * size_t + t] /= (float)vec_nr_voxels[i];
+                    }
+                    vecALF[i] /= (float)vec_nr_voxels[i];
                 }
-                vecALF[i] /= (float)vec_nr_voxels[i];
-            }
 
-            // ----------------------------------------------------------------
-            // Do voxel deconvolution
-            // ----------------------------------------------------------------
+                // ------------------------------------------------------------
+                // Do voxel deconvolution
+                // ------------------------------------------------------------
 
-            // Normalize amplitude of low frequencies (ALF)
-            float ALF_sum = 0 ;
-            for (int i = 0; i < nr_layers; ++i) {
-                if (vec_nr_voxels[i] > 0) {
-                    ALF_sum += vecALF[i];
+                // Normalize amplitude of low frequencies (ALF)
+                float ALF_sum = 0 ;
+                for (int i = 0; i < nr_layers; ++i) {
+                    if (vec_nr_voxels[i] > 0) {
+                        ALF_sum += vecALF[i];
+                    }
                 }
-            }
-            for (int i = 0; i < nr_layers; ++i) {
-                if (vec_nr_voxels[i] > 0) {
-                    vecALF[i] /= ALF_sum;
+                for (int i = 0; i < nr_layers; ++i) {
+                    if (vec_nr_voxels[i] > 0) {
+                        vecALF[i] /= ALF_sum;
+                    }
                 }
-            }
 
-            for (int t = 0; t < size_t; t++){
+                for (int t = 0; t < size_t; t++){
 
-                for (int i = 0; i < nr_layers; ++i) {
-                    if (mode_CBV) {  // Just CBV normalization
-                        if (vec_nr_voxels[i] > 0) {
-                            vec2[i][t] = vec1[i][t] / vecALF[i] * (float)nr_layers;
-                        }
-                    } else {  // Deconvolution
-                        // Macrovascular contribution value, that needs to be
-                        // subtracted from the current voxel.
-                        float sum = 0;
-                        for (int j = i-1; j >= 0; --j) {
-                            // This is the deconvolution, It is weighted with CBV.
-                            // Lambda is the inverse of peak to tail ratio
-                            // from from Markuerkiaga et al. 2016 Fig. 5B at 7T.
-                            if (vec_nr_voxels[j] > 0) {
-                                sum += vec1[j][t] / (float)nr_layers / vecALF[j] * lambda;
+                    for (int i = 0; i < nr_layers; ++i) {
+                        if (mode_CBV) {  // Just CBV normalization
+                            if (vec_nr_voxels[i] > 0) {
+                                vec2[i * size_t + t] = vec1[i * size_t + t] / vecALF[i] * (float)nr_layers;
+                            }
+                        } else {  // Deconvolution
+                            // Macrovascular contribution value, that needs to be
+                            // subtracted from the current voxel.
+                            float sum = 0;
+                            for (int j = i-1; j >= 0; --j) {
+                                // This is the deconvolution, It is weighted with CBV.
+                                // Lambda is the inverse of peak to tail ratio
+                                // from from Markuerkiaga et al. 2016 Fig. 5B at 7T.
+                                if (vec_nr_voxels[j] > 0) {
+                                    sum += vec1[j * size_t + t] / (float)nr_layers / vecALF[j] * lambda;
+                                }
+                            }
+                            if (vec_nr_voxels[i] > 0) {
+                                vec2[i * size_t + t] = (vec1[i * size_t + t] - sum);
                             }
-                        }
-                        if (vec_nr_voxels[i] > 0) {
-                            vec2[i][t] = (vec1[i][t] - sum);
                         }
                     }
                 }
-            }
 
-            // Fill file with the deconvolved values
-            for (int ivox = 0; ivox < nr_voxels; ++ivox) {
-                if (icol == *(nii_column_data + ivox)) {
+                // Fill file with the deconvolved values
+                for (int k = column_start[icol - 1]; k < column_start[icol]; ++k) {
+                    int ivox = column_voxels[k];
                     int i = *(nii_layer_data + ivox) - 1;
                     for (int t = 0; t < size_t; t++) {
-                        *(nii_output_data + t * nr_voxels + ivox ) = vec2[i][t];
+                        *(nii_output_data + t * nr_voxels + ivox ) = vec2[i * size_t + t];
                     }
                 }
             }
@@ -1,4 +1,5 @@
 #include "../dep/laynii_lib.h"
+#include <unordered_map>
 
 
 int show_help(void) {
@@ -19,7 +20,9 @@ int show_help(void) {
     "    -kernel_size : (Optional) Use an odd positive integer (default 11).\n"
     "    -output      : (Optional) Output filename, including .nii or\n"
     "                   .nii.gz, and path if needed. Overwrites existing files.\n"
-    "                   If not given, the prefix 'fPSF' is added.\n"
+    "                   The three outputs get the tags 'parcel_val',\n"
+    "                   'output_laminarity' and 'output_columnarity'.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    This is written foir Richard as a side project.  \n"
@@ -43,6 +46,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, " ** missing argument for -layers\n");
@@ -86,17 +93,17 @@ int main(int argc, char * argv[]) {
 
 
     // Read input dataset
-    nifti_image* nim_column_r = nifti_image_read(fin_columns, 1);
+    nifti_image* nim_column_r = pipeline_image_read(fin_columns, 1);
     if (!nim_column_r) {
         fprintf(stderr, " ** failed to read NIfTI from '%s'\n", fin_columns);
         return 2;
     }
-    nifti_image* nim_layers_r = nifti_image_read(fin_layers, 1);
+    nifti_image* nim_layers_r = pipeline_image_read(fin_layers, 1);
     if (!nim_layers_r) {
         fprintf(stderr, " ** failed to read NIfTI from '%s'\n", fin_layers);
         return 2;
     }
-    nifti_image * nii_input = nifti_image_read(fin, 1);
+    nifti_image * nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -129,6 +136,7 @@ int main(int argc, char * argv[]) {
 
     // Allocate new nifti images
     nifti_image * nii_laminarity = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_laminarity);
     nii_laminarity->nt = 1;
     nii_laminarity->nvox = nii->nvox / size_time;
     nii_laminarity->datatype = NIFTI_TYPE_FLOAT32;
@@ -137,6 +145,7 @@ int main(int argc, char * argv[]) {
     float* nii_laminarity_data = static_cast<float*>(nii_laminarity->data);
     
     nifti_image * nii_columnarity = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_columnarity);
     nii_columnarity->nt = 1;
     nii_columnarity->nvox = nii->nvox / size_time;
     nii_columnarity->datatype = NIFTI_TYPE_FLOAT32;
@@ -145,6 +154,7 @@ int main(int argc, char * argv[]) {
     float* nii_columnarity_data = static_cast<float*>(nii_columnarity->data);
 
     nifti_image * nii_parcelval = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_parcelval);
     nii_parcelval->nt = 1;
     nii_parcelval->nvox = nii->nvox / size_time;
     nii_parcelval->datatype = NIFTI_TYPE_FLOAT32;
@@ -153,944 +163,178 @@ int main(int argc, char * argv[]) {
     float* nii_parcelval_data = static_cast<float*>(nii_parcelval->data);
 
     // ========================================================================
-    ////////////////////////////////////////////////////////////
-    // finding number of layers and columsn to work with ///////
-    ////////////////////////////////////////////////////////////
-    
-    int Nr_columns = 0; 
-    int Nr_layers  = 0; 
-    int Nr_parcels  = 0; 
-    
-    for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		   if ((int)*(nim_columns_data  +  nxy*iz + nx*iy + ix) >= Nr_columns ) {
-			    Nr_columns = (int)*(nim_columns_data +  nxy*iz + nx*iy + ix) ; 
-		   }
-		   if ((int)*(nim_layers_data   +  nxy*iz + nx*iy + ix) >= Nr_layers ) {
-			    Nr_layers = (int)*(nim_layers_data +  nxy*iz + nx*iy + ix) ; 
-		   }
-	    }
-	  }
+    // Finding number of layers and columns to work with
+    // ========================================================================
+    int Nr_columns = 0;
+    int Nr_layers  = 0;
+    for (int i = 0; i != nxyz; ++i) {
+        if (*(nim_columns_data + i) > Nr_columns) {
+            Nr_columns = *(nim_columns_data + i);
+        }
+        if (*(nim_layers_data + i) > Nr_layers) {
+            Nr_layers = *(nim_layers_data + i);
+        }
     }
     cout << "there are "<< Nr_columns << " columns"   << endl;
     cout << "there are "<< Nr_layers  << "  layers" << endl << endl;
-    Nr_parcels = Nr_columns  * Nr_layers ; 
+
+    // Every layer column combination is a parcel:
+    // parcel = Nr_columns * (layer - 1) + (column - 1)
+    const int Nr_parcels = Nr_columns * Nr_layers;
     cout << "there are "<< Nr_parcels  << " parcels" << endl << endl;
-    
-    
-    // ========================================================================
-    /////////////////////////////////////////////////////////////////////
-    // finding approximate number of voxels per parcel (layer column combination) ///////
-    /////////////////////////////////////////////////////////////////////
-    int layeridx = 0; 
-    int columnindx = 0; 
-    int voxelidx = 0;
-    int runningidx = 0; 
-    
-    double vec_nrVox_pacels[Nr_parcels] ; // Access the parcel as; vec_nrVox_pacels[ Nr_columns * LayerIndex + ColumnIndex]
-    double vec_mostcommonval_pacels[Nr_parcels] ; // Access the parcel as; vec_mostcommonval_pacels[ Nr_columns * LayerIndex + ColumnIndex]
 
-    
-    for (int ip=0; ip<Nr_parcels; ++ip){
-			vec_nrVox_pacels[ip] = 0.; 
-			vec_mostcommonval_pacels[ip] = 0.; 
-	}
-	
-	for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		 //  vec_val_pacels[(int)*(nim_columns_data +  nxy*iz + nx*iy + ix)][(int)*(nim_layers_data +  nxy*iz + nx*iy + ix)] =+  ;
-		 //cout <<  Nr_columns * (int)*(nim_layers_data +  nxy*iz + nx*iy + ix) + (int)*(nim_columns_data +  nxy*iz + nx*iy + ix) << endl; 
-		 layeridx = (int)*(nim_layers_data +  nxy*iz + nx*iy + ix)-1;
-		 columnindx = (int)*(nim_columns_data +  nxy*iz + nx*iy + ix)-1; 
-		 vec_nrVox_pacels[ Nr_columns * layeridx + columnindx]++ ; 
-	    }
-	  }
+    vector<int32_t> voxel_parcel(nxyz, -1);  // -1 outside of the parcels
+    for (int i = 0; i != nxyz; ++i) {
+        if (*(nim_columns_data + i) > 0 && *(nim_layers_data + i) > 0) {
+            voxel_parcel[i] = Nr_columns * (*(nim_layers_data + i) - 1)
+                              + *(nim_columns_data + i) - 1;
+        }
     }
-        
-    double mean_Nr_voxels_per_parcel = 0; 
-    double stdev_Nr_voxels_per_parcel = 0; 
-    
-    mean_Nr_voxels_per_parcel =  ren_average(vec_nrVox_pacels, Nr_layers*Nr_columns); 
-    stdev_Nr_voxels_per_parcel = ren_stdev(vec_nrVox_pacels, Nr_layers*Nr_columns); 
-    
-    cout << "Mean number of voxels per pacel is " << mean_Nr_voxels_per_parcel << endl; 
-    cout << "Stdev number of voxels per pacel is " << stdev_Nr_voxels_per_parcel << endl;   
-    
-    
-    // ========================================================================
-    /////////////////////////////////////////////////////////////////////
-    // finding most common value in each parcel ///////
-    /////////////////////////////////////////////////////////////////////   
-    
-    int MaxVoxelPerParcel = (int) mean_Nr_voxels_per_parcel + (int) stdev_Nr_voxels_per_parcel; // for very very large columns, some voxels are missed.
-      cout << "MaxVoxelPerParcel is " << MaxVoxelPerParcel << endl;   
-
-    int* val_Vox_pacels = new int[Nr_parcels*MaxVoxelPerParcel]; 
-    //Access the parcel as: val_Vox_pacels[ MaxVoxelPerParcel * Nr_columns * LayerIndex + MaxVoxelPerParcel * ColumnIndex + VoxelIndex]
-    
-    
-    /////////////////////////////////////////////////////////////////////
-    // loop across voxels for filling vector across parcels  ///////
-    /////////////////////////////////////////////////////////////////////   
-    
-    for (int il=0; il<Nr_layers; ++il){
-		for (int ic=0; ic<Nr_columns; ++ic){	
-			    vec_nrVox_pacels[Nr_columns * il +  ic] = 0.; 
-			    
-			   for (int iv=0; iv<MaxVoxelPerParcel; ++iv){
-			    val_Vox_pacels[ MaxVoxelPerParcel * Nr_columns * il + MaxVoxelPerParcel * ic + iv] = 0 ; 
-		       }
-		}
-	}
-                  cout << " Hi1 "  << endl;   
 
-    
-   for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		   if (*(nim_columns_data +  nxy*iz + nx*iy + ix) >0) {     // NOTE(Renzo): include a check somewhere above that the layer-file makes sense in all voxles where columns are defined.
-			layeridx = *(nim_layers_data +  nxy*iz + nx*iy + ix) -1 ;
-			columnindx = *(nim_columns_data +  nxy*iz + nx*iy + ix) -1 ; 
-			vec_nrVox_pacels[Nr_columns * layeridx +  columnindx] += 1 ; 
-			voxelidx = vec_nrVox_pacels[Nr_columns * layeridx +  columnindx] - 1 ; 
-			voxelidx = min(voxelidx,MaxVoxelPerParcel-1);  // ignore the last voxels of gigantic column outliers. 
-		 
-			//cout << layeridx << " " << columnindx << "  "<< voxelidx << endl ; 
-			val_Vox_pacels[MaxVoxelPerParcel * Nr_columns * layeridx + MaxVoxelPerParcel * columnindx + voxelidx] =  *(nii_data +  nxy*iz + nx*iy + ix) ; 
-		   }
-	   }
-	 }
-   }
-   
-    ///////////////////////////////////////////////////////////
-    // finding most common value in each parcel output  ///////
-    ///////////////////////////////////////////////////////////
-    
-    cout << " Hi1a "  << endl;  
-    //vec_mostcommonval_pacels[ Nr_columns * LayerIndex + ColumnIndex]
-    
-    //double vec_val_in_parcel[MaxVoxelPerParcel] ; 
-    int* vec_val_in_parcel = new int[MaxVoxelPerParcel];
-    for (int ivox=0; ivox<MaxVoxelPerParcel; ++ivox) vec_val_in_parcel[ivox] = 0; 
-	int NRvoxel_in_this_parcel = 0; 
-   
-
-    for (int il=0; il<Nr_layers; ++il){
-		for (int ic=0; ic<Nr_columns; ++ic){
-			  
-			    NRvoxel_in_this_parcel = vec_nrVox_pacels[Nr_columns * il +  ic]; 
-			    NRvoxel_in_this_parcel = min(MaxVoxelPerParcel,NRvoxel_in_this_parcel); 
-			    
-			  
-				for (int ivox=0; ivox<NRvoxel_in_this_parcel; ++ivox){
-                    vec_val_in_parcel[ivox] =  val_Vox_pacels[MaxVoxelPerParcel * Nr_columns * il + MaxVoxelPerParcel * ic + ivox]; 
-			    }
-			    
-			    vec_mostcommonval_pacels[ Nr_columns * il + ic] = ren_most_occurred_number(vec_val_in_parcel, NRvoxel_in_this_parcel); 
-			    
-			   // cout << il << " " << ic << "  "<< vec_mostcommonval_pacels[ Nr_columns * il + ic]<< endl;
-		}
-	}
-    
-
-   for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		   if (*(nim_columns_data +  nxy*iz + nx*iy + ix) >0) { 
-			layeridx = *(nim_layers_data +  nxy*iz + nx*iy + ix) -1 ;
-			columnindx = *(nim_columns_data +  nxy*iz + nx*iy + ix) -1 ; 
-		    *(nii_parcelval_data +  nxy*iz + nx*iy + ix) = vec_mostcommonval_pacels[ Nr_columns * layeridx + columnindx];
-		   }
-	   }
-	 }
-   }
-   
-    if (!use_outpath) fout = fin;
-    save_output_nifti(fout, "parcel_val", nii_parcelval, true, use_outpath);
-   
-    ////////////////////////////////////////////////////////////////////////////////////
-    // finding local patch of neigbors (snipets repurposed from LN2_COLTRAIN) ///////
-    ////////////////////////////////////////////////////////////////////////////////////
-    uint32_t ix, iy, iz;
-    uint32_t iix, iiy, iiz;
-	// Voxels of interest
-    uint32_t nr_voi = 0;
-    for (uint32_t i = 0; i != nxyz; ++i) {
-        if (*(nim_columns_data + i) > 0){
-            nr_voi += 1;
+    // ========================================================================
+    // Voxels of each parcel in compressed rows: the voxels of parcel p are
+    // parcel_voxels[parcel_start[p]] to parcel_voxels[parcel_start[p+1] - 1].
+    // Memory scales with the number of labelled voxels, not with the largest
+    // parcel.
+    // ========================================================================
+    vector<uint32_t> parcel_start(Nr_parcels + 1, 0);
+    for (int i = 0; i != nxyz; ++i) {
+        if (voxel_parcel[i] >= 0) {
+            parcel_start[voxel_parcel[i] + 1] += 1;
         }
     }
-    // Allocate memory to only the voxel of interest
-    int32_t* voi_id;
-    voi_id = (int32_t*) malloc(nr_voi*sizeof(int32_t));
+    for (int p = 0; p != Nr_parcels; ++p) {
+        parcel_start[p + 1] += parcel_start[p];
+    }
 
-    // Fill in indices to be able to remap from subset to full set of voxels
-    uint32_t ii = 0;
-    for (uint32_t i = 0; i != nxyz; ++i) {
-        if (*(nim_columns_data + i) > 0){
-            *(voi_id + ii) = i;
-            ii += 1;
+    // NOTE: Voxels are listed in y, x, z loop order, which decides the most
+    // common value when there is a tie.
+    vector<uint32_t> parcel_voxels(parcel_start[Nr_parcels]);
+    vector<uint32_t> parcel_fill(parcel_start.begin(), parcel_start.end() - 1);
+    for (int iy = 0; iy < size_y; ++iy) {
+        for (int ix = 0; ix < size_x; ++ix) {
+            for (int iz = 0; iz < size_z; ++iz) {
+                const int i = nxy * iz + nx * iy + ix;
+                if (voxel_parcel[i] >= 0) {
+                    parcel_voxels[parcel_fill[voxel_parcel[i]]++] = i;
+                }
+            }
         }
     }
 
+    vector<double> vec_nrVox_parcels(Nr_parcels);
+    for (int p = 0; p != Nr_parcels; ++p) {
+        vec_nrVox_parcels[p] = parcel_start[p + 1] - parcel_start[p];
+    }
+    cout << "Mean number of voxels per pacel is "
+         << ren_average(vec_nrVox_parcels.data(), Nr_parcels) << endl;
+    cout << "Stdev number of voxels per pacel is "
+         << ren_stdev(vec_nrVox_parcels.data(), Nr_parcels) << endl;
+
     // ========================================================================
-    // Triangulation on subset Voronoi cells
+    // Finding most common value in each parcel
     // ========================================================================
-    // Keep neighbouring column ID's in an array
-   int32_t* neighbours;
-   neighbours = (int32_t*) malloc(27*sizeof(int32_t));// there are 26 neighbors of in a rubics cube.
-   for (int j=0; j<27; ++j) {
-        *(neighbours + j) = 0;
-   }
-    
-   int* ColId_in_neigh_column = new int[Nr_parcels*27];
-      //Access the parcel as: [ Nr_parcels * NeighColidx  +   parcelID ]  
-   // center parcelID: Nr_columns * layeridx + columnindx
-   int* val_in_neigh_column   = new int[Nr_parcels*27];
-      //Access the parcel as: [ Nr_parcels * NeighColidx +   parcelID ]  
-   // center parcelID: Nr_columns * layeridx + columnindx
-   for (int j=0; j<Nr_parcels*27; ++j) {
-	   ColId_in_neigh_column [j] =0 ;
-	   val_in_neigh_column [j] =0 ;
-   }
-   
-   int* Collumn_in_neighbor = new int[Nr_parcels*27];
-   int* layer_in_neighbor   = new int[Nr_parcels*27];
-   for (int j=0; j<Nr_parcels*27; ++j) {
-	   Collumn_in_neighbor [j] =0 ;
-	   layer_in_neighbor [j] =0 ;
-   }
-      
-
-   int runidx_neigh_parcel[Nr_parcels];
-      //Access the parcel as: [ parcelID ]  
-   // center parcelID: Nr_columns * layeridx + columnindx
-   for (int j=0; j<Nr_parcels; ++j) {
-	   runidx_neigh_parcel [j] = 1 ;
-   }
-   
-  
-   
-   int current_column_idx = 0 ;
-   int current_layer_idx  = 0 ; 
-   int current_parcel_idx  = 0 ; 
-   int current_column_neighbor = 0 ;
-   int current_layer_neighbor  = 0 ; 
-   int current_parcel_neighbor  = 0 ;
-   int layer_of_new_neigbor = 0; 
-   int niegbor_id = 0; 
-   int is_notnew_nighbor = 0;
-   int is_notnew_parcel_nighbor = 0;
-//   int is_notnew_layer_nighbor = 0;
-   
-    cout << " Hi3 "  << endl;  
-  
-    for(uint32_t ii = 0; ii != nr_voi; ++ii) { 
-        uint32_t i = *(voi_id + ii);
-        tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-        current_column_idx = (int)*(nim_columns_data + i) -1;
-        current_layer_idx  = (int)*(nim_layers_data  + i) -1;
-        current_parcel_idx =  Nr_columns * current_layer_idx + current_column_idx;
-        
-        //cout << "column, layer, parcel " << current_column_idx << " "<< current_layer_idx << " "<< current_parcel_idx << " "<< endl;
-        //*(neighbours + 0) = *(nim_columns_data + i);
-
-		layer_in_neighbor   	[ Nr_parcels * 0 +  current_parcel_idx ] = current_layer_idx ; 
-        Collumn_in_neighbor 	[ Nr_parcels * 0 +  current_parcel_idx ] = current_column_idx ; 
-        val_in_neigh_column 	[ Nr_parcels * 0 +  current_parcel_idx ] = (int)*(nii_parcelval_data + i) ;
-        ColId_in_neigh_column 	[ Nr_parcels * 0 +  current_parcel_idx ] = current_parcel_idx; 
-        
-        // 1-jump neighbours
-         if (ix > 0) {
-            int j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-				
-				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-				 
-					 
-//				if (current_parcel_neighbor !=current_parcel_idx &&   is_notnew_parcel_nighbor == 0 ) {
-//					 cout << " current_parcel_idx " << current_parcel_idx << " current_column_idx " << current_column_idx << " current_layer_idx " << current_layer_idx  << endl;
-//					 cout << " current_parcel_neighbor " << current_parcel_neighbor << " current_column_neighbor " << current_column_neighbor << " current_layer_neighbor " << current_layer_neighbor  << endl;
-//				     cout << ix<< " "<< iy << " " << iz <<"       " <<   runidx_neigh_parcel  [current_parcel_idx]<< "  "<< runidx_neigh_parcel  [current_parcel_idx]<<  endl ; 
-//				     cout << ix-1<< " "<< iy << " " << iz <<"       " <<   runidx_neigh_parcel  [current_parcel_idx]<< "  "<< runidx_neigh_parcel  [current_parcel_idx]<<  endl ; 
-
-				
-//					      for (int niegbor_id_index = 0 ; niegbor_id_index < 27; niegbor_id_index++ ){ 
-//					      	cout << ColId_in_neigh_column[Nr_parcels * niegbor_id_index +  current_parcel_idx ] << " " ;
-					      	//cout << ColId_in_neigh_layer [Nr_parcels * current_column_neighboridx +  current_parcel_idx ] << " " ;
-//						  }
-//						  cout << endl; 
-//				          for (int niegbor_id_index = 0 ; niegbor_id_index < 27; niegbor_id_index++ ){ 
-//					      	cout << Collumn_in_neighbor[Nr_parcels * niegbor_id_index +  current_parcel_idx ] << " " ;
-//				          }     
-//				          cout << endl; 
-//				          for (int niegbor_id_index = 0 ; niegbor_id_index < 27; niegbor_id_index++ ){ 
-//					      	cout << layer_in_neighbor[Nr_parcels * niegbor_id_index +  current_parcel_idx ] << " " ;
-//				          }     
-//				          cout << endl; 
-//				          for (int niegbor_id_index = 0 ; niegbor_id_index < 27; niegbor_id_index++ ){ 
-//					      	cout << val_in_neigh_column[Nr_parcels * niegbor_id_index +  current_parcel_idx ] << " " ;
-					      	//cout << ColId_in_neigh_layer [Nr_parcels * current_column_neighboridx +  current_parcel_idx ] << " " ;
-//						  }
-//						  cout << endl; 
-//				}
-				    
-            } //loop across neigbors closed
-        }
-        
-        		
-				 
-        if (iy > 0) {
-            int j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-               				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (iz > 0) {
-            int j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix < size_x) {
-            int j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (iy < size_y) {
-            int j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (iz < size_z) {
-            int j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-
-        // 2-jump neighbours
-        if (ix > 0 && iy > 0) {
-            int j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix > 0 && iy < size_y) {
-            int j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix < size_x && iy > 0) {
-            int j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix < size_x && iy < size_y) {
-            int j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-       if (iy > 0 && iz > 0) {
-            int j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (iy > 0 && iz < size_z) {
-            int j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
+    // Same result as ren_most_occurred_number: among values with the same
+    // count, the value whose first occurrence comes last wins. Counted with a
+    // hash map in one pass per parcel.
+    vector<int> parcel_mode(Nr_parcels, 0);
+    std::unordered_map<int, std::pair<int, uint32_t> > value_counts;
+    for (int p = 0; p != Nr_parcels; ++p) {
+        value_counts.clear();
+        for (uint32_t k = parcel_start[p]; k != parcel_start[p + 1]; ++k) {
+            const int val = (int)*(nii_data + parcel_voxels[k]);
+            std::unordered_map<int, std::pair<int, uint32_t> >::iterator it
+                = value_counts.find(val);
+            if (it == value_counts.end()) {
+                value_counts[val] = std::make_pair(1, k);
+            } else {
+                it->second.first += 1;
             }
         }
-        if (iy < size_y && iz > 0) {
-            int j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (iy < size_y && iz < size_z) {
-            int j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix > 0 && iz > 0) {
-            int j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-               				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix < size_x && iz > 0) {
-            int j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-               				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix > 0 && iz < size_z) {
-            int j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
-            }
-        }
-        if (ix < size_x && iz < size_z) {
-            int j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                				 is_notnew_parcel_nighbor = 0; 
-				 current_column_neighbor  = (int)*(nim_columns_data + j)-1;
-                 current_layer_neighbor   = (int)*(nim_layers_data + j) -1; 
-                 current_parcel_neighbor  =  Nr_columns * current_layer_neighbor + current_column_neighbor ;
-                 
-               // checking if this neigbor is already considered or not        
-				 for (int current_column_neighboridx = 0 ; current_column_neighboridx < 27; current_column_neighboridx++ ){ 
-					     if (current_parcel_neighbor == ColId_in_neigh_column[Nr_parcels * current_column_neighboridx +  current_parcel_idx ]){
-					         is_notnew_parcel_nighbor ++;
-						 }
-				 }
-				 if (current_parcel_idx == current_parcel_neighbor )   is_notnew_parcel_nighbor = 1;
-			 
-				 if ( is_notnew_parcel_nighbor == 0 ){
-					 niegbor_id = min (runidx_neigh_parcel [current_parcel_idx], 27) ; // this is to make sure that we are not runnign out of memory if there are more than 27 nioghbors. 
-					 ColId_in_neigh_column [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_parcel_neighbor;
-					 val_in_neigh_column   [Nr_parcels * niegbor_id +  current_parcel_idx ] = (int)*(nii_parcelval_data + j) ; 
-					 Collumn_in_neighbor   [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_column_neighbor ; 
-					 layer_in_neighbor     [Nr_parcels * niegbor_id +  current_parcel_idx ] = current_layer_neighbor ; 
-					 runidx_neigh_parcel   [current_parcel_idx] ++; 
-				 }	 
+        int max_count = 0;
+        uint32_t max_first = 0;
+        for (std::unordered_map<int, std::pair<int, uint32_t> >::iterator it
+             = value_counts.begin(); it != value_counts.end(); ++it) {
+            if (it->second.first > max_count
+                || (it->second.first == max_count
+                    && it->second.second > max_first)) {
+                max_count = it->second.first;
+                max_first = it->second.second;
+                parcel_mode[p] = it->first;
             }
         }
+    }
 
-        //  not useing 3-jump neighbours 
-        if (ix > 0 && iy > 0 && iz > 0) {
-            int j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 19) = *(nim_columns_data + j);
-            }
-        }
-        if (ix > 0 && iy > 0 && iz < size_z) {
-            int j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-               // *(neighbours + 20) = *(nim_columns_data + j);
-            }
-        }
-        if (ix > 0 && iy < size_y && iz > 0) {
-            int j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 21) = *(nim_columns_data + j);
-            }
+    for (int i = 0; i != nxyz; ++i) {
+        if (voxel_parcel[i] >= 0) {
+            *(nii_parcelval_data + i) = parcel_mode[voxel_parcel[i]];
         }
-        if (ix < size_x && iy > 0 && iz > 0) {
-            int j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 22) = *(nim_columns_data + j);
-            }
-        }
-        if (ix > 0 && iy < size_y && iz < size_z) {
-            int j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 23) = *(nim_columns_data + j);
-            }
-        }
-        if (ix < size_x && iy > 0 && iz < size_z) {
-            int j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 24) = *(nim_columns_data + j);
-            }
-        }
-        if (ix < size_x && iy < size_y && iz > 0) {
-            int j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 25) = *(nim_columns_data + j);
-            }
-        }
-        if (ix < size_x && iy < size_y && iz < size_z) {
-            int j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-            if (*(nim_columns_data + j) > 0) {
-                //*(neighbours + 26) = *(nim_columns_data + j);
-            }
-        }
-
-
+    }
 
-		/*
-        // Have an array to note down columns id's that will form triangles.
-        // NOTE(Faruk): I allocate 8 elements here because if the volume is
-        // over-parcellated (i.e. too many columns), hit count can go above 3
-        int32_t* trio;
-        trio = (int32_t*) malloc(8*sizeof(int32_t));
+    if (!use_outpath) fout = fin;
+    save_output_nifti(fout, "parcel_val", nii_parcelval, true);
 
-        for (int m=0; m<8; m++) {
-            int n;
-            for (n=0; n<m; n++) {
-                if (*(neighbours + m) == *(neighbours + n)) {
-                    break;
+    // ========================================================================
+    // Laminarity and columnarity from the neighbouring parcels
+    // ========================================================================
+    // Laminarity (columnarity) of a parcel is the fraction of the neighbouring
+    // parcels in the same layer (column) that have the same most common value.
+    // Parcels are neighbours if any of their voxels are 18-connected. Every
+    // neighbour is counted once, which is tracked per parcel id.
+    const voxel_stencil<18> nb(nii_input);
+    vector<int32_t> seen_by(Nr_parcels, -1);
+    vector<double> laminarity(Nr_parcels, 0);
+    vector<double> columnarity(Nr_parcels, 0);
+    for (int p = 0; p != Nr_parcels; ++p) {
+        const int layer_p = p / Nr_columns;
+        const int column_p = p % Nr_columns;
+        int count_same_layer = 0, count_same_val_layer = 0;
+        int count_same_col = 0, count_same_val_col = 0;
+
+        for (uint32_t k = parcel_start[p]; k != parcel_start[p + 1]; ++k) {
+            uint32_t nb_j[18];
+            uint8_t nb_k[18];
+            int nr_nb = nb.neighbours(parcel_voxels[k], nb_j, nb_k);
+            for (int nn = 0; nn != nr_nb; ++nn) {
+                const int32_t q = voxel_parcel[nb_j[nn]];
+                if (q < 0 || q == p || seen_by[q] == p) continue;
+                seen_by[q] = p;
+
+                if (q / Nr_columns == layer_p) {
+                    count_same_layer++;
+                    if (parcel_mode[q] == parcel_mode[p]) {
+                        count_same_val_layer++;
+                    }
                 }
-            }
-            if (m == n) {
-                if (*(neighbours + m) != 0) {
-                    *(trio + count_neigh) = *(neighbours + m);
-                    count_neigh += 1;
+                if (q % Nr_columns == column_p) {
+                    count_same_col++;
+                    if (parcel_mode[q] == parcel_mode[p]) {
+                        count_same_val_col++;
+                    }
                 }
             }
         }
-        if (count_neigh == 3) {  // Hard-lock to triplets only
-            for (int l=0; l<count_neigh; ++l) {
-                *(triplets + count_triplets * 3 + l) = *(trio + l);
-            }
-            count_triplets += 1;
+        if (count_same_layer > 0) {
+            laminarity[p] = (double)count_same_val_layer / (double)count_same_layer;
+        }
+        if (count_same_col > 0) {
+            columnarity[p] = (double)count_same_val_col / (double)count_same_col;
         }
-        */
     }
 
+    for (int i = 0; i != nxyz; ++i) {
+        if (voxel_parcel[i] >= 0) {
+            *(nii_laminarity_data + i) = laminarity[voxel_parcel[i]];
+            *(nii_columnarity_data + i) = columnarity[voxel_parcel[i]];
+        }
+    }
 
-
-cout << " I am done filling the neighbor array "<< endl; 
-
-//////////////////////////////////////////////////////////////
-////////////  Loop over parcels and quantifying their similary of valued across layers and columns
-//////////////////////////////////////////////////////////////////////
-
-double laminarity[Nr_parcels];      //Access the parcel as: [ parcelID ]  // center parcelID: Nr_columns * layeridx + columnindx
-for (int j=0; j<Nr_parcels; ++j)   laminarity [j] = 0;  
-int count_same_val_layer = 0;    
-int count_same_layer = 0;       
-
-for (int paridx=0; paridx<Nr_parcels; ++paridx) {
-//	cout << "runidx_neigh_parcel["<<paridx<<"]   "<< runidx_neigh_parcel[paridx] << endl; 
-//    cout << "   layer_in_neighbor[Nr_parcels *"<<paridx<<" + 0]   "<< layer_in_neighbor[Nr_parcels * paridx +  0 ] << endl; 
-	count_same_val_layer = 0;    
-	count_same_layer = 0;   
-
-	for (int nigidx=1; nigidx<min(runidx_neigh_parcel[paridx],27); ++nigidx){
-		if (layer_in_neighbor[Nr_parcels * 0 +  paridx] == layer_in_neighbor[Nr_parcels * nigidx +  paridx ]  ){
-			count_same_layer ++;
-			if (val_in_neigh_column[Nr_parcels * 0 +  paridx ] == val_in_neigh_column[Nr_parcels * nigidx +  paridx ]  ){
-				count_same_val_layer++;
-			}
-		}
-	}	
-	if ( count_same_layer > 0 ) laminarity [paridx] = (double)count_same_val_layer / (double) count_same_layer; 
-	 //cout << "   laminarity[ "<<paridx<<" ]   "<< laminarity [paridx]<< endl; 
-}
-
-   for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		   if (*(nim_columns_data +  nxy*iz + nx*iy + ix) >0) { 
-			layeridx = *(nim_layers_data +  nxy*iz + nx*iy + ix) -1 ;
-			columnindx = *(nim_columns_data +  nxy*iz + nx*iy + ix) -1 ; 
-		    *(nii_laminarity_data +  nxy*iz + nx*iy + ix)  = laminarity [ Nr_columns * layeridx + columnindx];
-		   }
-	   }
-	 }
-   }
-
-
-    if (!use_outpath) fout = fin;
-    save_output_nifti(fout, "output_laminarity", nii_laminarity, true, use_outpath);
-    
-
-double columnarity[Nr_parcels];      //Access the parcel as: [ parcelID ]  // center parcelID: Nr_columns * layeridx + columnindx
-for (int j=0; j<Nr_parcels; ++j)   laminarity [j] = 0;  
-int count_same_val_col = 0;    
-int count_same_col = 0;       
-
-for (int paridx=0; paridx<Nr_parcels; ++paridx) {
-//	cout << "runidx_neigh_parcel["<<paridx<<"]   "<< runidx_neigh_parcel[paridx] << endl; 
-//    cout << "   layer_in_neighbor[Nr_parcels *"<<paridx<<" + 0]   "<< layer_in_neighbor[Nr_parcels * paridx +  0 ] << endl; 
-	count_same_val_col = 0;    
-	count_same_col = 0;   
-
-	for (int nigidx=1; nigidx<min(runidx_neigh_parcel[paridx],27); ++nigidx){
-		if (Collumn_in_neighbor[Nr_parcels * 0 +  paridx] == Collumn_in_neighbor[Nr_parcels * nigidx +  paridx ]  ){
-			count_same_col ++;
-			if (val_in_neigh_column[Nr_parcels * 0 +  paridx ] == val_in_neigh_column[Nr_parcels * nigidx +  paridx ]  ){
-				count_same_val_col++;
-			}
-		}
-	}	
-	if ( count_same_col > 0 ) columnarity [paridx] = (double)count_same_val_col / (double) count_same_col; 
-	 //cout << "   columnarity[ "<<paridx<<" ]   "<< columnarity [paridx]<< endl; 
-}
-
-
-   for(int iy=0; iy<size_y; ++iy){
-     for(int ix=0; ix<size_x; ++ix){
-       for(int iz=0; iz<size_z; ++iz){
-		   if (*(nim_columns_data +  nxy*iz + nx*iy + ix) >0) { 
-			layeridx = *(nim_layers_data +  nxy*iz + nx*iy + ix) -1 ;
-			columnindx = *(nim_columns_data +  nxy*iz + nx*iy + ix) -1 ; 
-		    *(nii_laminarity_data +  nxy*iz + nx*iy + ix)  = laminarity [ Nr_columns * layeridx + columnindx];
-		    *(nii_columnarity_data +  nxy*iz + nx*iy + ix) = columnarity[ Nr_columns * layeridx + columnindx];
-		   }
-	   }
-	 }
-   }
-
-//Collumn_in_neighbor[Nr_parcels * niegbor_id_index +  current_parcel_idx ] 
-//layer_in_neighbor[Nr_parcels * niegbor_id_index +  current_parcel_idx ] 
-//val_in_neigh_column[Nr_parcels * niegbor_id_index +  current_parcel_idx ] 
-//runidx_neigh_parcel   [current_parcel_idx]
-
-
-
-    // =======================
-    //////////////////////////
-    // writing output  ///////
-    //////////////////////////
-
-    if (!use_outpath) fout = fin;
-    save_output_nifti(fout, "output_columnarity", nii_columnarity, true, use_outpath);
+    // ========================================================================
+    // Writing output
+    // ========================================================================
+    save_output_nifti(fout, "output_laminarity", nii_laminarity, true);
+    save_output_nifti(fout, "output_columnarity", nii_columnarity, true);
 
     cout << "  Finished." << endl;
     return 0;
 }
-
-  
@@ -16,6 +16,7 @@ int show_help(void) {
     "                when the input contains e.g. phase values (0 to 2*pi).\n"
     "                Input range is assumed to be 2*pi.\n"
     "    -output   : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Reference / further reading:\n"
     "    [See Figure 1 from] Gulban, O.F., Schneider, M., Marquardt, I., \n"
@@ -37,6 +38,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -64,7 +69,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
@@ -17,6 +17,7 @@ int show_help(void) {
     "    -radius   : Radius of the circle inscribed within hexagons.\n"
     "                In UV coordinate metric units (e.g. mm).\n"
     "    -output   : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -33,6 +34,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-coord_uv")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -coord_uv\n");
@@ -64,7 +69,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
@@ -87,6 +92,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Allocating new nifti for output 3D nifti
     nifti_image* nii_bins = nifti_copy_nim_info(nii_input);
+    pipeline_image_track(nii_bins);
     nii_bins->datatype = NIFTI_TYPE_INT32;
     nii_bins->dim[0] = 4;  // For proper 4D nifti
     // nii_bins->dim[1] = bins_u;
@@ -22,6 +22,8 @@ int show_help(void) {
     "    LN2_LAYERS -rim rim.nii -nr_layers 3\n"
     "    LN2_LAYERS -rim rim.nii -nr_layers 3 -equivol\n"
     "    LN2_LAYERS -rim rim.nii -nr_layers 3 -equivol -iter_smooth 1000\n"
+    "    LN2_LAYERS -rim rim.nii -nr_layers 3,6,10 -equivol -iter_smooth 100,1000\n"
+    "    LN2_LAYERS -rim rim.nii -nr_layers 3 -laplace -thickness\n"
     "    ../LN2_LAYERS -rim sc_rim.nii -nr_layers 10 -equivol \n"
     "\n"
     "Options:\n"
@@ -30,7 +32,8 @@ int show_help(void) {
     "                    gray matter border voxels (facing mostly CSF), 2 to code inner\n"
     "                    gray matter border voxels (facing mostly white matter), and\n"
     "                    3 to code pure gray matter voxels.\n"
-    "    -nr_layers    : Number of layers. Default is 3.\n"
+    "    -nr_layers    : Number of layers. Default is 3. A comma separated list\n"
+    "                    (e.g. 3,6,10) produces all of them in one go.\n"
     "    -equivol      : (Optional) Create equi-volume layers. We do not\n"
     "                    recommend this option if your rim file is above 0.3mm\n"
     "                    resolution. You can always upsample your rim file to\n"
@@ -39,12 +42,18 @@ int show_help(void) {
     "    -iter_smooth  : (Optional) Number of smoothing iterations. Default\n"
     "                    is 100. Only used together with '-equivol' flag. Use\n"
     "                    larger values when equi-volume layers are jagged.\n"
+    "                    Can also be a comma separated list.\n"
     "    -curvature    : (Optional) Compute curvature. Uses -iter_smooth value\n"
     "                    for smoothing the curvature estimates. Off by default.\n"
     "    -streamlines  : (Optional) Export streamline vectors. Useful for e.g.\n"
     "                    computing B0 angular differences. Off by default.\n"
     "    -thickness    : (Optional) Export cortical thickness. Uses -iter_smooth\n"
     "                    value for smoothing the thickness. Off by default.\n"
+    "    -laplace      : (Optional) Also compute a potential based cortical depth\n"
+    "                    by solving Laplace's equation in the gray matter. Gives\n"
+    "                    smooth depths without '-iter_smooth'. Together with\n"
+    "                    '-thickness', thickness is also measured along the\n"
+    "                    streamlines of the potential. Off by default.\n"
     "    -incl_borders : (Optional) Include inner and outer gray matter borders\n"
     "                    into the layering. This treats the borders as \n"
     "                    a part of gray matter. Off by default.\n"
@@ -55,31 +64,308 @@ int show_help(void) {
     "    -no_smooth    : (Optional) Disable smoothing on cortical depth metric.\n"
     "    -debug        : (Optional) Save extra intermediate outputs.\n"
     "    -output       : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - You can find further explanation of this algorithm at:\n"
     "      <https://thingsonthings.org/ln2_layers>\n"
     "    - For a general discussion on equi-volume layering:\n"
     "      <https://layerfmri.com/equivol>\n"
+    "    - With lists for '-nr_layers' or '-iter_smooth', the distance fields\n"
+    "      are computed once and every variant is written with a suffix such\n"
+    "      as '_layers6' or '_smooth1000'. Outputs that do not depend on a\n"
+    "      parameter are written once without a suffix.\n"
     "\n");
     return 0;
 }
 
+// ============================================================================
+// Helpers shared by the equi-distant and equi-volume stages. Both are run
+// once for every requested number of layers and smoothing iterations.
+// ============================================================================
+string sweep_tag(const string name, const uint16_t value, const bool is_sweep) {
+    // Output file name suffix that tells parameter sweep variants apart
+    if (!is_sweep) {
+        return "";
+    }
+    return "_" + name + to_string(value);
+}
+
+void quantize_layers(const float* metric_data, const int32_t* voi_id,
+                     const uint32_t nr_voi, const uint16_t nr_layers,
+                     int16_t* nii_layers_data) {
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+        *(nii_layers_data + i) = ceil(*(metric_data + i) * nr_layers);
+    }
+}
+
+void sort_layer_metric(const float* metric_data, const int32_t* voi_id,
+                       const uint32_t nr_voi, vector<float>& vec_lay) {
+    // Sorted positive metric values, the same for every number of layers
+    vec_lay.clear();
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+        if ( *(metric_data + i)  > 0){
+            vec_lay.push_back(*(metric_data + i) );
+        }
+    }
+    std::sort(vec_lay.begin(),  vec_lay.end());
+}
+
+void equalize_layer_counts(const float* metric_data, const int32_t* voi_id,
+                           const uint32_t nr_voi, const uint16_t nr_layers,
+                           const vector<float>& vec_lay,
+                           const uint32_t nr_voxels, int16_t* binlayers_data) {
+    // Enforce each integer layer to have the same number of voxels.
+    for (uint32_t i = 0; i != nr_voxels; ++i) {
+        *(binlayers_data + i) = 0;
+    }
+    float_t current_metric_val = 0;
+    uint32_t current_layer_thresh = 0;
+    int nr_layervoxels = vec_lay.size();
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+        current_metric_val = *(metric_data + i) ;
+
+        for (uint32_t jj = 0 ; jj < nr_layers ; jj++ ){
+            current_layer_thresh = (jj * nr_layervoxels)/nr_layers;
+            if (current_metric_val > 0 && current_metric_val > vec_lay[current_layer_thresh]) {
+                *(binlayers_data + i) = (int16_t)(jj + 1);
+            }
+        }
+    }
+}
+
+void handle_layer_borders(const int16_t* nii_rim_data, const int32_t* voi_id,
+                          const uint32_t nr_voi, const uint16_t nr_layers,
+                          const bool mode_incl_borders,
+                          int16_t* nii_layers_data) {
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+        if (mode_incl_borders) {
+            if (*(nii_rim_data + i) == 1) {
+                *(nii_layers_data + i) = nr_layers;
+            } else if (*(nii_rim_data + i) == 2) {
+                *(nii_layers_data + i) = 1;
+            }
+        } else {
+            if (*(nii_rim_data + i) != 3) {
+                *(nii_layers_data + i) = 0;
+            }
+        }
+    }
+}
+
+void handle_metric_borders(const int16_t* nii_rim_data, const int32_t* voi_id,
+                           const uint32_t nr_voi, const bool mode_incl_borders,
+                           float* metric_data) {
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+        if (mode_incl_borders) {
+            if (*(nii_rim_data + i) == 1) {
+                *(metric_data + i) = 1;
+            } else if (*(nii_rim_data + i) == 2) {
+                *(metric_data + i) = std::numeric_limits<float>::min();
+            }
+        } else {
+            if (*(nii_rim_data + i) != 3) {
+                *(metric_data + i) = 0;
+            }
+        }
+    }
+}
+
+void find_middle_gm(const float* normdistdiff_data, const int16_t* nii_rim_data,
+                    const int32_t* innerGM_prevstep_id_data,
+                    const int32_t* outerGM_prevstep_id_data,
+                    const int32_t* voi_id, const uint32_t nr_voi,
+                    int16_t* midGM_data, int32_t* midGM_id_data) {
+    uint32_t j;
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
+
+        if (*(nii_rim_data + i) == 3) {
+            // Check sign changes in normalized distance differences between
+            // neighbouring voxels on a column path (a.k.a. streamline)
+            if (*(normdistdiff_data + i) == 0) {
+                *(midGM_data + i) = 1;
+                *(midGM_id_data + i) = i;
+            } else {
+                float m = *(normdistdiff_data + i);
+                float n;
+
+                // Inner neighbour
+                j = *(innerGM_prevstep_id_data + ii);
+                if (*(nii_rim_data + j) == 3) {
+                    n = *(normdistdiff_data + j);
+                    if (signbit(m) - signbit(n) != 0) {
+                        if ( m*m < n*n) {
+                            *(midGM_data + i) = 1;
+                            *(midGM_id_data + i) = i;
+                        } else if (m*m > n*n) {  // Closer to prev. step
+                            *(midGM_data + j) = 1;
+                            *(midGM_id_data + j) = j;
+                        } else {  // Equal +/- normalized distance
+                            *(midGM_data + i) = 1;
+                            *(midGM_id_data + i) = i;
+                            *(midGM_data + j) = 1;
+                            *(midGM_id_data + j) = i;  // On purpose
+                        }
+                    }
+                }
+
+                // Outer neighbour
+                j = *(outerGM_prevstep_id_data + ii);
+                if (*(nii_rim_data + j) == 3) {
+                    n = *(normdistdiff_data + j);
+                    if (signbit(m) - signbit(n) != 0) {
+                        if (m*m < n*n) {
+                            *(midGM_data + i) = 1;
+                            *(midGM_id_data + i) = i;
+                        } else if (m*m > n*n) {  // Closer to prev. step
+                            *(midGM_data + j) = 1;
+                            *(midGM_id_data + j) = j;
+                        } else {  // Equal +/- normalized distance
+                            *(midGM_data + i) = 1;
+                            *(midGM_id_data + i) = i;
+                            *(midGM_data + j) = 1;
+                            *(midGM_id_data + j) = i;  // On purpose
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+nifti_image* smooth_further(nifti_image* nii_in, nifti_image* nii_prev,
+                            const uint16_t iter_prev, const uint16_t iter_smooth,
+                            nifti_image* nii_mask, const int32_t mask_value) {
+    // Iterative smoothing repeats the same local averaging, so
+    // continuing from the result of a smaller number of iterations gives the
+    // same result as starting over. Frees the previous result.
+    nifti_image* nii_smooth;
+    if (nii_prev == NULL || iter_prev == 0) {
+        nii_smooth = iterative_smoothing(nii_in, iter_smooth, nii_mask,
+                                         mask_value);
+    } else {
+        nii_smooth = iterative_smoothing(nii_prev, iter_smooth - iter_prev,
+                                         nii_mask, mask_value);
+    }
+    if (nii_prev != NULL) {
+        pipeline_image_free(nii_prev);
+    }
+    return nii_smooth;
+}
+
+float trace_streamline(const uint32_t i, const int sign,
+                       const vector<float>& grad, const vector<int32_t>& voi_pos,
+                       const int16_t* nii_rim_data, const uint32_t size_x,
+                       const uint32_t size_y, const uint32_t size_z,
+                       const float dX, const float dY, const float dZ,
+                       const float step_mm, const int max_steps) {
+    // Follows the potential gradient (sign +1) or its opposite (sign -1) from
+    // voxel i until the outer (1) or inner (2) gray matter border is reached,
+    // or the rim ends. The gradient is interpolated trilinearly from the rim
+    // voxels. Returns the path length in mm.
+    uint32_t ix, iy, iz;
+    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
+    float p[3] = {static_cast<float>(ix), static_cast<float>(iy),
+                  static_cast<float>(iz)};
+    const float vox[3] = {dX, dY, dZ};
+    const int16_t target = sign > 0 ? 1 : 2;
+    float length = 0;
+
+    for (int s = 0; s != max_steps; ++s) {
+        // Trilinear interpolation over the rim corners of the cell
+        float g[3] = {0, 0, 0}, w_sum = 0;
+        int32_t base[3];
+        float frac[3];
+        for (int a = 0; a != 3; ++a) {
+            base[a] = static_cast<int32_t>(floor(p[a]));
+            frac[a] = p[a] - base[a];
+        }
+        for (int c = 0; c != 8; ++c) {
+            int32_t cx = base[0] + (c & 1);
+            int32_t cy = base[1] + ((c >> 1) & 1);
+            int32_t cz = base[2] + ((c >> 2) & 1);
+            if (cx < 0 || cy < 0 || cz < 0 || cx >= (int32_t)size_x
+                || cy >= (int32_t)size_y || cz >= (int32_t)size_z) {
+                continue;
+            }
+            int32_t ii = voi_pos[sub2ind_3D(cx, cy, cz, size_x, size_y)];
+            if (ii < 0) continue;
+            float w = ((c & 1) ? frac[0] : 1 - frac[0])
+                      * (((c >> 1) & 1) ? frac[1] : 1 - frac[1])
+                      * (((c >> 2) & 1) ? frac[2] : 1 - frac[2]);
+            g[0] += w * grad[3 * ii];
+            g[1] += w * grad[3 * ii + 1];
+            g[2] += w * grad[3 * ii + 2];
+            w_sum += w;
+        }
+        float norm = sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+        if (w_sum == 0 || norm == 0) break;
+
+        // Step of fixed length in mm, converted to voxel coordinates
+        for (int a = 0; a != 3; ++a) {
+            p[a] += sign * step_mm * g[a] / norm / vox[a];
+        }
+        length += step_mm;
+
+        // Stop at the border or where the rim ends
+        int32_t vx = static_cast<int32_t>(floor(p[0] + 0.5));
+        int32_t vy = static_cast<int32_t>(floor(p[1] + 0.5));
+        int32_t vz = static_cast<int32_t>(floor(p[2] + 0.5));
+        if (vx < 0 || vy < 0 || vz < 0 || vx >= (int32_t)size_x
+            || vy >= (int32_t)size_y || vz >= (int32_t)size_z) {
+            break;
+        }
+        int16_t r = *(nii_rim_data + sub2ind_3D(vx, vy, vz, size_x, size_y));
+        if (r == target || r == 0) break;
+    }
+    return length;
+}
+
+bool parse_sweep(const char* text, vector<uint16_t>& values) {
+    // Sorted unique values of a comma separated list, e.g. "3,6,10"
+    vector<float> list;
+    if (!parse_float_list(text, list)) {
+        return false;
+    }
+    values.clear();
+    for (size_t i = 0; i != list.size(); ++i) {
+        if (list[i] < 0) {
+            return false;
+        }
+        values.push_back(static_cast<uint16_t>(list[i]));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return true;
+}
+
 int main(int argc, char*  argv[]) {
 
     nifti_image *nii1 = NULL;
     char *fin = NULL, *fout = NULL;
-    uint16_t ac, nr_layers = 3;
-    uint16_t iter_smooth = 100;
+    int ac;
+    vector<uint16_t> nr_layers_list(1, 3);
+    vector<uint16_t> iter_smooth_list(1, 100);
     bool mode_equivol = false, mode_debug = false, mode_incl_borders = false;
     bool mode_curvature =false, mode_streamlines = false, mode_smooth = true;
     bool mode_thickness = false, mode_equal_counts = false;
+    bool mode_laplace = false;
 
     // Process user options
     if (argc < 2) return show_help();
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-rim")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -rim\n");
@@ -90,14 +376,16 @@ int main(int argc, char*  argv[]) {
         } else if (!strcmp(argv[ac], "-nr_layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -nr_layers\n");
-            } else {
-                nr_layers = atof(argv[ac]);
+            } else if (!parse_sweep(argv[ac], nr_layers_list)) {
+                fprintf(stderr, "** invalid argument for -nr_layers, '%s'\n", argv[ac]);
+                return 1;
             }
         } else if (!strcmp(argv[ac], "-iter_smooth")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -iter_smooth\n");
-            } else {
-                iter_smooth = atof(argv[ac]);
+            } else if (!parse_sweep(argv[ac], iter_smooth_list)) {
+                fprintf(stderr, "** invalid argument for -iter_smooth, '%s'\n", argv[ac]);
+                return 1;
             }
         } else if (!strcmp(argv[ac], "-equivol")) {
             mode_equivol = true;
@@ -113,6 +401,8 @@ int main(int argc, char*  argv[]) {
             mode_streamlines = true;
         } else if (!strcmp(argv[ac], "-thickness")) {
             mode_thickness = true;
+        } else if (!strcmp(argv[ac], "-laplace")) {
+            mode_laplace = true;
         } else if (!strcmp(argv[ac], "-incl_borders")) {
             mode_incl_borders = true;
         } else if (!strcmp(argv[ac], "-equal_counts")) {
@@ -133,7 +423,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin, 1);
+    nii1 = pipeline_image_read(fin, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -142,35 +432,31 @@ int main(int argc, char*  argv[]) {
     log_welcome("LN2_LAYERS");
     log_nifti_descriptives(nii1);
 
-    cout << "  Nr. layers: " << nr_layers << endl;
+    cout << "  Nr. layers:";
+    for (size_t n = 0; n != nr_layers_list.size(); ++n) {
+        cout << " " << nr_layers_list[n];
+    }
+    cout << endl;
 
     // Get dimensions of input
     const uint32_t size_x = nii1->nx;
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
     const float dX = nii1->pixdim[1];
     const float dY = nii1->pixdim[2];
     const float dZ = nii1->pixdim[3];
 
-    // Short diagonals
-    const float dia_xy = sqrt(dX * dX + dY * dY);
-    const float dia_xz = sqrt(dX * dX + dZ * dZ);
-    const float dia_yz = sqrt(dY * dY + dZ * dZ);
-    // Long diagonals
-    const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
 
     // ========================================================================
     // Fix input datatype issues
     nifti_image* nii_rim = copy_nifti_as_int16(nii1);
     int16_t* nii_rim_data = static_cast<int16_t*>(nii_rim->data);
-    free(nii1);
+    pipeline_image_free(nii1);
 
     // ------------------------------------------------------------------------
     // NOTE(Faruk): This section is written to constrain voxel visits
@@ -185,6 +471,9 @@ int main(int argc, char*  argv[]) {
     int32_t* voi_id;
     voi_id = (int32_t*) malloc(nr_voi*sizeof(int32_t));
 
+    // Rim with a halo of zeros, so the growth loops need no bounds checks
+    const padded_volume<int16_t> rim_pad(nii_rim, nii_rim_data, 0);
+
     // Fill in indices to be able to remap from subset to full set of voxels
     uint32_t ii = 0;
     for (uint32_t i = 0; i != nr_voxels; ++i) {
@@ -204,30 +493,24 @@ int main(int argc, char*  argv[]) {
         *(nii_layers_data + i) = 0;
     }
 
-    nifti_image* innerGM_step = copy_nifti_as_int16(nii_layers);
-    int16_t* innerGM_step_data = static_cast<int16_t*>(innerGM_step->data);
-    nifti_image* innerGM_dist = copy_nifti_as_float32(nii_layers);
-    float* innerGM_dist_data = static_cast<float*>(innerGM_dist->data);
-
-    nifti_image* outerGM_step = copy_nifti_as_int16(nii_layers);
-    int16_t* outerGM_step_data = static_cast<int16_t*>(outerGM_step->data);
-    nifti_image* outerGM_dist = copy_nifti_as_float32(nii_layers);
-    float* outerGM_dist_data = static_cast<float*>(outerGM_dist->data);
+    // Growth results are only kept for the voxels of interest, indexed by ii
+    const voi_index voi(voi_id, nr_voi, nr_voxels);
+    voi_array<int16_t> innerGM_step(voi), outerGM_step(voi);
+    voi_array<float> innerGM_dist(voi), outerGM_dist(voi);
+    voi_array<int32_t> innerGM_id(voi), outerGM_id(voi);
+    voi_array<int32_t> innerGM_prevstep_id(voi), outerGM_prevstep_id(voi);
+    int16_t* innerGM_step_data = innerGM_step.data.data();
+    int16_t* outerGM_step_data = outerGM_step.data.data();
+    float* innerGM_dist_data = innerGM_dist.data.data();
+    float* outerGM_dist_data = outerGM_dist.data.data();
+    int32_t* innerGM_id_data = innerGM_id.data.data();
+    int32_t* outerGM_id_data = outerGM_id.data.data();
+    int32_t* innerGM_prevstep_id_data = innerGM_prevstep_id.data.data();
+    int32_t* outerGM_prevstep_id_data = outerGM_prevstep_id.data.data();
 
     // nifti_image* err_dist = copy_nifti_as_float16(nii_layers);
     // short* err_dist_data = static_cast<short*>(err_dist->data);
 
-    nifti_image* innerGM_id = copy_nifti_as_int32(nii_layers);
-    int32_t* innerGM_id_data = static_cast<int32_t*>(innerGM_id->data);
-    nifti_image* outerGM_id = copy_nifti_as_int32(nii_layers);
-    int32_t* outerGM_id_data = static_cast<int32_t*>(outerGM_id->data);
-
-    nifti_image* innerGM_prevstep_id = copy_nifti_as_int32(nii_layers);
-    int32_t* innerGM_prevstep_id_data =
-        static_cast<int32_t*>(innerGM_prevstep_id->data);
-    nifti_image* outerGM_prevstep_id = copy_nifti_as_int32(nii_layers);
-    int32_t* outerGM_prevstep_id_data =
-        static_cast<int32_t*>(outerGM_prevstep_id->data);
     nifti_image* normdist = copy_nifti_as_float32(nii_layers);
     float* normdist_data = static_cast<float*>(normdist->data);
     nifti_image* normdistdiff = copy_nifti_as_float32(nii_layers);
@@ -249,828 +532,62 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Grow from WM
     // ========================================================================
-    cout << "\n  Start growing from inner GM (WM-facing border)..." << endl;
+    log_stage("Start growing from inner GM (WM-facing border)...");
 
     // Initialize grow volume
-    for (uint32_t i = 0; i != nr_voxels; ++i) {
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
         if (*(nii_rim_data + i) == 2) {  // WM boundary voxels within GM
-            *(innerGM_step_data + i) = 1;
-            *(innerGM_dist_data + i) = 0.;
-            *(innerGM_id_data + i) = i;
-        } else {
-            *(innerGM_step_data + i) = 0.;
-            *(innerGM_dist_data + i) = 0.;
+            *(innerGM_step_data + ii) = 1;
+            *(innerGM_id_data + ii) = i;
         }
     }
 
-    uint16_t grow_step = 1;
-    uint32_t voxel_counter = nr_voxels;
-    uint32_t ix, iy, iz, j, k;
-    float d;
-    while (voxel_counter != 0) {
-        voxel_counter = 0;
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-
-            if (*(innerGM_step_data + i) == grow_step) {
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                voxel_counter += 1;
-
-                // ------------------------------------------------------------
-                // 1-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        d = *(innerGM_dist_data + i) + dX;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dX;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dY;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dY;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dZ;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dZ;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 2-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xy;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y) {
-                    j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xy;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xy;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y) {
-                    j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xy;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_yz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_yz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_yz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_yz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 3-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 1 ) {
-                        d = *(innerGM_dist_data + i) + dia_xyz;
-                        if (d < *(innerGM_dist_data + j)
-                            || *(innerGM_dist_data + j) == 0) {
-                            *(innerGM_dist_data + j) = d;
-                            *(innerGM_step_data + j) = grow_step + 1;
-                            *(innerGM_id_data + j) = *(innerGM_id_data + i);
-                            *(innerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-            }
-        }
-        grow_step += 1;
-    }
+    // Grown from a frontier, in parallel if OpenMP is enabled. Results are
+    // the same as sweeping over all voxels of interest.
+    grow_frontier(nb, voi, rim_pad,
+                  [](const int16_t label, const int n) {
+                      // The -x neighbour does not grow into the outer border
+                      return label == 3 || (label == 1 && n != 0);
+                  },
+                  innerGM_dist_data, innerGM_step_data, innerGM_id_data,
+                  innerGM_prevstep_id_data);
     if (mode_debug) {
-        save_output_nifti(fout, "innerGM_step", innerGM_step, false);
-        save_output_nifti(fout, "innerGM_dist", innerGM_dist, false);
-        save_output_nifti(fout, "innerGM_id", innerGM_id, false);
+        save_output_voi(fout, "innerGM_step", innerGM_step, nii_rim, false);
+        save_output_voi(fout, "innerGM_dist", innerGM_dist, nii_rim, false);
+        save_output_voi(fout, "innerGM_id", innerGM_id, nii_rim, false);
     }
 
     // ========================================================================
     // Grow from CSF
     // ========================================================================
-    cout << "\n  Start growing from outer GM..." << endl;
+    log_stage("Start growing from outer GM...");
 
-    for (uint32_t i = 0; i != nr_voxels; ++i) {
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t i = *(voi_id + ii);
         if (*(nii_rim_data + i) == 1) {
-            *(outerGM_step_data + i) = 1.;
-            *(outerGM_dist_data + i) = 0.;
-            *(outerGM_id_data + i) = i;
-        } else {
-            *(outerGM_step_data + i) = 0.;
-            *(outerGM_dist_data + i) = 0.;
+            *(outerGM_step_data + ii) = 1;
+            *(outerGM_id_data + ii) = i;
         }
     }
 
-    grow_step = 1, voxel_counter = nr_voxels;
-    while (voxel_counter != 0) {
-        voxel_counter = 0;
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-
-            if (*(outerGM_step_data + i) == grow_step) {
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                voxel_counter += 1;
-
-                // ------------------------------------------------------------
-                // 1-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dX;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dX;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dY;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dY;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dZ;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dZ;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 2-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xy;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y) {
-                    j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xy;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xy;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y) {
-                    j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xy;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_yz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_yz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_yz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_yz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-
-                // ------------------------------------------------------------
-                // 3-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix > 0 && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-                if (ix < end_x && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                    if (*(nii_rim_data + j) == 3 || *(nii_rim_data + j) == 2 ) {
-                        d = *(outerGM_dist_data + i) + dia_xyz;
-                        if (d < *(outerGM_dist_data + j)
-                            || *(outerGM_dist_data + j) == 0) {
-                            *(outerGM_dist_data + j) = d;
-                            *(outerGM_step_data + j) = grow_step + 1;
-                            *(outerGM_id_data + j) = *(outerGM_id_data + i);
-                            *(outerGM_prevstep_id_data + j) = i;
-                        }
-                    }
-                }
-            }
-        }
-        grow_step += 1;
-    }
+    grow_frontier(nb, voi, rim_pad,
+                  [](const int16_t label, const int) {
+                      return label == 3 || label == 2;
+                  },
+                  outerGM_dist_data, outerGM_step_data, outerGM_id_data,
+                  outerGM_prevstep_id_data);
     if (mode_debug) {
-        save_output_nifti(fout, "outerGM_step", outerGM_step, false);
-        save_output_nifti(fout, "outerGM_dist", outerGM_dist, false);
-        save_output_nifti(fout, "outerGM_id", outerGM_id, false);
+        save_output_voi(fout, "outerGM_step", outerGM_step, nii_rim, false);
+        save_output_voi(fout, "outerGM_dist", outerGM_dist, nii_rim, false);
+        save_output_voi(fout, "outerGM_id", outerGM_id, nii_rim, false);
     }
 
     // ========================================================================
     // Layers
     // ========================================================================
-    cout << "\n  Start layering (equi-distant)..." << endl;
+    log_stage("Start layering (equi-distant)...");
+    uint32_t j, k;
     float x, y, z, wm_x, wm_y, wm_z, gm_x, gm_y, gm_z;
 
     for (uint32_t ii = 0; ii != nr_voi; ++ii) {
@@ -1078,9 +595,9 @@ int main(int argc, char*  argv[]) {
 
         if (*(nii_rim_data + i) == 3) {
             tie(x, y, z) = ind2sub_3D(i, size_x, size_y);
-            tie(wm_x, wm_y, wm_z) = ind2sub_3D(*(innerGM_id_data + i),
+            tie(wm_x, wm_y, wm_z) = ind2sub_3D(*(innerGM_id_data + ii),
                                                size_x, size_y);
-            tie(gm_x, gm_y, gm_z) = ind2sub_3D(*(outerGM_id_data + i),
+            tie(gm_x, gm_y, gm_z) = ind2sub_3D(*(outerGM_id_data + ii),
                                                size_x, size_y);
 
             // // Normalize distance
@@ -1089,8 +606,8 @@ int main(int argc, char*  argv[]) {
             // float dist_normalized = dist1 / (dist1 + dist2);
 
             // Normalize distance (completely discrete)
-            float dist1 = *(innerGM_dist_data + i);
-            float dist2 = *(outerGM_dist_data + i);
+            float dist1 = *(innerGM_dist_data + ii);
+            float dist2 = *(outerGM_dist_data + ii);
             float total_dist = dist1 + dist2;;
             float dist_normalized = dist1 / total_dist;
 
@@ -1100,9 +617,9 @@ int main(int argc, char*  argv[]) {
             *(normdistdiff_data + i) = (dist1 - dist2) / total_dist;
 
             // Count inner and outer GM anchor voxels
-            j = *(innerGM_id_data + i);
+            j = *(innerGM_id_data + ii);
             *(hotspots_data + j) += 1;
-            j = *(outerGM_id_data + i);
+            j = *(outerGM_id_data + ii);
             *(hotspots_data + j) -= 1;
         }
     }
@@ -1115,7 +632,7 @@ int main(int argc, char*  argv[]) {
     // to voxel-dimension bound distances, due to regular rectangular grid
     // nature of the volume data structure.
     if (mode_smooth) {
-        cout << "\n  Start mildly smoothing equidistant cortical depths..." << endl;
+        log_stage("Start mildly smoothing equidistant cortical depths...");
 
         // Add extremum values to non GM voxels
         // NOTE(Faruk): This is important to reduce dynamic range shrinkage in
@@ -1138,78 +655,48 @@ int main(int argc, char*  argv[]) {
         }
         normdist = iterative_smoothing(normdist, 3, temp_mask, 1);
         normdist_data = static_cast<float*>(normdist->data);
-        free(temp_mask_data);
-        free(temp_mask);
+        pipeline_image_free(temp_mask);
     }
     // ------------------------------------------------------------------------
-    // Quantize metric file to get layers
+    // Quantize metric file to get layers, once for every number of layers
     // ------------------------------------------------------------------------
-    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-        uint32_t i = *(voi_id + ii);
-        *(nii_layers_data + i) = ceil(*(normdist_data + i) * nr_layers);
+    log_stage("Saving equidistant metric and layers files...");
+    nifti_image* nii_binlayers = NULL;
+    vector <float> vec_lay;
+    if (mode_equal_counts) {
+        nii_binlayers = copy_nifti_as_int16(nii_rim);
+        sort_layer_metric(normdist_data, voi_id, nr_voi, vec_lay);
     }
 
-    // ========================================================================
-    // Enforce each integer layer to have the same number of voxels.
-    // ========================================================================
-
-    if(mode_equal_counts){
-        nifti_image* nii_binlayers  = copy_nifti_as_int16(nii_rim);
-        int16_t* nii_binlayers_data = static_cast<int16_t*>(nii_binlayers->data);
-        // Setting zero
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            *(nii_binlayers_data + i) = 0;
-        }
-        vector <float> vec_lay;
-        float_t current_metric_val = 0;
-        uint32_t current_layer_thresh = 0;
-
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-            if ( *(normdist_data + i)  > 0){
-                vec_lay.push_back(*(normdist_data + i) );
-            }
+    for (size_t n = 0; n != nr_layers_list.size(); ++n) {
+        const uint16_t nr_layers = nr_layers_list[n];
+        const string layers_tag = sweep_tag("layers", nr_layers,
+                                            nr_layers_list.size() > 1);
+
+        quantize_layers(normdist_data, voi_id, nr_voi, nr_layers,
+                        nii_layers_data);
+
+        // Enforce each integer layer to have the same number of voxels.
+        if (mode_equal_counts) {
+            equalize_layer_counts(normdist_data, voi_id, nr_voi, nr_layers,
+                                  vec_lay, nr_voxels,
+                                  static_cast<int16_t*>(nii_binlayers->data));
+            save_output_nifti(fout, "layers_equicount" + layers_tag,
+                              nii_binlayers);
         }
-        int nr_layervoxels = vec_lay.size();
-        std::sort(vec_lay.begin(),  vec_lay.end());
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-            current_metric_val = *(normdist_data + i) ;
 
-            for (uint32_t jj = 0 ; jj < nr_layers ; jj++ ){
-            current_layer_thresh = (jj * nr_layervoxels)/nr_layers;
-                if (current_metric_val > 0 && current_metric_val > vec_lay[current_layer_thresh]) {
-                    *(nii_binlayers_data + i) = (int16_t)(jj + 1);
-                }
-            }
-        }
-        save_output_nifti(fout, "layers_equicount", nii_binlayers);
+        handle_layer_borders(nii_rim_data, voi_id, nr_voi, nr_layers,
+                             mode_incl_borders, nii_layers_data);
+        save_output_nifti(fout, "layers_equidist" + layers_tag, nii_layers,
+                          true);
     }
 
     // ------------------------------------------------------------------------
     // Handle include borders type
     // ------------------------------------------------------------------------
-    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-        uint32_t i = *(voi_id + ii);
-        if (mode_incl_borders) {
-            if (*(nii_rim_data + i) == 1) {
-                *(nii_layers_data + i) = nr_layers;
-                *(normdist_data + i) = 1;
-            } else if (*(nii_rim_data + i) == 2) {
-                *(nii_layers_data + i) = 1;
-                *(normdist_data + i) = std::numeric_limits<float>::min();
-            }
-        } else {
-            if (*(nii_rim_data + i) != 3) {
-                *(nii_layers_data + i) = 0;
-                *(normdist_data + i) = 0;
-            }
-        }
-    }
-    // ------------------------------------------------------------------------
-    cout << "\n  Saving equidistant metric and layers files..." << endl;
+    handle_metric_borders(nii_rim_data, voi_id, nr_voi, mode_incl_borders,
+                          normdist_data);
     save_output_nifti(fout, "metric_equidist", normdist);
-    save_output_nifti(fout, "layers_equidist", nii_layers, true);
 
     if (mode_debug) {
         save_output_nifti(fout, "hotspots", hotspots, false);
@@ -1219,64 +706,11 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Middle gray matter
     // ========================================================================
-    cout << "\n  Start finding middle gray matter (equi-distant)..." << endl;
-    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-        uint32_t i = *(voi_id + ii);
-
-        if (*(nii_rim_data + i) == 3) {
-            // Check sign changes in normalized distance differences between
-            // neighbouring voxels on a column path (a.k.a. streamline)
-            if (*(normdistdiff_data + i) == 0) {
-                *(midGM_data + i) = 1;
-                *(midGM_id_data + i) = i;
-            } else {
-                float m = *(normdistdiff_data + i);
-                float n;
-
-                // Inner neighbour
-                j = *(innerGM_prevstep_id_data + i);
-                if (*(nii_rim_data + j) == 3) {
-                    n = *(normdistdiff_data + j);
-                    if (signbit(m) - signbit(n) != 0) {
-                        if ( m*m < n*n) {
-                            *(midGM_data + i) = 1;
-                            *(midGM_id_data + i) = i;
-                        } else if (m*m > n*n) {  // Closer to prev. step
-                            *(midGM_data + j) = 1;
-                            *(midGM_id_data + j) = j;
-                        } else {  // Equal +/- normalized distance
-                            *(midGM_data + i) = 1;
-                            *(midGM_id_data + i) = i;
-                            *(midGM_data + j) = 1;
-                            *(midGM_id_data + j) = i;  // On purpose
-                        }
-                    }
-                }
-
-                // Outer neighbour
-                j = *(outerGM_prevstep_id_data + i);
-                if (*(nii_rim_data + j) == 3) {
-                    n = *(normdistdiff_data + j);
-                    if (signbit(m) - signbit(n) != 0) {
-                        if (m*m < n*n) {
-                            *(midGM_data + i) = 1;
-                            *(midGM_id_data + i) = i;
-                        } else if (m*m > n*n) {  // Closer to prev. step
-                            *(midGM_data + j) = 1;
-                            *(midGM_id_data + j) = j;
-                        } else {  // Equal +/- normalized distance
-                            *(midGM_data + i) = 1;
-                            *(midGM_id_data + i) = i;
-                            *(midGM_data + j) = 1;
-                            *(midGM_id_data + j) = i;  // On purpose
-                        }
-                    }
-                }
-            }
-        }
-    }
+    log_stage("Start finding middle gray matter (equi-distant)...");
+    find_middle_gm(normdistdiff_data, nii_rim_data, innerGM_prevstep_id_data,
+                   outerGM_prevstep_id_data, voi_id, nr_voi, midGM_data,
+                   midGM_id_data);
     save_output_nifti(fout, "midGM_equidist", midGM, true);
-
     // ========================================================================
     // Columns
     // ========================================================================
@@ -1285,8 +719,8 @@ int main(int argc, char*  argv[]) {
 
         if (*(nii_rim_data + i) == 3) {
             // Approximate curvature measurement per column/streamline
-            j = *(innerGM_id_data + i);
-            k = *(outerGM_id_data + i);  // These values are negative
+            j = *(innerGM_id_data + ii);
+            k = *(outerGM_id_data + ii);  // These values are negative
             *(curvature_data + i) = *(hotspots_data + j) + *(hotspots_data + k);
             *(curvature_data + i) /=
                 max(*(hotspots_data + j), -*(hotspots_data + k));  // normalize
@@ -1384,7 +818,7 @@ int main(int argc, char*  argv[]) {
     // Equi-volume layers
     // ========================================================================
     if (mode_equivol) {
-        cout << "\n  Start equi-volume stage..." << endl;
+        log_stage("Start equi-volume stage...");
 
         nifti_image* hotspots_i = copy_nifti_as_float32(nii_rim);
         float* hotspots_i_data = static_cast<float*>(hotspots_i->data);
@@ -1403,8 +837,8 @@ int main(int argc, char*  argv[]) {
 
             if (*(nii_rim_data + i) == 3) {
                 // Find inner/outer anchors
-                j = *(innerGM_id_data + i);
-                k = *(outerGM_id_data + i);
+                j = *(innerGM_id_data + ii);
+                k = *(outerGM_id_data + ii);
 
                 // Count how many voxels fall inner and outer shells from MidGM
                 if (*(curvature_data + i) < 0) {
@@ -1433,7 +867,7 @@ int main(int argc, char*  argv[]) {
         // --------------------------------------------------------------------
         // Compute equi-volume factors
         // --------------------------------------------------------------------
-        cout << "\n  Start computing equi-volume factors..." << endl;
+        log_stage("Start computing equi-volume factors...");
         nifti_image* equivol_factors = copy_nifti_as_float32(nii_rim);
         float* equivol_factors_data = static_cast<float*>(equivol_factors->data);
         for (uint32_t i = 0; i != nr_voxels; ++i) {
@@ -1446,8 +880,8 @@ int main(int argc, char*  argv[]) {
 
             if (*(nii_rim_data + i) == 3) {
                 // Find mass at each end of the given column
-                j = *(innerGM_id_data + i);
-                k = *(outerGM_id_data + i);
+                j = *(innerGM_id_data + ii);
+                k = *(outerGM_id_data + ii);
                 if (*(curvature_data + i) == 0) {
                     w = 0.5;
                 } else if (*(curvature_data + i) < 0) {
@@ -1465,250 +899,318 @@ int main(int argc, char*  argv[]) {
             save_output_nifti(fout, "equivol_factors", equivol_factors, false);
         }
 
-        // --------------------------------------------------------------------
-        // Smooth equi-volume factors for seamless transitions
-        // --------------------------------------------------------------------
-        cout << "\n  Start smoothing equi-volume transitions..." << endl;
-
-        nifti_image* equivol_factors_smooth = iterative_smoothing(
-            equivol_factors, iter_smooth, nii_rim, 3);
-        float* equivol_factors_smooth_data = static_cast<float*>(equivol_factors_smooth->data);
-        free(equivol_factors);
 
-        if (mode_debug) {
-            save_output_nifti(fout, "equivol_factors_smooth", equivol_factors_smooth, false);
+        // Temporary binary mask for iterative smoothing
+        nifti_image* temp_mask = copy_nifti_as_int16(nii_rim);
+        int16_t* temp_mask_data = static_cast<int16_t*>(temp_mask->data);
+        for (uint32_t i = 0; i != nr_voxels; ++i) {
+            if (*(nii_rim_data + i) != 0) {
+                *(temp_mask_data + i) = 1;
+            }
         }
 
-        // --------------------------------------------------------------------
-        // Apply equi-volume factors
-        // --------------------------------------------------------------------
-        cout << "\n  Start final layering..." << endl;
-        float d1_new, d2_new, a, b;
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-
-            if (*(nii_rim_data + i) == 3) {
-                // Find normalized distances from a given point on a column
-                float dist1 = *(innerGM_dist_data + i);
-                float dist2 = *(outerGM_dist_data + i);
-                float total_dist = dist1 + dist2;;
-                dist1 /= total_dist;
-                dist2 /= total_dist;
-
-                a = *(equivol_factors_smooth_data + i);
-                b = 1 - a;
-
-                // Perturb using masses to modify distances in simplex space
-                tie(d1_new, d2_new) = simplex_perturb_2D(dist1, dist2, a, b);
-
-                // Difference of normalized distances (used in finding midGM)
-                *(normdistdiff_data + i) = d1_new - d2_new;
-
-                // // Cast distances to integers as number of desired layers
-                // if (d1_new != 0 && isfinite(d1_new)) {
-                //     *(nii_layers_data + i) =  ceil(nr_layers * d1_new);
-                // } else {
-                //     *(nii_layers_data + i) = 1;
-                // }
+        nifti_image* equivol_factors_smooth = NULL;
+        for (size_t s = 0; s != iter_smooth_list.size(); ++s) {
+            const uint16_t iter_smooth = iter_smooth_list[s];
+            const string smooth_tag = sweep_tag("smooth", iter_smooth,
+                                                iter_smooth_list.size() > 1);
+
+            // ----------------------------------------------------------------
+            // Smooth equi-volume factors for seamless transitions
+            // ----------------------------------------------------------------
+            log_stage("Start smoothing equi-volume transitions...");
+            equivol_factors_smooth = smooth_further(
+                equivol_factors, equivol_factors_smooth,
+                s > 0 ? iter_smooth_list[s - 1] : 0, iter_smooth, nii_rim, 3);
+            float* equivol_factors_smooth_data =
+                static_cast<float*>(equivol_factors_smooth->data);
+
+            if (mode_debug) {
+                save_output_nifti(fout, "equivol_factors_smooth" + smooth_tag,
+                                  equivol_factors_smooth, false);
             }
-        }
 
-        save_output_nifti(fout, "layers_equivol", nii_layers, true);
+            // ----------------------------------------------------------------
+            // Apply equi-volume factors
+            // ----------------------------------------------------------------
+            log_stage("Start final layering...");
+            // Every smoothing value starts from the equi-distant differences
+            nifti_image* metric = copy_nifti_as_float32(normdistdiff);
+            float* metric_data = static_cast<float*>(metric->data);
 
-        // Save equi-volume metric in a simple 0-1 range form.
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
+            float d1_new, d2_new, a, b;
+            for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+                uint32_t i = *(voi_id + ii);
 
-            if (*(nii_rim_data + i) == 3) {
-                *(normdistdiff_data + i) /= 2;
-                *(normdistdiff_data + i) += 0.5;
-            }
-        }
-        // --------------------------------------------------------------------
-        // Smooth metric file
-        // --------------------------------------------------------------------
-        // NOTE(Faruk): Renzo wanted this for smoother metric distribution close
-        // When close to borders. Otherwise the first few voxels are constrained
-        // to voxel-dimension bound distances, due to regular rectangular grid
-        // nature of the volume data structure.
-        if (mode_smooth) {
-            cout << "\n  Start mildly smoothing equivolume cortical depth..." << endl;
-
-            // Add extremum values to non GM voxels
-            // NOTE(Faruk): This is important to reduce dynamic range shrinkage in
-            // iterative smoothing (averaging pulls down extremes near borders).
-            for (uint32_t i = 0; i != nr_voxels; ++i) {
-                if (*(nii_rim_data + i) == 1) {  // outer GM
-                    *(normdistdiff_data + i) = 1.;
-                } else if  (*(nii_rim_data + i) == 2) {  // inner GM
-                    *(normdistdiff_data + i) = 0.;
-                }
-            }
+                if (*(nii_rim_data + i) == 3) {
+                    // Find normalized distances from a given point on a column
+                    float dist1 = *(innerGM_dist_data + ii);
+                    float dist2 = *(outerGM_dist_data + ii);
+                    float total_dist = dist1 + dist2;;
+                    dist1 /= total_dist;
+                    dist2 /= total_dist;
 
-            // Temporary binary mask for iterative smoothing
-            nifti_image* temp_mask = copy_nifti_as_int16(nii_rim);
-            int16_t* temp_mask_data = static_cast<int16_t*>(temp_mask->data);
-            for (uint32_t i = 0; i != nr_voxels; ++i) {
-                if (*(nii_rim_data + i) != 0) {
-                    *(temp_mask_data + i) = 1;
-                }
-            }
-            normdistdiff = iterative_smoothing(normdistdiff, 3, temp_mask, 1);
-            normdistdiff_data = static_cast<float*>(normdistdiff->data);
-            free(temp_mask_data);
-            free(temp_mask);
-        }
-        // --------------------------------------------------------------------
-        // Quantize metric file to get layers
-        // --------------------------------------------------------------------
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-            *(nii_layers_data + i) = ceil(*(normdistdiff_data + i) * nr_layers);
-        }
+                    a = *(equivol_factors_smooth_data + i);
+                    b = 1 - a;
 
-        // ========================================================================
-        // Enfource each integer layer to have the same number of voxels.
-        // ========================================================================
-        if(mode_equal_counts){
-            nifti_image* nii_bineqlayers  = copy_nifti_as_int16(nii_rim);
-            int16_t* nii_bineqlayers_data = static_cast<int16_t*>(nii_bineqlayers->data);
-            // Setting zero
-            for (uint32_t i = 0; i != nr_voxels; ++i) {
-                *(nii_bineqlayers_data + i) = 0;
+                    // Perturb using masses to modify distances in simplex space
+                    tie(d1_new, d2_new) = simplex_perturb_2D(dist1, dist2, a, b);
+
+                    // Difference of normalized distances (used in finding midGM)
+                    *(metric_data + i) = d1_new - d2_new;
+                }
             }
-            vector <float> vec_lay;
-            float_t current_metric_val = 0;
-            uint32_t current_layer_thresh = 0;
 
+            // Save equi-volume metric in a simple 0-1 range form.
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                 uint32_t i = *(voi_id + ii);
-                if ( *(normdistdiff_data + i)  > 0){
-                    vec_lay.push_back(*(normdistdiff_data + i) );
+
+                if (*(nii_rim_data + i) == 3) {
+                    *(metric_data + i) /= 2;
+                    *(metric_data + i) += 0.5;
                 }
             }
-            int nr_layervoxels = vec_lay.size();
-            std::sort(vec_lay.begin(),  vec_lay.end());
+            // ----------------------------------------------------------------
+            // Smooth metric file
+            // ----------------------------------------------------------------
+            // NOTE(Faruk): Renzo wanted this for smoother metric distribution close
+            // When close to borders. Otherwise the first few voxels are constrained
+            // to voxel-dimension bound distances, due to regular rectangular grid
+            // nature of the volume data structure.
+            if (mode_smooth) {
+                log_stage("Start mildly smoothing equivolume cortical depth...");
+
+                // Add extremum values to non GM voxels
+                // NOTE(Faruk): This is important to reduce dynamic range shrinkage in
+                // iterative smoothing (averaging pulls down extremes near borders).
+                for (uint32_t i = 0; i != nr_voxels; ++i) {
+                    if (*(nii_rim_data + i) == 1) {  // outer GM
+                        *(metric_data + i) = 1.;
+                    } else if  (*(nii_rim_data + i) == 2) {  // inner GM
+                        *(metric_data + i) = 0.;
+                    }
+                }
+                nifti_image* metric_smooth = iterative_smoothing(metric, 3,
+                                                                 temp_mask, 1);
+                pipeline_image_free(metric);
+                metric = metric_smooth;
+                metric_data = static_cast<float*>(metric->data);
+            }
+
+            // ----------------------------------------------------------------
+            // Quantize metric file to get layers, once for every number of
+            // layers
+            // ----------------------------------------------------------------
+            log_stage("Saving equivolume metric and layers files...");
+            if (mode_equal_counts) {
+                sort_layer_metric(metric_data, voi_id, nr_voi, vec_lay);
+            }
+            for (size_t n = 0; n != nr_layers_list.size(); ++n) {
+                const uint16_t nr_layers = nr_layers_list[n];
+                const string tag = sweep_tag("layers", nr_layers,
+                                             nr_layers_list.size() > 1)
+                                   + smooth_tag;
+
+                quantize_layers(metric_data, voi_id, nr_voi, nr_layers,
+                                nii_layers_data);
+
+                // Enforce each integer layer to have the same number of voxels.
+                if (mode_equal_counts) {
+                    equalize_layer_counts(metric_data, voi_id, nr_voi,
+                                          nr_layers, vec_lay, nr_voxels,
+                                          static_cast<int16_t*>(nii_binlayers->data));
+                    save_output_nifti(fout, "layerbins_equivol" + tag,
+                                      nii_binlayers);
+                }
+
+                handle_layer_borders(nii_rim_data, voi_id, nr_voi, nr_layers,
+                                     mode_incl_borders, nii_layers_data);
+                save_output_nifti(fout, "layers_equivol" + tag, nii_layers);
+            }
+
+            // ----------------------------------------------------------------
+            // Handle include borders type
+            // ----------------------------------------------------------------
+            handle_metric_borders(nii_rim_data, voi_id, nr_voi,
+                                  mode_incl_borders, metric_data);
+            save_output_nifti(fout, "metric_equivol" + smooth_tag, metric);
+
+            // ================================================================
+            // Middle gray matter for equi-volume
+            // ================================================================
+            log_stage("Start finding middle gray matter (equi-volume)...");
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                 uint32_t i = *(voi_id + ii);
-                current_metric_val = *(normdistdiff_data + i) ;
 
-                for (uint32_t jj = 0 ; jj < nr_layers ; jj++ ){
-                    current_layer_thresh = (jj * nr_layervoxels)/nr_layers;
-                    if (current_metric_val > 0 && current_metric_val > vec_lay[current_layer_thresh]) {
-                        *(nii_bineqlayers_data + i) = (int16_t)(jj + 1);
-                    }
+                *(midGM_data + i) = 0;
+                *(midGM_id_data + i) = 0;
+                // Change back normalized dist. differences after saves above
+                if (*(nii_rim_data + i) == 3) {
+                    *(metric_data + i) -= 0.5;
+                    *(metric_data + i) *= 2;
                 }
             }
-            save_output_nifti(fout, "layerbins_equivol", nii_bineqlayers);
+            find_middle_gm(metric_data, nii_rim_data, innerGM_prevstep_id_data,
+                           outerGM_prevstep_id_data, voi_id, nr_voi, midGM_data,
+                           midGM_id_data);
+            save_output_nifti(fout, "midGM_equivol" + smooth_tag, midGM, true);
+            pipeline_image_free(metric);
         }
+        pipeline_image_free(equivol_factors_smooth);
+        pipeline_image_free(equivol_factors);
+        pipeline_image_free(temp_mask);
+    }
 
-        // --------------------------------------------------------------------
-        // Handle include borders type
-        // --------------------------------------------------------------------
+    // ========================================================================
+    // Laplace (potential based) layers
+    // ========================================================================
+    // The potential is 0 at the inner and 1 at the outer gray
+    // matter border and satisfies Laplace's equation in between, with zero
+    // flux where the rim ends. It gives smooth depths without iterative
+    // smoothing. Face neighbours are weighted with the inverse squared voxel
+    // size, and the equi-distant metric is used as the starting point.
+    if (mode_laplace) {
+        log_stage("Start solving Laplace equation...");
+        const vector<int32_t>& voi_pos = voi.compact;
+        vector<int32_t> gm_row(nr_voi, -1);
+        vector<int32_t> gm_voi;
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-            if (mode_incl_borders) {
-                if (*(nii_rim_data + i) == 1) {
-                    *(nii_layers_data + i) = nr_layers;
-                    *(normdistdiff_data + i) = 1;
-                } else if (*(nii_rim_data + i) == 2) {
-                    *(nii_layers_data + i) = 1;
-                    *(normdistdiff_data + i) = std::numeric_limits<float>::min();
-                }
-            } else {
-                if (*(nii_rim_data + i) != 3) {
-                    *(nii_layers_data + i) = 0;
-                    *(normdistdiff_data + i) = 0;
-                }
+            if (*(nii_rim_data + *(voi_id + ii)) == 3) {
+                gm_row[ii] = gm_voi.size();
+                gm_voi.push_back(ii);
             }
         }
-        // --------------------------------------------------------------------
-        cout << "\n  Saving equivolume metric and layers files..." << endl;
-        save_output_nifti(fout, "metric_equivol", normdistdiff);
-        save_output_nifti(fout, "layers_equivol", nii_layers);
-
-        // ====================================================================
-        // Middle gray matter for equi-volume
-        // ====================================================================
-        cout << "\n  Start finding middle gray matter (equi-volume)..." << endl;
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
+        const int32_t nr_gm = gm_voi.size();
 
-            *(midGM_data + i) = 0;
-            *(midGM_id_data + i) = 0;
-            // Change back normalized dist. differences after saves above
-            if (*(nii_rim_data + i) == 3) {
-                *(normdistdiff_data + i) -= 0.5;
-                *(normdistdiff_data + i) *= 2;
+        const voxel_stencil<6> faces(nii_rim);
+        float face_weight[6];
+        for (int k = 0; k != 6; ++k) {
+            face_weight[k] = 1 / (faces.dist[k] * faces.dist[k]);
+        }
+        laplace_system system;
+        system.row_start.assign(nr_gm + 1, 0);
+        system.diag.assign(nr_gm, 0);
+        system.rhs.assign(nr_gm, 0);
+        vector<double> potential(nr_gm);
+        for (int32_t n = 0; n != nr_gm; ++n) {
+            uint32_t i = *(voi_id + gm_voi[n]);
+            uint32_t nb_j[6];
+            uint8_t nb_k[6];
+            int nr_nb = faces.neighbours(i, nb_j, nb_k);
+            for (int nn = 0; nn != nr_nb; ++nn) {
+                int16_t r = *(nii_rim_data + nb_j[nn]);
+                if (r < 1 || r > 3) continue;
+                float w = face_weight[nb_k[nn]];
+                system.diag[n] += w;
+                if (r == 3) {
+                    system.row_col.push_back(gm_row[voi_pos[nb_j[nn]]]);
+                    system.row_weight.push_back(w);
+                } else if (r == 1) {  // Outer GM border
+                    system.rhs[n] += w;
+                }
             }
+            system.row_start[n + 1] = system.row_col.size();
+            potential[n] = min(max(*(normdist_data + i), 0.f), 1.f);
         }
-
+        cout << "    Gray matter voxels: " << nr_gm << endl;
+
+        double rel_residual;
+        int nr_iter = laplace_solve_cg(system, potential, 1e-6, 10000,
+                                       rel_residual);
+        cout << "    Converged in " << nr_iter << " iterations, relative "
+             << "residual: " << rel_residual << endl;
+
+        // Potential over all rim voxels, borders included
+        nifti_image* metric_laplace = copy_nifti_as_float32(normdist);
+        float* metric_laplace_data = static_cast<float*>(metric_laplace->data);
+        vector<float> phi(nr_voi);
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
             uint32_t i = *(voi_id + ii);
+            int16_t r = *(nii_rim_data + i);
+            phi[ii] = (r == 1) ? 1 : (r == 3) ? potential[gm_row[ii]] : 0;
+            *(metric_laplace_data + i) = phi[ii];
+        }
 
-            if (*(nii_rim_data + i) == 3) {
-                // Check sign changes in normalized distance differences between
-                // neighbouring voxels on a column path (a.k.a. streamline)
-                if (*(normdistdiff_data + i) == 0) {
-                    *(midGM_data + i) = 1;
-                    *(midGM_id_data + i) = i;
-                } else {
-                    float m = *(normdistdiff_data + i);
-                    float n;
-
-                    // Inner neighbour
-                    j = *(innerGM_prevstep_id_data + i);
-                    if (*(nii_rim_data + j) == 3) {
-                        n = *(normdistdiff_data + j);
-                        if (signbit(m) - signbit(n) != 0) {
-                            if (m*m < n*n) {
-                                *(midGM_data + i) = 1;
-                                *(midGM_id_data + i) = i;
-                            } else if (m*m > n*n) {  // Closer to prev. step
-                                *(midGM_data + j) = 1;
-                                *(midGM_id_data + j) = j;
-                            } else {  // Equal +/- normalized distance
-                                *(midGM_data + i) = 1;
-                                *(midGM_id_data + i) = i;
-                                *(midGM_data + j) = 1;
-                                *(midGM_id_data + j) = i;  // On purpose
-                            }
-                        }
-                    }
+        // --------------------------------------------------------------------
+        // Quantize potential to get layers, once for every number of layers
+        // --------------------------------------------------------------------
+        for (size_t n = 0; n != nr_layers_list.size(); ++n) {
+            const uint16_t nr_layers = nr_layers_list[n];
+            quantize_layers(metric_laplace_data, voi_id, nr_voi, nr_layers,
+                            nii_layers_data);
+            handle_layer_borders(nii_rim_data, voi_id, nr_voi, nr_layers,
+                                 mode_incl_borders, nii_layers_data);
+            save_output_nifti(fout, "layers_laplace" + sweep_tag("layers",
+                              nr_layers, nr_layers_list.size() > 1),
+                              nii_layers, true);
+        }
+        handle_metric_borders(nii_rim_data, voi_id, nr_voi, mode_incl_borders,
+                              metric_laplace_data);
+        save_output_nifti(fout, "metric_laplace", metric_laplace, true);
+        pipeline_image_free(metric_laplace);
 
-                    // Outer neighbour
-                    j = *(outerGM_prevstep_id_data + i);
-                    if (*(nii_rim_data + j) == 3) {
-                        n = *(normdistdiff_data + j);
-                        if (signbit(m) - signbit(n) != 0) {
-                            if (m*m < n*n) {
-                                *(midGM_data + i) = 1;
-                                *(midGM_id_data + i) = i;
-                            } else if (m*m > n*n) {  // Closer to prev. step
-                                *(midGM_data + j) = 1;
-                                *(midGM_id_data + j) = j;
-                            } else {  // Equal +/- normalized distance
-                                *(midGM_data + i) = 1;
-                                *(midGM_id_data + i) = i;
-                                *(midGM_data + j) = 1;
-                                *(midGM_id_data + j) = i;  // On purpose
-                            }
-                        }
+        // --------------------------------------------------------------------
+        // Thickness along streamlines of the potential gradient
+        // --------------------------------------------------------------------
+        if (mode_thickness) {
+            log_stage("Start tracing Laplace streamlines for thickness...");
+            // Gradient per rim voxel (per mm), one-sided where the rim ends
+            vector<float> grad(3 * nr_voi, 0);
+            #pragma omp parallel for
+            for (int32_t ii = 0; ii < static_cast<int32_t>(nr_voi); ++ii) {
+                uint32_t i = *(voi_id + ii);
+                uint32_t ix, iy, iz;
+                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
+                const uint32_t coord[3] = {ix, iy, iz};
+                const uint32_t size[3] = {size_x, size_y, size_z};
+                const uint32_t step[3] = {1, size_x, size_x * size_y};
+                const float vox[3] = {dX, dY, dZ};
+                for (int a = 0; a != 3; ++a) {
+                    int32_t lo = coord[a] > 0 ? voi_pos[i - step[a]] : -1;
+                    int32_t hi = coord[a] < size[a] - 1 ? voi_pos[i + step[a]] : -1;
+                    if (lo >= 0 && hi >= 0) {
+                        grad[3 * ii + a] = (phi[hi] - phi[lo]) / (2 * vox[a]);
+                    } else if (hi >= 0) {
+                        grad[3 * ii + a] = (phi[hi] - phi[ii]) / vox[a];
+                    } else if (lo >= 0) {
+                        grad[3 * ii + a] = (phi[ii] - phi[lo]) / vox[a];
                     }
                 }
             }
+
+            nifti_image* thickness = copy_nifti_as_float32(normdist);
+            float* thickness_data = static_cast<float*>(thickness->data);
+            for (uint32_t i = 0; i != nr_voxels; ++i) {
+                *(thickness_data + i) = 0;
+            }
+            const float step_mm = 0.5 * min(dX, min(dY, dZ));
+            const int max_steps = 4 * (size_x + size_y + size_z);
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (int32_t n = 0; n < nr_gm; ++n) {
+                uint32_t i = *(voi_id + gm_voi[n]);
+                float length = 0;
+                for (int sign = -1; sign <= 1; sign += 2) {
+                    length += trace_streamline(i, sign, grad, voi_pos,
+                                               nii_rim_data, size_x, size_y,
+                                               size_z, dX, dY, dZ, step_mm,
+                                               max_steps);
+                }
+                *(thickness_data + i) = length;
+            }
+            save_output_nifti(fout, "thickness_laplace", thickness, true);
+            pipeline_image_free(thickness);
         }
-        save_output_nifti(fout, "midGM_equivol", midGM, true);
     }
 
     // ========================================================================
     // Cortical thickness
     // ========================================================================
     if (mode_thickness) {
-        cout << "\n  Start saving cortical thickness..." << endl;
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            *(innerGM_dist_data + i) += *(outerGM_dist_data + i);
+        log_stage("Start saving cortical thickness...");
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            *(innerGM_dist_data + ii) += *(outerGM_dist_data + ii);
         }
+        nifti_image* thickness_raw = innerGM_dist.to_nifti(nii_rim);
 
         // Temporary binary mask for iterative smoothing
         nifti_image* temp_mask = copy_nifti_as_int16(nii_rim);
@@ -1719,36 +1221,47 @@ int main(int argc, char*  argv[]) {
             }
         }
 
-        nifti_image* thickness = iterative_smoothing(
-            innerGM_dist, iter_smooth, temp_mask, 1);
-        float* thickness_data = static_cast<float*>(thickness->data);
-        free(temp_mask_data);
-        free(temp_mask);
-
-        // --------------------------------------------------------------------
-        // Handle include borders type
-        // --------------------------------------------------------------------
-        if (mode_incl_borders == false) {
-            for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-                uint32_t i = *(voi_id + ii);
-                if (*(nii_rim_data + i) != 3) {
-                    *(thickness_data + i) = 0;
+        nifti_image* thickness_smooth = NULL;
+        for (size_t s = 0; s != iter_smooth_list.size(); ++s) {
+            const uint16_t iter_smooth = iter_smooth_list[s];
+            thickness_smooth = smooth_further(
+                thickness_raw, thickness_smooth,
+                s > 0 ? iter_smooth_list[s - 1] : 0, iter_smooth, temp_mask, 1);
+
+            // Borders are masked on a copy, the smoothing continues from the
+            // unmasked thickness for the next smoothing value.
+            nifti_image* thickness = copy_nifti_as_float32(thickness_smooth);
+            float* thickness_data = static_cast<float*>(thickness->data);
+
+            // ----------------------------------------------------------------
+            // Handle include borders type
+            // ----------------------------------------------------------------
+            if (mode_incl_borders == false) {
+                for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+                    uint32_t i = *(voi_id + ii);
+                    if (*(nii_rim_data + i) != 3) {
+                        *(thickness_data + i) = 0;
+                    }
                 }
             }
+            save_output_nifti(fout, "thickness" + sweep_tag("smooth",
+                              iter_smooth, iter_smooth_list.size() > 1),
+                              thickness, true);
+            pipeline_image_free(thickness);
         }
-        save_output_nifti(fout, "thickness", thickness, true);
-        free(thickness);
-        free(thickness_data);
+        pipeline_image_free(thickness_smooth);
+        pipeline_image_free(thickness_raw);
+        pipeline_image_free(temp_mask);
     }
-
     // ========================================================================
     // Streamline vectors
     // ========================================================================
     if (mode_streamlines) {
-        cout << "\n  Start saving streamline vectors..." << endl;
+        log_stage("Start saving streamline vectors...");
 
         // Prepare a 4D nifti for streamline vectors
         nifti_image* svec = nifti_copy_nim_info(normdist);
+        pipeline_image_track(svec);
         svec->dim[0] = 4;  // For proper 4D nifti
         svec->dim[1] = size_x;
         svec->dim[2] = size_y;
@@ -1766,9 +1279,9 @@ int main(int argc, char*  argv[]) {
 
             if (*(nii_rim_data + i) == 3) {
                 tie(x, y, z) = ind2sub_3D(i, size_x, size_y);
-                tie(wm_x, wm_y, wm_z) = ind2sub_3D(*(innerGM_id_data + i),
+                tie(wm_x, wm_y, wm_z) = ind2sub_3D(*(innerGM_id_data + ii),
                                                    size_x, size_y);
-                tie(gm_x, gm_y, gm_z) = ind2sub_3D(*(outerGM_id_data + i),
+                tie(gm_x, gm_y, gm_z) = ind2sub_3D(*(outerGM_id_data + ii),
                                                    size_x, size_y);
 
                 // Vector 1 [white matter to center]
@@ -1806,11 +1319,19 @@ int main(int argc, char*  argv[]) {
             }
         }
         // --------------------------------------------------------------------
-        cout << "\n  Start smoothing streamline vector components..." << endl;
-        svec = iterative_smoothing(svec, iter_smooth, nii_rim, 3);
-        // --------------------------------------------------------------------
-        save_output_nifti(fout, "streamline_vectors", svec, true);
-        free(svec);
+        nifti_image* svec_smooth = NULL;
+        for (size_t s = 0; s != iter_smooth_list.size(); ++s) {
+            const uint16_t iter_smooth = iter_smooth_list[s];
+            log_stage("Start smoothing streamline vector components...");
+            svec_smooth = smooth_further(
+                svec, svec_smooth, s > 0 ? iter_smooth_list[s - 1] : 0,
+                iter_smooth, nii_rim, 3);
+            save_output_nifti(fout, "streamline_vectors" + sweep_tag("smooth",
+                              iter_smooth, iter_smooth_list.size() > 1),
+                              svec_smooth, true);
+        }
+        pipeline_image_free(svec_smooth);
+        pipeline_image_free(svec);
     }
 
     // ========================================================================
@@ -1830,38 +1351,46 @@ int main(int argc, char*  argv[]) {
     // Smooth curvature
     // --------------------------------------------------------------------
     if (mode_curvature) {
-        cout << "\n  Start smoothing curvature..." << endl;
+        nifti_image* curvature_smooth = NULL;
+        for (size_t s = 0; s != iter_smooth_list.size(); ++s) {
+            const uint16_t iter_smooth = iter_smooth_list[s];
+            const string smooth_tag = sweep_tag("smooth", iter_smooth,
+                                                iter_smooth_list.size() > 1);
+            log_stage("Start smoothing curvature...");
 
-        nifti_image* curvature_smooth = iterative_smoothing(
-            curvature, iter_smooth, nii_rim, 3);
-        float* curvature_smooth_data = static_cast<float*>(curvature_smooth->data);
+            curvature_smooth = smooth_further(
+                curvature, curvature_smooth,
+                s > 0 ? iter_smooth_list[s - 1] : 0, iter_smooth, nii_rim, 3);
+            float* curvature_smooth_data = static_cast<float*>(curvature_smooth->data);
 
-        save_output_nifti(fout, "curvature", curvature_smooth, true);
+            save_output_nifti(fout, "curvature" + smooth_tag, curvature_smooth, true);
 
-        // Quantize curvature
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
+            // Quantize curvature
+            for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+                uint32_t i = *(voi_id + ii);
 
-            if (*(nii_rim_data + i) == 3) {
+                if (*(nii_rim_data + i) == 3) {
 
-                // 2 class binning
-                if (*(curvature_smooth_data + i) < 0) {  // Sulcus
-                    *(nii_columns_data + i) = 1;
-                } else {  // Gyrus
-                    *(nii_columns_data + i) = 2;
-                }
+                    // 2 class binning
+                    if (*(curvature_smooth_data + i) < 0) {  // Sulcus
+                        *(nii_columns_data + i) = 1;
+                    } else {  // Gyrus
+                        *(nii_columns_data + i) = 2;
+                    }
 
-                // // 3 class binning
-                // if (*(curvature_smooth_data + i) < -1./3.) {  // Sulcal fundi
-                //     *(nii_columns_data + i) = 1;
-                // } else if (*(curvature_smooth_data + i) > 1./3.) {  // Gyral crown
-                //     *(nii_columns_data + i) = 3;
-                // } else {  // Walls
-                //     *(nii_columns_data + i) = 2;
-                // }
+                    // // 3 class binning
+                    // if (*(curvature_smooth_data + i) < -1./3.) {  // Sulcal fundi
+                    //     *(nii_columns_data + i) = 1;
+                    // } else if (*(curvature_smooth_data + i) > 1./3.) {  // Gyral crown
+                    //     *(nii_columns_data + i) = 3;
+                    // } else {  // Walls
+                    //     *(nii_columns_data + i) = 2;
+                    // }
+                }
             }
+            save_output_nifti(fout, "curvature_binned" + smooth_tag, nii_columns, true);
         }
-        save_output_nifti(fout, "curvature_binned", nii_columns, true);
+        pipeline_image_free(curvature_smooth);
     }
 
     cout << "\n  Finished." << endl;
@@ -35,6 +35,7 @@ int show_help(void) {
     "                  !!!WARNING!!! this option is not well tested for version 1.5\n"
     "    -output     : (Optional) Output filename, including .nii or\n"
     "                  .nii.gz, and path if needed. Overwrites existing files.\n"    
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -51,6 +52,10 @@ int main(int argc, char* argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layer_file")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -layer_file\n");
@@ -101,13 +106,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Read inputs including data
-    nifti_image* nii1 = nifti_image_read(f_input, 1);
+    nifti_image* nii1 = pipeline_image_read(f_input, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_input);
         return 2;
     }
 
-    nifti_image* nii2 = nifti_image_read(f_layer, 1);
+    nifti_image* nii2 = pipeline_image_read(f_layer, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", f_layer);
         return 2;
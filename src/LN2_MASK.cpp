@@ -32,6 +32,7 @@ int show_help(void) {
     "                .nii.gz, and path if needed. Overwrites existing files.\n"
     "    -abs      : (Optional) if you want to also consider negative score values\n"
     "                use this option.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - This refers to layerfMRI artifact here: \n"
@@ -54,6 +55,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-scores")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -scores\n");
@@ -107,12 +112,12 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
@@ -36,6 +36,7 @@ int show_help(void) {
     "    -angles         : (Optional) Save angles in radians and 4 quadrants.\n"
     "    -debug          : (Optional) Save extra intermediate outputs.\n"
     "    -output         : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - Outputs of this program is often used with LN2_PATCH_FLATTEN.\n"
@@ -51,6 +52,84 @@ int show_help(void) {
     return 0;
 }
 
+// ============================================================================
+// Multi-channel flooding over the voxels of interest (midgm). Independent
+// floods are grown together as channels of one flood. The channel values of a
+// voxel are stored next to each other, so every neighbour update is applied to
+// all channels at once instead of sweeping the volume once per flood.
+// ============================================================================
+struct voi_neighbours {
+    vector<uint32_t> start;  // Per voxel of interest, offset into pos & dist
+    vector<uint32_t> pos;    // Neighbour index within the voxels of interest
+    vector<float> dist;      // Neighbour distance in mm
+};
+
+void find_voi_neighbours(const int32_t* voi_id, const uint32_t nr_voi,
+                         const voxel_stencil<26>& stencil,
+                         voi_neighbours& nb) {
+    // Map full set to subset, -1 outside of the voxels of interest
+    const voi_index voi(voi_id, nr_voi,
+                        stencil.size_x * stencil.size_y * stencil.size_z);
+    const vector<int32_t>& voi_pos = voi.compact;
+
+    nb.start.assign(nr_voi + 1, 0);
+    nb.pos.clear();
+    nb.dist.clear();
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        uint32_t nb_j[26];
+        uint8_t nb_k[26];
+        int nr_nb = stencil.neighbours(*(voi_id + ii), nb_j, nb_k);
+        for (int nn = 0; nn != nr_nb; ++nn) {
+            if (voi_pos[nb_j[nn]] < 0) continue;
+            nb.pos.push_back(voi_pos[nb_j[nn]]);
+            nb.dist.push_back(stencil.dist[nb_k[nn]]);
+        }
+        nb.start[ii + 1] = nb.pos.size();
+    }
+}
+
+template <int C>
+void flood_channels(const voi_neighbours& nb, const uint32_t nr_voi,
+                    float* dist, int32_t* step) {
+    // dist and step hold C channels per voxel of interest (ii * C + c). Flood
+    // sources are at step 1 with a non-zero distance, the rest is zero.
+    // Voxels are visited in the same order as the single channel
+    // flood, hence every channel ends up with exactly the same distances.
+    int32_t grow_step = 1;
+    uint32_t voxel_counter = 1;
+    while (voxel_counter != 0) {
+        voxel_counter = 0;
+        timing_count(static_cast<uint64_t>(nr_voi) * C);
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            const float* dist_i = dist + static_cast<size_t>(ii) * C;
+            const int32_t* step_i = step + static_cast<size_t>(ii) * C;
+            bool active[C];
+            uint32_t nr_active = 0;
+            for (int c = 0; c != C; ++c) {
+                active[c] = *(step_i + c) == grow_step;
+                nr_active += active[c];
+            }
+            if (nr_active == 0) continue;
+            voxel_counter += nr_active;
+
+            for (uint32_t k = nb.start[ii]; k != nb.start[ii + 1]; ++k) {
+                float* dist_j = dist + static_cast<size_t>(nb.pos[k]) * C;
+                int32_t* step_j = step + static_cast<size_t>(nb.pos[k]) * C;
+                const float w = nb.dist[k];
+                #pragma omp simd
+                for (int c = 0; c < C; ++c) {
+                    float d = *(dist_i + c) + w;
+                    bool update = active[c]
+                        && (d < *(dist_j + c) || *(dist_j + c) == 0);
+                    *(dist_j + c) = update ? d : *(dist_j + c);
+                    *(step_j + c) = update ? grow_step + 1 : *(step_j + c);
+                }
+            }
+        }
+        grow_step += 1;
+    }
+}
+
 int main(int argc, char*  argv[]) {
 
     nifti_image *nii1 = NULL, *nii2 = NULL;
@@ -65,6 +144,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-rim")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -rim\n");
@@ -116,12 +199,12 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
@@ -146,18 +229,18 @@ int main(int argc, char*  argv[]) {
     const float dY = nii1->pixdim[2];
     const float dZ = nii1->pixdim[3];
 
-    // Short diagonals
-    const float dia_xy = sqrt(dX * dX + dY * dY);
-    const float dia_xz = sqrt(dX * dX + dZ * dZ);
-    const float dia_yz = sqrt(dY * dY + dZ * dZ);
     // Long diagonals
     const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
 
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
+    const voxel_stencil<6> nb6(nii1);
+
     // ========================================================================
     // Fix input datatype issues
     nifti_image* nii_rim = copy_nifti_as_int32(nii1);
     int32_t* nii_rim_data = static_cast<int32_t*>(nii_rim->data);
-    free(nii1);
+    pipeline_image_free(nii1);
     // ------------------------------------------------------------------------
     // Include borders adjustment to rim labels
     if (mode_incl_borders) {
@@ -171,7 +254,7 @@ int main(int argc, char*  argv[]) {
     // Control points file (modified middle gray matter)
     nifti_image* control_points = copy_nifti_as_int32(nii2);
     int32_t* control_points_data = static_cast<int32_t*>(control_points->data);
-    free(nii2);
+    pipeline_image_free(nii2);
 
     // Prepare flood fill related nifti images
     nifti_image* flood_step = copy_nifti_as_int32(nii_rim);
@@ -192,6 +275,7 @@ int main(int argc, char*  argv[]) {
     // ------------------------------------------------------------------------
     // Create a 4D nifti image for point distances
     nifti_image* point_dist = nifti_copy_nim_info(flood_dist);
+    pipeline_image_track(point_dist);
     point_dist->dim[0] = 4;  // For proper 4D nifti
     point_dist->dim[1] = size_x;
     point_dist->dim[2] = size_y;
@@ -205,6 +289,7 @@ int main(int argc, char*  argv[]) {
 
     // Create a 4D nifti image for UV coordinates
     nifti_image* point_coords = nifti_copy_nim_info(flood_dist);
+    pipeline_image_track(point_coords);
     point_coords->dim[0] = 4;  // For proper 4D nifti
     point_coords->dim[1] = size_x;
     point_coords->dim[2] = size_y;
@@ -224,13 +309,6 @@ int main(int argc, char*  argv[]) {
     nifti_image* pin_coords = copy_nifti_as_float32(point_coords);
     float* pin_coords_data = static_cast<float*>(pin_coords->data);
 
-    // ------------------------------------------------------------------------
-    // Final voronoi volume to output midgm distances for whole rim
-    nifti_image* voronoi = copy_nifti_as_float32(flood_dist);
-    float* voronoi_data = static_cast<float*>(voronoi->data);
-    nifti_image* smooth = copy_nifti_as_float32(flood_dist);
-    float* smooth_data = static_cast<float*>(smooth->data);
-
     // ------------------------------------------------------------------------
     // NOTE(Faruk): This section is written to constrain the big iterative
     // flooding distance loop to the subset of voxels. Required for substantial
@@ -284,7 +362,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Initial flood from centroid
     // ========================================================================
-    cout << "\n  Checking control points..." << endl;
+    log_stage("Checking control points...");
     // Find the initial voxel
     uint32_t control_point0;  // Origin
     uint32_t control_point1 = 0, control_point2 = 0;  // First extrema pair
@@ -329,7 +407,7 @@ int main(int argc, char*  argv[]) {
     float d;
 
     if (!mode_custom_extrema) {
-        cout << "\n  Computing control point 0 distances..." << endl;
+        log_stage("Computing control point 0 distances...");
         // Initialize grow volume
         for (uint32_t i = 0; i != nr_voxels; ++i) {
             if (*(control_points_data + i) == 2) {
@@ -340,322 +418,19 @@ int main(int argc, char*  argv[]) {
 
         while (voxel_counter != 0) {
             voxel_counter = 0;
+            timing_count(nr_voi);
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                 i = *(voi_id + ii);  // Map subset to full set
                 if (*(flood_step_data + i) == grow_step) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
                     voxel_counter += 1;
 
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
+                    uint32_t nb_j[26];
+                    uint8_t nb_k[26];
+                    int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                    for (int nn = 0; nn != nr_nb; ++nn) {
+                        j = nb_j[nn];
                         if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
+                            d = *(flood_dist_data + i) + nb.dist[nb_k[nn]];
                             if (d < *(flood_dist_data + j)
                                 || *(flood_dist_data + j) == 0) {
                                 *(flood_dist_data + j) = d;
@@ -676,7 +451,7 @@ int main(int argc, char*  argv[]) {
         // ========================================================================
         // Find perimeter
         // ========================================================================
-        cout << "\n  Finding perimeter..." << endl;
+        log_stage("Finding perimeter...");
 
         // Translate 0 crossing
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
@@ -1140,7 +915,7 @@ int main(int argc, char*  argv[]) {
         // ====================================================================
         // Find control point extrema and compute distances on midgm domain
         // ====================================================================
-        cout << "\n  Computing control points 1 to 4..." << endl;
+        log_stage("Computing control points 1 to 4...");
         if (mode_custom_extrema) {
             cout << "    Using custom extrema control points." << endl;
         } else {
@@ -1158,7 +933,7 @@ int main(int argc, char*  argv[]) {
             for (int32_t n = 4; n < 7; ++n) {
                 int32_t grow_step = 1;
                 uint32_t voxel_counter = nr_voxels;
-                uint32_t ix, iy, iz, i, j;
+                uint32_t i, j;
                 float d;
 
                 // Initialize grow volume
@@ -1177,322 +952,19 @@ int main(int argc, char*  argv[]) {
                 voxel_counter = nr_voxels;
                 while (voxel_counter != 0) {
                     voxel_counter = 0;
+                    timing_count(nr_voi);
                     for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                         i = *(voi_id + ii);  // Map subset to full set
                         if (*(flood_step_data + i) == grow_step) {
-                            tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
                             voxel_counter += 1;
 
-                            // ------------------------------------------------
-                            // 1-jump neighbours
-                            // ------------------------------------------------
-                            if (ix > 0) {
-                                j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dX;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x) {
-                                j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
+                            uint32_t nb_j[26];
+                            uint8_t nb_k[26];
+                            int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                            for (int nn = 0; nn != nr_nb; ++nn) {
+                                j = nb_j[nn];
                                 if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dX;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy > 0) {
-                                j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dY;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy < end_y) {
-                                j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dY;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iz > 0) {
-                                j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dZ;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iz < end_z) {
-                                j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dZ;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            // ------------------------------------------------
-                            // 2-jump neighbours
-                            // ------------------------------------------------
-                            if (ix > 0 && iy > 0) {
-                                j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xy;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iy < end_y) {
-                                j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xy;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy > 0) {
-                                j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xy;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy < end_y) {
-                                j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xy;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy > 0 && iz > 0) {
-                                j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_yz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy > 0 && iz < end_z) {
-                                j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_yz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy < end_y && iz > 0) {
-                                j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_yz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (iy < end_y && iz < end_z) {
-                                j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_yz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iz > 0) {
-                                j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iz > 0) {
-                                j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iz < end_z) {
-                                j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iz < end_z) {
-                                j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-
-                            // ------------------------------------------------
-                            // 3-jump neighbours
-                            // ------------------------------------------------
-                            if (ix > 0 && iy > 0 && iz > 0) {
-                                j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iy > 0 && iz < end_z) {
-                                j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iy < end_y && iz > 0) {
-                                j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy > 0 && iz > 0) {
-                                j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix > 0 && iy < end_y && iz < end_z) {
-                                j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy > 0 && iz < end_z) {
-                                j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy < end_y && iz > 0) {
-                                j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
-                                    if (d < *(flood_dist_data + j)
-                                        || *(flood_dist_data + j) == 0) {
-                                        *(flood_dist_data + j) = d;
-                                        *(flood_step_data + j) = grow_step + 1;
-                                    }
-                                }
-                            }
-                            if (ix < end_x && iy < end_y && iz < end_z) {
-                                j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                                if (*(perimeter_data + j) == 2) {
-                                    d = *(flood_dist_data + i) + dia_xyz;
+                                    d = *(flood_dist_data + i) + nb.dist[nb_k[nn]];
                                     if (d < *(flood_dist_data + j)
                                         || *(flood_dist_data + j) == 0) {
                                         *(flood_dist_data + j) = d;
@@ -1529,368 +1001,52 @@ int main(int argc, char*  argv[]) {
     // Compute flood distances from each extrema control points
     // ========================================================================
     cout << "  Computing control point (1 to 4) distances..." << endl;
-    for (int p = 3; p < 7; ++p) {
-        cout << "    Relative to control point" + std::to_string(p-2) + "..." << endl;
-        // Initialize grow volume
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            if (*(control_points_data + i) == p) {
-                *(flood_step_data + i) = 1.;
-                *(flood_dist_data + i) = 1.;
-            } else {
-                *(flood_step_data + i) = 0.;
-                *(flood_dist_data + i) = 0.;
+    voi_neighbours voi_nb;
+    find_voi_neighbours(voi_id, nr_voi, nb, voi_nb);
+
+    // Control points 1 to 4 are flooded together as 4 channels
+    vector<float> point_flood_dist(nr_voi * 4, 0);
+    vector<int32_t> point_flood_step(nr_voi * 4, 0);
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        i = *(voi_id + ii);  // Map subset to full set
+        for (int p = 0; p != 4; ++p) {
+            if (*(control_points_data + i) == p + 3) {
+                point_flood_step[ii * 4 + p] = 1;
+                point_flood_dist[ii * 4 + p] = 1.;
             }
         }
+    }
+    flood_channels<4>(voi_nb, nr_voi, point_flood_dist.data(),
+                      point_flood_step.data());
 
-        // Reset some parameters
-        grow_step = 1;
-        voxel_counter = nr_voxels;
+    for (int p = 0; p != 4; ++p) {
+        // Record distances into a 4D nifti
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            i = *(voi_id + ii);  // Map subset to full set
+            *(point_dist_data + nr_voxels*p + i) = point_flood_dist[ii * 4 + p];
+        }
 
-        while (voxel_counter != 0) {
-            voxel_counter = 0;
+        if (mode_debug) {
+            // Control points outside of midgm keep their initial distance
+            for (uint32_t i = 0; i != nr_voxels; ++i) {
+                if (*(control_points_data + i) == p + 3) {
+                    *(flood_dist_data + i) = 1.;
+                } else {
+                    *(flood_dist_data + i) = 0.;
+                }
+            }
             for (uint32_t ii = 0; ii != nr_voi; ++ii) {
                 i = *(voi_id + ii);  // Map subset to full set
-                if (*(flood_step_data + i) == grow_step) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                    voxel_counter += 1;
-
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) > 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                }
-            }
-            grow_step += 1;
-        }
-
-        if (mode_debug) {
-            save_output_nifti(fout, "control_point" + std::to_string(p-2) + "_dist", flood_dist, false);
-        }
-
-        // Record distances into a 4D nifti
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            i = *(voi_id + ii);  // Map subset to full set
-            *(point_dist_data + nr_voxels*(p-3) + i) = *(flood_dist_data + i);
-        }
-    }
+                *(flood_dist_data + i) = point_flood_dist[ii * 4 + p];
+            }
+            save_output_nifti(fout, "control_point" + std::to_string(p+1) + "_dist", flood_dist, false);
+        }
+    }
 
     // ------------------------------------------------------------------------
     // Derive coordinates from control point (1, 2, 3, 4) distances
     // ------------------------------------------------------------------------
-    cout << "\n  Computing control point coordinates..." << endl;
+    log_stage("Computing control point coordinates...");
     // Subtract distances pair-wise to get axis coordinates
     for (uint32_t t = 0; t != 2; ++t) {
         for (uint32_t ii = 0; ii != nr_voi; ++ii) {
@@ -1918,852 +1074,178 @@ int main(int argc, char*  argv[]) {
         save_output_nifti(fout, "control_point_coordinates", point_coords, true);
     }
 
-    // ========================================================================
-    // Find rolling pin axes
-    // ========================================================================
-    cout << "\n  Finding pin axes..." << endl;
-    for (uint32_t i = 0; i != nr_voxels; ++i) {
-        *(pin_axes_data + nr_voxels * 0 + i) = 0;
-        *(pin_axes_data + nr_voxels * 1 + i) = 0;
-    }
-
-    for (uint32_t t = 0; t != 2; ++t) {
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            uint32_t i = *(voi_id + ii);
-            tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-
-            // Check sign changes in normalized distance differences between
-            // neighbouring voxels
-            float m = *(point_coords_data + nr_voxels * t + i);
-            float n;
-
-            // ------------------------------------------------------------
-            // 1-jump neighbours
-            // ------------------------------------------------------------
-            if (ix > 0) {
-                j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-            if (ix < end_x) {
-                j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-            if (iy > 0) {
-                j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-            if (iy < end_y) {
-                j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-            if (iz > 0) {
-                j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-            if (iz < end_z) {
-                j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                n = *(point_coords_data + nr_voxels * t + j);
-                if (*(control_points_data + j) != 0) {
-                    if (signbit(m) - signbit(n) != 0) {
-                        *(pin_axes_data + nr_voxels * t + i) = 1;
-                    }
-                }
-            }
-        }
-    }
-    if (mode_debug) {
-        save_output_nifti(fout, "pin_axes", pin_axes, true);
-    }
-
-    // ========================================================================
-    // Compute flood distances relative to pin axes
-    // ========================================================================
-    cout << "\n  Computing pin axis distances..." << endl;
-    for (int p = 0; p != 2; ++p) {
-        cout << "    Relative to pin axis " + std::to_string(p+1) + "/2..." << endl;
-
-        // TODO(Faruk): Guesstimate an initial distance to axis lines. Probably
-        // I can do this better by considering the local neighbourhood in the
-        // future.
-        float dist_to_axes = ((dX + dY + dZ) / 3) / 2;  // Half a voxel
-
-        // Initialize grow volume
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            if (*(pin_axes_data + nr_voxels * p + i) != 0) {
-                *(flood_step_data + i) = 1.;
-                *(flood_dist_data + i) = dist_to_axes;
-            } else {
-                *(flood_step_data + i) = 0.;
-                *(flood_dist_data + i) = 0.;
-            }
-        }
-
-        // Reset some parameters
-        grow_step = 1;
-        voxel_counter = nr_voxels;
-
-        while (voxel_counter != 0) {
-            voxel_counter = 0;
-            for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-                i = *(voi_id + ii);  // Map subset to full set
-                if (*(flood_step_data + i) == grow_step) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                    voxel_counter += 1;
-
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y) {
-                        j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y) {
-                        j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 3-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0 && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix > 0 && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy > 0 && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz > 0) {
-                        j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                    if (ix < end_x && iy < end_y && iz < end_z) {
-                        j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-
-                        if (*(control_points_data + j) != 0) {
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                            }
-                        }
-                    }
-                }
-            }
-            grow_step += 1;
-        }
-
-        if (mode_debug) {
-            save_output_nifti(fout, "pin_axis" + std::to_string(p+1) + "_dist", flood_dist, true);
-        }
-
-        // Save distances into 4D nifti
-        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-            i = *(voi_id + ii);  // Map subset to full set
-            // Transfer signs onto pin distances to convert them to coordinates
-            if (*(point_coords_data + nr_voxels * p + i) < 0) {
-                *(pin_coords_data + nr_voxels * p + i) = -*(flood_dist_data + i);
-            } else {
-                *(pin_coords_data + nr_voxels * p + i) = *(flood_dist_data + i);
-            }
-        }
-    }
-
-    if (mode_debug) {
-        save_output_nifti(fout, "pin_coordinates", pin_coords, true);
-    }
-
-    // ========================================================================
-    // Final Voronoi for propagating distances to all gray matter
-    // ========================================================================
-    cout << "\n  Start Voronoi propagation..." << endl;
-    for (uint32_t t = 0; t != 2; ++t) {
-        cout << "    Doing coordinate " + std::to_string(t+1) + "/2..." << endl;
-        // Initialize grow volume
-        for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
-            i = *(voi_id2 + iii);  // Map subset to full set
-            if (*(pin_coords_data + nr_voxels*t + i) != 0) {
-                *(voronoi_data + i) = *(pin_coords_data + nr_voxels*t + i);
-                *(flood_step_data + i) = 1.;
-                *(flood_dist_data + i) = 1.;
-            } else {
-                *(voronoi_data + i) = 0;
-                *(flood_step_data + i) = 0.;
-                *(flood_dist_data + i) = 0.;
-            }
-        }
-
-        grow_step = 1;
-        voxel_counter = nr_voxels;
-
-        while (voxel_counter != 0) {
-            voxel_counter = 0;
-            for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
-                i = *(voi_id2 + iii);
-                if (*(flood_step_data + i) == grow_step) {
-                    tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
-                    voxel_counter += 1;
-
-                    bool jump_lock = false;
-                    // --------------------------------------------------------
-                    // 1-jump neighbours
-                    // --------------------------------------------------------
-                    if (ix > 0) {
-                        j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-                    if (ix < end_x) {
-                        j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-                    if (iy > 0) {
-                        j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-                    if (iy < end_y) {
-                        j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-                    if (iz > 0) {
-                        j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-                    if (iz < end_z) {
-                        j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-
-                        if (*(nii_rim_data + j) == 3) {
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(voronoi_data + j) = *(voronoi_data + i);
-                            }
-                        } else if (*(nii_rim_data + j) != 0) {
-                            jump_lock = true;
-                        }
-                    }
-
-                    // --------------------------------------------------------
-                    // 2-jump neighbours
-                    // --------------------------------------------------------
-                    if (jump_lock == false) {
-
-                        if (ix > 0 && iy > 0) {
-                            j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xy;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iy < end_y) {
-                            j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xy;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iy > 0) {
-                            j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xy;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iy < end_y) {
-                            j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xy;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_yz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_yz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_yz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_yz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
+    // ========================================================================
+    // Find rolling pin axes
+    // ========================================================================
+    log_stage("Finding pin axes...");
+    for (uint32_t i = 0; i != nr_voxels; ++i) {
+        *(pin_axes_data + nr_voxels * 0 + i) = 0;
+        *(pin_axes_data + nr_voxels * 1 + i) = 0;
+    }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
+    for (uint32_t t = 0; t != 2; ++t) {
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            uint32_t i = *(voi_id + ii);
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
+            // Check sign changes in normalized distance differences between
+            // neighbouring voxels
+            float m = *(point_coords_data + nr_voxels * t + i);
+            float n;
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
+            uint32_t nb_j[6];
+            uint8_t nb_k[6];
+            int nr_nb = nb6.neighbours(i, nb_j, nb_k);
+            for (int nn = 0; nn != nr_nb; ++nn) {
+                j = nb_j[nn];
+                n = *(point_coords_data + nr_voxels * t + j);
+                if (*(control_points_data + j) != 0) {
+                    if (signbit(m) - signbit(n) != 0) {
+                        *(pin_axes_data + nr_voxels * t + i) = 1;
+                    }
+                }
+            }
+        }
+    }
+    if (mode_debug) {
+        save_output_nifti(fout, "pin_axes", pin_axes, true);
+    }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
+    // ========================================================================
+    // Compute flood distances relative to pin axes
+    // ========================================================================
+    log_stage("Computing pin axis distances...");
+
+    // TODO(Faruk): Guesstimate an initial distance to axis lines. Probably
+    // I can do this better by considering the local neighbourhood in the
+    // future.
+    float dist_to_axes = ((dX + dY + dZ) / 3) / 2;  // Half a voxel
+
+    // Both pin axes are flooded together as 2 channels
+    vector<float> pin_flood_dist(nr_voi * 2, 0);
+    vector<int32_t> pin_flood_step(nr_voi * 2, 0);
+    for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+        i = *(voi_id + ii);  // Map subset to full set
+        for (int p = 0; p != 2; ++p) {
+            if (*(pin_axes_data + nr_voxels * p + i) != 0) {
+                pin_flood_step[ii * 2 + p] = 1;
+                pin_flood_dist[ii * 2 + p] = dist_to_axes;
+            }
+        }
+    }
+    flood_channels<2>(voi_nb, nr_voi, pin_flood_dist.data(),
+                      pin_flood_step.data());
 
-                        // ----------------------------------------------------
-                        // 3-jump neighbours
-                        // ----------------------------------------------------
-                        if (ix > 0 && iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
+    for (int p = 0; p != 2; ++p) {
+        // Flood volumes hold the last channel afterwards, as before
+        for (uint32_t i = 0; i != nr_voxels; ++i) {
+            *(flood_step_data + i) = 0;
+            *(flood_dist_data + i) = 0;
+        }
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            i = *(voi_id + ii);  // Map subset to full set
+            *(flood_step_data + i) = pin_flood_step[ii * 2 + p];
+            *(flood_dist_data + i) = pin_flood_dist[ii * 2 + p];
+        }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
+        if (mode_debug) {
+            save_output_nifti(fout, "pin_axis" + std::to_string(p+1) + "_dist", flood_dist, true);
+        }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
+        // Save distances into 4D nifti
+        for (uint32_t ii = 0; ii != nr_voi; ++ii) {
+            i = *(voi_id + ii);  // Map subset to full set
+            // Transfer signs onto pin distances to convert them to coordinates
+            if (*(point_coords_data + nr_voxels * p + i) < 0) {
+                *(pin_coords_data + nr_voxels * p + i) = -*(flood_dist_data + i);
+            } else {
+                *(pin_coords_data + nr_voxels * p + i) = *(flood_dist_data + i);
+            }
+        }
+    }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
+    if (mode_debug) {
+        save_output_nifti(fout, "pin_coordinates", pin_coords, true);
+    }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix > 0 && iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
+    // ========================================================================
+    // Final Voronoi for propagating distances to all gray matter
+    // ========================================================================
+    log_stage("Start Voronoi propagation...");
+    // Voronoi and smoothing values are only kept for the rim (3) voxels,
+    // indexed by iii
+    const voi_index voi2(voi_id2, nr_voi2, nr_voxels);
+    voi_array<int32_t> voronoi_step(voi2);
+    voi_array<float> voronoi_dist(voi2);
+    voi_array<float> voronoi(voi2);
+    voi_array<float> smooth(voi2);
+    const int32_t* voi2_compact = voi2.compact.data();
+    int32_t* voronoi_step_data = voronoi_step.data.data();
+    float* voronoi_dist_data = voronoi_dist.data.data();
+    float* voronoi_data = voronoi.data.data();
+    float* smooth_data = smooth.data.data();
+    int32_t jjj;
+    for (uint32_t t = 0; t != 2; ++t) {
+        cout << "    Doing coordinate " + std::to_string(t+1) + "/2..." << endl;
+        // Initialize grow volume
+        for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
+            i = *(voi_id2 + iii);  // Map subset to full set
+            if (*(pin_coords_data + nr_voxels*t + i) != 0) {
+                *(voronoi_data + iii) = *(pin_coords_data + nr_voxels*t + i);
+                *(voronoi_step_data + iii) = 1;
+                *(voronoi_dist_data + iii) = 1.;
+            } else {
+                *(voronoi_data + iii) = 0;
+                *(voronoi_step_data + iii) = 0;
+                *(voronoi_dist_data + iii) = 0.;
+            }
+        }
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
+        grow_step = 1;
+        voxel_counter = nr_voxels;
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
-                            }
-                        }
-                        if (ix < end_x && iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
+        while (voxel_counter != 0) {
+            voxel_counter = 0;
+            timing_count(nr_voi2);
+            for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
+                i = *(voi_id2 + iii);
+                if (*(voronoi_step_data + iii) == grow_step) {
+                    voxel_counter += 1;
 
-                            if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
-                                }
+                    bool jump_lock = false;
+                    uint32_t nb_j[26];
+                    uint8_t nb_k[26];
+                    int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                    int nn = 0;
+                    for (; nn != nr_nb && nb_k[nn] < 6; ++nn) {
+                        j = nb_j[nn];
+                        if (*(nii_rim_data + j) == 3) {
+                            jjj = *(voi2_compact + j);
+                            d = *(voronoi_dist_data + iii) + nb.dist[nb_k[nn]];
+                            if (d < *(voronoi_dist_data + jjj)
+                                || *(voronoi_dist_data + jjj) == 0) {
+                                *(voronoi_dist_data + jjj) = d;
+                                *(voronoi_step_data + jjj) = grow_step + 1;
+                                *(voronoi_data + jjj) = *(voronoi_data + iii);
                             }
+                        } else if (*(nii_rim_data + j) != 0) {
+                            jump_lock = true;
                         }
-                        if (ix < end_x && iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+                    }
 
+                    // --------------------------------------------------------
+                    // 2-jump and 3-jump neighbours
+                    // --------------------------------------------------------
+                    if (jump_lock == false) {
+                        for (; nn != nr_nb; ++nn) {
+                            j = nb_j[nn];
                             if (*(nii_rim_data + j) == 3) {
-                                d = *(flood_dist_data + i) + dia_xyz;
-                                if (d < *(flood_dist_data + j)
-                                    || *(flood_dist_data + j) == 0) {
-                                    *(flood_dist_data + j) = d;
-                                    *(flood_step_data + j) = grow_step + 1;
-                                    *(voronoi_data + j) = *(voronoi_data + i);
+                                jjj = *(voi2_compact + j);
+                                d = *(voronoi_dist_data + iii) + nb.dist[nb_k[nn]];
+                                if (d < *(voronoi_dist_data + jjj)
+                                    || *(voronoi_dist_data + jjj) == 0) {
+                                    *(voronoi_dist_data + jjj) = d;
+                                    *(voronoi_step_data + jjj) = grow_step + 1;
+                                    *(voronoi_data + jjj) = *(voronoi_data + iii);
                                 }
                             }
                         }
@@ -2776,7 +1258,7 @@ int main(int argc, char*  argv[]) {
         // Record into 4D nifti
         for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
             i = *(voi_id2 + iii);  // Map subset to full set
-            *(pin_coords_data + nr_voxels * t + i) = *(voronoi_data + i);
+            *(pin_coords_data + nr_voxels * t + i) = *(voronoi_data + iii);
         }
     }
 
@@ -2787,82 +1269,47 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Smooth coordinates
     // ========================================================================
-    cout << "\n  Smoothing coordinates..." << endl;
+    log_stage("Smoothing coordinates...");
     for (uint32_t t = 0; t != 2; ++t) {
         cout << "    Doing coordinate " + std::to_string(t+1) + "/2..." << endl;
-        for (uint32_t i = 0; i != nr_voxels; ++i) {
-            *(smooth_data + i) = 0;
+        for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
+            *(smooth_data + iii) = 0;
         }
 
         // Pre-compute weights
         float FWHM_val = 1;  // TODO(Faruk): Might tweak this one
         float w_0 = gaus(0, FWHM_val);
-        float w_dX = gaus(dX, FWHM_val);
-        float w_dY = gaus(dY, FWHM_val);
-        float w_dZ = gaus(dZ, FWHM_val);
+        float w_nb[6];
+        for (int k = 0; k != 6; ++k) {
+            w_nb[k] = gaus(nb6.dist[k], FWHM_val);
+        }
 
         for (uint16_t n = 0; n != 2; ++n) {
             for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
                 i = *(voi_id2 + iii);
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
                 float new_val = 0, total_weight = 0;
 
                 // Start with the voxel itself
                 new_val += *(pin_coords_data + nr_voxels * t + i) * w_0;
                 total_weight += w_0;
 
-                // ------------------------------------------------------------
-                // 1-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dX;
-                        total_weight += w_dX;
-                    }
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dX;
-                        total_weight += w_dX;
-                    }
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
+                uint32_t nb_j[6];
+                uint8_t nb_k[6];
+                int nr_nb = nb6.neighbours(i, nb_j, nb_k);
+                for (int nn = 0; nn != nr_nb; ++nn) {
+                    j = nb_j[nn];
                     if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dY;
-                        total_weight += w_dY;
+                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_nb[nb_k[nn]];
+                        total_weight += w_nb[nb_k[nn]];
                     }
                 }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dY;
-                        total_weight += w_dY;
-                    }
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dZ;
-                        total_weight += w_dZ;
-                    }
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                    if (*(nii_rim_data + j) == 3) {
-                        new_val += *(pin_coords_data + nr_voxels*t + j) * w_dZ;
-                        total_weight += w_dZ;
-                    }
-                }
-                *(smooth_data + i) = new_val / total_weight;
+                *(smooth_data + iii) = new_val / total_weight;
             }
 
             // Swap image that needs to be smoothed
             for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
                 i = *(voi_id2 + iii);
-                *(pin_coords_data + nr_voxels * t + i) = *(smooth_data + i);
+                *(pin_coords_data + nr_voxels * t + i) = *(smooth_data + iii);
             }
         }
     }
@@ -2874,7 +1321,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Compute norms
     // ========================================================================
-    cout << "\n  Computing L2 and Linf norms..." << endl;
+    log_stage("Computing L2 and Linf norms...");
     // Compute Linfinity norm
     for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
         i = *(voi_id2 + iii);
@@ -2902,7 +1349,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Update perimeter mask using norm
     // ========================================================================
-    cout << "\n  Updating perimeter using L2 norm..." << endl;
+    log_stage("Updating perimeter using L2 norm...");
     for (uint32_t i = 0; i != nr_voxels; ++i) {
         if (*(flood_dist_data + i) != 0) {
             if (*(flood_dist_data + i) < thr_radius) {
@@ -2921,170 +1368,13 @@ int main(int argc, char*  argv[]) {
     // for (uint32_t i = 0; i != nr_voxels; ++i) {
     for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
         i = *(voi_id2 + iii);
-        tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
         if (*(perimeter_data + i) == 0) {
-            // --------------------------------------------------------
-            // 1-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0) {
-                j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x) {
-                j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0) {
-                j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y) {
-                j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iz > 0) {
-                j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iz < end_z) {
-                j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            // --------------------------------------------------------
-            // 2-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0 && iy > 0) {
-                j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y) {
-                j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0) {
-                j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y) {
-                j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iz > 0) {
-                j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iz > 0) {
-                j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            // --------------------------------------------------------
-            // 3-jump neighbours
-            // --------------------------------------------------------
-            if (ix > 0 && iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0 && iz > 0) {
-                j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix > 0 && iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy > 0 && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y && iz > 0) {
-                j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                if (*(perimeter_data + j) != *(perimeter_data + i)) {
-                    switch_border = true;
-                }
-            }
-            if (ix < end_x && iy < end_y && iz < end_z) {
-                j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+            uint32_t nb_j[26];
+            uint8_t nb_k[26];
+            int nr_nb = nb.neighbours(i, nb_j, nb_k);
+            for (int nn = 0; nn != nr_nb; ++nn) {
+                j = nb_j[nn];
                 if (*(perimeter_data + j) != *(perimeter_data + i)) {
                     switch_border = true;
                 }
@@ -3111,7 +1401,7 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Convert pin axes from 4D nifti into 3D
     // ========================================================================
-    cout << "\n  Start preparing axes output (used for quality control)..." << endl;
+    log_stage("Start preparing axes output (used for quality control)...");
     for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
         i = *(voi_id2 + iii);
 
@@ -3134,7 +1424,7 @@ int main(int argc, char*  argv[]) {
     // Mask out coordinates beyond periphery radius
     // ========================================================================
     if (mode_mask) {
-        cout << "\n  Masking outputs..." << endl;
+        log_stage("Masking outputs...");
         for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
             i = *(voi_id2 + iii);
             // Zero values outside of perimeter chunk
@@ -3153,7 +1443,7 @@ int main(int argc, char*  argv[]) {
     // Compute angles & quadrants
     // ========================================================================
     if (mode_angles) {
-        cout << "\n  Computing angles (in radians) and quadrants..." << endl;
+        log_stage("Computing angles (in radians) and quadrants...");
         for (uint32_t iii = 0; iii != nr_voi2; ++iii) {
             i = *(voi_id2 + iii);
             // Only compute for within the masked region
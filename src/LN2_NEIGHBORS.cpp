@@ -28,6 +28,7 @@ int show_help(void) {
     "                    Note that different labels can have different number of neighbors.\n"
     "                    Therefore, later volumes can contains more zeros.\n"
     "    -output       : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -45,6 +46,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -72,7 +77,7 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
@@ -86,12 +91,11 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
+
     // ========================================================================
     // Fix input datatype issues
     // ========================================================================
@@ -198,7 +202,7 @@ int main(int argc, char*  argv[]) {
     // Find first order neighbors
     // ========================================================================
     cout << "  Start finding neighbors (3-jump neighborhood)..." << endl;
-    uint32_t i, j, ix, iy, iz, max_nr_neighbors = 0;
+    uint32_t i, j, max_nr_neighbors = 0;
 
     // Loop through all unique labels
     int c = 0;
@@ -211,120 +215,12 @@ int main(int argc, char*  argv[]) {
             if (*(nii_input_data + i) == k) {
                 *(idx_label_data + i) = c;
 
-                tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
-                // ------------------------------------------------------------
-                // 1-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x) {
-                    j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy < end_y) {
-                    j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iz > 0) {
-                    j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iz < end_z) {
-                    j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                // ------------------------------------------------------------
-                // 2-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iy < end_y) {
-                    j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy < end_y) {
-                    j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-
-                // ------------------------------------------------------------
-                // 3-jump neighbours
-                // ------------------------------------------------------------
-                if (ix > 0 && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy > 0 && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix > 0 && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy > 0 && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy < end_y && iz > 0) {
-                    j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                    set_neighbors.insert(*(nii_input_data + j));
-                }
-                if (ix < end_x && iy < end_y && iz < end_z) {
-                    j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+                uint32_t nb_j[26];
+                uint8_t nb_k[26];
+                int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                for (int nn = 0; nn != nr_nb; ++nn) {
+                    j = nb_j[nn];
                     set_neighbors.insert(*(nii_input_data + j));
                 }
             }
@@ -384,6 +280,7 @@ int main(int argc, char*  argv[]) {
     if (export_nifti) {
         cout << "  Exporting nifti..." << endl;
         nifti_image* nii_output = nifti_copy_nim_info(nii_input);
+        pipeline_image_track(nii_output);
         nii_output->dim[0] = 4;  // For proper 4D nifti
         nii_output->dim[1] = size_x;
         nii_output->dim[2] = size_y;
@@ -33,6 +33,7 @@ int show_help(void) {
     "    -norm_mask : (Optional) Mask out flat domain voxels using L2 norm of coordinates.\n"
     "    -debug     : (Optional) Save extra intermediate outputs.\n"
     "    -output    : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Citation:\n"
     "    - Gulban, O. F., Bollmann, S., Huber, R., Wagstyl, K., Goebel, R., Poser,\n"
@@ -57,6 +58,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-values")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -values\n");
@@ -138,22 +143,22 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
     }
-    nii3 = nifti_image_read(fin3, 1);
+    nii3 = pipeline_image_read(fin3, 1);
     if (!nii3) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin3);
         return 2;
     }
-    nii4 = nifti_image_read(fin4, 1);
+    nii4 = pipeline_image_read(fin4, 1);
     if (!nii4) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin4);
         return 2;
@@ -242,6 +247,7 @@ int main(int argc, char*  argv[]) {
 
     // Allocating new 4D nifti for flat images
     nifti_image* flat_4D = nifti_copy_nim_info(nii1);
+    pipeline_image_track(flat_4D);
     flat_4D->datatype = NIFTI_TYPE_INT32;
     flat_4D->dim[0] = 4;  // For proper 4D nifti
     flat_4D->dim[1] = bins_u;
@@ -269,6 +275,7 @@ int main(int argc, char*  argv[]) {
     // ------------------------------------------------------------------------
     // Allocating new 3D nifti for flat images
     nifti_image* flat_3D = nifti_copy_nim_info(nii1);
+    pipeline_image_track(flat_3D);
     flat_3D->datatype = NIFTI_TYPE_INT32;
     flat_3D->dim[0] = 4;  // For proper 4D nifti
     flat_3D->dim[1] = bins_u;
@@ -300,6 +307,7 @@ int main(int argc, char*  argv[]) {
     // Allocating new 4D nifti for saveing the folded image coordinates in the 
     // flat image format. This is for back projection from flat to folded.
     nifti_image* flat_coords = nifti_copy_nim_info(nii1);
+    pipeline_image_track(flat_coords);
     flat_coords->datatype = NIFTI_TYPE_FLOAT32;
     flat_coords->dim[0] = 4;  // For proper 4D nifti
     flat_coords->dim[1] = bins_u;
@@ -453,7 +461,7 @@ int main(int argc, char*  argv[]) {
     // Optional Voronoi filling for empty flat bins
     // ========================================================================
     if (mode_voronoi) {
-        cout << "\n  Start Voronoi (nearest neighbor) filling-in..." << endl;
+        log_stage("Start Voronoi (nearest neighbor) filling-in...");
 
         // Prepare additional flat niftis
         nifti_image* flood_step = copy_nifti_as_float32(flat_4D);
@@ -462,23 +470,8 @@ int main(int argc, char*  argv[]) {
         float* flood_dist_data = static_cast<float*>(flood_dist->data);
 
         // --------------------------------------------------------------------
-        const int size_x = bins_u;
-        const int size_y = bins_v;
-        const int size_z = bins_d;
-        const int end_x = size_x - 1;
-        const int end_y = size_y - 1;
-        const int end_z = size_z - 1;
-
-        const float dX = 1;
-        const float dY = 1;
-        const float dZ = 1;
-
-        // Short diagonals
-        const float dia_xy = sqrt(dX * dX + dY * dY);
-        const float dia_xz = sqrt(dX * dX + dZ * dZ);
-        const float dia_yz = sqrt(dY * dY + dZ * dZ);
-        // Long diagonals
-        const float dia_xyz = sqrt(dX * dX + dY * dY + dZ * dZ);
+        // Neighbour offsets and distances on the flat grid (unit bins)
+        const voxel_stencil<26> nb(flat_4D);
 
         for (int t=0; t!=size_time; ++t) {
             // Initialize grow volume
@@ -492,7 +485,7 @@ int main(int argc, char*  argv[]) {
                 }
             }
             int grow_step = 1, bin_counter = 1;
-            int ix, iy, iz, j;
+            int j;
             float d;
             if (size_time > 1) {
                 cout << "  Doing 4th dimension: " << t+1 << endl;
@@ -503,399 +496,14 @@ int main(int argc, char*  argv[]) {
                 bin_counter = 0;
                 for (int i = 0; i != nr_bins; ++i) {
                     if (*(flood_step_data + i) == grow_step) {
-                        tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
                         bin_counter += 1;
 
-                        // --------------------------------------------------------
-                        // 1-jump neighbours
-                        // --------------------------------------------------------
-                        if (ix > 0) {
-                            j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x) {
-                            j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dX;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy > 0) {
-                            j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy < end_y) {
-                            j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dY;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iz > 0) {
-                            j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iz < end_z) {
-                            j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dZ;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-
-                        // --------------------------------------------------------
-                        // 2-jump neighbours
-                        // --------------------------------------------------------
-
-                        if (ix > 0 && iy > 0) {
-                            j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iy < end_y) {
-                            j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy > 0) {
-                            j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy < end_y) {
-                            j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xy;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_yz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-
-                        // --------------------------------------------------------
-                        // 3-jump neighbours
-                        // --------------------------------------------------------
-                        if (ix > 0 && iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy > 0 && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix > 0 && iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy > 0 && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy < end_y && iz > 0) {
-                            j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
-                            if (d < *(flood_dist_data + j)
-                                || *(flood_dist_data + j) == 0) {
-                                *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
-                                *(flood_dist_data + j) = d;
-                                *(flood_step_data + j) = grow_step + 1;
-                                *(flat_density_data + j) = *(flat_density_data + i);
-                                *(flat_domain_data + j) = *(flat_domain_data + i);
-                                *(flat_coords_data + nr_bins*0 + j) = *(flat_coords_data + nr_bins*0 + i);
-                                *(flat_coords_data + nr_bins*1 + j) = *(flat_coords_data + nr_bins*1 + i);
-                                *(flat_coords_data + nr_bins*2 + j) = *(flat_coords_data + nr_bins*2 + i);
-                            }
-                        }
-                        if (ix < end_x && iy < end_y && iz < end_z) {
-                            j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
-                            d = *(flood_dist_data + i) + dia_xyz;
+                        uint32_t nb_j[26];
+                        uint8_t nb_k[26];
+                        int nr_nb = nb.neighbours(i, nb_j, nb_k);
+                        for (int nn = 0; nn != nr_nb; ++nn) {
+                            j = nb_j[nn];
+                            d = *(flood_dist_data + i) + nb.dist[nb_k[nn]];
                             if (d < *(flood_dist_data + j)
                                 || *(flood_dist_data + j) == 0) {
                                 *(flat_values_data + j + t*nr_bins) = *(flat_values_data + i + t*nr_bins);
@@ -34,6 +34,7 @@ int show_help(void) {
     "                 the same flat bin.\n"
     "    -debug     : (Optional) Save extra intermediate outputs.\n"
     "    -output    : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "\n");
     return 0;
@@ -52,6 +53,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-values")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -values\n");
@@ -125,22 +130,22 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
     }
-    nii3 = nifti_image_read(fin3, 1);
+    nii3 = pipeline_image_read(fin3, 1);
     if (!nii3) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin3);
         return 2;
     }
-    nii4 = nifti_image_read(fin4, 1);
+    nii4 = pipeline_image_read(fin4, 1);
     if (!nii4) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin4);
         return 2;
@@ -227,6 +232,7 @@ int main(int argc, char*  argv[]) {
 
     // Allocating new 4D nifti for flat images
     nifti_image* flat_3D = nifti_copy_nim_info(nii1);
+    pipeline_image_track(flat_3D);
     flat_3D->datatype = NIFTI_TYPE_INT32;
     flat_3D->dim[0] = 4;  // For proper 4D nifti
     flat_3D->dim[1] = bins_tan;
@@ -254,6 +260,7 @@ int main(int argc, char*  argv[]) {
     // ------------------------------------------------------------------------
     // Allocating new 3D nifti for flat images
     nifti_image* flat_2D = nifti_copy_nim_info(nii1);
+    pipeline_image_track(flat_2D);
     flat_2D->datatype = NIFTI_TYPE_INT32;
     flat_2D->dim[0] = 4;  // For proper 4D nifti
     flat_2D->dim[1] = bins_tan;
@@ -389,7 +396,7 @@ int main(int argc, char*  argv[]) {
     // Optional Voronoi filling for empty flat bins
     // ========================================================================
     if (mode_voronoi) {
-        cout << "\n  Start Voronoi (nearest neighbor) filling-in..." << endl;
+        log_stage("Start Voronoi (nearest neighbor) filling-in...");
 
         // Prepare additional flat niftis
         nifti_image* flood_step = copy_nifti_as_float32(flat_3D);
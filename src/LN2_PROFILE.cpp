@@ -39,6 +39,7 @@ int show_help(void) {
     "    -debug  : (Optional) Save extra intermediate outputs.\n"
     "    -output : (Optional) Output basename.\n"
     "              Default is adding '_padded' as suffix \n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - The averaging is done across all voxels layers, independent of their value.\n"
@@ -48,7 +49,7 @@ int show_help(void) {
 }
 
 int main(int argc, char*  argv[]) {
-    uint16_t ac;
+    int ac;
     nifti_image *nii1 = NULL;
     nifti_image *niil = NULL;
     char *fin = NULL, *finl = NULL;
@@ -61,6 +62,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -101,12 +106,12 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin, 1);
+    nii1 = pipeline_image_read(fin, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
     }
-    niil = nifti_image_read(finl, 1);
+    niil = pipeline_image_read(finl, 1);
     if (!niil) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", finl);
         return 2;
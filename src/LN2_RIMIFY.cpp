@@ -34,6 +34,7 @@ int show_help(void) {
     // "                    'aseg' files containing 100 & 150, or 240 & 243 labeled voxels.\n"
     "    -output       : (Optional) Output filename, including .nii or\n"
     "                    .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - Values not indicated as innergm, outergm or gm will be 0 in\n"
@@ -57,6 +58,10 @@ int main(int argc, char *argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -120,7 +125,7 @@ int main(int argc, char *argv[]) {
 
 
     // Read input dataset
-    nifti_image *nii = nifti_image_read(fin, 1);
+    nifti_image *nii = pipeline_image_read(fin, 1);
     if (!nii) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -36,6 +36,7 @@ int show_help(void) {
     "    -columns   : (Optional) Take the mode within the window.\n"
     "    -peak_d    : (Optional) Take depth of the maximum value in the window.\n"
     "    -output    : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -54,6 +55,10 @@ int main(int argc, char* argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strcmp(argv[ac], "-help")) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-values")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -values\n");
@@ -151,22 +156,22 @@ int main(int argc, char* argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
     }
-    nii3 = nifti_image_read(fin3, 1);
+    nii3 = pipeline_image_read(fin3, 1);
     if (!nii3) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin3);
         return 2;
     }
-    nii4 = nifti_image_read(fin4, 1);
+    nii4 = pipeline_image_read(fin4, 1);
     if (!nii3) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin4);
         return 2;
@@ -16,6 +16,7 @@ int show_help(void) {
     "    -domain : 3D nifti file that contains non-zero voxel where zero crossings\n"
     "              will be computed. In other words, a mask file.\n"
     "    -output : (Optional) Output basename for all outputs.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -31,6 +32,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-values")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -values\n");
@@ -66,12 +71,12 @@ int main(int argc, char*  argv[]) {
     }
 
     // Read input dataset, including data
-    nii1 = nifti_image_read(fin1, 1);
+    nii1 = pipeline_image_read(fin1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nii2 = nifti_image_read(fin2, 1);
+    nii2 = pipeline_image_read(fin2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
@@ -87,24 +92,23 @@ int main(int argc, char*  argv[]) {
     const uint32_t size_y = nii1->ny;
     const uint32_t size_z = nii1->nz;
 
-    const uint32_t end_x = size_x - 1;
-    const uint32_t end_y = size_y - 1;
-    const uint32_t end_z = size_z - 1;
-
     const uint32_t nr_voxels = size_z * size_y * size_x;
 
+    // Neighbour offsets and distances
+    const voxel_stencil<26> nb(nii1);
+
     // ========================================================================
     // Fix input datatype issues
     nifti_image* nii_values = copy_nifti_as_float32(nii1);
     float* nii_values_data = static_cast<float*>(nii_values->data);
     nifti_image* nii_domain = copy_nifti_as_int32(nii2);
     int32_t* nii_domain_data = static_cast<int32_t*>(nii_domain->data);
-    free(nii2);
+    pipeline_image_free(nii2);
 
     // Output nifti
     nifti_image* nii_out = copy_nifti_as_int32(nii1);
     int32_t* nii_out_data = static_cast<int32_t*>(nii_out->data);
-    free(nii1);
+    pipeline_image_free(nii1);
 
     // Clean output array
     for (uint32_t i = 0; i != nr_voxels; ++i) {
@@ -138,254 +142,21 @@ int main(int argc, char*  argv[]) {
     // ========================================================================
     // Find zero crossing neighboring voxels
     // ========================================================================
-    cout << "\n  Finding zero crossing neighbour voxels..." << endl;
+    log_stage("Finding zero crossing neighbour voxels...");
 
     for (uint32_t ii = 0; ii != nr_voi; ++ii) {
-        uint32_t ix, iy, iz, i, j;
+        uint32_t i, j;
         i = *(voi_id + ii);
-        tie(ix, iy, iz) = ind2sub_3D(i, size_x, size_y);
 
         // Check sign changes between neighbouring voxels
         float m = *(nii_values_data + i);
         float n;
 
-        // --------------------------------------------------------------------
-        // 1-jump neighbours
-        // --------------------------------------------------------------------
-        if (ix > 0) {
-            j = sub2ind_3D(ix-1, iy, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x) {
-            j = sub2ind_3D(ix+1, iy, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy > 0) {
-            j = sub2ind_3D(ix, iy-1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy < end_y) {
-            j = sub2ind_3D(ix, iy+1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iz > 0) {
-            j = sub2ind_3D(ix, iy, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iz < end_z) {
-            j = sub2ind_3D(ix, iy, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        // --------------------------------------------------------------------
-        // 2-jump neighbours
-        // --------------------------------------------------------------------
-        if (ix > 0 && iy > 0) {
-            j = sub2ind_3D(ix-1, iy-1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iy < end_y) {
-            j = sub2ind_3D(ix-1, iy+1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy > 0) {
-            j = sub2ind_3D(ix+1, iy-1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy < end_y) {
-            j = sub2ind_3D(ix+1, iy+1, iz, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy > 0 && iz > 0) {
-            j = sub2ind_3D(ix, iy-1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy > 0 && iz < end_z) {
-            j = sub2ind_3D(ix, iy-1, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy < end_y && iz > 0) {
-            j = sub2ind_3D(ix, iy+1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (iy < end_y && iz < end_z) {
-            j = sub2ind_3D(ix, iy+1, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iz > 0) {
-            j = sub2ind_3D(ix-1, iy, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iz > 0) {
-            j = sub2ind_3D(ix+1, iy, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iz < end_z) {
-            j = sub2ind_3D(ix-1, iy, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iz < end_z) {
-            j = sub2ind_3D(ix+1, iy, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-
-        // --------------------------------------------------------------------
-        // 3-jump neighbours
-        // --------------------------------------------------------------------
-        if (ix > 0 && iy > 0 && iz > 0) {
-            j = sub2ind_3D(ix-1, iy-1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iy > 0 && iz < end_z) {
-            j = sub2ind_3D(ix-1, iy-1, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iy < end_y && iz > 0) {
-            j = sub2ind_3D(ix-1, iy+1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy > 0 && iz > 0) {
-            j = sub2ind_3D(ix+1, iy-1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix > 0 && iy < end_y && iz < end_z) {
-            j = sub2ind_3D(ix-1, iy+1, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy > 0 && iz < end_z) {
-            j = sub2ind_3D(ix+1, iy-1, iz+1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy < end_y && iz > 0) {
-            j = sub2ind_3D(ix+1, iy+1, iz-1, size_x, size_y);
-            n = *(nii_values_data + j);
-            if (*(nii_domain_data + j) != 0) {
-                if (signbit(m) - signbit(n) != 0) {
-                    *(nii_out_data + i) = 1;
-                }
-            }
-        }
-        if (ix < end_x && iy < end_y && iz < end_z) {
-            j = sub2ind_3D(ix+1, iy+1, iz+1, size_x, size_y);
+        uint32_t nb_j[26];
+        uint8_t nb_k[26];
+        int nr_nb = nb.neighbours(i, nb_j, nb_k);
+        for (int nn = 0; nn != nr_nb; ++nn) {
+            j = nb_j[nn];
             n = *(nii_values_data + j);
             if (*(nii_domain_data + j) != 0) {
                 if (signbit(m) - signbit(n) != 0) {
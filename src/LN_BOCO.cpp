@@ -30,6 +30,7 @@ int show_help(void) {
     "                 Note different to other LayNii programs in LN_COCO \n"
     "                 if no output file name is specified, the output file \n"
     "                 name is VASO_LN.nii in the current folder.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - It is assumed that BOLD and VASO refer to the double TR:\n"
@@ -51,6 +52,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-Nulled")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -Nulled\n");
@@ -96,175 +101,298 @@ int main(int argc, char * argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image* nii1 = nifti_image_read(fin_1, 1);
-    if (!nii1) {
+    // Read input headers, data is streamed volume by volume below
+    nifti_stream* stream1 = nifti_stream_open_read(fin_1, STREAM_CHUNK_VOXELS, true);
+    if (!stream1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'.\n", fin_1);
         return 2;
     }
-    nifti_image* nii2 = nifti_image_read(fin_2, 1);
-    if (!nii2) {
+    nifti_stream* stream2 = nifti_stream_open_read(fin_2, STREAM_CHUNK_VOXELS, true);
+    if (!stream2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'.\n", fin_2);
         return 2;
     }
+    nifti_image* nii1 = stream1->nii;
+    nifti_image* nii2 = stream2->nii;
 
     log_welcome("LN_BOCO");
     log_nifti_descriptives(nii1);
     log_nifti_descriptives(nii2);
 
+    if (nii1->nx != nii2->nx || nii1->ny != nii2->ny || nii1->nz != nii2->nz
+        || nii1->nvox != nii2->nvox) {
+        fprintf(stderr, "** Nulled and BOLD dimensions do not match.\n");
+        return 2;
+    }
+
     // Get dimensions of input
-    const int size_x = nii1->nx;
-    const int size_y = nii1->ny;
-    const int size_z = nii1->nz;
-    const int size_time = nii1->nt;
-    const int nx = nii1->nx;
-    const int nxy = nii1->nx * nii1->ny;
+    const int size_time = stream1->size_time;
     const int nxyz = nii1->nx * nii1->ny * nii1->nz;
-    const int nr_voxels = size_time * size_z * size_y * size_x;
-
-    // ========================================================================
-    // Fix datatype issues
-    nifti_image *nii_nulled = copy_nifti_as_float32(nii1);
-    float *nii_nulled_data = static_cast<float*>(nii_nulled->data);
-    nifti_image *nii_bold = copy_nifti_as_float32(nii2);
-    float *nii_bold_data = static_cast<float*>(nii_bold->data);
-
-    // Allocate new nifti
-    nifti_image *nii_boco_vaso = copy_nifti_as_float32(nii1);
-    float *nii_boco_vaso_data = static_cast<float*>(nii_boco_vaso->data);
-    
-    
-
+    const int nr_voxels = size_time * nxyz;
 
     // ========================================================================
     // Handle scaling factor effects
     // TODO(Faruk): I am not sure we need this part anymore. Need to check.
-    
-    float scl_slope1=nii_nulled->scl_slope, scl_slope2=nii_bold->scl_slope;
-    if (scl_slope2 != 0 || scl_slope1 != 0 ) { 
+    float scl_slope1 = nii1->scl_slope, scl_slope2 = nii2->scl_slope;
+    if (scl_slope2 != 0 || scl_slope1 != 0 ) {
         cout << "    !!!Warning!!! Input nifti header contains scl_scale !=0.\n"
              << "    Make sure to check the resulting output image.\n"<< endl;
     }
-    if (scl_slope1 != 0 ) {
-        for (int i = 0; i != nr_voxels; ++i) {
-            *(nii_nulled_data + i) *= scl_slope1;
-        }
-    } 
-    if (scl_slope2 != 0) {
-        for (int i = 0; i != nr_voxels; ++i) {
-            *(nii_bold_data + i) *= scl_slope2;
+
+    // Prepare output nifti, we can set scaling factor to 1 because we have
+    // accounted for them while reading
+    nifti_image *nii_boco_vaso = nifti_copy_nim_info(nii1);
+    pipeline_image_track(nii_boco_vaso);
+    nii_boco_vaso->datatype = NIFTI_TYPE_FLOAT32;
+    nii_boco_vaso->nbyper = sizeof(float);
+    nii_boco_vaso->scl_slope = 1.;
+    nifti_stream* stream_vaso;
+    if (use_outpath) {
+        stream_vaso = nifti_stream_open_write(nii_boco_vaso, "VASO_LN", "",
+                                              true, true);
+    } else {
+        stream_vaso = nifti_stream_open_write(nii_boco_vaso, fout, "VASO_LN",
+                                              true);
+    }
+    if (!stream_vaso) {
+        return 2;
+    }
+
+    // ------------------------------------------------------------------------
+    // Shift: Correlations are accumulated over a sliding window of 7 volumes
+    // ------------------------------------------------------------------------
+    float *ring_nulled = NULL, *ring_bold = NULL, *ring_vaso = NULL;
+    double *sum_x = NULL, *sum_xx = NULL, *sum_xy = NULL;
+    double *sum_y = NULL, *sum_yy = NULL;
+    if (shift == 1) {
+        ring_nulled = new float[7 * nxyz];
+        ring_bold = new float[7 * nxyz];
+        ring_vaso = new float[7 * nxyz];
+        sum_x = new double[7 * nxyz]();
+        sum_xx = new double[7 * nxyz]();
+        sum_xy = new double[7 * nxyz]();
+        sum_y = new double[nxyz]();
+        sum_yy = new double[nxyz]();
+    }
+    // Adds time point t to the correlation sums of all shifts
+    auto accumulate_shifts = [&](int t) {
+        const float* bold_t = ring_bold + nxyz * (t % 7);
+        const float* nulled_t = ring_nulled + nxyz * (t % 7);
+        const float* vaso_t = ring_vaso + nxyz * (t % 7);
+        bool is_inner = t >= 3 && t < size_time - 3;
+        // All 7 shifts of a voxel share the sums of BOLD, voxels are
+        // independent and accumulated in parallel
+        #pragma omp parallel for
+        for (int j = 0; j < nxyz; ++j) {
+            double y = bold_t[j];
+            sum_y[j] += y;
+            sum_yy[j] += y * y;
+            for (int shift = -3; shift <= 3; ++shift) {
+                float x = vaso_t[j];
+                if (is_inner) {
+                    x = nulled_t[j] / *(ring_bold + nxyz * ((t + shift) % 7) + j);
+                }
+                int k = nxyz * (shift + 3) + j;
+                sum_x[k] += x;
+                sum_xx[k] += static_cast<double>(x) * x;
+                sum_xy[k] += x * y;
+            }
         }
+    };
+
+    // ------------------------------------------------------------------------
+    // Trial average: Sums per trial time point
+    // ------------------------------------------------------------------------
+    int nr_trials = 0;
+    float *avg_Nulled = NULL, *avg_BOLD = NULL;
+    if (trialdur != 0) {
+        nr_trials = size_time / trialdur;
+        avg_Nulled = new float[trialdur * nxyz]();
+        avg_BOLD = new float[trialdur * nxyz]();
     }
 
-    // We can set scaling factor to 1 because we have accounted for them above
-    nii_nulled->scl_slope = 1.;
-    nii_bold->scl_slope = 1.;
-    nii_boco_vaso->scl_slope = 1.;
-    
     // ========================================================================
     // BOLD correction
     // ========================================================================
-    if (mode_alt) {
-        int nr_invalid_voxels = 0, nr_zero_voxels = 0;
-        for (int i = 0; i != nr_voxels; ++i) {
-            float nc = *(nii_nulled_data + i);  // Nulled condition
-            float nn = (*(nii_bold_data + i));  // Not nulled condition (a.k.a BOLD)
-
-            float S_ex = nc;  // Approximately extravascular signal
-            float S_in = nn - nc;  // Approximately intravascular signal
-
-            if (nc <= 0 || nn <= 0) {
-                *(nii_boco_vaso_data + i) = 0;
-                nr_zero_voxels += 1;
-            }  else {
-                if (S_in <= 0) {
-                    // VASO assumptions invalid S_in should not be negative.
-                    S_in *= -1;
-                    nr_invalid_voxels += 1;
+    if (shift == 1) {
+        cout << "  Calculating shifts = -3 to 3" << endl;
+    }
+    int nr_invalid_voxels = 0, nr_zero_voxels = 0;
+    nifti_image *chunk1, *chunk2;
+    while ((chunk1 = nifti_stream_read_chunk(stream1)) != NULL) {
+        chunk2 = nifti_stream_read_chunk(stream2);
+        if (!chunk2) {
+            return 2;
+        }
+        const int chunk_t = stream1->chunk_t;
+
+        // Fix datatype issues
+        nifti_image *nii_nulled = copy_nifti_as_float32(chunk1);
+        float *nii_nulled_data = static_cast<float*>(nii_nulled->data);
+        nifti_image *nii_bold = copy_nifti_as_float32(chunk2);
+        float *nii_bold_data = static_cast<float*>(nii_bold->data);
+        nifti_image *nii_vaso = copy_nifti_as_float32(chunk1);
+        float *nii_boco_vaso_data = static_cast<float*>(nii_vaso->data);
+        const int nr_chunk_voxels = nii_nulled->nvox;
+
+        if (scl_slope1 != 0) {
+            for (int i = 0; i != nr_chunk_voxels; ++i) {
+                *(nii_nulled_data + i) *= scl_slope1;
+            }
+        }
+        if (scl_slope2 != 0) {
+            for (int i = 0; i != nr_chunk_voxels; ++i) {
+                *(nii_bold_data + i) *= scl_slope2;
+            }
+        }
+
+        if (mode_alt) {
+            for (int i = 0; i != nr_chunk_voxels; ++i) {
+                float nc = *(nii_nulled_data + i);  // Nulled condition
+                float nn = (*(nii_bold_data + i));  // Not nulled condition (a.k.a BOLD)
+
+                float S_ex = nc;  // Approximately extravascular signal
+                float S_in = nn - nc;  // Approximately intravascular signal
+
+                if (nc <= 0 || nn <= 0) {
+                    *(nii_boco_vaso_data + i) = 0;
+                    nr_zero_voxels += 1;
+                }  else {
+                    if (S_in <= 0) {
+                        // VASO assumptions invalid S_in should not be negative.
+                        S_in *= -1;
+                        nr_invalid_voxels += 1;
+                    }
+                    // Compute relative contribution (always between -1 to 1)
+                    *(nii_boco_vaso_data + i) =  S_ex / (S_ex + S_in);
+                }
+            }
+        } else {
+            for (int i = 0; i != nr_chunk_voxels; ++i) {
+                float nc = *(nii_nulled_data + i);  // Nulled condition
+                float nn = *(nii_bold_data + i);  // Not nulled condition (a.k.a BOLD)
+
+                if (nc <= 0 || nn <= 0) {  // Skip masked-out or invalid voxels
+                    *(nii_boco_vaso_data + i) = 0;
+                }  else {  // BOLD correction is happening here
+                    *(nii_boco_vaso_data + i) = nc / nn;
+                }
+            }
+            // Clip VASO values that are unrealistic
+            for (int i = 0; i != nr_chunk_voxels; ++i) {
+                if (*(nii_boco_vaso_data + i) <= 0) {
+                    *(nii_boco_vaso_data + i) = 0;
+                }
+                if (*(nii_boco_vaso_data + i) >= 5) {
+                    *(nii_boco_vaso_data + i) = 5;
                 }
-                // Compute relative contribution (always between -1 to 1)
-                *(nii_boco_vaso_data + i) =  S_ex / (S_ex + S_in);
             }
         }
-        float term1 = static_cast<float>(nr_invalid_voxels);
-        float term2 = static_cast<float>(nr_voxels - nr_zero_voxels);
 
-        cout << "  Voxels with invalid VASO assumption:" << endl;
-        cout << "    "
-            << nr_invalid_voxels << "/" << nr_voxels - nr_zero_voxels
-            << "\n    " << (term1 / term2) * 100 << "%\n" << endl;
-    } else {
+        for (int it = 0; it < nii_nulled->nt; ++it) {
+            const int t = chunk_t + it;
+            const float* nulled_t = nii_nulled_data + nxyz * it;
+            const float* bold_t = nii_bold_data + nxyz * it;
+
+            // ----------------------------------------------------------------
+            // Shift
+            // ----------------------------------------------------------------
+            if (shift == 1) {
+                for (int j = 0; j != nxyz; ++j) {
+                    *(ring_nulled + nxyz * (t % 7) + j) = nulled_t[j];
+                    *(ring_bold + nxyz * (t % 7) + j) = bold_t[j];
+                    *(ring_vaso + nxyz * (t % 7) + j) = *(nii_boco_vaso_data + nxyz * it + j);
+                }
+                if (t >= 3) {
+                    accumulate_shifts(t - 3);
+                }
 
-        for (int i = 0; i != nr_voxels; ++i) {
-            float nc = *(nii_nulled_data + i);  // Nulled condition
-            float nn = *(nii_bold_data + i);  // Not nulled condition (a.k.a BOLD)
+                // Get back to default and clean unrealistic VASO values
+                for (int j = 0; j != nxyz; ++j) {
+                    float val = nulled_t[j] / bold_t[j];
+                    if (val <= 0) {
+                        val = 0;
+                    }
+                    if (val >= 2) {
+                        val = 2;
+                    }
+                    *(nii_boco_vaso_data + nxyz * it + j) = val;
+                }
+            }
 
-            if (nc <= 0 || nn <= 0) {  // Skip masked-out or invalid voxels
-                *(nii_boco_vaso_data + i) = 0;
-            }  else {  // BOLD correction is happening here
-                *(nii_boco_vaso_data + i) = nc / nn;
+            // ----------------------------------------------------------------
+            // Trial average
+            // ----------------------------------------------------------------
+            if (trialdur != 0 && t < trialdur * nr_trials) {
+                float* avg_Nulled_t = avg_Nulled + nxyz * (t % trialdur);
+                float* avg_BOLD_t = avg_BOLD + nxyz * (t % trialdur);
+                for (int j = 0; j != nxyz; ++j) {
+                    avg_Nulled_t[j] += nulled_t[j] / nr_trials;
+                    avg_BOLD_t[j] += bold_t[j] / nr_trials;
+                }
             }
         }
-        // Clip VASO values that are unrealistic
-        for (int i = 0; i != nr_voxels; ++i) {
-            if (*(nii_boco_vaso_data + i) <= 0) {
-                *(nii_boco_vaso_data + i) = 0;
-            }
-            if (*(nii_boco_vaso_data + i) >= 5) {
-                *(nii_boco_vaso_data + i) = 5;
+
+        // Replace nans with zeros
+        for (int i = 0; i < nr_chunk_voxels; ++i) {
+            if (*(nii_boco_vaso_data + i)!= *(nii_boco_vaso_data + i)) {
+               *(nii_boco_vaso_data + i) = 0;
             }
         }
+
+        if (!nifti_stream_write_chunk(stream_vaso, nii_vaso)) {
+            return 2;
+        }
+        pipeline_image_free(nii_nulled);
+        pipeline_image_free(nii_bold);
+        pipeline_image_free(nii_vaso);
+        pipeline_image_free(chunk1);
+        pipeline_image_free(chunk2);
+    }
+    if (!nifti_stream_close(stream_vaso)) {
+        return 2;
+    }
+
+    if (mode_alt) {
+        float term1 = static_cast<float>(nr_invalid_voxels);
+        float term2 = static_cast<float>(nr_voxels - nr_zero_voxels);
+
+        cout << "  Voxels with invalid VASO assumption:" << endl;
+        cout << "    "
+            << nr_invalid_voxels << "/" << nr_voxels - nr_zero_voxels
+            << "\n    " << (term1 / term2) * 100 << "%\n" << endl;
     }
 
     // ========================================================================
     // Shift
     // ========================================================================
     if (shift == 1) {
-        nifti_image* correl_file  = nifti_copy_nim_info(nii_nulled);
+        // Time points at the end of the window have not been added yet
+        for (int t = max(0, size_time - 3); t < size_time; ++t) {
+            accumulate_shifts(t);
+        }
+
+        nifti_image* correl_file  = nifti_copy_nim_info(nii1);
+        pipeline_image_track(correl_file);
         correl_file->nt = 7;
-        correl_file->nvox = nii_nulled->nvox / size_time *7;
+        correl_file->nvox = nxyz * 7;
         correl_file->datatype = NIFTI_TYPE_FLOAT32;
         correl_file->nbyper = sizeof(float);
+        correl_file->scl_slope = 1.;
         correl_file->data = calloc(correl_file->nvox, correl_file->nbyper);
         float* correl_file_data = static_cast<float*>(correl_file->data);
 
-        double vec_file1[size_time];
-        double vec_file2[size_time];
-
         for (int shift = -3; shift <= 3; ++shift) {
-            cout << "  Calculating shift = " << shift << endl;
-            for (int j = 0; j != size_z * size_y * size_x; ++j) {
-                for (int t = 3; t < size_time-3; ++t) {
-                    *(nii_boco_vaso_data + nxyz * t + j)  =      *(nii_nulled_data + nxyz * t + j)  / *(nii_bold_data + nxyz * (t + shift) + j);
-                }
-                for (int t = 0; t < size_time; ++t) {
-                    vec_file1[t] = *(nii_boco_vaso_data + nxyz * t + j);
-                    vec_file2[t] = *(nii_bold_data + nxyz * t + j);
-                }
-                *(correl_file_data + nxyz * (shift + 3) + j) =  ren_correl(vec_file1, vec_file2, size_time);
+            for (int j = 0; j != nxyz; ++j) {
+                int k = nxyz * (shift + 3) + j;
+                *(correl_file_data + k) = ren_correl_from_sums(
+                    size_time, sum_x[k], sum_y[j], sum_xx[k], sum_yy[j],
+                    sum_xy[k]);
             }
         }
 
-
-
-        // Get back to default
-        for (int i = 0; i != nr_voxels; ++i) {
-            *(nii_boco_vaso_data + i) = *(nii_nulled_data + i)
-                                        / *(nii_bold_data + i);
-        }
-
-        // Clean VASO values that are unrealistic
-        for (int i = 0; i != nr_voxels; ++i) {
-           if (*(nii_boco_vaso_data + i) <= 0) {
-                *(nii_boco_vaso_data + i) = 0;
-            }
-            if (*(nii_boco_vaso_data + i) >= 2) {
-                *(nii_boco_vaso_data + i) = 2;
-            }
-        }
-
-            // Replace nans with zeros
-        for (int i = 0; i < nr_voxels; ++i) {
+        // Replace nans with zeros
+        for (int i = 0; i < correl_file->nvox; ++i) {
             if (*(correl_file_data + i)!= *(correl_file_data + i)) {
                *(correl_file_data + i) = 0;
             }
@@ -282,69 +410,38 @@ int main(int argc, char * argv[]) {
              << ". This means there are " << (float)size_time / (float)trialdur
              <<  " trials recorded here." << endl;
 
-        int nr_trials = size_time / trialdur;
         // Trial averave file
         nifti_image *nii_avg1 = nifti_copy_nim_info(nii1);
+        pipeline_image_track(nii_avg1);
         nii_avg1->nt = trialdur;
-        nii_avg1->nvox = nii1->nvox / size_time * trialdur;
+        nii_avg1->nvox = nxyz * trialdur;
         nii_avg1->datatype = NIFTI_TYPE_FLOAT32;
         nii_avg1->nbyper = sizeof(float);
         nii_avg1->data = calloc(nii_avg1->nvox, nii_avg1->nbyper);
         float  *nii_avg1_data  = static_cast<float*>(nii_avg1->data);
 
         nifti_image *nii_avg2 = nifti_copy_nim_info(nii1);
+        pipeline_image_track(nii_avg2);
         nii_avg2->nt = trialdur;
-        nii_avg2->nvox = nii1->nvox / size_time * trialdur;
+        nii_avg2->nvox = nxyz * trialdur;
         nii_avg2->datatype = NIFTI_TYPE_FLOAT32;
         nii_avg2->nbyper = sizeof(float);
         nii_avg2->data = calloc(nii_avg2->nvox, nii_avg2->nbyper);
         float  *nii_avg1_B_data  = static_cast<float*>(nii_avg2->data);
 
-        float avg_Nulled[trialdur];
-        float avg_BOLD[trialdur];
+        for (int i = 0; i < nxyz * trialdur; ++i) {
+            *(nii_avg1_data + i) = avg_Nulled[i] / avg_BOLD[i];
+            *(nii_avg1_B_data + i) = avg_BOLD[i];
 
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_y; ++iy) {
-                for (int ix = 0; ix < size_x; ++ix) {
-                    for (int it = 0; it < trialdur; ++it) {
-                        avg_Nulled[it] = 0;
-                        avg_BOLD[it] = 0;
-                    }
-                    for (int it = 0; it < trialdur * nr_trials; ++it) {
-                        int voxel_i = nxyz * it + nxy * iz + nx * iy + ix;
-                        avg_Nulled[it % trialdur] +=
-                            *(nii_nulled_data + voxel_i) / nr_trials;
-                        avg_BOLD[it % trialdur] +=
-                            *(nii_bold_data + voxel_i) / nr_trials;
-                    }
-
-                    for (int it = 0; it < trialdur; ++it) {
-                        int voxel_i = nxyz * it + nxy * iz + nx * iy + ix;
-                        *(nii_avg1_data + voxel_i) = avg_Nulled[it] / avg_BOLD[it];
-                        *(nii_avg1_B_data + voxel_i) = avg_BOLD[it];
-
-                    }
-                }
+            // Clean VASO values that are unrealistic
+            if (*(nii_avg1_data + i) <= 0) {
+                *(nii_avg1_data + i) = 0;
             }
-        }
-
-        // Clean VASO values that are unrealistic
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_y; ++iy) {
-                for (int ix = 0; ix < size_x; ++ix) {
-                    for (int it = 0; it < trialdur; ++it) {
-                        int voxel_i = nxyz * it + nxy * iz + nx * iy + ix;
-
-                        if (*(nii_avg1_data + voxel_i) <= 0) {
-                            *(nii_avg1_data + voxel_i) = 0;
-                        }
-                        if (*(nii_avg1_data + voxel_i) >= 2) {
-                            *(nii_avg1_data + voxel_i) = 2;
-                        }
-                    }
-                }
+            if (*(nii_avg1_data + i) >= 2) {
+                *(nii_avg1_data + i) = 2;
             }
         }
+
         if (use_outpath) {
             save_output_nifti("VASO_trialAV_LN", "", nii_avg1, true, true);
             save_output_nifti("BOLD_trialAV_LN", "", nii_avg2, true, true);
@@ -354,19 +451,8 @@ int main(int argc, char * argv[]) {
         }
     }
 
-
-    // Replace nans with zeros
-    for (int i = 0; i < nr_voxels; ++i) {
-        if (*(nii_boco_vaso_data + i)!= *(nii_boco_vaso_data + i)) {
-           *(nii_boco_vaso_data + i) = 0;
-        }
-    }
-
-    if (use_outpath) {
-        save_output_nifti("VASO_LN", "", nii_boco_vaso, true, true);
-    } else {
-        save_output_nifti(fout, "VASO_LN", nii_boco_vaso, true);
-    }
+    nifti_stream_close(stream1);
+    nifti_stream_close(stream2);
 
     cout << "  Finished." << endl;
     return 0;
@@ -27,6 +27,7 @@ int show_help(void) {
     "                  steps of the algorithm (e.g. for debugging) \n"
     "    -output     : (Optional) Output filename, including .nii or\n"
     "                  .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - The layer nii file and the landmarks nii file should have the \n"
@@ -52,6 +53,10 @@ int main(int argc, char *argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -layers\n");
@@ -102,12 +107,12 @@ int main(int argc, char *argv[]) {
     }
 
     // Read input dataset
-    nifti_image * nii_input1 = nifti_image_read(fin_layer, 1);
+    nifti_image * nii_input1 = pipeline_image_read(fin_layer, 1);
     if (!nii_input1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_layer);
         return 2;
     }
-    nifti_image * nii_input2 = nifti_image_read(fin_landmark, 1);
+    nifti_image * nii_input2 = pipeline_image_read(fin_landmark, 1);
     if (!nii_input2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_landmark);
         return 2;
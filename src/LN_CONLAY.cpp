@@ -6,6 +6,33 @@
 #include "../dep/nifti2_io.h"
 #include "../dep/laynii_lib.h"
 
+// One output voxel along one axis covers these input voxels with these
+// fractions of their width.
+struct axis_overlap {
+    vector<int> start;  // Per output voxel, first entry in index/weight
+    vector<int> index;
+    vector<double> weight;
+};
+
+axis_overlap make_axis_overlap(const int size_in, const int size_out) {
+    const double ratio = static_cast<double>(size_in) / size_out;
+    axis_overlap a;
+    for (int o = 0; o < size_out; ++o) {
+        a.start.push_back(a.index.size());
+        double lo = o * ratio;
+        double hi = (o + 1) * ratio;
+        for (int i = floor(lo); i < ceil(hi) && i < size_in; ++i) {
+            double w = min(i + 1., hi) - max(static_cast<double>(i), lo);
+            if (w > 1e-6) {
+                a.index.push_back(i);
+                a.weight.push_back(w);
+            }
+        }
+    }
+    a.start.push_back(a.index.size());
+    return a;
+}
+
 int show_help(void) {
     printf(
     "LN_CONLAY: This program consenses the layers on a lower resolution grid \n"
@@ -14,8 +41,9 @@ int show_help(void) {
     "           want to use it on lower resolution functional data \n"
     "           This program has been originally written for Federico \n"
     "\n"
-    "           The two used spatial grids need to be scaled by intager values \n"
-    "           this program does not have a interpolation adapter \n"
+    "           The two used spatial grids are best scaled by integer values. \n"
+    "           For non-integer ratios, each input voxel contributes with \n"
+    "           the fraction of it that overlaps the output voxel. \n"
     "\n"
     "Usage: \n"
     "    LN_CONLAY -layers highres_layers.nii -ref funct.nii -output lowres_layers.nii\n"
@@ -36,6 +64,11 @@ int show_help(void) {
     "                  I would only recommend this for odd scale factors \n"
     "                  otherwiese your results will be dependent on the \n"
     "                  specific convention of upscaling tools e.g. AFNI!=BV \n"
+    "    -majority   : (Optional) Take the most frequent layer in each output\n"
+    "                  voxel instead of the local average, so that the output\n"
+    "                  only contains the input labels. Ties go to the lower\n"
+    "                  layer. Cannot be combined with -subsample.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -43,6 +76,7 @@ int show_help(void) {
 int main(int argc, char*  argv[]) {
     bool use_outpath = false ;
     bool subsample = false ;
+    bool majority = false;
     char *fout = NULL ;
     char *fin_1 = NULL, *fin_2 = NULL;
     int ac;
@@ -52,6 +86,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -67,6 +105,8 @@ int main(int argc, char*  argv[]) {
         } else if (!strcmp(argv[ac], "-subsample")) {
             subsample = true;
             cout << "I am subsampling the voxel centroid"  << endl;
+        } else if (!strcmp(argv[ac], "-majority")) {
+            majority = true;
         } else if (!strcmp(argv[ac], "-output")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -output\n");
@@ -87,14 +127,18 @@ int main(int argc, char*  argv[]) {
         fprintf(stderr, "** missing option '-ref'\n");
         return 1;
     }
+    if (subsample && majority) {
+        fprintf(stderr, "** '-majority' cannot be combined with '-subsample'\n");
+        return 1;
+    }
 
     // Read input dataset
-    nifti_image* nii1 = nifti_image_read(fin_1, 1);
+    nifti_image* nii1 = pipeline_image_read(fin_1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_1);
         return 2;
     }
-    nifti_image* nii2 = nifti_image_read(fin_2, 1);
+    nifti_image* nii2 = pipeline_image_read(fin_2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_2);
         return 2;
@@ -125,6 +169,7 @@ int main(int argc, char*  argv[]) {
     //float* nii_outlay_data = static_cast<float*>(nii_outlay->data);
 
     nifti_image* nii_outlay = nifti_copy_nim_info(nii2);
+    pipeline_image_track(nii_outlay);
     nii_outlay->datatype = NIFTI_TYPE_FLOAT32;
     nii_outlay->nbyper = sizeof(float);
     nii_outlay->nvox =  nii_outlay->nvox/nii_outlay->nt ;
@@ -161,15 +206,15 @@ int main(int argc, char*  argv[]) {
     if ((fmod(sratio_x,1)>4.76838e-06 && fmod(sratio_x,1)<1.-4.76838e-06)|| (fmod(sratio_y,1)>4.76838e-06 && fmod(sratio_y,1)<1.-4.76838e-06 ) || (fmod(sratio_z,1)>4.76838e-06 && fmod(sratio_z,1)<1.-4.76838e-06)) { //4.76838e-07is precision of float
         cout << " ******************************************* " << endl;
         cout << " *** there is a non intager ratio of the *** " << endl;
-        cout << " *** matrix size. This is not recommended ** " << endl;
-        cout << " *** I hope you know what you are doing. *** " << endl;
+        cout << " *** matrix size. Input voxels will be   *** " << endl;
+        cout << " *** weighted by their overlap.          *** " << endl;
         cout << " ******************************************* " << endl;
     }
     if ((fmod(rratio_x,1)>4.76838e-06 && fmod(rratio_x,1)<1.-4.76838e-06)|| (fmod(rratio_y,1)>4.76838e-06 && fmod(rratio_y,1)<1.-4.76838e-06 ) || (fmod(rratio_z,1)>4.76838e-06 && fmod(rratio_z,1)<1.-4.76838e-06)) {
         cout << " ******************************************* " << endl;
         cout << " *** there is a non intager ratio of the *** " << endl;
-        cout << " *** voxel size. This is not recommended *** " << endl;
-        cout << " *** I hope you know what you are doing. *** " << endl;
+        cout << " *** voxel size. Input voxels will be    *** " << endl;
+        cout << " *** weighted by their overlap.          *** " << endl;
         cout << " ******************************************* " << endl;
     }
 
@@ -187,57 +232,128 @@ int main(int argc, char*  argv[]) {
 
 
     // ========================================================================
-    // Copy voxel from the bigger input nifti image by averaging
-    if (!subsample) {
-        cout << "    I am averaging not subsampling" << endl;
-        int lo_z, lo_y, lo_x ;
-        float mean_val = 0.;
-        float nr_vox = 0;
+    // Overlap of input and output voxels along each axis
+    const axis_overlap ax = make_axis_overlap(size_x, size_xout);
+    const axis_overlap ay = make_axis_overlap(size_y, size_yout);
+    const axis_overlap az = make_axis_overlap(size_z, size_zout);
+    bool integer_ratio = true;
+    for (size_t i = 0; i < ax.weight.size(); ++i) integer_ratio &= ax.weight[i] == 1;
+    for (size_t i = 0; i < ay.weight.size(); ++i) integer_ratio &= ay.weight[i] == 1;
+    for (size_t i = 0; i < az.weight.size(); ++i) integer_ratio &= az.weight[i] == 1;
 
+    // ========================================================================
+    // Copy voxel from the bigger input nifti image by averaging
+    if (!subsample && !majority) {
+        log_stage("I am averaging not subsampling");
 
         for (int it = 0; it < size_timeout; ++it) {
-            for (int iz = 0; iz <size_z ; iz=iz+sratio_z) {
-                for (int iy = 0 ; iy < size_y; iy=iy+sratio_y) {
-                    for (int ix = 0; ix < size_x; ix=ix+sratio_x) {
-                        mean_val = 0.;
-                        nr_vox = 0;
-                        for (int jz = iz; jz < iz+sratio_z ; ++jz) {
-                            for (int jy = iy ; jy < iy+sratio_y; ++jy) {
-                                for (int jx = ix; jx < ix+sratio_x; ++jx) {
-                                    if ( *(nii1_data + nxyz * it + nxy * jz + nx * jy + jx) > 0 ){
-                                        mean_val = mean_val + (float)(*(nii1_data + nxyz * it + nxy * jz + nx * jy + jx)) ;
-                                        nr_vox++;
+            // Output slabs are independent, so they are computed in parallel.
+            // Every output voxel is summed in the same order, so results do
+            // not depend on the number of threads.
+            #pragma omp parallel for
+            for (int iz = 0; iz < size_zout; ++iz) {
+                for (int iy = 0; iy < size_yout; ++iy) {
+                    for (int ix = 0; ix < size_xout; ++ix) {
+                        float mean_val = 0.;
+                        float nr_vox = 0;
+                        if (integer_ratio) {  // Fast path, whole input voxels
+                            for (int jz = az.index[az.start[iz]]; jz <= az.index[az.start[iz + 1] - 1]; ++jz) {
+                                for (int jy = ay.index[ay.start[iy]]; jy <= ay.index[ay.start[iy + 1] - 1]; ++jy) {
+                                    const short* row = nii1_data + nxyz * it + nxy * jz + nx * jy;
+                                    for (int jx = ax.index[ax.start[ix]]; jx <= ax.index[ax.start[ix + 1] - 1]; ++jx) {
+                                        if (row[jx] > 0) {
+                                            mean_val += row[jx];
+                                            nr_vox++;
+                                        }
+                                    }
+                                }
+                            }
+                        } else {  // Fractions of input voxels
+                            for (int kz = az.start[iz]; kz < az.start[iz + 1]; ++kz) {
+                                for (int ky = ay.start[iy]; ky < ay.start[iy + 1]; ++ky) {
+                                    const short* row = nii1_data + nxyz * it + nxy * az.index[kz] + nx * ay.index[ky];
+                                    const double wzy = az.weight[kz] * ay.weight[ky];
+                                    for (int kx = ax.start[ix]; kx < ax.start[ix + 1]; ++kx) {
+                                        short val = row[ax.index[kx]];
+                                        if (val > 0) {
+                                            mean_val += wzy * ax.weight[kx] * val;
+                                            nr_vox += wzy * ax.weight[kx];
+                                        }
                                     }
                                 }
                             }
                         }
-
-                        lo_x = ix/sratio_x ;
-                        lo_y = iy/sratio_y ;
-                        lo_z = iz/sratio_z ;
-                        if (nr_vox != 0 ) mean_val = mean_val/nr_vox ;
-                        *(nii_outlay_data + nxyzo * it + nxyo * lo_z + nxo * lo_y + lo_x) =  mean_val;
+                        if (nr_vox != 0) mean_val = mean_val / nr_vox;
+                        *(nii_outlay_data + nxyzo * it + nxyo * iz + nxo * iy + ix) = mean_val;
                     }
                 }
             }
         }
     }
 
+    // ========================================================================
+    // Take the most frequent layer of the bigger input nifti image
+    if (!subsample && majority) {
+        log_stage("Taking the most frequent layer...");
+
+        for (int it = 0; it < size_timeout; ++it) {
+            #pragma omp parallel for
+            for (int iz = 0; iz < size_zout; ++iz) {
+                vector<short> labels;
+                vector<double> votes;
+                for (int iy = 0; iy < size_yout; ++iy) {
+                    for (int ix = 0; ix < size_xout; ++ix) {
+                        labels.clear();
+                        votes.clear();
+                        for (int kz = az.start[iz]; kz < az.start[iz + 1]; ++kz) {
+                            for (int ky = ay.start[iy]; ky < ay.start[iy + 1]; ++ky) {
+                                const short* row = nii1_data + nxyz * it + nxy * az.index[kz] + nx * ay.index[ky];
+                                const double wzy = az.weight[kz] * ay.weight[ky];
+                                for (int kx = ax.start[ix]; kx < ax.start[ix + 1]; ++kx) {
+                                    short val = row[ax.index[kx]];
+                                    if (val > 0) {
+                                        size_t k = 0;
+                                        while (k < labels.size() && labels[k] != val) ++k;
+                                        if (k == labels.size()) {
+                                            labels.push_back(val);
+                                            votes.push_back(0);
+                                        }
+                                        votes[k] += wzy * ax.weight[kx];
+                                    }
+                                }
+                            }
+                        }
+                        short winner = 0;
+                        double winner_votes = 0;
+                        for (size_t k = 0; k < labels.size(); ++k) {
+                            if (votes[k] > winner_votes
+                                || (votes[k] == winner_votes && labels[k] < winner)) {
+                                winner = labels[k];
+                                winner_votes = votes[k];
+                            }
+                        }
+                        *(nii_outlay_data + nxyzo * it + nxyo * iz + nxo * iy + ix) = winner;
+                    }
+                }
+            }
+        }
+    }
 
     // ========================================================================
     // Copy voxel from the bigger input nifti image by subsampling
 
     if (subsample) {
         cout << "I am subsampling not averaging " << endl;
-        int up_z, up_y, up_x ;
 
         for (int it = 0; it < size_timeout; ++it) {
+            #pragma omp parallel for
             for (int iz = 0; iz <size_zout ; ++iz) {
                 for (int iy = 0 ; iy < size_yout; ++iy) {
                     for (int ix = 0; ix < size_xout; ++ix) {
-                        up_x = ix*sratio_x + (int)(sratio_x)/2 ; // The division with two is to calculate based on voxel centroits rather than voxel edges
-                        up_y = iy*sratio_y + (int)(sratio_y)/2 ;
-                        up_z = iz*sratio_z + (int)(sratio_z)/2 ;
+                        // Input voxel at the centroid of the output voxel
+                        int up_x = min(static_cast<int>((ix + 0.5) * sratio_x), size_x - 1);
+                        int up_y = min(static_cast<int>((iy + 0.5) * sratio_y), size_y - 1);
+                        int up_z = min(static_cast<int>((iz + 0.5) * sratio_z), size_z - 1);
                         *(nii_outlay_data + nxyzo * it + nxyo * iz + nxo * iy + ix) =  (float)(*(nii1_data + nxyz * it + nxy * up_z + nx * up_y + up_x)) ;
                     }
                 }
@@ -10,14 +10,20 @@ int show_help(void) {
     "Usage:\n"
     "    LN_CORREL2FILES -file1 file1.nii -file2 file2.nii \n"
     "    ../LN_CORREL2FILES -file1 lo_Nulled_intemp.nii -file2 lo_BOLD_intemp.nii \n"
+    "    ../LN_CORREL2FILES -file1 lo_Nulled_intemp.nii -file2 lo_BOLD_intemp.nii -lags 3 \n"
     "\n"
     "Options:\n"
     "    -help   : Show this help.\n"
     "    -file1  : First time series.\n"
     "    -file2  : Second time series with should have the same dimensions \n"
     "              as first time series.\n"
+    "    -lags   : (Optional) Also correlate file1 at time t with file2 at\n"
+    "              time t + lag, for lag = -lags to lags. The output then has\n"
+    "              one volume per lag, starting with -lags. At most the\n"
+    "              number of time points minus 2. Default is 0.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - This program is motivated by Eli Merriam comparing in hunting down \n"
@@ -32,13 +38,17 @@ int main(int argc, char *argv[]) {
     bool use_outpath = false ;
     char  *fout = NULL ;
     char *fin_1 = NULL, *fin_2 = NULL;
-    int ac;
+    int ac, max_lag = 0;
     if (argc < 2) return show_help();
 
     // Process user options
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-file1")) {
             cout << "Hello " << endl;
             if (++ac >= argc) {
@@ -52,6 +62,16 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             fin_2 = argv[ac];
+        } else if (!strcmp(argv[ac], "-lags")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -lags\n");
+                return 1;
+            }
+            max_lag = atoi(argv[ac]);
+            if (max_lag < 0) {
+                fprintf(stderr, "** -lags should not be negative\n");
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-output")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -output\n");
@@ -75,12 +95,12 @@ int main(int argc, char *argv[]) {
     }
 
     // Read input dataset
-    nifti_image* nii1 = nifti_image_read(fin_1, 1);
+    nifti_image* nii1 = pipeline_image_read(fin_1, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin_1);
         return 2;
     }
-    nifti_image*nii2 = nifti_image_read(fin_2, 1);
+    nifti_image*nii2 = pipeline_image_read(fin_2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin_2);
         return 2;
@@ -95,10 +115,15 @@ int main(int argc, char *argv[]) {
     int size_x = nii1->nx;
     int size_y = nii1->ny;
     int size_time = nii1->nt;
-    int nx = nii1->nx;
-    int nxy = nii1->nx * nii1->ny;
     int nxyz = nii1->nx * nii1->ny * nii1->nz;
 
+    // A lag needs at least two overlapping time points for a correlation
+    if (max_lag > 0 && max_lag > size_time - 2) {
+        fprintf(stderr, "** -lags %d is too large for %d time points, "
+                "maximum is %d\n", max_lag, size_time, max(size_time - 2, 0));
+        return 1;
+    }
+
     // ========================================================================
     // Fix datatype issues
     nifti_image* nii1_temp = copy_nifti_as_float32(nii1);
@@ -106,29 +131,39 @@ int main(int argc, char *argv[]) {
     nifti_image* nii2_temp = copy_nifti_as_float32(nii2);
     float* nii2_temp_data = static_cast<float*>(nii2_temp->data);
 
-    // Allocate new nifti
+    // Allocate new nifti, one volume per lag
+    const int nr_lags = 2 * max_lag + 1;
     nifti_image *correl_file = nifti_copy_nim_info(nii1_temp);
-    correl_file->nt = 1;
-    correl_file->nvox = size_x * size_y * size_z;
+    pipeline_image_track(correl_file);
+    correl_file->nt = nr_lags;
+    correl_file->nvox = size_x * size_y * size_z * nr_lags;
     correl_file->data = calloc(correl_file->nvox, correl_file->nbyper);
     float *correl_file_data = static_cast<float*>(correl_file->data);
     // ========================================================================
+    if (max_lag > 0) {
+        cout << "  Calculating lags = " << -max_lag << " to " << max_lag << endl;
+    }
 
-    double vec1[size_time], vec2[size_time];
-    for (int iz = 0; iz < size_z; ++iz) {
-        for (int iy = 0; iy < size_y; ++iy) {
-            for (int ix = 0; ix < size_x; ++ix) {
-                int voxel_i = nxy * iz + nx * iy + ix;
-                for (int it = 0; it < size_time; ++it) {
-                    int voxel_j = nxyz * it + nxy * iz + nx * iy + ix;
-                    vec1[it] = *(nii1_temp_data + voxel_j);
-                    vec2[it] = *(nii2_temp_data + voxel_j);
-                }
-                *(correl_file_data + voxel_i) =
-                    static_cast<float>(ren_correl(vec1, vec2, size_time));
+    // Voxels are independent, so they are computed in parallel.
+    // All lags of a voxel come from one pass over its time courses.
+    #pragma omp parallel
+    {
+        vector<double> vec1(size_time), vec2(size_time), correl(nr_lags);
+        #pragma omp for
+        for (int voxel_i = 0; voxel_i < nxyz; ++voxel_i) {
+            for (int it = 0; it < size_time; ++it) {
+                vec1[it] = *(nii1_temp_data + nxyz * it + voxel_i);
+                vec2[it] = *(nii2_temp_data + nxyz * it + voxel_i);
+            }
+            ren_lag_correl(vec1.data(), vec2.data(), size_time, max_lag,
+                           correl.data());
+            for (int k = 0; k < nr_lags; ++k) {
+                *(correl_file_data + nxyz * k + voxel_i) =
+                    static_cast<float>(correl[k]);
             }
         }
     }
+    timing_count(static_cast<uint64_t>(nxyz) * size_time * nr_lags);
 
     if (!use_outpath) fout = fin_1;
     save_output_nifti(fout, "correlated", correl_file, true, use_outpath);
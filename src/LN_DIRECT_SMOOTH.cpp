@@ -21,6 +21,7 @@ int show_help(void) {
     "    -Anonymous_sri : You know what you did (no FWHM).\n"
     "    -output        : (Optional) Output filename, including .nii or\n"
     "                     .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - This program ignores zeroes. Thus, sharp borders (e.g. after MOCO)\n"
@@ -46,6 +47,10 @@ int main(int argc, char* argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -92,7 +97,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Read input dataset, including data
-    nifti_image* nii1 = nifti_image_read(fin, 1);
+    nifti_image* nii1 = pipeline_image_read(fin, 1);
     if (!nii1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -23,6 +23,7 @@ int show_help(void) {
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
     "              Note that the output name will always contain MaxTR/MinTR tags.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -38,6 +39,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-output")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -output\n");
@@ -57,12 +62,13 @@ int main(int argc, char * argv[]) {
         fprintf(stderr, "** missing option '-input'\n");
         return 1;
     }
-    // Read input dataset, including data
-    nifti_image* nii_in = nifti_image_read(fin_1, 1);
-    if (!nii_in) {
+    // Read input header, data is streamed in chunks below
+    nifti_stream* stream = nifti_stream_open_read(fin_1);
+    if (!stream) {
       fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_1);
       return 2;
     }
+    nifti_image* nii_in = stream->nii;
 
     log_welcome("LN_EXTREMETR");
     log_nifti_descriptives(nii_in);
@@ -71,18 +77,12 @@ int main(int argc, char * argv[]) {
     const int size_x = nii_in->nx;
     const int size_y = nii_in->ny;
     const int size_z = nii_in->nz;
-    const int size_time = nii_in->nt;
-    const int nx = size_x;
-    const int nxy = size_x * size_y;
     const int nxyz = size_x * size_y * size_z;
 
     // ========================================================================
-    // Fix datatype issues
-    nifti_image* nii = copy_nifti_as_float32(nii_in);
-    float* nii_data = static_cast<float*>(nii->data);
-
     // Allocate new nifti images
-    nifti_image* nii_max = nifti_copy_nim_info(nii);
+    nifti_image* nii_max = nifti_copy_nim_info(nii_in);
+    pipeline_image_track(nii_max);
     nii_max->nt = 1;
     nii_max->datatype = NIFTI_TYPE_FLOAT32;
     nii_max->nbyper = sizeof(float);
@@ -90,7 +90,8 @@ int main(int argc, char * argv[]) {
     nii_max->data = calloc(nii_max->nvox, nii_max->nbyper);
     float* nii_max_data = static_cast<float*>(nii_max->data);
 
-    nifti_image* nii_min = nifti_copy_nim_info(nii);
+    nifti_image* nii_min = nifti_copy_nim_info(nii_in);
+    pipeline_image_track(nii_min);
     nii_min->nt = 1;
     nii_min->datatype = NIFTI_TYPE_FLOAT32;
     nii_min->nbyper = sizeof(float);
@@ -98,30 +99,60 @@ int main(int argc, char * argv[]) {
     nii_min->data = calloc(nii_min->nvox, nii_min->nbyper);
     float* nii_min_data = static_cast<float*>(nii_min->data);
 
+    // Running extremes per voxel, updated volume by volume
+    float* max_val = new float[nxyz];
+    float* min_val = new float[nxyz];
+    int* max_tr = new int[nxyz];
+    int* min_tr = new int[nxyz];
+    for (int i = 0; i < nxyz; ++i) {
+        max_val[i] = 0;
+        min_val[i] = std::numeric_limits<float>::max();
+        max_tr[i] = -1;
+        min_tr[i] = -1;
+    }
+
     // ========================================================================
-    int TR_max = 0, TR_min = 0;
+    nifti_image* chunk_in;
+    while ((chunk_in = nifti_stream_read_chunk(stream)) != NULL) {
+        // Fix datatype issues
+        nifti_image* chunk = copy_nifti_as_float32(chunk_in);
+        float* chunk_data = static_cast<float*>(chunk->data);
+        const int nr_slab_voxels = chunk->nx * chunk->ny * chunk->nz;
+        const int offset = stream->chunk_z * size_x * size_y;
 
-    for (int iz = 0; iz < size_z; ++iz) {
-        for (int iy = 0; iy < size_y; ++iy) {
-            for (int ix = 0; ix < size_x; ++ix) {
-                int voxel_i = nxy * iz + nx * iy + ix;
-                float max_val = 0;
-                float min_val = std::numeric_limits<float>::max();
-                for (int it = 0; it < size_time; ++it) {
-                    int voxel_j = nxyz * it + nxy * iz + nx * iy + ix;
-                    if (*(nii_data + voxel_j) > max_val) {
-                        max_val = *(nii_data + voxel_j);
-                        TR_max = it;
-                    }
-                    if (*(nii_data + voxel_j) < min_val) {
-                        min_val = *(nii_data + voxel_j);
-                        TR_min = it;
-                    }
+        for (int t = 0; t < chunk->nt; ++t) {
+            int it = stream->chunk_t + t;
+            for (int i = 0; i < nr_slab_voxels; ++i) {
+                int voxel_i = offset + i;
+                float val = *(chunk_data + nr_slab_voxels * t + i);
+                if (val > max_val[voxel_i]) {
+                    max_val[voxel_i] = val;
+                    max_tr[voxel_i] = it;
+                }
+                if (val < min_val[voxel_i]) {
+                    min_val[voxel_i] = val;
+                    min_tr[voxel_i] = it;
                 }
-                *(nii_min_data + voxel_i) = TR_min;
-                *(nii_max_data + voxel_i) = TR_max;
-           }
+            }
+        }
+        pipeline_image_free(chunk);
+        pipeline_image_free(chunk_in);
+    }
+    if (!nifti_stream_close(stream)) {
+        return 2;
+    }
+
+    // Voxels without an extreme keep the last found time point
+    int TR_max = 0, TR_min = 0;
+    for (int i = 0; i < nxyz; ++i) {
+        if (max_tr[i] >= 0) {
+            TR_max = max_tr[i];
+        }
+        if (min_tr[i] >= 0) {
+            TR_min = min_tr[i];
         }
+        *(nii_min_data + i) = TR_min;
+        *(nii_max_data + i) = TR_max;
     }
     if (!use_outpath) fout = fin_1;
     save_output_nifti(fout, "MaxTR", nii_max, true);
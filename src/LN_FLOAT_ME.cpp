@@ -15,6 +15,7 @@ int show_help(void) {
     "    -input  : Dataset that should be shorted data.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -29,6 +30,10 @@ int main(int argc, char *argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -54,40 +59,56 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image *nii = nifti_image_read(fin, 1);
-    if (!nii) {
+    // Read input header, data is streamed in chunks below
+    nifti_stream* stream_in = nifti_stream_open_read(fin);
+    if (!stream_in) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
     }
+    nifti_image *nii = stream_in->nii;
 
     log_welcome("LN_FLOAT_ME");
     log_nifti_descriptives(nii);
 
-    // Get dimensions of input
-    const int size_x = nii->nx;
-    const int size_y = nii->ny;
-    const int size_z = nii->nz;
-    const int size_t = nii->nt;
-    const int nr_voxels = size_t * size_z * size_y * size_x;
-
-    // Cast input data to float
-    nifti_image *nii_new = copy_nifti_as_float32(nii);
-    float* nii_new_data = static_cast<float*>(nii_new->data);
+    // Prepare output header
+    nifti_image *nii_new = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_new);
+    nii_new->datatype = NIFTI_TYPE_FLOAT32;
+    nii_new->nbyper = sizeof(float);
+    nii_new->scl_slope = 1.;
+    nii_new->scl_inter = 0.;
+    if (!use_outpath) fout = fin;
+    nifti_stream* stream_out = nifti_stream_open_write(nii_new, fout, "float",
+                                                       true, use_outpath);
+    if (!stream_out) {
+        return 2;
+    }
 
     // Handle nifti header scl_slope and scl_inter effects
     float scl_slope = nii->scl_slope;
     float scl_inter = nii->scl_inter;
-    for (int i = 0; i != nr_voxels; ++i) {
-        *(nii_new_data + i) *= scl_slope;
-        *(nii_new_data + i) += scl_inter;
-    }
-    nii_new->scl_slope = 1.;
-    nii_new->scl_inter = 0.;
 
-    // Save
-    if (!use_outpath) fout = fin;
-    save_output_nifti(fout, "float", nii_new, true, use_outpath);
+    nifti_image* chunk;
+    while ((chunk = nifti_stream_read_chunk(stream_in)) != NULL) {
+        // Cast input data to float
+        nifti_image *chunk_new = copy_nifti_as_float32(chunk);
+        float* chunk_new_data = static_cast<float*>(chunk_new->data);
+        const int nr_voxels = chunk_new->nvox;
+
+        for (int i = 0; i != nr_voxels; ++i) {
+            *(chunk_new_data + i) *= scl_slope;
+            *(chunk_new_data + i) += scl_inter;
+        }
+        if (!nifti_stream_write_chunk(stream_out, chunk_new)) {
+            return 2;
+        }
+        pipeline_image_free(chunk_new);
+        pipeline_image_free(chunk);
+    }
+    nifti_stream_close(stream_in);
+    if (!nifti_stream_close(stream_out)) {
+        return 2;
+    }
 
     cout << "  Finished." << endl;
     return 0;
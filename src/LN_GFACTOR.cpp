@@ -1,19 +1,5 @@
-
-
 #include "../dep/laynii_lib.h"
 
-int N_rand = 1000;
-double_t lower = -10;
-double_t upper = 10;
-
-double verteilung(double x);
-typedef double ( * Functions)(double);
-Functions pFunc = verteilung;
-
-double_t arb_pdf_num(int N_rand, double ( * pFunc)(double), double_t lower,
-                     double_t upper);
-double adjusted_rand_numbers(double mean, double stdev, double value);
-
 int show_help(void) {
     printf(
     "LN_GFACTOR: Simulating where the g-factor penalty would be largest.\n"
@@ -21,37 +7,145 @@ int show_help(void) {
     "Usage:\n"
     "    LN_GFACTOR -input MEAN.nii -variance 1 -direction 1 -grappa 2 -cutoff 150 \n"
     "    ../LN_GFACTOR -input sc_INV2.nii  -variance 1 -direction 1 -grappa 2 -cutoff 200 \n"
+    "    LN_GFACTOR -input MEAN.nii -variance 1 -direction 1 -grappa 2,3,4 -cutoff 100,150 \n"
     "\n"
     "Options:\n"
     "    -help      : Show this help.\n"
     "    -input     : Specify input dataset.\n"
     "    -variance  : How much noise there will be.\n"
     "    -direction : Phase encoding direction [0=x, 1=y, 2=z].\n"
-    "    -grappa    : GRAPPA factor."
-    "    -cutoff    : Value to separate noise from signal.\n"
+    "    -grappa    : GRAPPA factor. A comma separated list (e.g. 2,3,4) runs\n"
+    "                 all factors in one go.\n"
+    "    -cutoff    : Value to separate noise from signal. Can also be a comma\n"
+    "                 separated list.\n"
+    "    -seed      : (Optional) Seed of the random numbers. Default is 0.\n"
     "    -output    : (Optional) Output filename, including .nii or\n"
     "                 .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    An example application is mentioned on the blog post here: \n"
     "    <https://layerfmri.com/grappa-kernel-size> \n"
+    "    When more than one GRAPPA factor or cut-off is given, every combination\n"
+    "    is simulated from a single read of the input. The output file names\n"
+    "    then get a suffix such as '_grappa2_cutoff150'.\n"
     "\n");
     return 0;
 }
 
+
+// ============================================================================
+// Simulates one GRAPPA factor and cut-off. Voxels that alias onto each other
+// are 'grappa' segments apart along the phase encoding direction. Each group
+// of aliasing rows is folded and written out in one pass with contiguous
+// access along x. Slices are independent, so they are split across threads.
+// ============================================================================
+void simulate_gfactor(const float* input, float* binary, float* gmap,
+                      float* noise, const int nx, const int ny, const int nz,
+                      const int nt, const int direction, const int grappa,
+                      const float cutoff, const float variance,
+                      const uint64_t seed) {
+    const int64_t nxy = static_cast<int64_t>(nx) * ny;
+    const int64_t nxyz = nxy * nz;
+
+    // Trim the phase encoding direction to a multiple of the GRAPPA factor
+    int size_x = nx, size_y = ny, size_z = nz;
+    if (direction == 0) size_x -= nx % grappa;
+    if (direction == 1) size_y -= ny % grappa;
+    if (direction == 2) size_z -= nz % grappa;
+
+    // Distance between aliasing voxels and the ranges of one segment
+    int64_t seg_step;
+    int row_len = size_x, nr_rows = size_y, nr_slices = size_z;
+    if (direction == 0) {
+        row_len = size_x / grappa;
+        seg_step = row_len;
+    } else if (direction == 1) {
+        nr_rows = size_y / grappa;
+        seg_step = nx * nr_rows;
+    } else {
+        nr_slices = size_z / grappa;
+        seg_step = nxy * nr_slices;
+    }
+
+    #pragma omp parallel
+    {
+        vector<float> fold(row_len);
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int it = 0; it < nt; ++it) {
+            for (int iz = 0; iz < nr_slices; ++iz) {
+                for (int iy = 0; iy < nr_rows; ++iy) {
+                    int64_t row = nxyz * it + nxy * iz + nx * iy;
+
+                    // Fold the aliasing segments (in segment order, so the
+                    // float sums do not depend on the thread layout)
+                    for (int ix = 0; ix < row_len; ++ix) {
+                        fold[ix] = 0;
+                    }
+                    for (int seg = 0; seg < grappa; ++seg) {
+                        const float* in = input + row + seg * seg_step;
+                        for (int ix = 0; ix < row_len; ++ix) {
+                            fold[ix] += (cutoff <= in[ix] ? 1.f : 0.f) / grappa;
+                        }
+                    }
+
+                    // Unfold to every segment, masked by the signal
+                    for (int seg = 0; seg < grappa; ++seg) {
+                        int64_t start = row + seg * seg_step;
+                        for (int ix = 0; ix < row_len; ++ix) {
+                            int64_t i = start + ix;
+                            float b = cutoff <= input[i] ? 1.f : 0.f;
+                            binary[i] = b;
+                            gmap[i] = b * fold[ix];
+                            // Noise is drawn per voxel index
+                            // (counter-based), so the result is identical no
+                            // matter how the slices are split across threads.
+                            noise[i] = input[i] + gmap[i] * cutoff * variance
+                                       * rand_normal(seed, i);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Voxels trimmed off the phase encoding direction do not alias
+    for (int it = 0; it < nt; ++it) {
+        for (int iz = 0; iz < nz; ++iz) {
+            for (int iy = 0; iy < ny; ++iy) {
+                int ix_start = (iz < size_z && iy < size_y) ? size_x : 0;
+                for (int ix = ix_start; ix < nx; ++ix) {
+                    int64_t i = nxyz * it + nxy * iz + nx * iy + ix;
+                    binary[i] = cutoff <= input[i] ? 1 : 0;
+                    gmap[i] = 0;
+                    noise[i] = input[i];
+                }
+            }
+        }
+    }
+}
+
 int main(int argc, char * argv[]) {
     bool use_outpath = false ;
     char  *fout = NULL ;
     nifti_image* nii = NULL;
     char * fin = NULL;
-    int grappa_int, direction_int, ac;
-    float cutoff, variance_val;
+    int direction_int = 1, ac;
+    float variance_val = 1;
+    vector<int> grappa_list;
+    vector<float> cutoff_list;
+    uint64_t seed = 0;
     if (argc < 2) return show_help();
 
     // Process user options
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -60,7 +154,7 @@ int main(int argc, char * argv[]) {
             fin = argv[ac];
         } else if (!strcmp(argv[ac], "-variance")) {
             if (++ac >= argc) {
-                fprintf(stderr, "** missing argument for -input\n");
+                fprintf(stderr, "** missing argument for -variance\n");
                 return 1;
             }
             variance_val = atof(argv[ac]);
@@ -69,19 +163,37 @@ int main(int argc, char * argv[]) {
                 fprintf(stderr, "** missing argument for -direction\n");
                 return 1;
             }
-            direction_int = atof(argv[ac]);
+            char* end;
+            long value = strtol(argv[ac], &end, 10);
+            if (end == argv[ac] || *end != '\0' || value < 0 || value > 2) {
+                fprintf(stderr, "** -direction must be 0, 1 or 2, not '%s'\n", argv[ac]);
+                return 1;
+            }
+            direction_int = static_cast<int>(value);
         } else if (!strcmp(argv[ac], "-grappa")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -grappa\n");
                 return 1;
             }
-            grappa_int = atof(argv[ac]);
+            if (!parse_int_list(argv[ac], grappa_list)) {
+                fprintf(stderr, "** -grappa takes whole numbers, not '%s'\n", argv[ac]);
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-cutoff")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -cutoff\n");
                 return 1;
             }
-            cutoff = atof(argv[ac]);
+            if (!parse_float_list(argv[ac], cutoff_list)) {
+                fprintf(stderr, "** invalid argument for -cutoff, '%s'\n", argv[ac]);
+                return 1;
+            }
+        } else if (!strcmp(argv[ac], "-seed")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -seed\n");
+                return 1;
+            }
+            seed = strtoull(argv[ac], NULL, 10);
         } else if (!strcmp(argv[ac], "-output")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -output\n");
@@ -99,9 +211,23 @@ int main(int argc, char * argv[]) {
         fprintf(stderr, "** missing option '-input'\n");
         return 1;
     }
+    if (grappa_list.empty()) {
+        fprintf(stderr, "** missing option '-grappa'\n");
+        return 1;
+    }
+    if (cutoff_list.empty()) {
+        fprintf(stderr, "** missing option '-cutoff'\n");
+        return 1;
+    }
+    for (size_t i = 0; i < grappa_list.size(); ++i) {
+        if (grappa_list[i] < 1) {
+            fprintf(stderr, "** -grappa must be 1 or larger\n");
+            return 1;
+        }
+    }
 
     // Read input dataset
-    nii = nifti_image_read(fin, 1);
+    nii = pipeline_image_read(fin, 1);
     if (!nii) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin);
         return 2;
@@ -110,215 +236,59 @@ int main(int argc, char * argv[]) {
     log_welcome("LN_GFACTOR");
     log_nifti_descriptives(nii);
 
+    const bool is_sweep = grappa_list.size() * cutoff_list.size() > 1;
     cout << "  Variance  = " << variance_val << endl;
     cout << "  Direction = " << direction_int << endl;
-    cout << "  GRAPPA    = " << grappa_int << endl;
-    cout << "  Cut-off   = " << cutoff << endl;
-
-    // Get dimensions of input
-    int size_x = nii->nx;
-    int size_y = nii->ny;
-    int size_z = nii->nz;
-    int size_time = nii->nt;
-    int nx = nii->nx;
-    int nxy = nii->nx * nii->ny;
-    int nxyz = nii->nx * nii->ny * nii->nz;
-
-    if (direction_int == 0) {
-        size_x = size_x - (size_x % grappa_int);
-    }
-    if (direction_int == 1) {
-        size_y = size_y - (size_y % grappa_int);
-    }
-    if (direction_int == 2) {
-        size_z = size_z - (size_z % grappa_int);
+    cout << "  Seed      = " << seed << endl;
+    if (is_sweep) {
+        cout << "  Simulating " << grappa_list.size() * cutoff_list.size()
+             << " GRAPPA factor and cut-off combinations." << endl;
     }
 
     // ========================================================================
     nifti_image* nii_input = copy_nifti_as_float32(nii);
     float* nii_input_data = static_cast<float*>(nii_input->data);
+    pipeline_image_free(nii);
 
-    // Allocating additional images
-    nifti_image* nii_gfactormap = copy_nifti_as_float32(nii);
+    // Allocating output images once, they are reused by every combination
+    nifti_image* nii_gfactormap = copy_nifti_as_float32(nii_input);
     float* nii_gfactormap_data = static_cast<float*>(nii_gfactormap->data);
-    nifti_image* nii_binary = copy_nifti_as_float32(nii);
+    nifti_image* nii_binary = copy_nifti_as_float32(nii_input);
     float* nii_binary_data = static_cast<float*>(nii_binary->data);
-    nifti_image* nii_noise = copy_nifti_as_float32(nii);
+    nifti_image* nii_noise = copy_nifti_as_float32(nii_input);
     float* nii_noise_data = static_cast<float*>(nii_noise->data);
 
-    // ========================================================================
-
-    // for (int it = 0; it < size_time; ++it) {
-    //     for (int iz = 0; iz < size_z; ++iz) {
-    //         for (int iy = 0; iy < size_x; ++iy) {
-    //             for (int ix = 0; ix < size_y; ++ix) {
-    //                 *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_input_data + nxyz * it + nxy * iz + nx * ix + iy) + adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper));
-    //                 //cout << adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper)) << " noise    " << endl;
-    //             }
-    //         }
-    //     }
-    // }
-
-    for (int it = 0; it < size_time; ++it) {
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_x; ++iy) {
-                for (int ix = 0; ix < size_y; ++ix) {
-                    if (cutoff <= *(nii_input_data + nxyz * it + nxy * iz + nx * ix + iy)) {
-                        *(nii_binary_data + nxyz * it + nxy * iz + nx * ix + iy) = 1;
-                    } else {
-                        *(nii_binary_data + nxyz * it + nxy * iz + nx * ix + iy) = 0;
-                    }
-                    // cout << adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper)) << " noise    " << endl;
-                }
-            }
-        }
-    }
-    save_output_nifti(fin, "Gfactormap_binary", nii_binary, false);
-
-    // Setting initial condition
-    for (int it = 0; it < size_time; ++it) {
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_x; ++iy) {
-                for (int ix = 0; ix < size_y; ++ix) {
-                    *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = 0.;
-                    // cout << adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper)) << " noise    " << endl;
-                }
-            }
-        }
-    }
-
-    ////////////////////////////////////
-    // Adding additional GRAPPA noise //
-    ////////////////////////////////////
-
-    if (direction_int == 0) {
-        for (int grappa_seg = 0; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z; ++iz) {
-                    for (int iy = 0; iy < size_x / grappa_int; ++iy) {
-                        for (int ix = 0; ix < size_y; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) + *(nii_binary_data + nxyz * it + nxy * iz + nx * ix + iy + grappa_seg * size_x / grappa_int) / grappa_int;
-                        }
-                    }
-                }
-            }
-        }
-        // Completing dataset to full slice
-        for (int grappa_seg=1; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z; ++iz) {
-                    for (int iy = 0; iy < size_x / grappa_int; ++iy) {
-                        for (int ix = 0; ix < size_y; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy+ grappa_seg * size_x / grappa_int) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy);
-                        }
-                    }
-                }
-            }
-        }
-    }
+    if (!use_outpath) fout = fin;
 
-    if (direction_int == 1) {
-        for (int grappa_seg = 0; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z; ++iz) {
-                    for (int iy = 0; iy < size_x; ++iy) {
-                        for (int ix = 0; ix < size_y / grappa_int; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) + *(nii_binary_data + nxyz * it + nxy * iz + nx * (ix+ grappa_seg * size_y / grappa_int) + iy) / grappa_int;
-                        }
-                    }
-                }
-            }
-        }
-        // Completing dataset to full slice
-        for (int grappa_seg = 0; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z; ++iz) {
-                    for (int iy = 0; iy < size_x; ++iy) {
-                        for (int ix = 0; ix < size_y / grappa_int; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * (ix+ grappa_seg * size_y / grappa_int) + iy) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy);
-                        }
-                    }
-                }
-            }
-        }
-    }
+    for (size_t i = 0; i < grappa_list.size(); ++i) {
+        for (size_t j = 0; j < cutoff_list.size(); ++j) {
+            int grappa_int = grappa_list[i];
+            float cutoff = cutoff_list[j];
 
-    if (direction_int == 2) {
-        for (int grappa_seg = 0; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z / grappa_int; ++iz) {
-                    for (int iy = 0; iy < size_x; ++iy) {
-                        for (int ix = 0; ix < size_y; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) + *(nii_binary_data + nxyz * it + nxy * (iz+ grappa_seg * size_z / grappa_int) + nx * ix + iy) / grappa_int;
-                        }
-                    }
-                }
-            }
-        }
-        // Completing dataset to full slice
-        for (int grappa_seg = 0; grappa_seg < grappa_int; ++grappa_seg) {
-            for (int it = 0; it < size_time; ++it) {
-                for (int iz = 0; iz < size_z / grappa_int; ++iz) {
-                    for (int iy = 0; iy < size_x; ++iy) {
-                        for (int ix = 0; ix < size_y; ++ix) {
-                            *(nii_gfactormap_data + nxyz * it +nxy * (iz+ grappa_seg * size_z / grappa_int) + nx * ix + iy) = *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy);
-                        }
-                    }
-                }
-            }
-        }
-    }
+            cout << "  GRAPPA    = " << grappa_int << endl;
+            cout << "  Cut-off   = " << cutoff << endl;
+            log_stage("Simulating g-factor noise...");
+            simulate_gfactor(nii_input_data, nii_binary_data,
+                             nii_gfactormap_data, nii_noise_data,
+                             nii_input->nx, nii_input->ny, nii_input->nz,
+                             nii_input->nt, direction_int, grappa_int, cutoff,
+                             variance_val, seed);
+            timing_count(nii_input->nvox);
 
-    for (int it = 0; it < size_time; ++it) {
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_x; ++iy) {
-                for (int ix = 0; ix < size_y; ++ix) {
-                    *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_binary_data + nxyz * it + nxy * iz + nx * ix + iy) **(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy);
-                }
-            }
-        }
-    }
-    for (int it = 0; it < size_time; ++it) {
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_x; ++iy) {
-                for (int ix = 0; ix < size_y; ++ix) {
-                    *(nii_noise_data + nxyz * it + nxy * iz + nx * ix + iy) = *(nii_input_data + nxyz * it + nxy * iz + nx * ix + iy) + *(nii_gfactormap_data + nxyz * it + nxy * iz + nx * ix + iy) * cutoff * adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper));
-                    // cout << adjusted_rand_numbers(0, variance_val, arb_pdf_num(N_rand, pFunc, lower, upper)) << " noise    " << endl;
-                }
+            // Single runs keep the plain output names
+            string suffix = "";
+            if (is_sweep) {
+                char buffer[64];
+                snprintf(buffer, sizeof(buffer), "_grappa%d_cutoff%g",
+                         grappa_int, cutoff);
+                suffix = buffer;
             }
+            save_output_nifti(fin, "Gfactormap_binary" + suffix, nii_binary, false);
+            save_output_nifti(fout, "Gfactormap" + suffix, nii_gfactormap, true, false);
+            save_output_nifti(fout, "Amplified_GRAPPA" + suffix, nii_noise, true, false);
         }
     }
 
-    if (!use_outpath) fout = fin;
-    save_output_nifti(fout, "Gfactormap", nii_gfactormap, true, false);
-    save_output_nifti(fout, "Amplified_GRAPPA", nii_noise, true, false);
-
     cout << "  Finished." << endl;
     return 0;
 }
-
-// Gauss lower = -5, upper = 5
-double verteilung(double z) {
-    return exp(-z * z / (2.)) * 1. / sqrt(2. * 3.141592653);
-}
-
-double_t arb_pdf_num(int N_rand, double ( * pFunc)(double), double_t lower,
-                     double_t upper) {
-    double_t binwidth = (upper - lower)/(double_t)N_rand;
-    double_t integral = 0.0;
-    double_t rand_num = rand() / (double_t)RAND_MAX;
-    int i;
-
-    for (i = 0; integral < rand_num; i++) {
-        integral += pFunc(lower + (double_t) i * binwidth) * binwidth;
-        if ((lower + (double_t) i * binwidth) > upper) {
-            cout << "  Upper limit, vielleicht sollte da limit angepasst werden." << i << endl;
-            return lower + (double_t) i * binwidth;
-        }
-    }
-    return lower + (double_t) i * binwidth;
-}
-
-double adjusted_rand_numbers(double mean, double stdev, double value) {
-    return value * stdev + mean;
-}
@@ -33,6 +33,7 @@ int show_help(void){
     "                   NOTE: This option is not working yet.\n"
     "    -output      : (Optional) Output filename, including .nii or\n"
     "                   .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - If you run this on EPI-T1 data consider making them pretty, E.g:  \n"
@@ -61,6 +62,11 @@ int main(int argc, char * argv[])
         if( !strncmp(argv[ac], "-h", 2) ) {
             return show_help();
         }
+        else if( !strncmp(argv[ac], "-timing", 7) ) {
+            if( !parse_timing_option(ac, argc, argv) ) {
+                return 1;
+            }
+        }
         else if( !strcmp(argv[ac], "-gradfile") ) {
             if( ++ac >= argc ) {
                 fprintf(stderr, "** missing argument for -gradfile\n");
@@ -134,13 +140,13 @@ int main(int argc, char * argv[])
     }
 
     // Read input dataset, including data
-    nifti_image *nim_inputfi = nifti_image_read(finfi, 1);
+    nifti_image *nim_inputfi = pipeline_image_read(finfi, 1);
     if (!nim_inputfi) {
         fprintf(stderr,"** failed to read NIfTI from '%s'\n", finfi);
         return 2;
     }
 
-    nifti_image *nim_gradi = nifti_image_read(fgradi, 1);
+    nifti_image *nim_gradi = pipeline_image_read(fgradi, 1);
     if (!nim_gradi) {
         fprintf(stderr,"** failed to read NIfTI from '%s'\n", fgradi);
         return 2;
@@ -196,7 +202,7 @@ int main(int argc, char * argv[])
 
     if ( do_masking == 1 ) {
         // Read input dataset, including data
-        nifti_image *nim_mask_input = nifti_image_read(fmaski, 1);
+        nifti_image *nim_mask_input = pipeline_image_read(fmaski, 1);
         if( !nim_mask_input ) {
             fprintf(stderr,"** failed to read NIfTI from '%s'\n", fmaski);
             return 2;
@@ -228,7 +234,9 @@ int main(int argc, char * argv[])
     // MAKE allocating necessary files
     // ========================================================================
     nifti_image *smoothed = nifti_copy_nim_info(nim_inputf);
+    pipeline_image_track(smoothed);
     nifti_image *gausweight = nifti_copy_nim_info(nim_inputf);
+    pipeline_image_track(gausweight);
     smoothed->datatype = NIFTI_TYPE_FLOAT32;
     gausweight->datatype = NIFTI_TYPE_FLOAT32;
     smoothed->nbyper = sizeof(float);
@@ -34,6 +34,7 @@ int show_help(void) {
     "              tissue types, it is written out.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    Example application in a blog post:\n"
@@ -57,6 +58,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac< argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-rim")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -100,7 +105,7 @@ int main(int argc, char * argv[]) {
 
     if (!fin) { fprintf(stderr, "** missing option '-rim'\n");  return 1; }
     // read input dataset, including data
-    nim_input_i = nifti_image_read(fin, 1);
+    nim_input_i = pipeline_image_read(fin, 1);
     if (!nim_input_i) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
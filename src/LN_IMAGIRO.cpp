@@ -23,6 +23,7 @@ int show_help(void) {
     "    -data    : Data that will be unfolded.\n"
     "    -output  : (Optional) Output filename, including .nii or\n"
     "               .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - All inputs should have the same dimensions.\n"
@@ -42,6 +43,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, " ** missing argument for -layers\n");
@@ -87,17 +92,17 @@ int main(int argc, char * argv[]) {
     }
 
     // Read input dataset
-    nifti_image* nim_column_r = nifti_image_read(fin_columns, 1);
+    nifti_image* nim_column_r = pipeline_image_read(fin_columns, 1);
     if (!nim_column_r) {
         fprintf(stderr, " ** failed to read NIfTI from '%s'\n", fin_columns);
         return 2;
     }
-    nifti_image* nim_layers_r = nifti_image_read(fin_layers, 1);
+    nifti_image* nim_layers_r = pipeline_image_read(fin_layers, 1);
     if (!nim_layers_r) {
         fprintf(stderr, " ** failed to read NIfTI from '%s'\n", fin_layers);
         return 2;
     }
-    nifti_image* nim_data_r = nifti_image_read(fin_data, 1);
+    nifti_image* nim_data_r = pipeline_image_read(fin_data, 1);
     if (!nim_data_r) {
         fprintf(stderr, " ** failed to read NIfTI from '%s'\n", fin_data);
         return 2;
@@ -151,6 +156,7 @@ int main(int argc, char * argv[]) {
     // Allocating necessary files //
     ////////////////////////////////
     nifti_image* imagiro = nifti_copy_nim_info(nim_data);
+    pipeline_image_track(imagiro);
     imagiro->datatype = NIFTI_TYPE_FLOAT32;
     imagiro->nbyper = sizeof(float);
 
@@ -199,6 +205,7 @@ int main(int argc, char * argv[]) {
     nifti_nim_is_valid(imagiro, nii_ok);
 
     nifti_image* imagiro_vnr = nifti_copy_nim_info(imagiro);
+    pipeline_image_track(imagiro_vnr);
     imagiro_vnr->datatype = NIFTI_TYPE_INT32;
     imagiro_vnr->nbyper = sizeof(int);
     imagiro_vnr->data = calloc(imagiro_vnr->nvox, imagiro_vnr->nbyper);
@@ -209,18 +216,6 @@ int main(int argc, char * argv[]) {
     // Resample across Layers and columns //
     ////////////////////////////////////////
     cout << "  Resampling..." << endl;
-    float value_ofinput_data = 0;
-
-
-
-    for (int iz = 0; iz < size_z_imagiro; ++iz) {
-        for (int iy = 0; iy < size_y_imagiro; ++iy) {
-            for (int ix = 0; ix < size_x_imagiro; ++ix) {
-                *(imagiro_data + nxy_imagiro * iz + nx_imagiro * iy + ix) = 0;
-                *(imagiro_vnr_data + nxy_imagiro * iz + nx_imagiro * iy + ix) = 0;
-            }
-        }
-    }
 
     ///////////////////////////////////////////////////////
     // Calculating the number of voxels per layer/column //
@@ -228,6 +223,11 @@ int main(int argc, char * argv[]) {
     cout << "  Calculating the number of voxels per layer column..." << endl;
     int lay = 0, col = 0, dep = 0;
 
+    // The labels are the same for every time point. Therefore
+    // the (source voxel, target cell, weight) triples are collected once,
+    // and each volume only visits the labelled voxels instead of the full
+    // field of view.
+    vector<int> plan_source, plan_target;
     for (int iz = 0; iz < size_z; ++iz) {
         for (int iy = 0; iy < size_y; ++iy) {
             for (int ix = 0; ix < size_x; ++ix) {
@@ -238,90 +238,98 @@ int main(int argc, char * argv[]) {
                     lay = *(nim_layers_data + voxel_i) - 1;
                     col = *(nim_columns_data + voxel_i) - 1;
                     dep = iz;
-                    *(imagiro_vnr_data + nxy_imagiro * lay + nx_imagiro * dep + col) += 1;
+                    int voxel_j = nxy_imagiro * lay + nx_imagiro * dep + col;
+                    *(imagiro_vnr_data + voxel_j) += 1;
+                    plan_source.push_back(voxel_i);
+                    plan_target.push_back(voxel_j);
                 }
             }
         }
     }
+    int nr_plan = plan_source.size();
+    vector<float> plan_weight(nr_plan);
+    for (int k = 0; k < nr_plan; ++k) {
+        plan_weight[k] = 1. / *(imagiro_vnr_data + plan_target[k]);
+    }
+    cout << "    " << nr_plan << " of " << nr_voxels << " voxels are labelled." << endl;
 
     //////////////////////////////////////////
     // Averaging all voxels in layer\column //
     //////////////////////////////////////////
     cout << "  Averaging all voxels in layer column..." << endl;
+    #pragma omp parallel for
     for (int it = 0; it < size_time; ++it) {
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_y; ++iy) {
-                for (int ix = 0; ix < size_x; ++ix) {
-                    int voxel_i = nxy * iz + nx * iy + ix;
-
-                    if (*(nim_layers_data + voxel_i) > 0
-                        && *(nim_columns_data + voxel_i) > 0) {
-                        lay = *(nim_layers_data + voxel_i) - 1;
-                        col = *(nim_columns_data + voxel_i) - 1;
-                        dep = iz;
-                        int voxel_j = nxy_imagiro * lay + nx_imagiro * dep + col;
-
-                        value_ofinput_data =
-                            *(nim_data_data + nxyz * it + voxel_i)
-                            / *(imagiro_vnr_data + voxel_j);
-                        *(imagiro_data + nxyz_imagiro * it + voxel_j) += value_ofinput_data;
-                    }
-
-
-                }
-            }
+        const float* data_t = nim_data_data + nxyz * it;
+        float* imagiro_t = imagiro_data + nxyz_imagiro * it;
+        for (int k = 0; k < nr_plan; ++k) {
+            imagiro_t[plan_target[k]] += data_t[plan_source[k]] * plan_weight[k];
         }
     }
+    timing_count(static_cast<uint64_t>(nr_plan) * size_time);
+
     //////////////////
     // Fixing holes //
     //////////////////
     cout << "  Fixing holes..." << size_time << endl;
     int vinc = 2;  // vicinity
-    float value_to_fill = 0;  // Average value in vicinity
-    float nr_vic = 0;  // Number of non-zero voxels in vicinity
 
+    // Empty cells are filled with the average of the non-empty cells in their
+    // vicinity. The vicinity is the same for every time point, so it is also
+    // collected once.
+    vector<int> hole_cell, hole_start(1, 0), hole_neighbor;
     for (int iz = 0; iz < size_z_imagiro; ++iz) {
         for (int iy = 0; iy < size_y_imagiro; ++iy) {
             for (int ix = 0; ix < size_x_imagiro; ++ix) {
                 int voxel_i = nxy_imagiro * iz + nx_imagiro * iy + ix;
 
                 if (*(imagiro_vnr_data + voxel_i) == 0) {
-                    for (int it = 0; it < size_time; ++it) {
-                        value_to_fill = 0;
-                        nr_vic = 0;
-
-                        int jy_start = max(0, iy - vinc);
-                        int jy_stop = min(iy + vinc + 1, size_x_imagiro);
-                        int jx_start = max(0, ix - vinc);
-                        int jx_stop = min(ix + vinc + 1, size_y_imagiro);
-                        int jz_start = max(0, iz - vinc);
-                        int jz_stop = min(iz + vinc + 1, size_z_imagiro);
-
-                        for (int jz = jz_start; jz < jz_stop; ++jz) {
-                            for (int jy = jy_start; jy < jy_stop; ++jy) {
-                                for (int jx = jx_start; jx < jx_stop; ++jx) {
-                                    int voxel_j = nxy_imagiro * jz + nx_imagiro * jy + jx;
-
-                                    if (*(imagiro_vnr_data + voxel_j) != 0) {
-                                        nr_vic += 1;
-                                        value_to_fill += static_cast<float>(*(imagiro_data + nxyz_imagiro * it + voxel_j));
-                                    }
+                    int jy_start = max(0, iy - vinc);
+                    int jy_stop = min(iy + vinc + 1, size_y_imagiro);
+                    int jx_start = max(0, ix - vinc);
+                    int jx_stop = min(ix + vinc + 1, size_x_imagiro);
+                    int jz_start = max(0, iz - vinc);
+                    int jz_stop = min(iz + vinc + 1, size_z_imagiro);
+
+                    for (int jz = jz_start; jz < jz_stop; ++jz) {
+                        for (int jy = jy_start; jy < jy_stop; ++jy) {
+                            for (int jx = jx_start; jx < jx_stop; ++jx) {
+                                int voxel_j = nxy_imagiro * jz + nx_imagiro * jy + jx;
+
+                                if (*(imagiro_vnr_data + voxel_j) != 0) {
+                                    hole_neighbor.push_back(voxel_j);
                                 }
                             }
                         }
-                        *(imagiro_data + nxyz_imagiro * it + voxel_i) = value_to_fill / nr_vic;
                     }
+                    hole_cell.push_back(voxel_i);
+                    hole_start.push_back(hole_neighbor.size());
                 }
             }
         }
     }
+    int nr_holes = hole_cell.size();
+
+    #pragma omp parallel for
+    for (int it = 0; it < size_time; ++it) {
+        float* imagiro_t = imagiro_data + nxyz_imagiro * it;
+        for (int h = 0; h < nr_holes; ++h) {
+            float value_to_fill = 0;  // Average value in vicinity
+            for (int k = hole_start[h]; k < hole_start[h + 1]; ++k) {
+                value_to_fill += imagiro_t[hole_neighbor[k]];
+            }
+            // Number of non-zero voxels in vicinity
+            float nr_vic = hole_start[h + 1] - hole_start[h];
+            imagiro_t[hole_cell[h]] = value_to_fill / nr_vic;
+        }
+    }
 
+  // Holes without non-empty cells in their vicinity are NaN
   for (int it = 0; it < size_time; ++it) {
    for (int iz = 0; iz < size_z_imagiro; ++iz) {
-    for (int ilayer = 0; ilayer < nr_layers; ++ilayer) {
+    for (int iy = 0; iy < size_y_imagiro; ++iy) {
         for (int icolum = 0; icolum < nr_columns; ++icolum) {
-             if (( *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * ilayer +  icolum)) != ( *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * ilayer +  icolum))) {
-                  *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * ilayer +  icolum) = 0 ;
+             if (( *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * iy +  icolum)) != ( *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * iy +  icolum))) {
+                  *(imagiro_data + nxyz_imagiro * it + nxy_imagiro * iz + nx_imagiro * iy +  icolum) = 0 ;
               }
         }
     }
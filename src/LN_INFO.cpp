@@ -25,9 +25,12 @@ int show_help(void) {
     "    -help   : Show this help.\n"
     "    -input  : Specify input dataset.\n"
     "    -NoPlot : (Optional) In case you do not want to plot the content of the BRIKS.\n"
+    "    -header_only : (Optional) Only show the header. No image data is read,\n"
+    "              which is fast also for large compressed files.\n"
     "    -sub    : (Optional) subsample plotting to make it smaller.\n"
     "              the number given after -sub is the factor of voxels to skip \n" 
     "    -inv    : (Optional) invert color scale for black terminal.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "\n");
     cout << endl ; 
@@ -40,6 +43,7 @@ int main(int argc, char * argv[]) {
     int subs = 1. ;
     float std_val;
     bool NoPlotting = false ;
+    bool header_only = false;
     bool inv = false ;  
     
 
@@ -47,8 +51,14 @@ int main(int argc, char * argv[]) {
     if (argc < 2) return show_help();
     
     for (ac = 1; ac < argc; ac++) {
-        if (!strncmp(argv[ac], "-h", 2)) {
+        if (!strcmp(argv[ac], "-header_only")) {
+            header_only = true;
+        } else if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -77,12 +87,13 @@ int main(int argc, char * argv[]) {
         fprintf(stderr, "** missing option '-input'\n");
         return 1;
     }
-    // Read input dataset, including data
-    nifti_image* nii_input = nifti_image_read(fin, 1);
-    if (!nii_input) {
+    // Read input header, data is streamed volume by volume below
+    nifti_stream* stream_in = nifti_stream_open_read(fin, 1, true);
+    if (!stream_in) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin);
         return 2;
     }
+    nifti_image* nii_input = stream_in->nii;
 
     log_welcome("LN_INFO");
 
@@ -94,64 +105,64 @@ int main(int argc, char * argv[]) {
     cout << "    nii intersept : "  << nii_input->scl_inter << endl; 
     cout << "    nii intent: code="  << nii_input->intent_code << ", string="  << nifti_intent_string(nii_input->intent_code ) << endl;  
 
-    
-    // ========================================================================
-    // Allocating new nifti
-    nifti_image* nii_new = copy_nifti_as_float32(nii_input);
-    float* nii_new_data = static_cast<float*>(nii_new->data);
+    if (header_only) {
+        nifti_stream_close(stream_in);
+        return 0;
+    }
+
     // ========================================================================
    int sizeSlice = nii_input->nz ; 
    int sizePhase = nii_input->ny ; 
    int sizeRead = nii_input->nx ; 
-   int nrep =  nii_input->nt; 
+   int nrep = stream_in->size_time;
    int nx =  nii_input->nx;
    int nxy = nii_input->nx * nii_input->ny;
    int nxyz = nii_input->nx * nii_input->ny * nii_input->nz;
 
     // ========================================================================
     // signal characteristics. 
+    // The volumes are read one at a time. Only the first one is kept, for
+    // the sampled mean and STDEV and for plotting.
 
 
     cout << endl<< endl<<  "    BRIK value characeristics" << endl;  
 
-    // max value
     double max_val = -2147483648 ; 
     int max_x = -1 ; 
     int max_y = -1 ; 
     int max_z = -1 ; 
     int max_t = -1 ; 
-    
-    for(int it=0; it<nrep; ++it){  
-      for(int iz=0; iz<sizeSlice; ++iz){  
-        for(int iy=0; iy<sizePhase; ++iy){
-          for(int ix=0; ix<sizeRead-0; ++ix){
-            if (*(nii_new_data    + nxyz *it + nxy*iz + nx*iy  + ix  ) > max_val ) {
-                    max_val = *(nii_new_data    + nxyz *it + nxy*iz + nx*iy  + ix  ) ;
-                    max_x = ix ; 
-                    max_y = iy ;
-                    max_z = iz ;
-                    max_t = it ;
-            }  
-          }
-        }
-      }
-    }
-    cout << "    Maximal value is "  << max_val << " at (t="  << max_t<< ",x="<< max_x<< ",y="<< max_y<< ",z="<< max_z<< ")" << endl;  
 
-
-    // min value
     double min_val = 2147483648 ; 
     int min_x = -1 ; 
     int min_y = -1 ; 
     int min_z = -1 ; 
     int min_t = -1 ; 
-    
+
+    float* nii_new_data = NULL;  // First volume
     for(int it=0; it<nrep; ++it){  
+      nifti_image* chunk = nifti_stream_read_chunk(stream_in);
+      if (!chunk) {
+          return 2;
+      }
+      nifti_image* chunk_float = copy_nifti_as_float32(chunk);
+      pipeline_image_free(chunk);
+      float* vol = static_cast<float*>(chunk_float->data);
+
       for(int iz=0; iz<sizeSlice; ++iz){  
         for(int iy=0; iy<sizePhase; ++iy){
           for(int ix=0; ix<sizeRead-0; ++ix){
-            if (*(nii_new_data    + nxyz *it + nxy*iz + nx*iy  + ix  ) < min_val ) {
-                    min_val = *(nii_new_data    + nxyz *it + nxy*iz + nx*iy  + ix  ) ;
+            // max value
+            if (*(vol + nxy*iz + nx*iy  + ix  ) > max_val ) {
+                    max_val = *(vol + nxy*iz + nx*iy  + ix  ) ;
+                    max_x = ix ; 
+                    max_y = iy ;
+                    max_z = iz ;
+                    max_t = it ;
+            }  
+            // min value
+            if (*(vol + nxy*iz + nx*iy  + ix  ) < min_val ) {
+                    min_val = *(vol + nxy*iz + nx*iy  + ix  ) ;
                     min_x = ix ; 
                     min_y = iy ;
                     min_z = iz ;
@@ -160,19 +171,26 @@ int main(int argc, char * argv[]) {
           }
         }
       }
+      if (it == 0) {
+          nii_new_data = vol;
+      } else {
+          pipeline_image_free(chunk_float);
+      }
     }
+    nifti_stream_close(stream_in);
+    cout << "    Maximal value is "  << max_val << " at (t="  << max_t<< ",x="<< max_x<< ",y="<< max_y<< ",z="<< max_z<< ")" << endl;  
     cout << "    Minimal value is "  << min_val << " at (t="  << min_t<< ",x="<< min_x<< ",y="<< min_y<< ",z="<< min_z<< ")" << endl;  
 
     // average value
     //cout << "nxyz+"<< nxyz*nrep  << endl; 
     //nxyz = 100 ; 
-    double vec1[nxyz/100];
+    vector<double> vec1(nxyz/100);
     for (int iv = 0; iv < nxyz/100; ++iv) {
         vec1[iv] =  static_cast<double>(*(nii_new_data + iv*100)) ; 
     }
-    double mean_val = ren_average(vec1, nxyz/100) ; 
-    double stdev_val = ren_stdev(vec1, nxyz/100) ; 
-    cout << "    Average value is "  << mean_val << " and STEDV across space and time is " << stdev_val << endl;  
+    double mean_val = ren_average(vec1.data(), nxyz/100) ; 
+    double stdev_val = ren_stdev(vec1.data(), nxyz/100) ; 
+    cout << "    Average value is "  << mean_val << " and STEDV across space (first volume) is " << stdev_val << endl;  
 
 
     cout << endl<< endl<<  "    Attempt of plotting in terminal" << endl;  
@@ -2,6 +2,68 @@
 #include <limits>
 #include "../dep/laynii_lib.h"
 
+// Sliding minimum or maximum over the windows [i - range, i + range) along
+// lines of n samples that are step apart. Neighbouring lines (lanes) are
+// contiguous in memory and processed together, so the inner loops run over
+// contiguous memory. Uses the van Herk/Gil-Werman algorithm: 3 comparisons
+// per sample, independent of the window size.
+void sliding_extreme(const float* in, float* out, const int n, const int step,
+                     const int nr_lanes, const int range, const bool is_min,
+                     vector<float>& g, vector<float>& h) {
+    const int w = 2 * range;
+    const int nr_padded = ((n + 2 * range + w - 1) / w) * w;
+    const float identity = is_min ? numeric_limits<float>::max() : 0.0;
+    g.resize(static_cast<size_t>(nr_padded) * nr_lanes);
+    h.resize(static_cast<size_t>(nr_padded) * nr_lanes);
+
+    // Padded samples, outside of the line the identity of the operation
+    for (int k = 0; k < nr_padded; ++k) {
+        float* gk = &g[static_cast<size_t>(k) * nr_lanes];
+        if (k < range || k >= range + n) {
+            for (int l = 0; l < nr_lanes; ++l) gk[l] = identity;
+        } else {
+            const float* ik = in + static_cast<int64_t>(k - range) * step;
+            for (int l = 0; l < nr_lanes; ++l) gk[l] = ik[l];
+        }
+    }
+    // Suffix extremes within blocks of w samples (backwards)
+    for (int k = nr_padded - 1; k >= 0; --k) {
+        float* hk = &h[static_cast<size_t>(k) * nr_lanes];
+        const float* gk = &g[static_cast<size_t>(k) * nr_lanes];
+        if (k % w == w - 1) {
+            for (int l = 0; l < nr_lanes; ++l) hk[l] = gk[l];
+        } else if (is_min) {
+            const float* hn = hk + nr_lanes;
+            for (int l = 0; l < nr_lanes; ++l) hk[l] = min(hn[l], gk[l]);
+        } else {
+            const float* hn = hk + nr_lanes;
+            for (int l = 0; l < nr_lanes; ++l) hk[l] = max(hn[l], gk[l]);
+        }
+    }
+    // Prefix extremes within blocks of w samples (in place)
+    for (int k = 0; k < nr_padded; ++k) {
+        if (k % w == 0) continue;
+        float* gk = &g[static_cast<size_t>(k) * nr_lanes];
+        const float* gp = gk - nr_lanes;
+        if (is_min) {
+            for (int l = 0; l < nr_lanes; ++l) gk[l] = min(gp[l], gk[l]);
+        } else {
+            for (int l = 0; l < nr_lanes; ++l) gk[l] = max(gp[l], gk[l]);
+        }
+    }
+    // Each window spans the end of one block and the start of the next
+    for (int i = 0; i < n; ++i) {
+        const float* hi = &h[static_cast<size_t>(i) * nr_lanes];
+        const float* gi = &g[static_cast<size_t>(i + w - 1) * nr_lanes];
+        float* oi = out + static_cast<int64_t>(i) * step;
+        if (is_min) {
+            for (int l = 0; l < nr_lanes; ++l) oi[l] = min(hi[l], gi[l]);
+        } else {
+            for (int l = 0; l < nr_lanes; ++l) oi[l] = max(hi[l], gi[l]);
+        }
+    }
+}
+
 int show_help(void) {
     printf(
     "LN_INTPRO: Do maximum and minimum intensity projections. For example,\n"
@@ -22,6 +84,7 @@ int show_help(void) {
     "                 Default is all aslices. \n"
     "    -output    : (Optional) Output filename, including .nii or\n"
     "                 .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - If the input is a time series, the entire time domain is also\n"
@@ -45,6 +108,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-direction")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -direction\n");
@@ -84,7 +151,7 @@ int main(int argc, char * argv[]) {
         return 1;
     }
     // Read input dataset
-    nifti_image * nii_input = nifti_image_read(fin_1, 1);
+    nifti_image * nii_input = pipeline_image_read(fin_1, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin_1);
         return 2;
@@ -94,10 +161,14 @@ int main(int argc, char * argv[]) {
         fprintf(stderr, "** Do either maximum or minimum. Not both.\n");
         return 1;
     }
-    if (is_direction-2 >1) {
+    if (is_direction < 1 || is_direction > 3) {
         cout << "  Invalid direction. ";
         return 1;
     }
+    if (is_range < 0) {
+        fprintf(stderr, "** -range must not be negative.\n");
+        return 1;
+    }
 
     cout << "The signal is collapsed along: ";
     if (is_direction == 1) {
@@ -137,6 +208,7 @@ int main(int argc, char * argv[]) {
 
     // Allocate new nifti images
     nifti_image * nii_collapse = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_collapse);
     nii_collapse->nt = 1;
     nii_collapse->nvox = nii->nvox / size_time;
     nii_collapse->datatype = NIFTI_TYPE_FLOAT32;
@@ -144,112 +216,65 @@ int main(int argc, char * argv[]) {
     nii_collapse->data = calloc(nii_collapse->nvox, nii_collapse->nbyper);
     float* nii_collapse_data = static_cast<float*>(nii_collapse->data);
 
-    double vec_file1[size_time];
-
     // ========================================================================
     cout << "  Starting with dimensionality collapse = " << endl;
 
-    float extreme_val = 0.0;
-    if (is_min == 1) {
-        extreme_val = numeric_limits<float>::max();
+    // Minima only consider values above zero and maxima start
+    // at zero. The time domain is collapsed first, which gives the same
+    // extremes as searching across time and the window at once.
+    const int nr_voxels = nxyz;
+    vector<float> extreme_time(nr_voxels);
+    #pragma omp parallel for
+    for (int i = 0; i < nr_voxels; ++i) {
+        float extreme_val = (is_min == 1) ? numeric_limits<float>::max() : 0.0;
+        for (int it = 0; it < size_time; ++it) {
+            float val = *(nii_data + nxyz * it + i);
+            if (is_min == 1 && val < extreme_val && val > 0.0) {
+                extreme_val = val;
+            }
+            if (is_max == 1 && val > extreme_val) {
+                extreme_val = val;
+            }
+        }
+        extreme_time[i] = extreme_val;
     }
 
-    for (int ix = 0; ix < size_y; ++ix) {
-        for (int iy = 0; iy < size_x; ++iy) {
-            for (int iz = 0; iz < size_z; ++iz) {
-                int voxel_i, voxel_j;
-                if (is_min == 1) extreme_val = numeric_limits<float>::max();
-                if (is_max == 1) extreme_val = 0.0;
-                // ------------------------------------------------------------
-                if (is_direction == 1) {
-                    for (int ix_i = max(ix - is_range, 0);
-                         ix_i < min(ix + is_range, size_y); ++ix_i) {
-                        for (int it = 0; it < size_time; ++it) {
-                            voxel_i = nxyz * it + nxy * iz + nx * ix + iy;
-                            voxel_j = nxyz * it + nxy * iz + nx * ix_i + iy;
-                            if (is_min == 1
-                                && *(nii_data + voxel_j) < extreme_val
-                                && *(nii_data + voxel_j) > 0.0) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                            if (is_max == 1
-                                && *(nii_data + voxel_j) > extreme_val) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                        }
-                    }
-                    for (int it = 0; it < size_time; ++it) {
-                        if (is_min == 1
-                            && *(nii_data + voxel_i) >= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                        if (is_max == 1
-                            && *(nii_data + voxel_i) <= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                    }
-                    // ------------------------------------------------------------
-                } else if (is_direction == 2) {
-                    for (int iy_i = max(iy - is_range, 0);
-                         iy_i < min(iy + is_range, size_x); ++iy_i) {
-                        for (int it = 0; it < size_time; ++it) {
-                            voxel_i = nxyz * it + nxy * iz + nx * ix + iy;
-                            voxel_j = nxyz * it + nxy * iz + nx * ix + iy_i;
-
-                            if (is_min == 1
-                                && *(nii_data + voxel_j) < extreme_val
-                                && *(nii_data + voxel_j) > 0.0) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                            if (is_max == 1
-                                && *(nii_data + voxel_j) > extreme_val) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                        }
-                    }
-                    for (int it = 0; it < size_time; ++it) {
-                        if (is_min == 1
-                            && *(nii_data + voxel_i) >= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                        if (is_max == 1
-                            && *(nii_data + voxel_i) <= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                    }
-                    // ------------------------------------------------------------
-                } else if (is_direction == 3) {
-                    for (int iz_i = max(iz - is_range, 0);
-                         iz_i < min(iz + is_range, size_z); ++iz_i) {
-                        for (int it = 0; it < size_time; ++it) {
-                            voxel_i = nxyz * it + nxy * iz + nx * ix + iy;
-                            voxel_j = nxyz * it + nxy * iz_i + nx * ix + iy;
-                            if (is_min == 1
-                                && *(nii_data + voxel_j) < extreme_val
-                                && *(nii_data + voxel_j) > 0.0) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                            if (is_max == 1
-                                && *(nii_data + voxel_j) > extreme_val) {
-                                extreme_val = *(nii_data + voxel_j);
-                            }
-                        }
-                    }
-                    for (int it = 0; it < size_time; ++it) {
-                        if (is_min == 1
-                            && *(nii_data + voxel_i) >= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                        if (is_max == 1
-                            && *(nii_data + voxel_i) <= extreme_val) {
-                            *(nii_collapse_data + voxel_i) = extreme_val;
-                        }
-                    }
+    // Sliding extremes along the chosen direction, parallel over slices
+    // (or rows when the slices are collapsed). Direction 1 runs along the
+    // second and direction 2 along the first image axis.
+    if (is_direction == 3) {
+        #pragma omp parallel for
+        for (int iy = 0; iy < size_y; ++iy) {
+            vector<float> g, h;
+            sliding_extreme(&extreme_time[nx * iy], nii_collapse_data + nx * iy,
+                            size_z, nxy, size_x, is_range, is_min == 1, g, h);
+        }
+    } else {
+        #pragma omp parallel for
+        for (int iz = 0; iz < size_z; ++iz) {
+            vector<float> g, h;
+            if (is_direction == 1) {
+                sliding_extreme(&extreme_time[nxy * iz], nii_collapse_data + nxy * iz,
+                                size_y, nx, size_x, is_range, is_min == 1, g, h);
+            } else {
+                for (int iy = 0; iy < size_y; ++iy) {
+                    int row = nxy * iz + nx * iy;
+                    sliding_extreme(&extreme_time[row], nii_collapse_data + row,
+                                    size_x, 1, 1, is_range, is_min == 1, g, h);
                 }
             }
         }
     }
 
+    // Minimum projections are only kept where the voxel itself is above zero
+    if (is_min == 1) {
+        for (int i = 0; i < nr_voxels; ++i) {
+            if (extreme_time[i] == numeric_limits<float>::max()) {
+                *(nii_collapse_data + i) = 0;
+            }
+        }
+    }
+    timing_count(static_cast<uint64_t>(nr_voxels) * size_time);
 
     if (!use_outpath) fout = fin_1;
     save_output_nifti(fout, "collapsed", nii_collapse, true, use_outpath);
@@ -28,6 +28,7 @@ int show_help(void){
     "                  This option can only smooth within layers and removes signal outside the layer mask  \n"
     "    -output     : (Optional) Output filename, including .nii or\n"
     "                  .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    An application of this program is mentioned on these blog posts:\n"
@@ -50,6 +51,11 @@ int main(int argc, char * argv[])
       if( ! strncmp(argv[ac], "-h", 2) ) {
          return show_help();
       }
+      else if( ! strncmp(argv[ac], "-timing", 7) ) {
+         if( !parse_timing_option(ac, argc, argv) ) {
+            return 1;
+         }
+      }
       else if( ! strcmp(argv[ac], "-layer_file") ) {
          if( ++ac >= argc ) {
             fprintf(stderr, "** missing argument for -layer_file\n");
@@ -99,7 +105,7 @@ int main(int argc, char * argv[])
 
    if( !finfi  ) { fprintf(stderr, "** missing option '-input'\n");  return 1; }
    // read input dataset, including data
-   nifti_image * nim_inputfi = nifti_image_read(finfi, 1);
+   nifti_image * nim_inputfi = pipeline_image_read(finfi, 1);
    if( !nim_inputfi ) {
       fprintf(stderr,"** failed to read layer NIfTI image from '%s'\n", finfi);
       return 2;
@@ -107,7 +113,7 @@ int main(int argc, char * argv[])
 
    if( !fmaski  ) { fprintf(stderr, "** missing option '-layer_file'\n");  return 1; }
    // read input dataset, including data
-   nifti_image * nim_maski = nifti_image_read(fmaski, 1);
+   nifti_image * nim_maski = pipeline_image_read(fmaski, 1);
    if( !nim_maski ) {
       fprintf(stderr,"** failed to read layer NIfTI image from '%s'\n", fmaski);
       return 2;
@@ -138,6 +144,7 @@ int main(int argc, char * argv[])
 
 
    nifti_image * nim_inputf  	= nifti_copy_nim_info(nim_inputfi);
+   pipeline_image_track(nim_inputf);
    nim_inputf->datatype = NIFTI_TYPE_FLOAT32;
    nim_inputf->nbyper = sizeof(float);
    nim_inputf->data = calloc(nim_inputf->nvox, nim_inputf->nbyper);
@@ -146,6 +153,7 @@ int main(int argc, char * argv[])
 
 
    nifti_image * nim_mask  	= nifti_copy_nim_info(nim_maski);
+   pipeline_image_track(nim_mask);
    nim_mask->datatype = NIFTI_TYPE_INT32;
    nim_mask->nbyper = sizeof(int);
    nim_mask->data = calloc(nim_mask->nvox, nim_mask->nbyper);
@@ -250,7 +258,9 @@ if ( nim_maski->datatype == NIFTI_TYPE_INT32 ) {
 
 
     nifti_image * smoothed  	= nifti_copy_nim_info(nim_inputf);
+    pipeline_image_track(smoothed);
     nifti_image * gausweight  	= nifti_copy_nim_info(nim_inputf);
+    pipeline_image_track(gausweight);
 
     smoothed->datatype 		= NIFTI_TYPE_FLOAT32;
 	gausweight->datatype 	= NIFTI_TYPE_FLOAT32;
@@ -385,6 +395,7 @@ if (sulctouch == 1 ){
 
 // allocating local connected vicinity file
     nifti_image * hairy_brain  	= nifti_copy_nim_info(nim_mask);
+    pipeline_image_track(hairy_brain);
     hairy_brain->datatype 		= NIFTI_TYPE_INT32;
 	hairy_brain->nbyper 		= sizeof(int);
     hairy_brain->data 			= calloc(hairy_brain->nvox, hairy_brain->nbyper);
@@ -23,13 +23,24 @@ int show_help(void) {
     "                  this is in contrast to the program LN2_LAYERS \n"
     "    -dim        : Specify value (2 or 3) layer algorithm.Default is 3 (3D).\n"
     "    -iterations : number of iterations, in most cases 100 (default) should be enough.\n"
+    "                  With '-solver cg' this is the maximum number of iterations.\n"
+    "    -solver     : (Optional) 'jacobi' (default) smooths for a fixed number of\n"
+    "                  iterations. 'cg' solves for the equilibrium directly with\n"
+    "                  preconditioned conjugate gradients, which needs far fewer\n"
+    "                  iterations on fine rims.\n"
+    "    -tolerance  : (Optional) Relative residual at which '-solver cg' stops.\n"
+    "                  Default is 1e-6.\n"
     "    -nr_layers  : number of layers, default is 20.\n"
     "    -output     : (Optional) Output filename, including .nii or\n"
     "                  .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - This can be 3D. Hence the rim file should be dmsmooth in all\n"
     "      three dimensions.\n"
+    "    - Both solvers approach the same equilibrium, where every gray matter\n"
+    "      voxel is the weighted average of its neighbours. The relative\n"
+    "      residual printed at the end shows how close the result is to it.\n"
     "\n");
     return 0;
 }
@@ -38,15 +49,22 @@ int main(int argc, char * argv[]) {
     bool use_outpath = false ;
     char  *fout = NULL ;
     char *fin = NULL;
-    int ac, dim;
+    int ac, dim = 3;
     int nr_iterations = 30 ;
+    int nr_cg_iterations = 10000;
     int nr_layers = 20 ;
+    bool use_cg = false;
+    double tolerance = 1e-6;
     if (argc < 2) return show_help();
 
     // Process user options.
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-rim")) {
             if (++ac >= argc) {
                 fprintf(stderr, " * * missing argument for -rim\n");
@@ -65,6 +83,26 @@ int main(int argc, char * argv[]) {
                 return 1;
             }
             nr_iterations = atof(argv[ac]);
+            nr_cg_iterations = nr_iterations;
+        } else if (!strcmp(argv[ac], "-solver")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -solver\n");
+                return 1;
+            }
+            if (!strcmp(argv[ac], "cg")) {
+                use_cg = true;
+            } else if (!strcmp(argv[ac], "jacobi")) {
+                use_cg = false;
+            } else {
+                fprintf(stderr, "** -solver must be 'jacobi' or 'cg'\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[ac], "-tolerance")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -tolerance\n");
+                return 1;
+            }
+            tolerance = atof(argv[ac]);
         } else if (!strcmp(argv[ac], "-nr_layers")) {
             if (++ac >= argc) {
                 fprintf(stderr, " * * missing argument for -nr_layers\n");
@@ -89,7 +127,7 @@ int main(int argc, char * argv[]) {
         return 1;
     }
     // Read input dataset, including data
-    nifti_image * nii_input = nifti_image_read(fin, 1);
+    nifti_image * nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, " * * failed to read NIfTI image from '%s'\n", fin);
         return 2;
@@ -125,16 +163,27 @@ int main(int argc, char * argv[]) {
     float* layers_data = static_cast<float*>(layers->data);
     nifti_image* leaky = copy_nifti_as_int16(nii_rim);
     int16_t* leaky_data = static_cast<int16_t*>(leaky->data);
-    nifti_image* gaus_weigth = copy_nifti_as_float32(nii_rim);
-    float* gaus_weigth_data = static_cast<float*>(gaus_weigth->data);
 
     // ========================================================================
     float kernel_size = 1;  // Corresponds to one voxel sice.
     int vic = max(1., 1. * kernel_size);  // Ignore if voxel is too far
-    float d = 0.;
     cout << "  vic = " << vic << endl;
     cout << "  Kernel size = " << kernel_size << endl;
 
+    // Weights only depend on the offset between voxels, compute them once
+    const int box = 2 * vic + 1;
+    vector<float> kernel_weight(box * box * box);
+    for (int kz = -vic; kz <= vic; ++kz) {
+        for (int ky = -vic; ky <= vic; ++ky) {
+            for (int kx = -vic; kx <= vic; ++kx) {
+                float d = dist(0., 0., 0., (float)kx, (float)ky, (float)kz,
+                               dX, dY, dZ);
+                kernel_weight[((kz + vic) * box + ky + vic) * box + kx + vic] =
+                    gaus(d, kernel_size);
+            }
+        }
+    }
+
     for (int i = 0; i < nr_voxels; ++i) {
         if (*(nii_rim_data + i) == 1) {
             *(layers_data + i) = 200.;
@@ -148,74 +197,126 @@ int main(int argc, char * argv[]) {
     }
 
     // ========================================================================
-    // Start iterative loop here
+    // Linear system of the equilibrium
     // ========================================================================
-    int iter_max = nr_iterations ;
-    float total_weigth = 0;
-    int voxel_j = 0;
-    float w =  0 ;
-
-    for (int iter = 0; iter < iter_max; ++iter) {
-        cout << "\r  Iteration: " << iter << " of " << iter_max << flush;
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_y; ++iy) {
-                for (int ix = 0; ix < size_x; ++ix) {
-                    int voxel_i = nxy * iz + nx * iy + ix;
-                    if (*(nii_rim_data + voxel_i)  == 3) {
-                      *(smooth_data + voxel_i) = *(layers_data + voxel_i);
-                      *(gaus_weigth_data + voxel_i) = 1;
-
-
-                         total_weigth = 0;
-
-                        int jz_start = max(0, iz - vic);
-                        int jz_stop = min(iz + vic + 1, size_z);
-                        int jy_start = max(0, iy - vic);
-                        int jy_stop = min(iy + vic + 1, size_y);
-                        int jx_start = max(0, ix - vic);
-                        int jx_stop = min(ix + vic + 1, size_x);
-
-                        for (int jz = jz_start; jz < jz_stop; ++jz) {
-                            for (int jy = jy_start; jy < jy_stop; ++jy) {
-                                for (int jx = jx_start; jx < jx_stop; ++jx) {
-                                     voxel_j = nxy * jz + nx * jy + jx;
-
-                                        d = dist((float)ix, (float)iy, (float)iz,
-                                                 (float)jx, (float)jy, (float)jz,
-                                                 dX, dY, dZ);
-                                        if (*(nii_rim_data + voxel_j)  > 0. ) {
-                                            w = gaus(d, kernel_size);
-                                            *(smooth_data + voxel_i)      += *(layers_data + voxel_j) * w;
-                                            *(gaus_weigth_data + voxel_i) += w;
-                                        }
-
-                                }
-                            }
-                        }
-                        if (*(gaus_weigth_data + voxel_i) > 0) {
-                            *(smooth_data + voxel_i) /= *(gaus_weigth_data + voxel_i);
-                        }
+    // At equilibrium every GM voxel is the weighted average of
+    // its neighbours with rim > 0. Border voxels are fixed (+/-200), which
+    // makes this a discrete Laplace equation A u = b over the GM voxels. A is
+    // symmetric and diagonally dominant, stored here in compressed rows.
+    log_stage("Setting up the gray matter system...");
+    vector<int32_t> gm_index(nr_voxels, -1);
+    vector<int32_t> gm_voxel;
+    for (int i = 0; i < nr_voxels; ++i) {
+        if (*(nii_rim_data + i) == 3) {
+            gm_index[i] = gm_voxel.size();
+            gm_voxel.push_back(i);
+        }
+    }
+    const int nr_gm = gm_voxel.size();
+
+    laplace_system system;
+    system.row_start.assign(nr_gm + 1, 0);
+    system.diag.assign(nr_gm, 0);
+    system.rhs.assign(nr_gm, 0);
+    for (int n = 0; n < nr_gm; ++n) {
+        int voxel_i = gm_voxel[n];
+        int iz = voxel_i / nxy;
+        int iy = (voxel_i % nxy) / nx;
+        int ix = voxel_i % nx;
+        for (int jz = max(0, iz - vic); jz < min(iz + vic + 1, size_z); ++jz) {
+            for (int jy = max(0, iy - vic); jy < min(iy + vic + 1, size_y); ++jy) {
+                for (int jx = max(0, ix - vic); jx < min(ix + vic + 1, size_x); ++jx) {
+                    int voxel_j = nxy * jz + nx * jy + jx;
+                    if (voxel_j == voxel_i || *(nii_rim_data + voxel_j) <= 0.) {
+                        continue;
+                    }
+                    float w = kernel_weight[((jz - iz + vic) * box + jy - iy + vic)
+                                            * box + jx - ix + vic];
+                    system.diag[n] += w;
+                    if (gm_index[voxel_j] >= 0) {
+                        system.row_col.push_back(gm_index[voxel_j]);
+                        system.row_weight.push_back(w);
+                    } else {
+                        system.rhs[n] += w * *(layers_data + voxel_j);
                     }
                 }
             }
         }
-        for (int iz = 0; iz < size_z; ++iz) {
-            for (int iy = 0; iy < size_y; ++iy) {
-                for (int ix = 0; ix < size_x; ++ix) {
-                    int voxel_i = nxy * iz + nx * iy + ix;
-                    if (*(nii_rim_data + voxel_i) == 1) {
-                        *(layers_data + voxel_i) = 200.0;
-                    }
-                    if (*(nii_rim_data + voxel_i) == 2) {
-                        *(layers_data + voxel_i) = -200.0;
-                    }
-                    if (*(nii_rim_data + voxel_i) == 3) {
-                        *(layers_data + voxel_i) = *(smooth_data + voxel_i);
+        system.row_start[n + 1] = system.row_col.size();
+    }
+    cout << "  Gray matter voxels: " << nr_gm << endl;
+
+    if (use_cg) {
+        // ====================================================================
+        // Preconditioned conjugate gradients (Jacobi preconditioner)
+        // ====================================================================
+        log_stage("Solving with preconditioned conjugate gradients...");
+        vector<double> x(nr_gm, 0);
+        double rel_residual;
+        laplace_solve_cg(system, x, tolerance, nr_cg_iterations, rel_residual);
+        for (int n = 0; n < nr_gm; ++n) {
+            *(layers_data + gm_voxel[n]) = x[n];
+        }
+    } else {
+        // ====================================================================
+        // Start iterative loop here
+        // ====================================================================
+        log_stage("Smoothing with Jacobi iterations...");
+        int iter_max = nr_iterations ;
+
+        for (int iter = 0; iter < iter_max; ++iter) {
+            cout << "\r  Iteration: " << iter << " of " << iter_max << flush;
+            timing_count(nr_gm);
+            #pragma omp parallel for
+            for (int n = 0; n < nr_gm; ++n) {
+                int voxel_i = gm_voxel[n];
+                int iz = voxel_i / nxy;
+                int iy = (voxel_i % nxy) / nx;
+                int ix = voxel_i % nx;
+                float smooth_val = *(layers_data + voxel_i);
+                float total_weight = 1;
+
+                int jz_start = max(0, iz - vic);
+                int jz_stop = min(iz + vic + 1, size_z);
+                int jy_start = max(0, iy - vic);
+                int jy_stop = min(iy + vic + 1, size_y);
+                int jx_start = max(0, ix - vic);
+                int jx_stop = min(ix + vic + 1, size_x);
+
+                for (int jz = jz_start; jz < jz_stop; ++jz) {
+                    for (int jy = jy_start; jy < jy_stop; ++jy) {
+                        int k = ((jz - iz + vic) * box + jy - iy + vic) * box
+                                + jx_start - ix + vic;
+                        for (int jx = jx_start; jx < jx_stop; ++jx, ++k) {
+                            int voxel_j = nxy * jz + nx * jy + jx;
+                            if (*(nii_rim_data + voxel_j)  > 0. ) {
+                                smooth_val += *(layers_data + voxel_j) * kernel_weight[k];
+                                total_weight += kernel_weight[k];
+                            }
+                        }
                     }
                 }
+                if (total_weight > 0) {
+                    smooth_val /= total_weight;
+                }
+                *(smooth_data + voxel_i) = smooth_val;
+            }
+            for (int n = 0; n < nr_gm; ++n) {
+                *(layers_data + gm_voxel[n]) = *(smooth_data + gm_voxel[n]);
             }
         }
+        cout << endl;
     }
+
+    // Report how close the layering is to the equilibrium
+    {
+        vector<double> u(nr_gm);
+        for (int n = 0; n < nr_gm; ++n) {
+            u[n] = *(layers_data + gm_voxel[n]);
+        }
+        cout << "  Relative residual: " << laplace_residual(system, u) << endl;
+    }
+
 /*
     // ------------------------------------------------------------------------
     for (int i = 0; i < nr_voxels; ++i) {
@@ -244,8 +345,6 @@ int main(int argc, char * argv[]) {
     if (!use_outpath) fout = fin;
     save_output_nifti(fout, "leaky_layers", leaky, true, use_outpath);
 
-    //save_output_nifti(fin, "gauswight", gaus_weigth, true);
-
     cout << "  Finished." << endl;
     return 0;
 }
@@ -25,6 +25,7 @@ int show_help( void )
     "                 .nii.gz. Overwrites existing files.\n"
     "                 default is equi_volume_layers.nii, equi_distance_layers.nii, and leaky_layers.nii in current folder \n"
     "                 this is used as prefix not the entire name  \n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    - If you run this on EPI-T1 data consider preparing them as follows:\n"
@@ -49,6 +50,11 @@ int main(int argc, char * argv[])
       if( ! strncmp(argv[ac], "-h", 2) ) {
          return show_help();
       }
+      else if( ! strncmp(argv[ac], "-timing", 7) ) {
+         if( !parse_timing_option(ac, argc, argv) ) {
+            return 1;
+         }
+      }
       else if( ! strcmp(argv[ac], "-equidist") ) {
          if( ++ac >= argc ) {
             fprintf(stderr, "** missing argument for -equidist\n");
@@ -96,7 +102,7 @@ int main(int argc, char * argv[])
 
    if( !fleakyi  ) { fprintf(stderr, "** missing option '-leaky'\n");  return 1; }
 //   // read input dataset, including data
-//   nifti_image * nim_leakyi = nifti_image_read(fleakyi, 1);
+//   nifti_image * nim_leakyi = pipeline_image_read(fleakyi, 1);
 //   if( !nim_leakyi ) {
 //      fprintf(stderr,"** failed to read layer NIfTI image from '%s'\n", fleakyi);
 //      return 2;
@@ -104,17 +110,17 @@ int main(int argc, char * argv[])
 
    if( !fdisti  ) { fprintf(stderr, "** missing option '-equidist'\n");  return 1; }
    // read input dataset, including data
-//   nifti_image * nim_disti = nifti_image_read(fdisti, 1);
+//   nifti_image * nim_disti = pipeline_image_read(fdisti, 1);
 //   if( !nim_disti ) {
 //      fprintf(stderr,"** failed to read layer NIfTI image from '%s'\n", fdisti);
 //      return 2;
 //   }
 
-    nifti_image* fdist = nifti_image_read(fdisti, 1);
+    nifti_image* fdist = pipeline_image_read(fdisti, 1);
     nifti_image* nii_dist = copy_nifti_as_int16(fdist);
     int16_t* nii_dist_data = static_cast<int16_t*>(nii_dist->data);
 
-    nifti_image* fleaky = nifti_image_read(fleakyi, 1);
+    nifti_image* fleaky = pipeline_image_read(fleakyi, 1);
     nifti_image* nii_leak = copy_nifti_as_int16(fleaky);
     int16_t* nii_leak_data = static_cast<int16_t*>(nii_leak->data);
 
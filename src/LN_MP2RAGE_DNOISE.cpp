@@ -25,6 +25,7 @@ int show_help(void) {
     "    -beta   : Regularization term. Default is '0.2'.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    An application of this program is mentioned in this blog post:\n"
@@ -45,6 +46,10 @@ int main(int argc, char* argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-beta")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -beta");
@@ -96,114 +101,158 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image* nii1 = nifti_image_read(fin1, 1);
-    if (!nii1) {
+    // Read input headers, data is streamed in chunks below
+    nifti_stream* stream1 = nifti_stream_open_read(fin1);
+    if (!stream1) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin1);
         return 2;
     }
-    nifti_image* nii2 = nifti_image_read(fin2, 1);
-    if (!nii2) {
+    nifti_stream* stream2 = nifti_stream_open_read(fin2);
+    if (!stream2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin2);
         return 2;
     }
-    nifti_image* nii3 = nifti_image_read(fin3, 1);
-    if (!nii3) {
+    nifti_stream* stream3 = nifti_stream_open_read(fin3);
+    if (!stream3) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin3);
         return 2;
     }
+    nifti_image* nii1 = stream1->nii;
+    nifti_image* nii2 = stream2->nii;
+    nifti_image* nii3 = stream3->nii;
 
     log_welcome("LN_MP2RAGE_DNOISE");
     log_nifti_descriptives(nii1);
     log_nifti_descriptives(nii2);
     log_nifti_descriptives(nii3);
 
-    // Get dimensions of input
-    const int size_x = nii1->nx;
-    const int size_y = nii1->ny;
-    const int size_z = nii1->nz;
-    const int nr_voxels = size_z * size_y * size_x;
-
-    // ========================================================================
-    // Fix datatype issues
-    nifti_image* nii_inv1 = copy_nifti_as_float32(nii1);
-    float* nii_inv1_data = static_cast<float*>(nii_inv1->data);
-    nifti_image* nii_inv2 = copy_nifti_as_float32(nii2);
-    float* nii_inv2_data = static_cast<float*>(nii_inv2->data);
-    nifti_image* nii_uni = copy_nifti_as_float32(nii3);
-    float* nii_uni_data = static_cast<float*>(nii_uni->data);
-
-    // Allocate output nifti files
-    nifti_image* nii_denoised = copy_nifti_as_float32(nii1);
-    float* nii_denoised_data = static_cast<float*>(nii_denoised->data);
-    nifti_image* nii_phaseerr = copy_nifti_as_float32(nii1);
-    float* nii_phaseerr_data = static_cast<float*>(nii_phaseerr->data);
-
-    // fixing slopes
+    if (nii1->nvox != nii2->nvox || nii1->nvox != nii3->nvox
+        || nii1->nx != nii2->nx || nii1->nx != nii3->nx
+        || nii1->ny != nii2->ny || nii1->ny != nii3->ny
+        || nii1->nz != nii2->nz || nii1->nz != nii3->nz) {
+        fprintf(stderr, "** INV1, INV2 and UNI dimensions do not match\n");
+        return 2;
+    }
 
     // ========================================================================
     // Handle scaling factor effects
-    float scl_slope1=nii_inv1->scl_slope;
-    float scl_slope2=nii_inv2->scl_slope;
-    float scl_slope3=nii_uni->scl_slope;
-    if (scl_slope1 != 0 || scl_slope2 != 0 || scl_slope3 != 0) {
-        for (int i = 0; i != nr_voxels; ++i) {
-            *(nii_inv1_data + i) = *(nii_inv1_data + i) * scl_slope1;
-            *(nii_inv2_data + i) = *(nii_inv2_data + i) * scl_slope2;
-            *(nii_uni_data  + i) = *(nii_uni_data + i) * scl_slope3;
-        }
-    } else {
+    float scl_slope1 = nii1->scl_slope;
+    float scl_slope2 = nii2->scl_slope;
+    float scl_slope3 = nii3->scl_slope;
+    bool apply_slope = scl_slope1 != 0 || scl_slope2 != 0 || scl_slope3 != 0;
+    if (!apply_slope) {
         cout << "    !!!Warning!!! Input nifti header contains scl_scale=0.\n"
              << "    Make sure to check the resulting output image.\n"<< endl;
     }
+
+    // Prepare output nifti files
+    nifti_image* nii_out = nifti_copy_nim_info(nii1);
+    pipeline_image_track(nii_out);
+    nii_out->datatype = NIFTI_TYPE_FLOAT32;
+    nii_out->nbyper = sizeof(float);
     // We can set scaling factor to 1 because we have accounted for them above
-    nii_denoised->scl_slope = 1.0 ;
-    nii_phaseerr->scl_slope = 1.0 ;
+    nii_out->scl_slope = 1.0;
+    nifti_stream* stream_denoised = nifti_stream_open_write(
+        nii_out, fout, "denoised", true, use_outpath);
+    nifti_stream* stream_phaseerr = nifti_stream_open_write(
+        nii_out, fout, "border_enhance", true);
+    if (!stream_denoised || !stream_phaseerr) {
+        return 2;
+    }
 
     // ========================================================================
-    // Big calculation across all voxels
+    // Big calculation across all voxels, chunk by chunk
     beta = beta * SIEMENS_f;
-    for (int i = 0; i != nr_voxels; ++i) {
-        float val_uni = *(nii_uni_data + i);
-        float val_inv1 = *(nii_inv1_data + i);
-        float val_inv2 = *(nii_inv2_data + i);
-        float new_uni1, new_uni2, val_uni_wrong;
-
-        // Skip nan or zero voxels
-        if ( val_uni != val_uni || val_uni == 0 || val_uni == 0.0) {
-            *(nii_phaseerr_data + i) = 0;
-            *(nii_denoised_data + i) = 0;
-        } else {
-            // Scale UNI to range of -0.5 to 0.5 (as in O’Brien et al. [2014])
-            val_uni = val_uni / SIEMENS_f - 0.5;
+    nifti_image *chunk1, *chunk2, *chunk3;
+    while ((chunk1 = nifti_stream_read_chunk(stream1)) != NULL) {
+        chunk2 = nifti_stream_read_chunk(stream2);
+        chunk3 = nifti_stream_read_chunk(stream3);
+        if (!chunk2 || !chunk3) {
+            return 2;
+        }
 
-            if (val_uni < 0) {
-                new_uni1 = val_inv2 * (1. / (2. * val_uni)
-                                       + sqrt(1. / pow(2 * val_uni, 2) - 1.));
-            } else {
-                new_uni1 = val_inv2 * (1. / (2. * val_uni)
-                                       - sqrt(1. / pow(2 * val_uni, 2) - 1.));
+        // Fix datatype issues
+        nifti_image* nii_inv1 = copy_nifti_as_float32(chunk1);
+        float* nii_inv1_data = static_cast<float*>(nii_inv1->data);
+        nifti_image* nii_inv2 = copy_nifti_as_float32(chunk2);
+        float* nii_inv2_data = static_cast<float*>(nii_inv2->data);
+        nifti_image* nii_uni = copy_nifti_as_float32(chunk3);
+        float* nii_uni_data = static_cast<float*>(nii_uni->data);
+
+        // Allocate output chunks
+        nifti_image* nii_denoised = copy_nifti_as_float32(chunk1);
+        float* nii_denoised_data = static_cast<float*>(nii_denoised->data);
+        nifti_image* nii_phaseerr = copy_nifti_as_float32(chunk1);
+        float* nii_phaseerr_data = static_cast<float*>(nii_phaseerr->data);
+
+        const int nr_voxels = nii_inv1->nvox;
+        if (apply_slope) {
+            for (int i = 0; i != nr_voxels; ++i) {
+                *(nii_inv1_data + i) = *(nii_inv1_data + i) * scl_slope1;
+                *(nii_inv2_data + i) = *(nii_inv2_data + i) * scl_slope2;
+                *(nii_uni_data  + i) = *(nii_uni_data + i) * scl_slope3;
             }
+        }
+
+        for (int i = 0; i != nr_voxels; ++i) {
+            float val_uni = *(nii_uni_data + i);
+            float val_inv1 = *(nii_inv1_data + i);
+            float val_inv2 = *(nii_inv2_data + i);
+            float new_uni1, new_uni2, val_uni_wrong;
+
+            // Skip nan or zero voxels
+            if ( val_uni != val_uni || val_uni == 0 || val_uni == 0.0) {
+                *(nii_phaseerr_data + i) = 0;
+                *(nii_denoised_data + i) = 0;
+            } else {
+                // Scale UNI to range of -0.5 to 0.5 (as in O’Brien et al. [2014])
+                val_uni = val_uni / SIEMENS_f - 0.5;
 
-            // Eq. 2 in O’Brien et al. [2014].
-            new_uni2 = (new_uni1 * val_inv2 - beta)
-                       / ((pow(new_uni1, 2) + pow(val_inv2, 2) + 2. * beta));
+                if (val_uni < 0) {
+                    new_uni1 = val_inv2 * (1. / (2. * val_uni)
+                                           + sqrt(1. / pow(2 * val_uni, 2) - 1.));
+                } else {
+                    new_uni1 = val_inv2 * (1. / (2. * val_uni)
+                                           - sqrt(1. / pow(2 * val_uni, 2) - 1.));
+                }
 
-            // Scale back the value range
-            *(nii_denoised_data + i) =  (new_uni2 + 0.5) * SIEMENS_f;
+                // Eq. 2 in O’Brien et al. [2014].
+                new_uni2 = (new_uni1 * val_inv2 - beta)
+                           / ((pow(new_uni1, 2) + pow(val_inv2, 2) + 2. * beta));
 
-            // ----------------------------------------------------------------
-            // Border enhance
-            val_uni_wrong = val_inv1 * val_inv2
-                            / (pow(val_inv1, 2) + pow(val_inv2, 2));
+                // Scale back the value range
+                *(nii_denoised_data + i) =  (new_uni2 + 0.5) * SIEMENS_f;
 
-            *(nii_phaseerr_data + i) = val_uni_wrong;
-            // ----------------------------------------------------------------
+                // ------------------------------------------------------------
+                // Border enhance
+                val_uni_wrong = val_inv1 * val_inv2
+                                / (pow(val_inv1, 2) + pow(val_inv2, 2));
+
+                *(nii_phaseerr_data + i) = val_uni_wrong;
+                // ------------------------------------------------------------
+            }
         }
-    }
 
-    save_output_nifti(fout, "denoised", nii_denoised, true, use_outpath);
-    save_output_nifti(fout, "border_enhance", nii_phaseerr, true);
+        if (!nifti_stream_write_chunk(stream_denoised, nii_denoised)
+            || !nifti_stream_write_chunk(stream_phaseerr, nii_phaseerr)) {
+            return 2;
+        }
+        pipeline_image_free(nii_inv1);
+        pipeline_image_free(nii_inv2);
+        pipeline_image_free(nii_uni);
+        pipeline_image_free(nii_denoised);
+        pipeline_image_free(nii_phaseerr);
+        pipeline_image_free(chunk1);
+        pipeline_image_free(chunk2);
+        pipeline_image_free(chunk3);
+    }
+    nifti_stream_close(stream1);
+    nifti_stream_close(stream2);
+    nifti_stream_close(stream3);
+    bool complete = nifti_stream_close(stream_denoised);
+    if (!nifti_stream_close(stream_phaseerr) || !complete) {
+        return 2;
+    }
 
     cout << "  Finished." << endl;
     return 0;
@@ -1,18 +1,6 @@
 
 #include "../dep/laynii_lib.h"
 
-int N_rand = 1000;
-double_t lower = -10;
-double_t upper = 10;
-
-double verteilung(double x);
-typedef double (*Functions)(double);
-Functions pFunc = verteilung;
-
-double_t arb_pdf_num(int N_rand, double (*pFunc)(double),
-                     double_t lower, double_t upper);
-double adjusted_rand_numbers(double mean, double stdev, double value);
-
 int show_help(void) {
     printf(
     "LN_NOISEME: Adds noise to image.\n"
@@ -20,14 +8,19 @@ int show_help(void) {
     "Usage:\n"
     "    LN_NOISEME -input input_example.nii -std 0.5 \n"
     "    ../LN_NOISEME -input lo_VASO_act.nii -std 1 \n"
+    "    ../LN_NOISEME -input lo_VASO_act.nii -std 1 -seed 42 \n"
     "\n"
     "Options:\n"
     "    -help   : Show this help.\n"
     "    -input  : Specify input dataset.\n"
     "    -std    : Noise standard deviance.\n"
+    "    -seed   : (Optional) Seed of the random numbers. Default is 0. The\n"
+    "              same seed always gives the same noise, also when the\n"
+    "              program runs on multiple threads.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
     "              If not given, the prefix 'noised' is added.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "\n");
     cout << endl ;
@@ -40,6 +33,7 @@ int main(int argc, char * argv[]) {
     char *fin = NULL;
     int ac;
     float std_val;
+    uint64_t seed = 0;
 
 
 
@@ -49,6 +43,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -61,6 +59,12 @@ int main(int argc, char * argv[]) {
                 return 1;
             }
             std_val = atof(argv[ac]);
+        } else if (!strcmp(argv[ac], "-seed")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -seed\n");
+                return 1;
+            }
+            seed = strtoull(argv[ac], NULL, 10);
         } else if (!strcmp(argv[ac], "-output")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -output\n");
@@ -78,7 +82,7 @@ int main(int argc, char * argv[]) {
         return 1;
     }
     // Read input dataset, including data
-    nifti_image* nii_input = nifti_image_read(fin, 1);
+    nifti_image* nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI image from '%s'\n", fin);
         return 2;
@@ -87,6 +91,7 @@ int main(int argc, char * argv[]) {
     log_welcome("LN_NOISEME");
     log_nifti_descriptives(nii_input);
     cout << "  Variance chosen to " << std_val << endl;
+    cout << "  Seed = " << seed << endl;
 
     // ========================================================================
     // Allocating new nifti
@@ -94,14 +99,14 @@ int main(int argc, char * argv[]) {
     float* nii_new_data = static_cast<float*>(nii_new->data);
     // ========================================================================
 
-    int nr_voxels = nii_input->nvox;
-    for (int i = 0; i < nr_voxels; ++i) {
-        *(nii_new_data + i) +=
-            adjusted_rand_numbers(0, std_val,
-                                  arb_pdf_num(N_rand, pFunc, lower, upper));
+    // Each voxel draws from its own counter, so the noise is
+    // identical no matter how the loop is split across threads.
+    int64_t nr_voxels = nii_input->nvox;
+    #pragma omp parallel for
+    for (int64_t i = 0; i < nr_voxels; ++i) {
+        *(nii_new_data + i) += std_val * rand_normal(seed, i);
     }
 
-
     if (!use_outpath) fout = fin;
     save_output_nifti(fout, "noised", nii_new, true, use_outpath);
 
@@ -109,32 +114,3 @@ int main(int argc, char * argv[]) {
     return 0;
 }
 
-// Gauss lower = -5 , upper = 5
-double verteilung(double z) {
-    return exp(-z * z / (2.)) * 1. / sqrt(2. * 3.141592653);
-}
-
-double_t arb_pdf_num(int N_rand, double (*pFunc)(double), double_t lower,
-                     double_t upper) {
-    double_t binwidth = (upper - lower)/(double_t)N_rand;
-    double_t integral = 0.0;
-    double_t rand_num = rand() / (double_t)RAND_MAX;
-    // rand_num = rand()/(double_t)RAND_MAX;
-    // rand_num = rand()/(double_t)RAND_MAX;
-    int i;
-
-    for (i = 0; integral < rand_num; i++) {
-        integral += pFunc(lower + (double_t)i * binwidth) * binwidth;
-
-        if ((lower + (double_t)i * binwidth) > upper) {
-            cout << "  Upper limit, maybe there should be adjusted limit "
-                 << i << endl;
-            return lower + (double_t) i *binwidth;
-        }
-    }
-    return lower + (double_t)i * binwidth;
-}
-
-double adjusted_rand_numbers(double mean, double stdev, double value) {
-    return value * stdev + mean;
-}
@@ -19,6 +19,7 @@ int show_help(void) {
     "    -output      : (Optional) Output filename, including .nii or\n"
     "                   .nii.gz, and path if needed. Overwrites existing files.\n"
     "                   If not given, the prefix 'fPSF' is added.\n"
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    Some applications of this program are mentioned in this blog post: \n"
@@ -39,6 +40,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-kernel_size")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -kernel_size\n");
@@ -68,7 +73,7 @@ int main(int argc, char * argv[]) {
 
 
     // Read input dataset
-    nifti_image * nii_input = nifti_image_read(fin, 1);
+    nifti_image * nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -129,6 +134,7 @@ for(int i = 0; i < kernel_size; i++) {
 
     // Allocate new nifti
     nifti_image* nii_kernel = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_kernel);
     nii_kernel->nt = 1;
     nii_kernel->nx = kernel_size;
     nii_kernel->ny = kernel_size;
@@ -29,6 +29,7 @@ int show_help(void) {
     "              Useful for investigating flattening effects on coarser scales.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -44,6 +45,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -75,7 +80,7 @@ int main(int argc, char * argv[]) {
     }
 
     // Read input dataset
-    nifti_image * nii_input = nifti_image_read(fin, 1);
+    nifti_image * nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -103,6 +108,7 @@ int main(int argc, char * argv[]) {
 
     // Allocating new nifti images
     nifti_image* ragrug = nifti_copy_nim_info(nii);
+    pipeline_image_track(ragrug);
     ragrug->nt = 1;
     ragrug->datatype = NIFTI_TYPE_INT32;
     ragrug->nbyper = sizeof(int32_t);
@@ -111,6 +117,7 @@ int main(int argc, char * argv[]) {
     int32_t* ragrug_data = static_cast<int32_t*>(ragrug->data);
 
     nifti_image* coord = nifti_copy_nim_info(nii);
+    pipeline_image_track(coord);
     coord->datatype = NIFTI_TYPE_INT32;
     coord->dim[0] = 4;  // For proper 4D nifti
     coord->dim[1] = size_x;
@@ -18,6 +18,7 @@ int show_help(void) {
     "    -input  : Dataset that should be shorted data.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"    
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -32,6 +33,10 @@ int main(int argc, char *argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -57,19 +62,43 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image *nii = nifti_image_read(fin, 1);
-    if (!nii) {
+    // Read input header, data is streamed in chunks below
+    nifti_stream* stream_in = nifti_stream_open_read(fin);
+    if (!stream_in) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
     }
+    nifti_image *nii = stream_in->nii;
 
     log_welcome("LN_SHORT_ME");
     log_nifti_descriptives(nii);
 
+    // Prepare output header
+    nifti_image *nii_new = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_new);
+    nii_new->datatype = NIFTI_TYPE_INT16;
+    nii_new->nbyper = sizeof(int16_t);
+    nii_new->scl_slope = nii->scl_slope / 1000.;
+    nifti_stream* stream_out = nifti_stream_open_write(nii_new, fout, "short",
+                                                       true, use_outpath);
+    if (!stream_out) {
+        return 2;
+    }
+
     // Cast input data to short (int16)
-    nifti_image *nii_new = copy_nifti_as_float16(nii);
-    save_output_nifti(fout, "short", nii_new, true, use_outpath);
+    nifti_image* chunk;
+    while ((chunk = nifti_stream_read_chunk(stream_in)) != NULL) {
+        nifti_image *chunk_new = copy_nifti_as_float16(chunk);
+        if (!nifti_stream_write_chunk(stream_out, chunk_new)) {
+            return 2;
+        }
+        pipeline_image_free(chunk_new);
+        pipeline_image_free(chunk);
+    }
+    nifti_stream_close(stream_in);
+    if (!nifti_stream_close(stream_out)) {
+        return 2;
+    }
 
     cout << "  Finished." << endl;
     return 0;
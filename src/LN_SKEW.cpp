@@ -22,6 +22,7 @@ int show_help(void) {
     "    -input  : Nifti (.nii or nii.gz) time series.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"    
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    Applications of this program are described in this blog post: \n"
@@ -41,6 +42,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -65,32 +70,30 @@ int main(int argc, char * argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image * nii_input = nifti_image_read(fin, 1);
-    if (!nii_input) {
+    // Read input header, data is streamed volume by volume below
+    nifti_stream* stream_in = nifti_stream_open_read(fin, 1, true);
+    if (!stream_in) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
     }
+    nifti_image* nii = stream_in->nii;
 
     log_welcome("LN_SKEW");
-    log_nifti_descriptives(nii_input);
+    log_nifti_descriptives(nii);
 
     // Get dimensions of input
-    int size_x = nii_input->nx;
-    int size_y = nii_input->ny;
-    int size_z = nii_input->nz;
-    int size_time = nii_input->nt;
-    int nx = nii_input->nx;
-    int nxy = nii_input->nx * nii_input->ny;
-    int nxyz = nii_input->nx * nii_input->ny * nii_input->nz;
+    int size_x = nii->nx;
+    int size_y = nii->ny;
+    int size_z = nii->nz;
+    int size_time = stream_in->size_time;
+    int nx = nii->nx;
+    int nxy = nii->nx * nii->ny;
+    int nxyz = nii->nx * nii->ny * nii->nz;
 
     // ========================================================================
-    // Fix data type issues
-    nifti_image* nii = copy_nifti_as_float32(nii_input);
-    float* nii_data = static_cast<float*>(nii->data);
-
     // Allocate new nifti
     nifti_image* nii_skew = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_skew);
     nii_skew->nt = 1;
     nii_skew->nvox = nii->nvox / size_time;
     nii_skew->datatype = NIFTI_TYPE_FLOAT32;
@@ -126,29 +129,94 @@ int main(int argc, char * argv[]) {
     float* nii_NOISESTDEV_data = static_cast<float*>(nii_NOISESTDEV->data);
 
     // ========================================================================
-    cout << "  Calculating skew, kurtosis, and autocorrelation..." << endl;
+    // All temporal statistics are accumulated in a single pass
+    // over the data, one volume at a time, so memory does not grow with the
+    // number of time points. Central moments are updated online (Welford,
+    // Terriberry). The lag-1 products are summed relative to the first time
+    // point of each voxel, which avoids cancellation for large means.
+    // ========================================================================
+    log_stage("Calculating skew, kurtosis, and autocorrelation...");
 
-    double vec1[size_time];
-    double vecl[27]; // local vector for spatial gradient (number of voxel's noigbour)
-    double vec2[size_time];
-    int voxel_i = 0; 
+    vector<double> m1(nxyz, 0), m2(nxyz, 0), m3(nxyz, 0), m4(nxyz, 0);
+    vector<double> first(nxyz, 0), previous(nxyz, 0), sum_lag(nxyz, 0);
+    vector<double> comoment(nxyz, 0);  // With the mean time course
+    double mean_all = 0, m2_all = 0;
 
-    for (int iz = 0; iz < size_z; ++iz) {
-        for (int iy = 0; iy < size_y; ++iy) {
-            for (int ix = 0; ix < size_x; ++ix) {
-                voxel_i = nxy * iz + nx * iy + ix;
-                for (int it = 0; it < size_time; ++it) {
-                    vec1[it] =
-                        static_cast<double>(*(nii_data + nxyz * it + voxel_i));
-                }
-                *(nii_skew_data + voxel_i) = ren_skew(vec1, size_time);
-                *(nii_kurt_data + voxel_i) = ren_kurt(vec1, size_time);
-                *(nii_autocorr_data + voxel_i) = ren_autocor(vec1, size_time);
-                *(nii_mean_data + voxel_i) =  ren_average(vec1, size_time);
-                *(nii_stdev_data + voxel_i) = ren_stdev(vec1, size_time);
-                *(nii_tSNR_data + voxel_i) = ren_average(vec1, size_time)/ren_stdev(vec1, size_time);
+    // Image SNR uses pairs of even- and odd-numbered time points
+    const int size_time_even = size_time - size_time % 2;
+
+    for (int it = 0; it < size_time; ++it) {
+        nifti_image* chunk = nifti_stream_read_chunk(stream_in);
+        if (!chunk) {
+            return 2;
+        }
+        nifti_image* chunk_float = copy_nifti_as_float32(chunk);
+        const float* vol = static_cast<float*>(chunk_float->data);
+
+        // Mean time course of everything
+        double all = 0;
+        for (int voxel_i = 0; voxel_i < nxyz; ++voxel_i) {
+            all += static_cast<double>(vol[voxel_i] / nxyz);
+        }
+        const double n = it + 1;
+        const double delta_all = all - mean_all;
+        mean_all += delta_all / n;
+        m2_all += delta_all * (all - mean_all);
+
+        const double sign = (it % 2 == 0) ? 1 : -1;
+        const bool is_pair = it < size_time_even;
+
+        #pragma omp parallel for
+        for (int voxel_i = 0; voxel_i < nxyz; ++voxel_i) {
+            double x = vol[voxel_i];
+
+            double delta = x - m1[voxel_i];
+            double delta_n = delta / n;
+            double delta_n2 = delta_n * delta_n;
+            double term1 = delta * delta_n * (n - 1);
+            m1[voxel_i] += delta_n;
+            m4[voxel_i] += term1 * delta_n2 * (n * n - 3 * n + 3)
+                           + 6 * delta_n2 * m2[voxel_i]
+                           - 4 * delta_n * m3[voxel_i];
+            m3[voxel_i] += term1 * delta_n * (n - 2)
+                           - 3 * delta_n * m2[voxel_i];
+            m2[voxel_i] += term1;
+            comoment[voxel_i] += delta * (all - mean_all);
+
+            if (it == 0) {
+                first[voxel_i] = x;
+            } else {
+                sum_lag[voxel_i] += (x - first[voxel_i]) * previous[voxel_i];
+            }
+            previous[voxel_i] = x - first[voxel_i];
+
+            if (is_pair) {
+                *(nii_NOISE_data + voxel_i) += sign * x;
             }
         }
+        pipeline_image_free(chunk_float);
+        pipeline_image_free(chunk);
+    }
+    nifti_stream_close(stream_in);
+    timing_count(static_cast<uint64_t>(nxyz) * size_time);
+
+    const double n = size_time;
+    for (int voxel_i = 0; voxel_i < nxyz; ++voxel_i) {
+        // Lag-1 autocorrelation from the sums relative to the first value
+        double mean_shift = m1[voxel_i] - first[voxel_i];
+        double sum_all = mean_shift * n;
+        double lag = sum_lag[voxel_i]
+                     - mean_shift * (2 * sum_all - previous[voxel_i])
+                     + (n - 1) * mean_shift * mean_shift;
+
+        double stdev = sqrt(m2[voxel_i] / (n - 1));
+        *(nii_skew_data + voxel_i) = (m3[voxel_i] / n) / pow(m2[voxel_i] / (n - 1), 1.5);
+        *(nii_kurt_data + voxel_i) = (m4[voxel_i] / n) / ((m2[voxel_i] / n) * (m2[voxel_i] / n)) - 3;
+        *(nii_autocorr_data + voxel_i) = lag / m2[voxel_i];
+        *(nii_mean_data + voxel_i) = m1[voxel_i];
+        *(nii_stdev_data + voxel_i) = stdev;
+        *(nii_tSNR_data + voxel_i) = m1[voxel_i] / stdev;
+        *(nii_conc_data + voxel_i) = comoment[voxel_i] / sqrt(m2[voxel_i] * m2_all);
     }
 
     for (int voxel_i = 0; voxel_i < nxyz ; voxel_i++) {
@@ -163,41 +231,6 @@ int main(int argc, char * argv[]) {
     save_output_nifti(fout, "mean", nii_mean, true);
     save_output_nifti(fout, "stedev", nii_stdev, true);
     save_output_nifti(fout, "tSNR", nii_tSNR, true);
-    // ========================================================================
-    cout << "  Calculating correlation with everything..." << endl;
-
-    for (int it = 0; it < size_time; ++it) {
-        vec1[it] = 0;
-        vec2[it] = 0;
-    }
-
-    // Mean time course of everything
-    for (int iz = 0; iz < size_z; ++iz) {
-        for (int iy = 0; iy < size_y; ++iy) {
-            for (int ix = 0; ix < size_x; ++ix) {
-                voxel_i = nxy * iz + nx * iy + ix;
-                for (int it = 0; it < size_time; ++it) {
-                    vec1[it] +=
-                        static_cast<double>(*(nii_data + nxyz * it + voxel_i)
-                                            / nxyz);
-                }
-            }
-        }
-    }
-
-    // Voxel-wise corelation to mean of everything
-    for (int iz = 0; iz < size_z; ++iz) {
-        for (int iy = 0; iy < size_y; ++iy) {
-            for (int ix = 0; ix <size_x; ++ix) {
-                voxel_i = nxy * iz + nx * iy + ix;
-                for (int it = 0; it < size_time; ++it)   {
-                    vec2[it] =
-                        static_cast<double>(*(nii_data + nxyz * it + voxel_i));
-                }
-                *(nii_conc_data + voxel_i) = ren_correl(vec1, vec2, size_time);
-            }
-        }
-    }
     save_output_nifti(fout, "overall_correl", nii_conc, true);
     
     
@@ -205,17 +238,8 @@ int main(int argc, char * argv[]) {
     
     // ========================================================================
     cout << "  Calculating image SNR ..." << endl;
-    //size_time = 20;
-    if (size_time%2 == 1) size_time = size_time -1  ;  // make sure its and odd number of time points 
-    
-    for (int it = 0; it < size_time-1 ; it = it + 2 )   {
-        for (int voxel_i = 0; voxel_i < nxyz ; voxel_i++) {
-                    //vec2[it] =  static_cast<double>(*(nii_data + nxyz * it + voxel_i));
-                *(nii_NOISE_data + voxel_i) += static_cast<double>(*(nii_data + nxyz * it     + voxel_i)) ;
-                *(nii_NOISE_data + voxel_i) -= static_cast<double>(*(nii_data + nxyz * (it+1) + voxel_i)) ;
-        }
-    }
-  
+    size_time = size_time_even;  // make sure its and odd number of time points 
+
   // normalicing to time course duration
     for (int voxel_i = 0; voxel_i < nxyz ; voxel_i++) {
                 *(nii_NOISE_data + voxel_i) = *(nii_NOISE_data + voxel_i) / sqrt((double) (size_time)/2 ) ;
@@ -227,6 +251,7 @@ int main(int argc, char * argv[]) {
 //-------------------------------------
     // estimating local gradient of mean  
     
+    double vecl[27]; // local vector for spatial gradient (number of voxel's noigbour)
     int vinc_counter = 0 ;
     int vinc_x = 0 , vinc_y = 0 , vinc_z = 0;
     int vic = 1 ; // this will result in 26 neighbors (27 voxels) and is sufficient for decent STDEV estimation
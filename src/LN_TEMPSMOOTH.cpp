@@ -25,6 +25,7 @@ int show_help(void) {
     "              running average sliding window.\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"    
+    TIMING_OPTIONS_HELP
     "\n"
     "Notes:\n"
     "    An application of this program is described on this blog post:\n"
@@ -45,6 +46,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac  <  argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-gaus")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -gaus\n");
@@ -84,7 +89,7 @@ int main(int argc, char * argv[]) {
     }
 
     // Read input dataset
-    nifti_image * nii_input = nifti_image_read(fin, 1);
+    nifti_image * nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -123,6 +128,7 @@ int main(int argc, char * argv[]) {
     float* nii_smooth_data = static_cast<float*>(nii_smooth->data);
 
     nifti_image* nii_weight = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_weight);
     nii_weight->nt = 1;
     nii_weight->datatype = NIFTI_TYPE_FLOAT32;
     nii_weight->nbyper = sizeof(float);
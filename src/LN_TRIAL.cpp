@@ -17,6 +17,7 @@ int show_help(void) {
     "    -trial_dur : Duration of activity-rest trial in TRs.\n"
     "    -output    : (Optional) Output filename, including .nii or\n"
     "                 .nii.gz, and path if needed. Overwrites existing files.\n"    
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -33,6 +34,10 @@ int main(int argc, char * argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -64,7 +69,7 @@ int main(int argc, char * argv[]) {
     }
 
     // Read input dataset
-    nifti_image *nii_input = nifti_image_read(fin, 1);
+    nifti_image *nii_input = pipeline_image_read(fin, 1);
     if (!nii_input) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin);
         return 2;
@@ -94,6 +99,7 @@ int main(int argc, char * argv[]) {
 
     // Allocate trial average file
     nifti_image* nii_trials = nifti_copy_nim_info(nii);
+    pipeline_image_track(nii_trials);
     nii_trials->nt = trial_dur;
     nii_trials->nvox = nii->nvox / nr_trials;
     nii_trials->data = calloc(nii_trials->nvox, nii_trials->nbyper);
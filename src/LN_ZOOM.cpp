@@ -20,6 +20,7 @@ int show_help(void) {
     "              (e.g. the layer mask with one time point).\n"
     "    -output : (Optional) Output filename, including .nii or\n"
     "              .nii.gz, and path if needed. Overwrites existing files.\n"
+    TIMING_OPTIONS_HELP
     "\n");
     return 0;
 }
@@ -35,6 +36,10 @@ int main(int argc, char*  argv[]) {
     for (ac = 1; ac < argc; ac++) {
         if (!strncmp(argv[ac], "-h", 2)) {
             return show_help();
+        } else if (!strncmp(argv[ac], "-timing", 7)) {
+            if (!parse_timing_option(ac, argc, argv)) {
+                return 1;
+            }
         } else if (!strcmp(argv[ac], "-input")) {
             if (++ac >= argc) {
                 fprintf(stderr, "** missing argument for -input\n");
@@ -68,13 +73,14 @@ int main(int argc, char*  argv[]) {
         return 1;
     }
 
-    // Read input dataset
-    nifti_image* nii1 = nifti_image_read(fin_1, 1);
-    if (!nii1) {
+    // Read input header, only the zoomed box is read below
+    nifti_stream* stream_in = nifti_stream_open_read(fin_1);
+    if (!stream_in) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_1);
         return 2;
     }
-    nifti_image* nii2 = nifti_image_read(fin_2, 1);
+    nifti_image* nii1 = stream_in->nii;
+    nifti_image* nii2 = pipeline_image_read(fin_2, 1);
     if (!nii2) {
         fprintf(stderr, "** failed to read NIfTI from '%s'\n", fin_2);
         return 2;
@@ -88,15 +94,16 @@ int main(int argc, char*  argv[]) {
     const int size_z = nii1->nz;
     const int size_x = nii1->nx;
     const int size_y = nii1->ny;
-    const int size_time = nii1->nt;
     const int nx = nii1->nx;
     const int nxy = nii1->nx * nii1->ny;
-    const int nxyz = nii1->nx * nii1->ny * nii1->nz;
+
+    if (nii2->nx != size_x || nii2->ny != size_y || nii2->nz != size_z) {
+        fprintf(stderr, "** mask and input dimensions do not match\n");
+        return 1;
+    }
 
     // ========================================================================
     // Fix datatype issues
-    nifti_image* nim_file_1 = copy_nifti_as_int16(nii1);
-    short* nii1_data = static_cast<short*>(nim_file_1->data);
     nifti_image* nim_file_2 = copy_nifti_as_int16(nii2);
     short* nii2_data = static_cast<short*>(nim_file_2->data);
 
@@ -119,48 +126,55 @@ int main(int argc, char*  argv[]) {
             }
         }
     }
+    if (min_x > max_x) {
+        fprintf(stderr, "** mask '%s' has no voxels above zero\n", fin_2);
+        return 1;
+    }
     cout << "  x range is " << min_x << "-" << max_x << endl;
     cout << "  y range is " << min_y << "-" << max_y << endl;
     cout << "  z range is " << min_z << "-" << max_z << endl;
     const int new_size_z = max_z - min_z + 1;
     const int new_size_x = max_x - min_x + 1;
     const int new_size_y = max_y - min_y + 1;
-    const int new_nr_voxels = new_size_x * new_size_y * new_size_z;
 
     // ========================================================================
     // Handle new (zoomed) nifti
-    nifti_image* nii_new = nifti_copy_nim_info(nim_file_1);
-    nii_new->nx = new_size_x;
-    nii_new->ny = new_size_y;
-    nii_new->nz = new_size_z;
-    nii_new->nvox = new_nr_voxels;
+    nifti_image* nii_new = nifti_copy_nim_info(nii1);
+    pipeline_image_track(nii_new);
+    nii_new->dim[1] = new_size_x;
+    nii_new->dim[2] = new_size_y;
+    nii_new->dim[3] = new_size_z;
+    nifti_update_dims_from_array(nii_new);
     nii_new->datatype = NIFTI_TYPE_INT16;
     nii_new->nbyper = sizeof(short);
-    nii_new->data = calloc(nii_new->nvox, nii_new->nbyper);
-    short* nii_new_data = static_cast<short*>(nii_new->data);
+
+    if (!use_outpath) fout = fin_1;
+    nifti_stream* stream_out = nifti_stream_open_write(nii_new, fout, "zoomed",
+                                                       true, use_outpath);
+    if (!stream_out) {
+        return 2;
+    }
 
     // ========================================================================
-    // Copy voxel from the bigger input nifti image
-    const int nx_2 = nii_new->nx;
-    const int nxy_2 = nii_new->nx * nii_new->ny;
-    const int nxyz_2 = nii_new->nx * nii_new->ny * nii_new->nz;
-    for (int it = 0; it < size_time; ++it) {
-        for (int iz = min_z; iz <= max_z; ++iz) {
-            for (int iy = min_y; iy <= max_y; ++iy) {
-                for (int ix = min_x; ix <= max_x; ++ix) {
-                    int voxel_i = nxyz * it + nxy * iz + nx * iy + ix;
-                    int voxel_j = nxyz_2 * it
-                                  + nxy_2 * (iz - min_z)
-                                  + nx_2 * (iy - min_y)
-                                  + (ix - min_x);
-                    *(nii_new_data + voxel_j) = *(nii1_data + voxel_i);
-                }
-            }
+    // Copy the box from the bigger input nifti image, volume by volume
+    for (int64_t it = 0; it < stream_in->size_time; ++it) {
+        nifti_image* box = nifti_stream_read_box(stream_in, min_x, min_y, min_z,
+                                                 new_size_x, new_size_y,
+                                                 new_size_z);
+        if (!box) {
+            return 2;
+        }
+        nifti_image* box_new = copy_nifti_as_int16(box);
+        if (!nifti_stream_write_chunk(stream_out, box_new)) {
+            return 2;
         }
+        pipeline_image_free(box_new);
+        pipeline_image_free(box);
+    }
+    nifti_stream_close(stream_in);
+    if (!nifti_stream_close(stream_out)) {
+        return 2;
     }
-
-    if (!use_outpath) fout = fin_1;
-    save_output_nifti(fout, "zoomed", nii_new, true, use_outpath);
 
     cout << "Finished!" << endl;
     return 0;
@@ -0,0 +1,191 @@
+#include "../dep/laynii_lib.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// Entry points of all programs, see dep/laynii_tool.cpp
+#define LAYNII_TOOL(name) namespace name { int main(int argc, char* argv[]); }
+#include "laynii_tools.h"
+#undef LAYNII_TOOL
+
+struct laynii_program {
+    const char* name;
+    int (*main)(int argc, char* argv[]);
+};
+
+static const laynii_program programs[] = {
+#define LAYNII_TOOL(name) {#name, name::main},
+#include "laynii_tools.h"
+#undef LAYNII_TOOL
+};
+static const int nr_programs = sizeof(programs) / sizeof(programs[0]);
+
+int show_help(void) {
+    printf(
+    "laynii: Run LayNii programs from a single binary, optionally as a\n"
+    "        pipeline that keeps images in memory between programs.\n"
+    "\n"
+    "    Every program is called with its usual options. In a pipeline, the\n"
+    "    outputs of one program are kept in memory and handed directly to the\n"
+    "    programs that read them later on. Only the outputs asked for are\n"
+    "    written to disk, which avoids repeatedly compressing and\n"
+    "    decompressing intermediate .nii.gz files.\n"
+    "\n"
+    "Usage:\n"
+    "    laynii LN2_LAYERS -rim rim.nii -nr_layers 10\n"
+    "    laynii -pipeline pipeline.txt\n"
+    "    laynii -pipeline pipeline.txt -write_all\n"
+    "    laynii -list\n"
+    "\n"
+    "Options:\n"
+    "    -help      : Show this help.\n"
+    "    -list      : List the programs included in this binary.\n"
+    "    -pipeline  : Text file with one program call per line (see Notes).\n"
+    "    -write_all : (Optional) Write all outputs of all programs to disk.\n"
+    "\n"
+    "Notes:\n"
+    "    An example pipeline file:\n"
+    "        # Outputs listed after 'write' are written to disk.\n"
+    "        write rim_layers.nii.gz rim_flat.nii.gz\n"
+    "        LN2_RIMIFY -input seg.nii.gz -innergm 2 -outergm 1 -gm 3 -output rim.nii.gz\n"
+    "        LN2_LAYERS -rim rim.nii.gz -nr_layers 10 -output rim_layers.nii.gz\n"
+    "    Lines starting with '#' are ignored. When there is no 'write' line,\n"
+    "    all outputs are written. Inputs that are not produced in the\n"
+    "    pipeline are read from disk as usual.\n"
+    "    Each program's images are freed when it returns. A program that\n"
+    "    exits the process instead (e.g. on a fatal NIfTI error) ends the\n"
+    "    whole pipeline.\n"
+    "\n");
+    return 0;
+}
+
+static const laynii_program* find_program(const string name) {
+    for (int i = 0; i < nr_programs; ++i) {
+        if (name == programs[i].name) {
+            return &programs[i];
+        }
+    }
+    return NULL;
+}
+
+static int run_program(const vector<string>& args) {
+    const laynii_program* program = find_program(args[0]);
+    if (!program) {
+        fprintf(stderr, "** unknown program '%s', see 'laynii -list'\n",
+                args[0].c_str());
+        return 1;
+    }
+
+    // Programs keep pointers into argv, so the strings live until the
+    // program returns
+    vector<char*> argv;
+    for (size_t i = 0; i < args.size(); ++i) {
+        argv.push_back(strdup(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+    int status = program->main(static_cast<int>(args.size()), argv.data());
+    for (size_t i = 0; i < args.size(); ++i) {
+        free(argv[i]);
+    }
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    char *fin = NULL;
+    bool write_all = false;
+    int ac;
+    if (argc < 2) return show_help();
+
+    // Run a single program when its name comes first
+    if (argv[1][0] != '-') {
+        vector<string> args(argv + 1, argv + argc);
+        return run_program(args);
+    }
+
+    // Process user options
+    for (ac = 1; ac < argc; ac++) {
+        if (!strncmp(argv[ac], "-h", 2)) {
+            return show_help();
+        } else if (!strcmp(argv[ac], "-list")) {
+            for (int i = 0; i < nr_programs; ++i) {
+                cout << programs[i].name << endl;
+            }
+            return 0;
+        } else if (!strcmp(argv[ac], "-pipeline")) {
+            if (++ac >= argc) {
+                fprintf(stderr, "** missing argument for -pipeline\n");
+                return 1;
+            }
+            fin = argv[ac];
+        } else if (!strcmp(argv[ac], "-write_all")) {
+            write_all = true;
+        } else {
+            fprintf(stderr, "** invalid option, '%s'\n", argv[ac]);
+            return 1;
+        }
+    }
+
+    if (!fin) {
+        fprintf(stderr, "** missing option '-pipeline'\n");
+        return 1;
+    }
+
+    // ========================================================================
+    // Parse pipeline file
+    // ========================================================================
+    ifstream file(fin);
+    if (!file.is_open()) {
+        fprintf(stderr, "** failed to open pipeline file '%s'\n", fin);
+        return 2;
+    }
+
+    vector<vector<string> > stages;
+    vector<string> outputs;
+    string line;
+    while (getline(file, line)) {
+        istringstream tokens(line);
+        vector<string> args;
+        string token;
+        while (tokens >> token) {
+            args.push_back(token);
+        }
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+        if (args[0] == "write") {
+            outputs.insert(outputs.end(), args.begin() + 1, args.end());
+        } else if (!find_program(args[0])) {
+            fprintf(stderr, "** unknown program '%s' in '%s'\n",
+                    args[0].c_str(), fin);
+            return 1;
+        } else {
+            stages.push_back(args);
+        }
+    }
+
+    // ========================================================================
+    // Run stages
+    // ========================================================================
+    pipeline_enable(write_all || outputs.empty());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        pipeline_request_output(outputs[i]);
+    }
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        cout << "\nlaynii: Stage " << i + 1 << "/" << stages.size() << ": "
+             << stages[i][0] << endl;
+        int status = run_program(stages[i]);
+        timing_report();  // Per stage, when the stage asked for -timing
+        pipeline_end_stage();
+        if (status != 0) {
+            fprintf(stderr, "** stage %d (%s) failed with exit code %d\n",
+                    static_cast<int>(i + 1), stages[i][0].c_str(), status);
+            pipeline_disable();
+            return status;
+        }
+    }
+    pipeline_disable();
+
+    cout << "\nlaynii: Finished " << stages.size() << " stages." << endl;
+    return 0;
+}
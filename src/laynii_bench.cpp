@@ -0,0 +1,650 @@
+#include "../dep/laynii_lib.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+int show_help(void) {
+    printf(
+    "laynii_bench: Benchmark LayNii programs on synthetic data.\n"
+    "\n"
+    "    Synthesizes a folded cortical ribbon (rim, middle gray matter,\n"
+    "    control point, layers, columns, anatomy, activation) and 4D time\n"
+    "    series at the requested sizes, runs the computationally heavy\n"
+    "    programs on them and reports their throughput in voxels per second.\n"
+    "    A checksum of the outputs of every run is reported as well, such\n"
+    "    that optimizations that change the results are noticed.\n"
+    "\n"
+    "Usage:\n"
+    "    laynii_bench\n"
+    "    laynii_bench -sizes 64,128,256 -volumes 10,100 -work_dir bench_data\n"
+    "    laynii_bench -tools LN2_LAYERS,LN_SKEW -reference bench_results.tsv\n"
+    "    make bench BENCH_SIZES=64,512 BENCH_VOLUMES=1,1000\n"
+    "\n"
+    "Options:\n"
+    "    -help       : Show this help.\n"
+    "    -sizes      : (Optional) Comma separated edge lengths of the cubic\n"
+    "                  synthetic images in voxels. Default is '64,128'.\n"
+    "    -volumes    : (Optional) Comma separated number of volumes of the\n"
+    "                  synthetic time series. Default is '10,100'.\n"
+    "    -tools      : (Optional) Comma separated programs to benchmark.\n"
+    "                  Default is all programs listed with '-list'.\n"
+    "    -list       : List the benchmarked programs and their arguments.\n"
+    "    -bin_dir    : (Optional) Folder of the LayNii binaries. Default is '.'.\n"
+    "    -work_dir   : (Optional) Existing folder for the synthetic data and\n"
+    "                  outputs. Default is '.'.\n"
+    "    -regenerate : (Optional) Synthesize data again even if it exists.\n"
+    "    -output     : (Optional) Results table (tab separated). Default is\n"
+    "                  'bench_results.tsv' in the work folder.\n"
+    "    -reference  : (Optional) Results table of an earlier run. Speedups\n"
+    "                  and changed checksums are reported against it.\n"
+    "\n"
+    "Notes:\n"
+    "    - Data is synthesized once per size and reused by later runs.\n"
+    "    - The program output of every run is kept in a '.log' file next to\n"
+    "      its outputs in the work folder.\n"
+    "    - Exits with code 1 when a program fails, or when a checksum differs\n"
+    "      from the reference table.\n"
+    "    - Throughput is the number of input voxels (times volumes for time\n"
+    "      series) divided by the wall time, including reading and writing.\n"
+    "\n");
+    return 0;
+}
+
+// ============================================================================
+// Benchmarked programs
+// ============================================================================
+// Arguments use placeholders that are filled in per size:
+//     {rim} {midgm} {cp} {layers} {columns} {anat} {act} : Synthetic 3D data
+//     {ts} {ts2}       : Synthetic time series (two noise realizations)
+//     {out}            : Output basename of this run
+//     {LN2_LAYERS}     : Output basename of an earlier run of that program
+//     {radius}         : One sixth of the image size
+// Outputs are the tags that the program appends to its output basename.
+// An empty tag means the output is written exactly as '{out}'. Programs
+// that use the outputs of other programs are listed after them.
+struct bench_case {
+    const char* program;
+    bool timeseries;
+    const char* args;
+    const char* outputs;
+};
+
+static const bench_case cases[] = {
+    {"LN2_LAYERS", false,
+     "-rim {rim} -nr_layers 10 -equivol -output {out}",
+     "metric_equidist,layers_equidist,metric_equivol,layers_equivol"},
+    {"LN2_MULTILATERATE", false,
+     "-rim {rim} -control_points {cp} -radius {radius} -output {out}",
+     "UV_coordinates,perimeter_chunk"},
+    {"LN2_UVD_FILTER", false,
+     "-values {act} -coord_uv {LN2_MULTILATERATE}_UV_coordinates.nii"
+     " -coord_d {LN2_LAYERS}_metric_equidist.nii"
+     " -domain {LN2_MULTILATERATE}_perimeter_chunk.nii"
+     " -radius 3 -height 0.25 -output {out}",
+     "UVD_median_filter"},
+    {"LN2_COLUMNS", false,
+     "-rim {rim} -midgm {midgm} -nr_columns 100 -output {out}",
+     "columns100"},
+    {"LN2_LAYER_SMOOTH", false,
+     "-input {act} -layer_file {layers} -FWHM 1 -output {out}",
+     ""},
+    {"LN_LAYER_SMOOTH", false,
+     "-input {act} -layer_file {layers} -FWHM 1 -output {out}",
+     ""},
+    {"LN_LEAKY_LAYERS", false,
+     "-rim {rim} -nr_layers 10 -output {out}",
+     ""},
+    {"LN_IMAGIRO", false,
+     "-layers {layers} -columns {columns} -data {act} -output {out}",
+     ""},
+    {"LN_INTPRO", false,
+     "-image {anat} -min -direction 2 -range 3 -output {out}",
+     ""},
+    {"LN_GFACTOR", false,
+     "-input {anat} -variance 1 -direction 1 -grappa 2 -cutoff 200 -output {out}",
+     "Gfactormap,Amplified_GRAPPA"},
+    {"LN_SKEW", true,
+     "-input {ts} -output {out}",
+     "skew,kurt,autocorr,mean,stedev,tSNR"},
+    {"LN_NOISE_KERNEL", true,
+     "-input {ts} -kernel_size 7 -output {out}",
+     ""},
+    {"LN_TEMPSMOOTH", true,
+     "-input {ts} -gaus 1 -output {out}",
+     ""},
+    {"LN_CORREL2FILES", true,
+     "-file1 {ts} -file2 {ts2} -output {out}",
+     ""},
+    {"LN_BOCO", true,
+     "-Nulled {ts} -BOLD {ts2} -shift -output {out}",
+     "VASO_LN,shift_correlated"},
+};
+static const int nr_cases = sizeof(cases) / sizeof(cases[0]);
+
+// ============================================================================
+// Synthetic data
+// ============================================================================
+static uint64_t rng_state = 1;
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+static float rng_uniform(void) {
+    // xorshift64*, deterministic on every platform
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1DULL) >> 40) / 16777216.f;
+}
+
+static float rng_noise(void) {
+    // Approximately standard normal (sum of four uniforms)
+    return (rng_uniform() + rng_uniform() + rng_uniform() + rng_uniform()
+            - 2.f) * 1.7320508f;
+}
+
+static nifti_image* new_image(int64_t size, int64_t nr_volumes, int datatype) {
+    int64_t dims[8] = {nr_volumes > 1 ? 4 : 3, size, size, size,
+                       nr_volumes, 1, 1, 1};
+    nifti_image* nii = nifti_make_new_nim(dims, datatype, nr_volumes == 1);
+    for (int d = nii->dim[0] + 1; d < 8; ++d) {  // Unused dimensions are 1
+        nii->dim[d] = 1;
+    }
+    nifti_update_dims_from_array(nii);
+    nii->pixdim[1] = nii->dx = 1;
+    nii->pixdim[2] = nii->dy = 1;
+    nii->pixdim[3] = nii->dz = 1;
+    nii->pixdim[4] = nii->dt = 2;
+    nii->qform_code = NIFTI_XFORM_SCANNER_ANAT;
+    nii->quatern_b = nii->quatern_c = nii->quatern_d = 0;
+    nii->qfac = 1;
+    nii->qoffset_x = nii->qoffset_y = nii->qoffset_z = 0;
+    nii->qto_xyz = nifti_quatern_to_dmat44(0, 0, 0, 0, 0, 0, 1, 1, 1, 1);
+    nii->qto_ijk = nifti_dmat44_inverse(nii->qto_xyz);
+    return nii;
+}
+
+static bool file_exists(const string path) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp) {
+        fclose(fp);
+    }
+    return fp != NULL;
+}
+
+static string data_path(const string work_dir, const string name,
+                        int64_t size, int64_t nr_volumes = 0) {
+    ostringstream path;
+    path << work_dir << "/bench_" << name << "_" << size;
+    if (nr_volumes > 0) {
+        path << "x" << nr_volumes;
+    }
+    path << ".nii";
+    return path.str();
+}
+
+static void write_image(nifti_image* nii, const string path) {
+    nifti_set_filenames(nii, path.c_str(), 1, 1);
+    nifti_image_write(nii);
+    log_output(path.c_str());
+}
+
+static void synthesize_3d(const string work_dir, int64_t size) {
+    ///////////////////////////////////////////////////////////////////////////
+    // A sphere whose inner and outer gray matter surfaces are
+    // modulated with the same folding pattern. Rim is coded as LN2_LAYERS
+    // expects: 1 = outer border, 2 = inner border, 3 = gray matter.
+    ///////////////////////////////////////////////////////////////////////////
+    nifti_image* rim = new_image(size, 1, NIFTI_TYPE_INT16);
+    nifti_image* midgm = new_image(size, 1, NIFTI_TYPE_INT16);
+    nifti_image* layers = new_image(size, 1, NIFTI_TYPE_INT16);
+    nifti_image* columns = new_image(size, 1, NIFTI_TYPE_INT32);
+    nifti_image* anat = new_image(size, 1, NIFTI_TYPE_FLOAT32);
+    nifti_image* act = new_image(size, 1, NIFTI_TYPE_FLOAT32);
+    int16_t* rim_data = static_cast<int16_t*>(rim->data);
+    int16_t* midgm_data = static_cast<int16_t*>(midgm->data);
+    int16_t* layers_data = static_cast<int16_t*>(layers->data);
+    int32_t* columns_data = static_cast<int32_t*>(columns->data);
+    float* anat_data = static_cast<float*>(anat->data);
+    float* act_data = static_cast<float*>(act->data);
+
+    const float center = (size - 1) / 2.f;
+    const float pi = 3.14159265f;
+    int64_t cp_index = -1;
+    rng_seed(size);
+
+    for (int64_t iz = 0; iz < size; ++iz) {
+        for (int64_t iy = 0; iy < size; ++iy) {
+            for (int64_t ix = 0; ix < size; ++ix) {
+                int64_t i = sub2ind_3D(ix, iy, iz, size, size);
+                float x = ix - center, y = iy - center, z = iz - center;
+                float r = sqrt(x * x + y * y + z * z);
+                float azimuth = atan2(y, x);
+                float elevation = r > 0 ? acos(z / r) : 0;
+                float fold = 1 + 0.12 * sin(5 * azimuth) * sin(4 * elevation);
+                float r_inner = 0.22 * size * fold;
+                float r_outer = 0.36 * size * fold;
+                float depth = (r - r_inner) / (r_outer - r_inner);
+
+                if (r >= r_inner && r <= r_outer) {
+                    rim_data[i] = 3;
+                    layers_data[i] = 1 + min(9, static_cast<int>(depth * 10));
+                    int column_az = min(23, static_cast<int>((azimuth + pi) / (2 * pi) * 24));
+                    int column_el = min(11, static_cast<int>(elevation / pi * 12));
+                    columns_data[i] = 1 + column_az * 12 + column_el;
+                    if (abs(depth - 0.5) * (r_outer - r_inner) < 0.5) {
+                        midgm_data[i] = 1;
+                        if (cp_index < 0 || iz > cp_index / (size * size)) {
+                            cp_index = i;
+                        }
+                    }
+                    anat_data[i] = 600;
+                    act_data[i] = 2 * sin(3 * azimuth) * cos(2 * elevation) * depth;
+                } else if (r < r_inner && r >= r_inner - 1.5) {
+                    rim_data[i] = 2;
+                } else if (r > r_outer && r <= r_outer + 1.5) {
+                    rim_data[i] = 1;
+                }
+                if (r < r_inner) {
+                    anat_data[i] = 900;
+                } else if (r > r_outer && r < 0.48 * size) {
+                    anat_data[i] = 300;
+                }
+                anat_data[i] += 20 * rng_noise();
+                act_data[i] += 0.5 * rng_noise();
+            }
+        }
+    }
+
+    write_image(rim, data_path(work_dir, "rim", size));
+    write_image(midgm, data_path(work_dir, "midgm", size));
+    midgm_data[cp_index] = 2;  // Control point for LN2_MULTILATERATE
+    write_image(midgm, data_path(work_dir, "cp", size));
+    write_image(layers, data_path(work_dir, "layers", size));
+    write_image(columns, data_path(work_dir, "columns", size));
+    write_image(anat, data_path(work_dir, "anat", size));
+    write_image(act, data_path(work_dir, "act", size));
+
+    nifti_image_free(rim);
+    nifti_image_free(midgm);
+    nifti_image_free(layers);
+    nifti_image_free(columns);
+    nifti_image_free(anat);
+    nifti_image_free(act);
+}
+
+static bool synthesize_4d(const string work_dir, int64_t size,
+                          int64_t nr_volumes, const string name, uint64_t seed) {
+    // Anatomy with a block design response in gray matter, written volume by
+    // volume so that long time series never have to fit in memory.
+    nifti_image* anat = nifti_image_read(
+        data_path(work_dir, "anat", size).c_str(), 1);
+    nifti_image* rim = nifti_image_read(
+        data_path(work_dir, "rim", size).c_str(), 1);
+    if (!anat || !rim) {
+        fprintf(stderr, "** failed to read synthetic 3D data\n");
+        return false;
+    }
+    float* anat_data = static_cast<float*>(anat->data);
+    int16_t* rim_data = static_cast<int16_t*>(rim->data);
+
+    nifti_image* ts = new_image(size, nr_volumes, NIFTI_TYPE_FLOAT32);
+    nifti_stream* stream = nifti_stream_open_write(
+        ts, data_path(work_dir, name, size, nr_volumes), "", true, true);
+    nifti_image_free(ts);
+    if (!stream) {
+        return false;
+    }
+    nifti_image* volume = new_image(size, 1, NIFTI_TYPE_FLOAT32);
+    float* volume_data = static_cast<float*>(volume->data);
+    const int64_t nr_voxels = size * size * size;
+
+    rng_seed(seed * 1000003 + size);
+    for (int64_t t = 0; t < nr_volumes; ++t) {
+        float response = (t / 10) % 2 == 1 ? 0.02 : 0;
+        for (int64_t i = 0; i < nr_voxels; ++i) {
+            volume_data[i] = anat_data[i] * (1 + (rim_data[i] == 3) * response)
+                             + 10 * rng_noise();
+        }
+        nifti_stream_write_chunk(stream, volume);
+    }
+    bool complete = nifti_stream_close(stream);
+
+    nifti_image_free(volume);
+    nifti_image_free(anat);
+    nifti_image_free(rim);
+    return complete;
+}
+
+// ============================================================================
+// Running and checksums
+// ============================================================================
+static void replace_all(string& text, const string from, const string to) {
+    size_t pos = 0;
+    while ((pos = text.find(from, pos)) != string::npos) {
+        text.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+
+static vector<string> split(const string text, char sep) {
+    vector<string> parts;
+    string part;
+    istringstream stream(text);
+    while (getline(stream, part, sep)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+static string run_label(const bench_case& c, int64_t size, int64_t nr_volumes) {
+    ostringstream label;
+    label << c.program << "_" << size;
+    if (c.timeseries) {
+        label << "x" << nr_volumes;
+    }
+    return label.str();
+}
+
+static bool checksum_file(const string path, uint64_t& hash) {
+    // FNV-1a over the header dimensions and the voxel data
+    nifti_image* nii = nifti_image_read(path.c_str(), 1);
+    if (!nii) {
+        return false;
+    }
+    const unsigned char* bytes = static_cast<unsigned char*>(nii->data);
+    const int64_t nr_bytes = nii->nvox * nii->nbyper;
+    for (int d = 0; d < 8; ++d) {
+        hash = (hash ^ static_cast<uint64_t>(nii->dim[d])) * 0x100000001B3ULL;
+    }
+    for (int64_t i = 0; i < nr_bytes; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    nifti_image_free(nii);
+    return true;
+}
+
+struct bench_result {
+    string program;
+    int64_t size, nr_volumes;
+    double seconds, voxels_per_second;
+    string checksum;
+};
+
+static bool read_results(const string path, vector<bench_result>& results) {
+    ifstream file(path.c_str());
+    if (!file.is_open()) {
+        return false;
+    }
+    string line;
+    getline(file, line);  // Header
+    while (getline(file, line)) {
+        istringstream fields(line);
+        bench_result r;
+        if (fields >> r.program >> r.size >> r.nr_volumes >> r.seconds
+                   >> r.voxels_per_second >> r.checksum) {
+            results.push_back(r);
+        }
+    }
+    return true;
+}
+
+static const bench_result* find_result(const vector<bench_result>& results,
+                                       const bench_result& r) {
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].program == r.program && results[i].size == r.size
+            && results[i].nr_volumes == r.nr_volumes) {
+            return &results[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    string sizes_arg = "64,128", volumes_arg = "10,100", tools_arg = "";
+    string bin_dir = ".", work_dir = ".", fout = "", freference = "";
+    bool regenerate = false;
+    int ac;
+
+    // Process user options
+    for (ac = 1; ac < argc; ac++) {
+        if (!strncmp(argv[ac], "-h", 2)) {
+            return show_help();
+        } else if (!strcmp(argv[ac], "-list")) {
+            for (int i = 0; i < nr_cases; ++i) {
+                printf("%-20s %s\n", cases[i].program, cases[i].args);
+            }
+            return 0;
+        } else if (!strcmp(argv[ac], "-regenerate")) {
+            regenerate = true;
+        } else if (ac + 1 >= argc) {
+            fprintf(stderr, "** missing argument for %s\n", argv[ac]);
+            return 1;
+        } else if (!strcmp(argv[ac], "-sizes")) {
+            sizes_arg = argv[++ac];
+        } else if (!strcmp(argv[ac], "-volumes")) {
+            volumes_arg = argv[++ac];
+        } else if (!strcmp(argv[ac], "-tools")) {
+            tools_arg = argv[++ac];
+        } else if (!strcmp(argv[ac], "-bin_dir")) {
+            bin_dir = argv[++ac];
+        } else if (!strcmp(argv[ac], "-work_dir")) {
+            work_dir = argv[++ac];
+        } else if (!strcmp(argv[ac], "-output")) {
+            fout = argv[++ac];
+        } else if (!strcmp(argv[ac], "-reference")) {
+            freference = argv[++ac];
+        } else {
+            fprintf(stderr, "** invalid option, '%s'\n", argv[ac]);
+            return 1;
+        }
+    }
+    if (fout.empty()) {
+        fout = work_dir + "/bench_results.tsv";
+    }
+
+    vector<int64_t> sizes, volumes;
+    vector<string> parts = split(sizes_arg, ',');
+    for (size_t i = 0; i < parts.size(); ++i) {
+        sizes.push_back(atoll(parts[i].c_str()));
+    }
+    parts = split(volumes_arg, ',');
+    for (size_t i = 0; i < parts.size(); ++i) {
+        volumes.push_back(atoll(parts[i].c_str()));
+    }
+    vector<string> tools = split(tools_arg, ',');
+    for (size_t i = 0; i < tools.size(); ++i) {
+        bool known = false;
+        for (int j = 0; j < nr_cases; ++j) {
+            known = known || tools[i] == cases[j].program;
+        }
+        if (!known) {
+            fprintf(stderr, "** '%s' is not benchmarked, see -list\n",
+                    tools[i].c_str());
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        if (sizes[i] < 16) {
+            fprintf(stderr, "** sizes should be at least 16 voxels\n");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < volumes.size(); ++i) {
+        if (volumes[i] < 1) {
+            fprintf(stderr, "** volumes should be at least 1\n");
+            return 1;
+        }
+    }
+
+    vector<bench_result> reference;
+    if (!freference.empty() && !read_results(freference, reference)) {
+        fprintf(stderr, "** failed to read reference '%s'\n", freference.c_str());
+        return 2;
+    }
+
+    log_welcome("laynii_bench");
+
+    // ========================================================================
+    // Run benchmarks
+    // ========================================================================
+    vector<bench_result> results;
+    set<string> synthesized;
+    int nr_failed = 0, nr_changed = 0;
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        const int64_t size = sizes[s];
+        const int64_t nr_voxels = size * size * size;
+        if (regenerate || !file_exists(data_path(work_dir, "act", size))) {
+            cout << "\n  Synthesizing " << size << "^3 data..." << endl;
+            synthesize_3d(work_dir, size);
+        }
+
+        for (size_t v = 0; v < volumes.size(); ++v) {
+            const int64_t nr_volumes = volumes[v];
+            for (int c = 0; c < nr_cases; ++c) {
+                const bench_case& bc = cases[c];
+                if (!tools.empty()
+                    && find(tools.begin(), tools.end(), bc.program) == tools.end()) {
+                    continue;
+                }
+                // 3D programs run once per size
+                if (!bc.timeseries && v > 0) {
+                    continue;
+                }
+                if (bc.timeseries) {
+                    const char* names[2] = {"ts", "ts2"};
+                    for (int n = 0; n < 2; ++n) {
+                        string path = data_path(work_dir, names[n], size, nr_volumes);
+                        if (!file_exists(path)
+                            || (regenerate && !synthesized.count(path))) {
+                            cout << "\n  Synthesizing " << size << "^3 x "
+                                 << nr_volumes << " time series..." << endl;
+                            if (!synthesize_4d(work_dir, size, nr_volumes,
+                                               names[n], n + 1)) {
+                                return 2;
+                            }
+                            synthesized.insert(path);
+                        }
+                    }
+                }
+
+                // Fill in arguments
+                string out = work_dir + "/bench_out_" + run_label(bc, size, nr_volumes);
+                string args = bc.args;
+                ostringstream radius;
+                radius << size / 6;
+                replace_all(args, "{rim}", data_path(work_dir, "rim", size));
+                replace_all(args, "{midgm}", data_path(work_dir, "midgm", size));
+                replace_all(args, "{cp}", data_path(work_dir, "cp", size));
+                replace_all(args, "{layers}", data_path(work_dir, "layers", size));
+                replace_all(args, "{columns}", data_path(work_dir, "columns", size));
+                replace_all(args, "{anat}", data_path(work_dir, "anat", size));
+                replace_all(args, "{act}", data_path(work_dir, "act", size));
+                replace_all(args, "{ts}", data_path(work_dir, "ts", size, nr_volumes));
+                replace_all(args, "{ts2}", data_path(work_dir, "ts2", size, nr_volumes));
+                replace_all(args, "{radius}", radius.str());
+                replace_all(args, "{out}", out + ".nii");
+                for (int d = 0; d < c; ++d) {
+                    replace_all(args, string("{") + cases[d].program + "}",
+                                work_dir + "/bench_out_" + run_label(cases[d], size, nr_volumes));
+                }
+                string command = bin_dir + "/" + bc.program + " " + args
+                                 + " > " + out + ".log 2>&1";
+
+                // Run and time
+                cout << "\n  " << run_label(bc, size, nr_volumes) << "..." << endl;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                int status = system(command.c_str());
+                double seconds = chrono::duration<double>(
+                    chrono::steady_clock::now() - start).count();
+
+                bench_result r;
+                r.program = bc.program;
+                r.size = size;
+                r.nr_volumes = bc.timeseries ? nr_volumes : 1;
+                r.seconds = seconds;
+                r.voxels_per_second = nr_voxels * r.nr_volumes / seconds;
+
+                // Checksum all outputs
+                uint64_t hash = 0xCBF29CE484222325ULL;
+                bool ok = status == 0;
+                vector<string> tags = split(bc.outputs, ',');
+                if (tags.empty()) {
+                    tags.push_back("");
+                }
+                for (size_t t = 0; ok && t < tags.size(); ++t) {
+                    string path = tags[t].empty()
+                        ? out + ".nii" : make_output_path(out + ".nii", tags[t], false);
+                    if (!checksum_file(path, hash)) {
+                        fprintf(stderr, "** missing output '%s'\n", path.c_str());
+                        ok = false;
+                    }
+                }
+                if (ok) {
+                    char hex[17];
+                    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+                    r.checksum = hex;
+                } else {
+                    fprintf(stderr, "** %s failed, see '%s.log'\n", bc.program,
+                            out.c_str());
+                    r.checksum = "failed";
+                    nr_failed += 1;
+                }
+
+                // Compare with reference
+                const bench_result* ref = find_result(reference, r);
+                string note = "";
+                if (ref) {
+                    ostringstream speedup;
+                    speedup.precision(2);
+                    speedup << fixed << ref->seconds / r.seconds << "x";
+                    note = " " + speedup.str();
+                    if (ref->checksum != r.checksum) {
+                        note += " CHANGED";
+                        nr_changed += ok;
+                    }
+                }
+                printf("    %.3f s, %.3g voxels/s, checksum %s%s\n", r.seconds,
+                       r.voxels_per_second, r.checksum.c_str(), note.c_str());
+                results.push_back(r);
+            }
+        }
+    }
+
+    // ========================================================================
+    // Report
+    // ========================================================================
+    ofstream file(fout.c_str());
+    if (!file.is_open()) {
+        fprintf(stderr, "** failed to write '%s'\n", fout.c_str());
+        return 2;
+    }
+    file << "program\tsize\tvolumes\tseconds\tvoxels_per_second\tchecksum\n";
+    printf("\n  %-24s %6s %8s %10s %12s %17s\n", "Program", "Size", "Volumes",
+           "Time [s]", "Voxels/s", "Checksum");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        file << r.program << "\t" << r.size << "\t" << r.nr_volumes << "\t"
+             << r.seconds << "\t" << r.voxels_per_second << "\t"
+             << r.checksum << "\n";
+        printf("  %-24s %6lld %8lld %10.3f %12.3g %17s\n", r.program.c_str(),
+               (long long)r.size, (long long)r.nr_volumes, r.seconds,
+               r.voxels_per_second, r.checksum.c_str());
+    }
+    file.close();
+    log_output(fout.c_str());
+
+    if (nr_failed > 0) {
+        fprintf(stderr, "** %d runs failed\n", nr_failed);
+    }
+    if (nr_changed > 0) {
+        fprintf(stderr, "** %d checksums differ from '%s'\n", nr_changed,
+                freference.c_str());
+    }
+    cout << "\n  Finished." << endl;
+    return (nr_failed + nr_changed) > 0;
+}
@@ -0,0 +1,461 @@
+#include "../dep/laynii_lib.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+int show_help(void) {
+    printf(
+    "laynii_regress: Compare outputs of LayNii programs with references.\n"
+    "\n"
+    "    Runs every program listed in a cases file on the bundled test data\n"
+    "    and compares the produced files with stored reference outputs,\n"
+    "    voxel by voxel. Integer images (e.g. layer and column labels) have\n"
+    "    to match exactly, floating point images within a tolerance. For\n"
+    "    every output, the number of differing voxels, the largest\n"
+    "    difference and the location of the first differences are reported.\n"
+    "\n"
+    "Usage:\n"
+    "    cd test_data && ../laynii_regress\n"
+    "    cd test_data && ../laynii_regress -programs LN2_LAYERS,LN2_COLUMNS\n"
+    "    cd test_data && ../laynii_regress -update\n"
+    "    laynii_regress -compare reference.nii.gz output.nii.gz\n"
+    "    make regression\n"
+    "\n"
+    "Options:\n"
+    "    -help          : Show this help.\n"
+    "    -cases         : (Optional) Cases file, see Notes. Default is\n"
+    "                     'regression/cases.txt'.\n"
+    "    -reference_dir : (Optional) Folder of the reference outputs. Default\n"
+    "                     is 'regression/reference'.\n"
+    "    -output_dir    : (Optional) Existing folder for the outputs. Default\n"
+    "                     is 'regression/output'.\n"
+    "    -bin_dir       : (Optional) Folder of the LayNii binaries. Default\n"
+    "                     is '..'.\n"
+    "    -programs      : (Optional) Comma separated programs to run. Default\n"
+    "                     is all programs in the cases file.\n"
+    "    -atol          : (Optional) Absolute tolerance for floating point\n"
+    "                     voxels. Default is 1e-5.\n"
+    "    -rtol          : (Optional) Relative tolerance for floating point\n"
+    "                     voxels. Default is 1e-4. A voxel differs when\n"
+    "                     |output - reference| > atol + rtol * |reference|.\n"
+    "    -locations     : (Optional) Number of differing voxel locations to\n"
+    "                     print per output. Default is 5.\n"
+    "    -update        : (Optional) Replace the references with the new\n"
+    "                     outputs. Only do this after checking that the\n"
+    "                     differences are intended.\n"
+    "    -compare       : Compare two files directly (reference first) and\n"
+    "                     exit. Uses the same tolerances.\n"
+    "\n"
+    "Notes:\n"
+    "    - Every line of the cases file is one program call, followed by '=>'\n"
+    "      and the outputs to compare. '{out}' is replaced by the output\n"
+    "      folder. Lines starting with '#' are ignored. For example:\n"
+    "          LN2_LAYERS -rim rim_M.nii.gz -output {out}/rim_M.nii.gz => rim_M_layers_equidist.nii.gz\n"
+    "    - Programs run in the current folder, in the order of the file, so\n"
+    "      later cases can use outputs of earlier cases.\n"
+    "    - Outputs that are not NIfTI files (e.g. text) have to match exactly.\n"
+    "    - Exits with code 1 when a program fails or any output differs.\n"
+    "\n");
+    return 0;
+}
+
+struct regress_case {
+    vector<string> args;
+    vector<string> outputs;
+    int line;
+};
+
+static bool file_exists(const string path) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp) {
+        fclose(fp);
+    }
+    return fp != NULL;
+}
+
+static void replace_all(string& text, const string from, const string to) {
+    size_t pos = 0;
+    while ((pos = text.find(from, pos)) != string::npos) {
+        text.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+
+static vector<string> split(const string text, char sep) {
+    vector<string> parts;
+    string part;
+    istringstream stream(text);
+    while (getline(stream, part, sep)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+static bool is_nifti(const string path) {
+    size_t n = path.size();
+    return (n > 4 && path.compare(n - 4, 4, ".nii") == 0)
+           || (n > 7 && path.compare(n - 7, 7, ".nii.gz") == 0);
+}
+
+static bool is_integer_type(int datatype) {
+    return datatype != NIFTI_TYPE_FLOAT32 && datatype != NIFTI_TYPE_FLOAT64
+           && datatype != NIFTI_TYPE_FLOAT128;
+}
+
+static double voxel_value(const nifti_image* nii, int64_t i) {
+    switch (nii->datatype) {
+        case NIFTI_TYPE_UINT8: return static_cast<uint8_t*>(nii->data)[i];
+        case NIFTI_TYPE_INT8: return static_cast<int8_t*>(nii->data)[i];
+        case NIFTI_TYPE_UINT16: return static_cast<uint16_t*>(nii->data)[i];
+        case NIFTI_TYPE_INT16: return static_cast<int16_t*>(nii->data)[i];
+        case NIFTI_TYPE_UINT32: return static_cast<uint32_t*>(nii->data)[i];
+        case NIFTI_TYPE_INT32: return static_cast<int32_t*>(nii->data)[i];
+        case NIFTI_TYPE_UINT64: return static_cast<uint64_t*>(nii->data)[i];
+        case NIFTI_TYPE_INT64: return static_cast<int64_t*>(nii->data)[i];
+        case NIFTI_TYPE_FLOAT32: return static_cast<float*>(nii->data)[i];
+        case NIFTI_TYPE_FLOAT64: return static_cast<double*>(nii->data)[i];
+    }
+    return 0;
+}
+
+static int64_t compare_nifti(const string fref, const string fout,
+                             double atol, double rtol, int nr_locations) {
+    ///////////////////////////////////////////////////////////////////////////
+    // Returns the number of differing voxels, or -1 if the images can not be
+    // compared at all (missing file, other dimensions or datatype).
+    ///////////////////////////////////////////////////////////////////////////
+    nifti_image* ref = nifti_image_read(fref.c_str(), 1);
+    if (!ref) {
+        fprintf(stderr, "** failed to read reference '%s'\n", fref.c_str());
+        return -1;
+    }
+    nifti_image* out = nifti_image_read(fout.c_str(), 1);
+    if (!out) {
+        fprintf(stderr, "** failed to read output '%s'\n", fout.c_str());
+        nifti_image_free(ref);
+        return -1;
+    }
+    for (int d = 1; d < 8; ++d) {
+        int64_t size_ref = d <= ref->dim[0] ? ref->dim[d] : 1;
+        int64_t size_out = d <= out->dim[0] ? out->dim[d] : 1;
+        if (size_ref != size_out) {
+            cout << "      Dimension " << d << " differs: " << size_out
+                 << " (reference " << size_ref << ")" << endl;
+            nifti_image_free(ref);
+            nifti_image_free(out);
+            return -1;
+        }
+    }
+    if (ref->datatype != out->datatype) {
+        cout << "      Datatype differs: " << nifti_datatype_string(out->datatype)
+             << " (reference " << nifti_datatype_string(ref->datatype) << ")" << endl;
+        nifti_image_free(ref);
+        nifti_image_free(out);
+        return -1;
+    }
+
+    const bool exact = is_integer_type(ref->datatype);
+    const int64_t size_x = ref->nx, size_y = ref->ny;
+    const int64_t size_z = ref->nz > 0 ? ref->nz : 1;
+    int64_t nr_diff = 0;
+    double max_diff = 0;
+    int64_t min_sub[4] = {0, 0, 0, 0}, max_sub[4] = {0, 0, 0, 0};
+
+    for (int64_t i = 0; i < static_cast<int64_t>(ref->nvox); ++i) {
+        double a = voxel_value(ref, i), b = voxel_value(out, i);
+        bool same;
+        double diff = 0;
+        if (exact) {
+            same = a == b;
+            diff = abs(b - a);
+        } else if (isnan(a) || isnan(b)) {
+            same = isnan(a) && isnan(b);
+        } else {
+            diff = abs(b - a);
+            same = diff <= atol + rtol * abs(a);
+        }
+        if (same) {
+            continue;
+        }
+
+        int64_t sub[4] = {i % size_x, (i / size_x) % size_y,
+                          (i / (size_x * size_y)) % size_z,
+                          i / (size_x * size_y * size_z)};
+        for (int k = 0; k < 4; ++k) {
+            min_sub[k] = nr_diff == 0 ? sub[k] : min(min_sub[k], sub[k]);
+            max_sub[k] = nr_diff == 0 ? sub[k] : max(max_sub[k], sub[k]);
+        }
+        if (nr_diff < nr_locations) {
+            printf("      [x=%lld, y=%lld, z=%lld, t=%lld] %.9g (reference %.9g)\n",
+                   (long long)sub[0], (long long)sub[1], (long long)sub[2],
+                   (long long)sub[3], b, a);
+        }
+        max_diff = isnan(diff) ? max_diff : max(max_diff, diff);
+        nr_diff += 1;
+    }
+
+    if (nr_diff > 0) {
+        printf("      %lld/%lld voxels differ, largest difference %.9g\n",
+               (long long)nr_diff, (long long)ref->nvox, max_diff);
+        printf("      Differences within x=%lld-%lld, y=%lld-%lld, z=%lld-%lld, t=%lld-%lld\n",
+               (long long)min_sub[0], (long long)max_sub[0],
+               (long long)min_sub[1], (long long)max_sub[1],
+               (long long)min_sub[2], (long long)max_sub[2],
+               (long long)min_sub[3], (long long)max_sub[3]);
+    }
+    nifti_image_free(ref);
+    nifti_image_free(out);
+    return nr_diff;
+}
+
+static int64_t compare_text(const string fref, const string fout) {
+    // Returns the number of differing lines, or -1 if a file is missing.
+    ifstream ref(fref.c_str()), out(fout.c_str());
+    if (!ref.is_open() || !out.is_open()) {
+        fprintf(stderr, "** failed to read '%s'\n",
+                ref.is_open() ? fout.c_str() : fref.c_str());
+        return -1;
+    }
+    string line_ref, line_out;
+    int64_t nr_diff = 0, line = 0;
+    while (true) {
+        bool more_ref = static_cast<bool>(getline(ref, line_ref));
+        bool more_out = static_cast<bool>(getline(out, line_out));
+        if (!more_ref && !more_out) {
+            break;
+        }
+        line += 1;
+        if (!more_ref || !more_out || line_ref != line_out) {
+            if (nr_diff == 0) {
+                cout << "      First difference at line " << line << endl;
+            }
+            nr_diff += 1;
+        }
+    }
+    if (nr_diff > 0) {
+        cout << "      " << nr_diff << " lines differ" << endl;
+    }
+    return nr_diff;
+}
+
+static string absolute_path(const string path) {
+    if (path.empty() || path[0] == '/' || path[0] == '\\'
+        || (path.size() > 1 && path[1] == ':')) {
+        return path;
+    }
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return path;
+    }
+    return string(cwd) + "/" + path;
+}
+
+static bool copy_file(const string from, const string to) {
+    ifstream in(from.c_str(), ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    ofstream out(to.c_str(), ios::binary);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << in.rdbuf();
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char* argv[]) {
+    string fcases = "regression/cases.txt";
+    string reference_dir = "regression/reference";
+    string output_dir = "regression/output";
+    string bin_dir = "..", programs_arg = "";
+    double atol = 1e-5, rtol = 1e-4;
+    int nr_locations = 5;
+    bool update = false;
+    char *fcompare_ref = NULL, *fcompare_out = NULL;
+    int ac;
+
+    // Process user options
+    for (ac = 1; ac < argc; ac++) {
+        if (!strncmp(argv[ac], "-h", 2)) {
+            return show_help();
+        } else if (!strcmp(argv[ac], "-update")) {
+            update = true;
+        } else if (!strcmp(argv[ac], "-compare")) {
+            if (ac + 2 >= argc) {
+                fprintf(stderr, "** missing arguments for -compare\n");
+                return 1;
+            }
+            fcompare_ref = argv[++ac];
+            fcompare_out = argv[++ac];
+        } else if (ac + 1 >= argc) {
+            fprintf(stderr, "** missing argument for %s\n", argv[ac]);
+            return 1;
+        } else if (!strcmp(argv[ac], "-cases")) {
+            fcases = argv[++ac];
+        } else if (!strcmp(argv[ac], "-reference_dir")) {
+            reference_dir = argv[++ac];
+        } else if (!strcmp(argv[ac], "-output_dir")) {
+            output_dir = argv[++ac];
+        } else if (!strcmp(argv[ac], "-bin_dir")) {
+            bin_dir = argv[++ac];
+        } else if (!strcmp(argv[ac], "-programs")) {
+            programs_arg = argv[++ac];
+        } else if (!strcmp(argv[ac], "-atol")) {
+            atol = atof(argv[++ac]);
+        } else if (!strcmp(argv[ac], "-rtol")) {
+            rtol = atof(argv[++ac]);
+        } else if (!strcmp(argv[ac], "-locations")) {
+            nr_locations = atoi(argv[++ac]);
+        } else {
+            fprintf(stderr, "** invalid option, '%s'\n", argv[ac]);
+            return 1;
+        }
+    }
+
+    if (fcompare_ref) {
+        int64_t nr_diff = is_nifti(fcompare_ref)
+            ? compare_nifti(fcompare_ref, fcompare_out, atol, rtol, nr_locations)
+            : compare_text(fcompare_ref, fcompare_out);
+        cout << "    " << (nr_diff == 0 ? "Same" : "Different") << endl;
+        return nr_diff != 0;
+    }
+
+    // ========================================================================
+    // Parse cases file
+    // ========================================================================
+    ifstream file(fcases.c_str());
+    if (!file.is_open()) {
+        fprintf(stderr, "** failed to open cases file '%s'\n", fcases.c_str());
+        return 2;
+    }
+    vector<string> programs = split(programs_arg, ',');
+    vector<regress_case> cases;
+    string line;
+    int line_nr = 0;
+    while (getline(file, line)) {
+        line_nr += 1;
+        replace_all(line, "{out}", output_dir);
+        istringstream tokens(line);
+        regress_case c;
+        c.line = line_nr;
+        string token;
+        bool outputs = false;
+        while (tokens >> token) {
+            if (token == "=>") {
+                outputs = true;
+            } else if (outputs) {
+                c.outputs.push_back(token);
+            } else {
+                c.args.push_back(token);
+            }
+        }
+        if (c.args.empty() || c.args[0][0] == '#') {
+            continue;
+        }
+        if (c.outputs.empty()) {
+            fprintf(stderr, "** no outputs listed after '=>' on line %d of '%s'\n",
+                    line_nr, fcases.c_str());
+            return 1;
+        }
+        if (programs.empty()
+            || find(programs.begin(), programs.end(), c.args[0]) != programs.end()) {
+            cases.push_back(c);
+        }
+    }
+
+    log_welcome("laynii_regress");
+
+    // ========================================================================
+    // Run cases and compare outputs
+    // ========================================================================
+    int nr_failed = 0, nr_different = 0, nr_same = 0;
+    vector<string> problems;
+    set<string> copied;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const regress_case& c = cases[i];
+        // Some programs write extra files next to their inputs
+        // or into the working folder. Inputs are therefore copied to the
+        // output folder and programs run from there, with absolute paths, so
+        // that these files do not end up in between the test data.
+        string command = "cd \"" + absolute_path(output_dir) + "\" && "
+                         + absolute_path(bin_dir) + "/" + c.args[0];
+        for (size_t k = 1; k < c.args.size(); ++k) {
+            string arg = c.args[k];
+            if (arg.compare(0, output_dir.size() + 1, output_dir + "/") == 0) {
+                arg = absolute_path(arg);
+            } else if (arg[0] != '-' && file_exists(arg)) {
+                string copy = output_dir + "/input_" + arg.substr(arg.find_last_of("/\\") + 1);
+                if (!copied.count(copy)) {
+                    if (!copy_file(arg, copy)) {
+                        fprintf(stderr, "** failed to copy '%s'\n", arg.c_str());
+                        return 2;
+                    }
+                    copied.insert(copy);
+                }
+                arg = absolute_path(copy);
+            }
+            command += " " + arg;
+        }
+        ostringstream flog;
+        flog << output_dir << "/" << c.args[0] << "_line" << c.line << ".log";
+        command += " > \"" + absolute_path(flog.str()) + "\" 2>&1";
+
+        cout << "\n  " << c.args[0] << " (line " << c.line << ")" << endl;
+        if (system(command.c_str()) != 0) {
+            cout << "    Failed, see '" << flog.str() << "'" << endl;
+            problems.push_back(c.args[0] + " failed");
+            nr_failed += 1;
+            continue;
+        }
+
+        for (size_t k = 0; k < c.outputs.size(); ++k) {
+            string fout = output_dir + "/" + c.outputs[k];
+            string fref = reference_dir + "/" + c.outputs[k];
+            if (update) {
+                bool copied = copy_file(fout, fref);
+                cout << "    " << (copied ? "Updated " : "Failed to update ")
+                     << fref << endl;
+                nr_failed += !copied;
+                continue;
+            }
+            if (!file_exists(fout)) {
+                cout << "    " << c.outputs[k] << ": missing output" << endl;
+                problems.push_back(c.outputs[k] + " missing");
+                nr_failed += 1;
+                continue;
+            }
+            if (!file_exists(fref)) {
+                cout << "    " << c.outputs[k] << ": no reference, see -update" << endl;
+                problems.push_back(c.outputs[k] + " has no reference");
+                nr_failed += 1;
+                continue;
+            }
+            cout << "    " << c.outputs[k] << endl;
+            int64_t nr_diff = is_nifti(fref)
+                ? compare_nifti(fref, fout, atol, rtol, nr_locations)
+                : compare_text(fref, fout);
+            if (nr_diff == 0) {
+                nr_same += 1;
+            } else {
+                problems.push_back(c.outputs[k] + " differs");
+                nr_different += 1;
+            }
+        }
+    }
+
+    // ========================================================================
+    // Summary
+    // ========================================================================
+    cout << "\n  Summary: " << cases.size() << " cases, " << nr_same
+         << " outputs match, " << nr_different << " differ, " << nr_failed
+         << " failed." << endl;
+    for (size_t i = 0; i < problems.size(); ++i) {
+        cout << "    " << problems[i] << endl;
+    }
+    cout << "\n  Finished." << endl;
+    return (nr_failed + nr_different) > 0;
+}